@@ -1,6 +1,7 @@
 // buttons.js
 
 import { BASE_URL } from './config.js';
+import { waitForCommand } from './global.js';
 
 const endPoint = BASE_URL;
 
@@ -146,8 +147,14 @@ export async function runButton(buttonId) {
     });
 
     if (response.ok) {
-      console.log(`Button ${buttonId} executed successfully`);
-      //showMessage(`Button ${buttonId} executed`);
+      // Queued; the press runs on the device's command executor
+      const { data } = await response.json();
+      const result = await waitForCommand(data.id);
+      if (result.status === "success") {
+        console.log(`Button ${buttonId} executed successfully`);
+      } else {
+        showMessage(`Failed to run button: ${result.result}`);
+      }
     } else {
       const errorText = await response.text();
       console.error(`Failed to run button ${buttonId}: ${errorText}`);
@@ -175,7 +182,13 @@ export async function sendCommand(command) {
     });
 
     if (response.ok) {
-      console.log(`Command sent: ${command}`);
+      const { data } = await response.json();
+      const result = await waitForCommand(data.id);
+      if (result.status === "success") {
+        console.log(`Command done: ${command}`);
+      } else {
+        showMessage(`Command failed: ${result.result}`);
+      }
     } else {
       showMessage("Failed to send command");
     }
@@ -11,9 +11,10 @@ const BASE_URL = window.location.hostname === "localhost"
     ? `http://${DEV_DEVICE}` 
     : "";
 
+// Command and log channel on the web server (the RemoteDebug console stays on port 8232)
 const WS_URL = `ws://${window.location.hostname === "localhost" 
     ? DEV_DEVICE 
-    : window.location.hostname}:8232`;
+    : window.location.host}/ws`;
 
 console.log(`BASE_URL: ${BASE_URL}`);
 
@@ -2,6 +2,7 @@
 console.log("files3.js loaded");
 
 import {BASE_URL} from './config.js';
+import {waitForCommand} from './global.js';
 
 //const endPoint = window.location.hostname === "localhost" ? `http://demo1.local` : "";
 const endPoint = BASE_URL;
@@ -372,17 +373,23 @@ async function runFile() {
         });
 
         const data = await response.json();
-        if (data.status === 'success') {
+        if (data.status !== 'success') {
+            showNotification(`Error executing command: ${data.message}`, 'error');
+            return;
+        }
+
+        // Queued; the script types on the device's command executor
+        showNotification(`Running file ${filename}`);
+        const result = await waitForCommand(data.data.id, 300000);
+        if (result.status === 'success') {
             showNotification(`Command executed successfully for ${filename}!`);
         } else {
-            showNotification(`Error executing command: ${data.message}`, 'error');
+            showNotification(`Error executing command: ${result.result}`, 'error');
         }
     } catch (err) {
         console.error('Error running file:', err);
         showNotification('Failed to execute command.', 'error');
     }
-
-    showNotification(`Running file ${filename}`);
 }
 
 async function deleteItem(isFolder) {
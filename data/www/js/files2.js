@@ -1,6 +1,8 @@
 //files.js
 console.log("files.js loaded");
 
+import {waitForCommand} from './global.js';
+
 const endPoint = window.location.hostname === "localhost" ? `http://demo1.local` : "";
 
 let fontSize = '18px';
@@ -369,17 +371,23 @@ async function runFile() {
         });
 
         const data = await response.json();
-        if (data.status === 'success') {
+        if (data.status !== 'success') {
+            showNotification(`Error executing command: ${data.message}`, 'error');
+            return;
+        }
+
+        // Queued; the script types on the device's command executor
+        showNotification(`Running file ${filename}`);
+        const result = await waitForCommand(data.data.id, 300000);
+        if (result.status === 'success') {
             showNotification(`Command executed successfully for ${filename}!`);
         } else {
-            showNotification(`Error executing command: ${data.message}`, 'error');
+            showNotification(`Error executing command: ${result.result}`, 'error');
         }
     } catch (err) {
         console.error('Error running file:', err);
         showNotification('Failed to execute command.', 'error');
     }
-
-    showNotification(`Running file ${filename}`);
 }
 
 async function deleteItem(isFolder) {
@@ -48,6 +48,24 @@ async function httpPost(endpoint, body) {
   }
 }
 
+// Wait for a command queued with /command/set, /command/batch or
+// /run-button (they answer 202 with its id) and return its result
+async function waitForCommand(id, timeoutMs = 30000) {
+  const deadline = Date.now() + timeoutMs;
+  while (Date.now() < deadline) {
+    const response = await fetch(`${BASE_URL}/command/result?id=${id}`);
+    const data = await response.json();
+    if (data.id === id) {
+      return data; // Finished; data.status says whether it worked
+    }
+    if (response.status !== 404) {
+      throw new Error(data.message || `HTTP ${response.status}`);
+    }
+    await new Promise((resolve) => setTimeout(resolve, 100));
+  }
+  throw new Error("Timed out waiting for the command");
+}
+
 // Show a message in the custom message box
 function showMessage(message, type) {
   const msgBox = document.getElementById("message-box");
@@ -64,32 +82,38 @@ function showMessage(message, type) {
   }
 }
 
-// Load Navbar and Footer dynamically
+// Highlight the link to the current page
+function highlightNavbar() {
+  const currentPath = window.location.pathname;
+  document.querySelectorAll(".nav-link").forEach((link) => {
+    if (link.getAttribute("href") === currentPath) {
+      link.setAttribute("aria-current", "page");
+    } else {
+      link.removeAttribute("aria-current");
+    }
+  });
+}
+
+// Load Navbar and Footer dynamically, unless the page was served from the
+// firmware with them already filled in
 document.addEventListener("DOMContentLoaded", () => {
   // Load Navbar
   const navbarContainer = document.getElementById("navbar-container");
-  if (navbarContainer) {
+  if (navbarContainer && navbarContainer.childElementCount > 0) {
+    highlightNavbar();
+  } else if (navbarContainer) {
     fetch("/navbar.html")
       .then((response) => response.text())
       .then((data) => {
         navbarContainer.innerHTML = data;
-
-        // Highlight the active page
-        const currentPath = window.location.pathname;
-        document.querySelectorAll(".nav-link").forEach((link) => {
-          if (link.getAttribute("href") === currentPath) {
-            link.setAttribute("aria-current", "page");
-          } else {
-            link.removeAttribute("aria-current");
-          }
-        });
+        highlightNavbar();
       })
       .catch((error) => console.error("Error loading navbar:", error));
   }
 
   // Load Footer
   const footerContainer = document.getElementById("footer-container");
-  if (footerContainer) {
+  if (footerContainer && footerContainer.childElementCount === 0) {
     fetch("/footer.html")
       .then((response) => response.text())
       .then((data) => {
@@ -100,4 +124,4 @@ document.addEventListener("DOMContentLoaded", () => {
 });
 
 // Export variables and functions for reuse
-export {httpGet, httpPost, showMessage};
\ No newline at end of file
+export {httpGet, httpPost, waitForCommand, showMessage};
\ No newline at end of file
@@ -2,6 +2,7 @@
 console.log('index.js loaded');
 
 import {httpGet, showMessage} from './global.js';
+import {BASE_URL} from './config.js';
 
 // Function to reboot the device
 async function rebootDevice() {
@@ -21,7 +22,51 @@ document.addEventListener("DOMContentLoaded", () => {
   rebootButton.addEventListener("click", rebootDevice);
 });
 
+// Show each field as a row, updating the rows that already exist
+function showDeviceInfo(data) {
+  const tableBody = document.getElementById('device-info');
+
+  for (const [key, value] of Object.entries(data)) {
+    let row = tableBody.querySelector(`tr[data-key="${key}"]`);
+    if (!row) {
+      row = document.createElement('tr');
+      row.dataset.key = key;
+
+      const keyCell = document.createElement('td');
+      keyCell.textContent = key;
+
+      row.appendChild(keyCell);
+      row.appendChild(document.createElement('td'));
+      tableBody.appendChild(row);
+    }
+    row.lastChild.textContent = value;
+  }
+}
+
+// The device pushes the full info once, then only the fields that change
+function subscribeDeviceInfo() {
+  const events = new EventSource(`${BASE_URL}/device/events`);
+
+  events.addEventListener('info', (event) => {
+    document.getElementById('device-info').innerHTML = ''; // Clear existing rows
+    showDeviceInfo(JSON.parse(event.data));
+  });
+
+  events.addEventListener('update', (event) => {
+    showDeviceInfo(JSON.parse(event.data));
+  });
+
+  events.onerror = () => {
+    console.warn('Device events interrupted; the browser will reconnect');
+  };
+}
+
 window.addEventListener('DOMContentLoaded', async () => {
+  if (window.EventSource) {
+    subscribeDeviceInfo();
+    return;
+  }
+
   try {
     const response = await httpGet('/device/info');
     const { data } = response; // Extract the 'data' object
@@ -30,26 +75,11 @@ window.addEventListener('DOMContentLoaded', async () => {
       throw new Error('Data not found in response.');
     }
 
-    const tableBody = document.getElementById('device-info');
-    tableBody.innerHTML = ''; // Clear existing rows
-
-    // Loop over each key-value pair in the 'data' object
-    for (const [key, value] of Object.entries(data)) {
-      const row = document.createElement('tr');
-
-      const keyCell = document.createElement('td');
-      keyCell.textContent = key;
-
-      const valueCell = document.createElement('td');
-      valueCell.textContent = value;
-
-      row.appendChild(keyCell);
-      row.appendChild(valueCell);
-      tableBody.appendChild(row);
-    }
+    document.getElementById('device-info').innerHTML = ''; // Clear existing rows
+    showDeviceInfo(data);
     console.log("Device info loaded successfully!");
   } catch (error) {
     console.error('Error fetching device info:', error);
     showMessage('Error fetching device info.', 'error');
   }
-});
\ No newline at end of file
+});
@@ -5,6 +5,9 @@ import {WS_URL} from './config.js';
 
 console.log(`WebSocket URL: ${WS_URL}`);
 
+const token = "test";
+const LOG_LEVELS = ["off", "verbose", "debug", "info", "warning", "error"];
+
 (() => {
     const terminal = document.getElementById('terminal');
     const input = document.getElementById('input');
@@ -23,16 +26,47 @@ console.log(`WebSocket URL: ${WS_URL}`);
         terminal.innerHTML = ''; // Remove all child elements from the terminal
     }
 
+    // Show one frame from /ws: a command result, a log line or a notice
+    function showFrame(data) {
+        let frame;
+        try {
+            frame = JSON.parse(data);
+        } catch (e) {
+            appendMessage(data, false);
+            return;
+        }
+
+        switch (frame.type) {
+            case "result": {
+                const result = typeof frame.result === "string" ? frame.result : JSON.stringify(frame.result, null, 2);
+                const timing = frame.durationUs !== undefined ? ` (${(frame.durationUs / 1000).toFixed(1)} ms)` : "";
+                appendMessage(`[${frame.code}] ${result}${timing}`, false);
+                break;
+            }
+            case "log":
+                appendMessage(`${frame.level}: ${frame.line}`, false);
+                break;
+            case "status":
+                appendMessage(`Log: ${frame.log}`, false);
+                break;
+            case "dropped":
+                appendMessage(`${frame.count} messages dropped while the page fell behind`, false);
+                break;
+            default:
+                appendMessage(data, false);
+        }
+    }
+
     // Initialize WebSocket connection
     function initWebSocket() {
-        socket = new WebSocket(WS_URL);
+        socket = new WebSocket(`${WS_URL}?token=${encodeURIComponent(token)}`);
 
         socket.onopen = () => {
             appendMessage("Connected to the server.", false);
         };
 
         socket.onmessage = (event) => {
-            appendMessage(event.data, false);
+            showFrame(event.data);
         };
 
         socket.onclose = (event) => {
@@ -46,6 +80,15 @@ console.log(`WebSocket URL: ${WS_URL}`);
         };
     }
 
+    // "log <level>" tails the device log; anything else runs as a command
+    function toFrame(message) {
+        const words = message.split(/\s+/);
+        if (words.length === 2 && words[0].toLowerCase() === "log" && LOG_LEVELS.includes(words[1].toLowerCase())) {
+            return JSON.stringify({ log: words[1].toLowerCase() });
+        }
+        return message;
+    }
+
     // Handle user input
     input.addEventListener('keydown', (event) => {
         if (event.key === 'Enter') {
@@ -55,7 +98,7 @@ console.log(`WebSocket URL: ${WS_URL}`);
                     // If the user types "clear", clear the terminal
                     clearTerminal();
                 } else if (socket.readyState === WebSocket.OPEN) {
-                    socket.send(message);
+                    socket.send(toFrame(message));
                     appendMessage(message, true);
                 } else {
                     appendMessage("Cannot send message. WebSocket is not open.", false);
@@ -8,6 +8,11 @@
 //#define BUTTONS_FILE "/data/buttons.json"
 #define BUTTONS_FILE "/data/buttonsSecure.json"
 
+// Record logs the button and category files are kept in; the JSON files
+// above are imported on first boot and written by "db export"
+#define BUTTONS_LOG "/data/buttons.log"
+#define CATEGORIES_LOG "/data/categories.log"
+
 //#define SETTINGS_FILE "/data/settings.json"
 #define SETTINGS_FILE "/data/settingsSecure.json"
 
@@ -25,4 +30,5 @@
 #include "NonBlockingTimer.h"
 #include "RemoteDebugHandler.h"
 #include "BoardPins.h"
-#include "CommandHandler.h"
\ No newline at end of file
+#include "CommandHandler.h"
+#include "CommandBus.h"
\ No newline at end of file
@@ -167,11 +167,12 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
     
   _client->setRxTimeout(0);
   _client->onError(NULL, NULL);
-  _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; ((AsyncEventSourceClient*)(r))->_onAck(len, time); }, this);
-  _client->onPoll([](void *r, AsyncClient* c){ (void)c; ((AsyncEventSourceClient*)(r))->_onPoll(); }, this);
+  //each callback holds the server's clients lock, so send() and count() from another task see a stable list
+  _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; AsyncWebLockGuard l(((AsyncEventSourceClient*)(r))->_server->clientsLock()); ((AsyncEventSourceClient*)(r))->_onAck(len, time); }, this);
+  _client->onPoll([](void *r, AsyncClient* c){ (void)c; AsyncWebLockGuard l(((AsyncEventSourceClient*)(r))->_server->clientsLock()); ((AsyncEventSourceClient*)(r))->_onPoll(); }, this);
   _client->onData(NULL, NULL);
-  _client->onTimeout([this](void *r, AsyncClient* c __attribute__((unused)), uint32_t time){ ((AsyncEventSourceClient*)(r))->_onTimeout(time); }, this);
-  _client->onDisconnect([this](void *r, AsyncClient* c){ ((AsyncEventSourceClient*)(r))->_onDisconnect(); delete c; }, this);
+  _client->onTimeout([this](void *r, AsyncClient* c __attribute__((unused)), uint32_t time){ AsyncWebLockGuard l(_server->clientsLock()); ((AsyncEventSourceClient*)(r))->_onTimeout(time); }, this);
+  _client->onDisconnect([this](void *r, AsyncClient* c){ { AsyncWebLockGuard l(_server->clientsLock()); ((AsyncEventSourceClient*)(r))->_onDisconnect(); } delete c; }, this);
 
   _server->_addClient(this);
   delete request;
@@ -282,16 +283,19 @@ void AsyncEventSource::_addClient(AsyncEventSourceClient * client){
     free(temp);
   }*/
   
+  AsyncWebLockGuard l(_clientsLock);
   _clients.add(client);
   if(_connectcb)
     _connectcb(client);
 }
 
 void AsyncEventSource::_handleDisconnect(AsyncEventSourceClient * client){
+  AsyncWebLockGuard l(_clientsLock);
   _clients.remove(client);
 }
 
 void AsyncEventSource::close(){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto &c: _clients){
     if(c->connected())
       c->close();
@@ -300,6 +304,7 @@ void AsyncEventSource::close(){
 
 // pmb fix
 size_t AsyncEventSource::avgPacketsWaiting() const {
+  AsyncWebLockGuard l(_clientsLock);
   if(_clients.isEmpty())
     return 0;
   
@@ -320,6 +325,7 @@ void AsyncEventSource::send(const char *message, const char *event, uint32_t id,
 
 
   String ev = generateEventMessage(message, event, id, reconnect);
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto &c: _clients){
     if(c->connected()) {
       c->write(ev.c_str(), ev.length());
@@ -328,6 +334,7 @@ void AsyncEventSource::send(const char *message, const char *event, uint32_t id,
 }
 
 size_t AsyncEventSource::count() const {
+  AsyncWebLockGuard l(_clientsLock);
   return _clients.count_if([](AsyncEventSourceClient *c){
     return c->connected();
   });
@@ -100,6 +100,7 @@ class AsyncEventSource: public AsyncWebHandler {
     String _url;
     LinkedList<AsyncEventSourceClient *> _clients;
     ArEventHandlerFunction _connectcb;
+    AsyncWebLock _clientsLock; //guards _clients and each client's queue against the AsyncTCP task
   public:
     AsyncEventSource(const String& url);
     ~AsyncEventSource();
@@ -109,6 +110,8 @@ class AsyncEventSource: public AsyncWebHandler {
     void onConnect(ArEventHandlerFunction cb);
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     size_t count() const; //number clinets connected
+    //held by the AsyncTCP task while it adds, frees or runs the queue of a client
+    const AsyncWebLock & clientsLock() const { return _clientsLock; }
     size_t  avgPacketsWaiting() const;
 
     //system callbacks (do not call)
@@ -481,12 +481,13 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _lastMessageTime = millis();
   _keepAlivePeriod = 0;
   _client->setRxTimeout(0);
-  _client->onError([](void *r, AsyncClient* c, int8_t error){ (void)c; ((AsyncWebSocketClient*)(r))->_onError(error); }, this);
-  _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onAck(len, time); }, this);
-  _client->onDisconnect([](void *r, AsyncClient* c){ ((AsyncWebSocketClient*)(r))->_onDisconnect(); delete c; }, this);
-  _client->onTimeout([](void *r, AsyncClient* c, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onTimeout(time); }, this);
-  _client->onData([](void *r, AsyncClient* c, void *buf, size_t len){ (void)c; ((AsyncWebSocketClient*)(r))->_onData(buf, len); }, this);
-  _client->onPoll([](void *r, AsyncClient* c){ (void)c; ((AsyncWebSocketClient*)(r))->_onPoll(); }, this);
+  //each callback holds the server's clients lock, so other tasks holding it see a stable client
+  _client->onError([](void *r, AsyncClient* c, int8_t error){ (void)c; AsyncWebLockGuard l(((AsyncWebSocketClient*)(r))->_server->clientsLock()); ((AsyncWebSocketClient*)(r))->_onError(error); }, this);
+  _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; AsyncWebLockGuard l(((AsyncWebSocketClient*)(r))->_server->clientsLock()); ((AsyncWebSocketClient*)(r))->_onAck(len, time); }, this);
+  _client->onDisconnect([](void *r, AsyncClient* c){ { AsyncWebLockGuard l(((AsyncWebSocketClient*)(r))->_server->clientsLock()); ((AsyncWebSocketClient*)(r))->_onDisconnect(); } delete c; }, this);
+  _client->onTimeout([](void *r, AsyncClient* c, uint32_t time){ (void)c; AsyncWebLockGuard l(((AsyncWebSocketClient*)(r))->_server->clientsLock()); ((AsyncWebSocketClient*)(r))->_onTimeout(time); }, this);
+  _client->onData([](void *r, AsyncClient* c, void *buf, size_t len){ (void)c; AsyncWebLockGuard l(((AsyncWebSocketClient*)(r))->_server->clientsLock()); ((AsyncWebSocketClient*)(r))->_onData(buf, len); }, this);
+  _client->onPoll([](void *r, AsyncClient* c){ (void)c; AsyncWebLockGuard l(((AsyncWebSocketClient*)(r))->_server->clientsLock()); ((AsyncWebSocketClient*)(r))->_onPoll(); }, this);
   _server->_addClient(this);
   _server->_handleEvent(this, WS_EVT_CONNECT, request, NULL, 0);
   delete request;
@@ -871,17 +872,19 @@ void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType ty
 }
 
 void AsyncWebSocket::_addClient(AsyncWebSocketClient * client){
+  AsyncWebLockGuard l(_clientsLock);
   _clients.add(client);
 }
 
 void AsyncWebSocket::_handleDisconnect(AsyncWebSocketClient * client){
-  
+  AsyncWebLockGuard l(_clientsLock);
   _clients.remove_first([=](AsyncWebSocketClient * c){
     return c->id() == client->id();
   });
 }
 
 bool AsyncWebSocket::availableForWriteAll(){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto& c: _clients){
     if(c->queueIsFull()) return false;
   }
@@ -889,6 +892,7 @@ bool AsyncWebSocket::availableForWriteAll(){
 }
 
 bool AsyncWebSocket::availableForWrite(uint32_t id){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto& c: _clients){
     if(c->queueIsFull() && (c->id() == id )) return false;
   }
@@ -896,12 +900,14 @@ bool AsyncWebSocket::availableForWrite(uint32_t id){
 }
 
 size_t AsyncWebSocket::count() const {
+  AsyncWebLockGuard l(_clientsLock);
   return _clients.count_if([](AsyncWebSocketClient * c){
     return c->status() == WS_CONNECTED;
   });
 }
 
 AsyncWebSocketClient * AsyncWebSocket::client(uint32_t id){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto &c: _clients){
     if(c->id() == id && c->status() == WS_CONNECTED){
       return c;
@@ -918,6 +924,7 @@ void AsyncWebSocket::close(uint32_t id, uint16_t code, const char * message){
 }
 
 void AsyncWebSocket::closeAll(uint16_t code, const char * message){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->close(code, message);
@@ -926,6 +933,7 @@ void AsyncWebSocket::closeAll(uint16_t code, const char * message){
 
 void AsyncWebSocket::cleanupClients(uint16_t maxClients)
 {
+  AsyncWebLockGuard l(_clientsLock);
   if (count() > maxClients){
     _clients.front()->close();
   }
@@ -938,6 +946,7 @@ void AsyncWebSocket::ping(uint32_t id, uint8_t *data, size_t len){
 }
 
 void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->ping(data, len);
@@ -952,6 +961,7 @@ void AsyncWebSocket::text(uint32_t id, const char * message, size_t len){
 
 void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
   if (!buffer) return;
+  AsyncWebLockGuard l(_clientsLock);
   buffer->lock(); 
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED){
@@ -982,6 +992,7 @@ void AsyncWebSocket::binaryAll(const char * message, size_t len){
 void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
 {
   if (!buffer) return;
+  AsyncWebLockGuard l(_clientsLock);
   buffer->lock(); 
     for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
@@ -998,6 +1009,7 @@ void AsyncWebSocket::message(uint32_t id, AsyncWebSocketMessage *message){
 }
 
 void AsyncWebSocket::messageAll(AsyncWebSocketMultiMessage *message){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->message(message);
@@ -1109,6 +1121,7 @@ void AsyncWebSocket::textAll(const String &message){
   textAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::textAll(const __FlashStringHelper *message){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->text(message);
@@ -1144,6 +1157,7 @@ void AsyncWebSocket::binaryAll(const String &message){
   binaryAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::binaryAll(const __FlashStringHelper *message, size_t len){
+  AsyncWebLockGuard l(_clientsLock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c-> binary(message, len);
@@ -250,6 +250,7 @@ class AsyncWebSocket: public AsyncWebHandler {
     AwsEventHandler _eventHandler;
     bool _enabled;
     AsyncWebLock _lock;
+    AsyncWebLock _clientsLock; //guards _clients and each client's queues against the AsyncTCP task
 
   public:
     AsyncWebSocket(const String& url);
@@ -262,6 +263,8 @@ class AsyncWebSocket: public AsyncWebHandler {
 
     size_t count() const;
     AsyncWebSocketClient * client(uint32_t id);
+    //hold with AsyncWebLockGuard to use a client() from another task; it is not freed, nor its queues run, until released
+    const AsyncWebLock & clientsLock() const { return _clientsLock; }
     bool hasClient(uint32_t id){ return client(id) != NULL; }
 
     void close(uint32_t id, uint16_t code=0, const char * message=NULL);
@@ -400,6 +400,7 @@ class AsyncWebServer {
     LinkedList<AsyncWebRewrite*> _rewrites;
     LinkedList<AsyncWebHandler*> _handlers;
     AsyncCallbackWebHandler* _catchAllHandler;
+    ArRequestHandlerFunction _requestEndHandler;
 
   public:
     AsyncWebServer(uint16_t port);
@@ -430,10 +431,12 @@ class AsyncWebServer {
     void onNotFound(ArRequestHandlerFunction fn);  //called when handler is not assigned
     void onFileUpload(ArUploadHandlerFunction fn); //handle file uploads
     void onRequestBody(ArBodyHandlerFunction fn); //handle posts with plain body content (JSON often transmitted this way as a request)
+    void onRequestEnd(ArRequestHandlerFunction fn); //called as each request is freed, however it ended (including WebSocket/EventSource upgrades)
 
     void reset(); //remove all writers and handlers, with onNotFound/onFileUpload/onRequestBody 
   
     void _handleDisconnect(AsyncWebServerRequest *request);
+    void _handleRequestEnd(AsyncWebServerRequest *request);
     void _attachHandler(AsyncWebServerRequest *request);
     void _rewriteRequest(AsyncWebServerRequest *request);
 };
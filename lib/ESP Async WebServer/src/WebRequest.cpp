@@ -78,6 +78,8 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
 }
 
 AsyncWebServerRequest::~AsyncWebServerRequest(){
+  _server->_handleRequestEnd(this);
+
   _headers.free();
 
   _params.free();
@@ -102,6 +102,10 @@ void AsyncWebServer::_handleDisconnect(AsyncWebServerRequest *request){
   delete request;
 }
 
+void AsyncWebServer::_handleRequestEnd(AsyncWebServerRequest *request){
+  if(_requestEndHandler) _requestEndHandler(request);
+}
+
 void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *request){
   for(const auto& r: _rewrites){
     if (r->match(request)){
@@ -172,6 +176,10 @@ void AsyncWebServer::onNotFound(ArRequestHandlerFunction fn){
   _catchAllHandler->onRequest(fn);
 }
 
+void AsyncWebServer::onRequestEnd(ArRequestHandlerFunction fn){
+  _requestEndHandler = fn;
+}
+
 void AsyncWebServer::onFileUpload(ArUploadHandlerFunction fn){
   _catchAllHandler->onUpload(fn);
 }
@@ -0,0 +1,84 @@
+// Arduino.cpp - host stand-in for the Arduino core used by the native env
+
+#include "Arduino.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static std::atomic<bool> virtualClock(false);
+static std::atomic<uint64_t> virtualMicros(0);
+static const auto clockStart = std::chrono::steady_clock::now();
+
+namespace NativeClock
+{
+void useVirtual(bool enabled) { virtualClock = enabled; }
+bool isVirtual() { return virtualClock; }
+void advanceMicros(uint64_t us) { virtualMicros += us; }
+} // namespace NativeClock
+
+static uint64_t nowMicros()
+{
+    if (virtualClock) return virtualMicros;
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - clockStart).count();
+}
+
+unsigned long millis() { return (unsigned long)(nowMicros() / 1000); }
+unsigned long micros() { return (unsigned long)nowMicros(); }
+int64_t esp_timer_get_time(void) { return (int64_t)nowMicros(); }
+
+void delayMicroseconds(uint32_t us)
+{
+    if (virtualClock) {
+        virtualMicros += us;
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+void delay(uint32_t ms) { delayMicroseconds(ms * 1000); }
+void yield() { std::this_thread::yield(); }
+
+static std::mt19937 &rng()
+{
+    static std::mt19937 engine(std::random_device{}());
+    return engine;
+}
+
+long random(long howbig) { return howbig <= 0 ? 0 : (long)(rng()() % (unsigned long)howbig); }
+long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) { rng().seed(seed); }
+
+uint32_t esp_random(void) { return rng()(); }
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *out = static_cast<uint8_t *>(buf);
+    while (len) {
+        uint32_t r = esp_random();
+        size_t n = len < 4 ? len : 4;
+        memcpy(out, &r, n);
+        out += n;
+        len -= n;
+    }
+}
+
+void configTime(long, int, const char *, const char *, const char *) {}
+
+bool getLocalTime(struct tm *info, uint32_t)
+{
+    time_t now = time(nullptr);
+    return localtime_r(&now, info) != nullptr;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return HIGH; }
+
+void EspClass::restart() { throw std::runtime_error("ESP.restart() called"); }
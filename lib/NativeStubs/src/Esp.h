@@ -0,0 +1,29 @@
+// Esp.h - host stand-in for the ESP32 EspClass (native env only)
+
+#pragma once
+
+#include <cstdint>
+
+class EspClass
+{
+public:
+    uint32_t getHeapSize() { return 320 * 1024; }
+    uint32_t getFreeHeap() { return 200 * 1024; }
+    uint32_t getMinFreeHeap() { return 180 * 1024; }
+    uint32_t getMaxAllocHeap() { return 100 * 1024; }
+    uint32_t getPsramSize() { return 0; }
+    uint32_t getFreePsram() { return 0; }
+    const char *getChipModel() { return "native"; }
+    uint8_t getChipRevision() { return 0; }
+    uint8_t getChipCores() { return 1; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    const char *getSdkVersion() { return "native"; }
+    uint32_t getFlashChipSize() { return 16 * 1024 * 1024; }
+    uint32_t getFlashChipSpeed() { return 80000000; }
+    int getFlashChipMode() { return 0; }
+    uint32_t getFreeSketchSpace() { return 0; }
+    uint64_t getEfuseMac() { return 0x0000DEADBEEF0000ULL; }
+    void restart();
+};
+
+extern EspClass ESP;
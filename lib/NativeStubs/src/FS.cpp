@@ -0,0 +1,236 @@
+// FS.cpp - host stand-in for the Arduino-ESP32 filesystem API (native env only)
+
+#include "FS.h"
+#include "LittleFS.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs
+{
+
+class FileImpl
+{
+public:
+    FILE *fp = nullptr;
+    std::string path;     // Path as seen by the firmware ("/data/x.json")
+    std::string hostPath; // Path on the host filesystem
+    std::string baseName;
+    bool directory = false;
+    std::vector<std::string> entries;
+    size_t nextEntry = 0;
+    FS *owner = nullptr;
+
+    ~FileImpl()
+    {
+        if (fp) fclose(fp);
+    }
+};
+
+static std::string joinPath(const std::string &dir, const std::string &name)
+{
+    if (dir.empty() || dir == "/") return "/" + name;
+    return dir + "/" + name;
+}
+
+static std::string baseNameOf(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+size_t File::write(uint8_t c) { return write(&c, 1); }
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+    if (!_p || !_p->fp) return 0;
+    return fwrite(buf, 1, size, _p->fp);
+}
+
+int File::available()
+{
+    if (!_p || !_p->fp) return 0;
+    long pos = ftell(_p->fp);
+    fseek(_p->fp, 0, SEEK_END);
+    long end = ftell(_p->fp);
+    fseek(_p->fp, pos, SEEK_SET);
+    return (int)(end - pos);
+}
+
+int File::read()
+{
+    if (!_p || !_p->fp) return -1;
+    int c = fgetc(_p->fp);
+    return c == EOF ? -1 : c;
+}
+
+int File::peek()
+{
+    if (!_p || !_p->fp) return -1;
+    int c = fgetc(_p->fp);
+    if (c == EOF) return -1;
+    ungetc(c, _p->fp);
+    return c;
+}
+
+void File::flush()
+{
+    if (_p && _p->fp) fflush(_p->fp);
+}
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+    if (!_p || !_p->fp) return 0;
+    return fread(buf, 1, size, _p->fp);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!_p || !_p->fp) return false;
+    int whence = mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END);
+    return fseek(_p->fp, (long)pos, whence) == 0;
+}
+
+size_t File::position() const
+{
+    if (!_p || !_p->fp) return 0;
+    return (size_t)ftell(_p->fp);
+}
+
+size_t File::size() const
+{
+    if (!_p) return 0;
+    if (_p->fp) fflush(_p->fp);
+    struct stat st;
+    if (stat(_p->hostPath.c_str(), &st) != 0) return 0;
+    return _p->directory ? 0 : (size_t)st.st_size;
+}
+
+void File::close() { _p.reset(); }
+
+File::operator bool() const { return _p != nullptr; }
+
+const char *File::path() const { return _p ? _p->path.c_str() : nullptr; }
+
+const char *File::name() const { return _p ? _p->baseName.c_str() : nullptr; }
+
+bool File::isDirectory(void) { return _p && _p->directory; }
+
+File File::openNextFile(const char *mode)
+{
+    if (!_p || !_p->directory || _p->nextEntry >= _p->entries.size()) return File();
+    std::string child = joinPath(_p->path, _p->entries[_p->nextEntry++]);
+    return _p->owner->open(child.c_str(), mode);
+}
+
+void File::rewindDirectory(void)
+{
+    if (_p) _p->nextEntry = 0;
+}
+
+std::string FS::hostPath(const char *path) const
+{
+    std::string p = path ? path : "/";
+    if (p.empty() || p[0] != '/') p = "/" + p;
+    return _root + p;
+}
+
+File FS::open(const char *path, const char *mode, const bool create)
+{
+    (void)create;
+    std::string host = hostPath(path);
+    struct stat st;
+    bool exists = stat(host.c_str(), &st) == 0;
+
+    auto impl = std::make_shared<FileImpl>();
+    impl->path = path;
+    if (impl->path.size() > 1 && impl->path.back() == '/') impl->path.pop_back();
+    impl->hostPath = host;
+    impl->baseName = baseNameOf(impl->path);
+    impl->owner = this;
+
+    if (exists && S_ISDIR(st.st_mode)) {
+        impl->directory = true;
+        DIR *dir = opendir(host.c_str());
+        if (!dir) return File();
+        while (struct dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") impl->entries.push_back(name);
+        }
+        closedir(dir);
+        std::sort(impl->entries.begin(), impl->entries.end());
+        return File(impl);
+    }
+
+    std::string m = mode ? mode : "r";
+    if (m[0] == 'r' && !exists) return File();
+    if (m.find('b') == std::string::npos) m += "b";
+    impl->fp = fopen(host.c_str(), m.c_str());
+    if (!impl->fp) return File();
+    return File(impl);
+}
+
+bool FS::exists(const char *path)
+{
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path) { return ::unlink(hostPath(path).c_str()) == 0; }
+
+bool FS::rename(const char *pathFrom, const char *pathTo)
+{
+    return ::rename(hostPath(pathFrom).c_str(), hostPath(pathTo).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) { return ::mkdir(hostPath(path).c_str(), 0755) == 0 || exists(path); }
+
+bool FS::rmdir(const char *path) { return ::rmdir(hostPath(path).c_str()) == 0; }
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel)
+{
+    (void)formatOnFail;
+    (void)basePath;
+    (void)maxOpenFiles;
+    (void)partitionLabel;
+    if (!_root.empty()) return true;
+
+    const char *root = getenv("PASSTXT_FS_ROOT");
+    if (root && *root) {
+        _root = root;
+        return true;
+    }
+
+    char tmpl[] = "/tmp/passtxt-littlefs-XXXXXX";
+    if (!mkdtemp(tmpl)) return false;
+    _root = tmpl;
+    return true;
+}
+
+bool LittleFSFS::format()
+{
+    if (_root.empty()) return false;
+    std::string cmd = "rm -rf '" + _root + "'/* '" + _root + "'/.[!.]* 2>/dev/null";
+    return system(cmd.c_str()) >= 0;
+}
+
+size_t LittleFSFS::totalBytes() { return 1536 * 1024; }
+
+size_t LittleFSFS::usedBytes()
+{
+    if (_root.empty()) return 0;
+    std::string cmd = "du -sb '" + _root + "' 2>/dev/null";
+    FILE *pipe = popen(cmd.c_str(), "r");
+    if (!pipe) return 0;
+    unsigned long long used = 0;
+    if (fscanf(pipe, "%llu", &used) != 1) used = 0;
+    pclose(pipe);
+    return (size_t)used;
+}
+
+} // namespace fs
+
+fs::LittleFSFS LittleFS;
@@ -0,0 +1,94 @@
+// FS.h - host stand-in for the Arduino-ESP32 filesystem API (native env only)
+//
+// Paths are resolved below a root directory on the host so LittleFS code can
+// run unchanged against a scratch folder.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+namespace fs
+{
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class FileImpl;
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+
+class File : public Stream
+{
+public:
+    File(FileImplPtr p = FileImplPtr()) : _p(p) {}
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t read(uint8_t *buf, size_t size);
+    size_t readBytes(char *buffer, size_t length) override { return read(reinterpret_cast<uint8_t *>(buffer), length); }
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    explicit operator bool() const;
+    const char *path() const;
+    const char *name() const;
+    bool isDirectory(void);
+    File openNextFile(const char *mode = FILE_READ);
+    void rewindDirectory(void);
+
+    using Print::write;
+
+private:
+    FileImplPtr _p;
+};
+
+class FS
+{
+public:
+    explicit FS(const std::string &root = std::string()) : _root(root) {}
+    virtual ~FS() {}
+
+    File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+    File open(const String &path, const char *mode = FILE_READ, const bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *pathFrom, const char *pathTo);
+    bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+    bool mkdir(const char *path);
+    bool mkdir(const String &path) { return mkdir(path.c_str()); }
+    bool rmdir(const char *path);
+    bool rmdir(const String &path) { return rmdir(path.c_str()); }
+
+    void setRoot(const std::string &root) { _root = root; }
+    const std::string &root() const { return _root; }
+    std::string hostPath(const char *path) const;
+
+protected:
+    std::string _root;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
@@ -0,0 +1,98 @@
+// HeapCaps.cpp - host stand-in for the ESP-IDF heap statistics (native env only)
+
+#include "esp_heap_caps.h"
+#include <atomic>
+#include <cstring>
+#include <malloc.h>
+
+// Pretend heap, so free and minimum free sizes look like the device's
+static const size_t HEAP_SIZE = 200 * 1024;
+
+static std::atomic<long> liveBlocks(0);
+static std::atomic<long> liveBytes(0);
+static std::atomic<long> peakBytes(0);
+static std::atomic<size_t> allocations(0);
+
+#ifdef NATIVE_COUNT_ALLOCATIONS
+
+// glibc keeps its allocator reachable under these names, so malloc and
+// friends can be wrapped to count live blocks and bytes
+extern "C" void *__libc_malloc(size_t);
+extern "C" void __libc_free(void *);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+
+static void track(void *p, long sign)
+{
+    long bytes = liveBytes += sign * (long)malloc_usable_size(p);
+    long peak = peakBytes;
+    while (bytes > peak && !peakBytes.compare_exchange_weak(peak, bytes)) {
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+    allocations++;
+    if (p) {
+        liveBlocks++;
+        track(p, 1);
+    }
+    return p;
+}
+
+extern "C" void free(void *p)
+{
+    if (!p) return;
+    liveBlocks--;
+    track(p, -1);
+    __libc_free(p);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *p = __libc_calloc(count, size);
+    allocations++;
+    if (p) {
+        liveBlocks++;
+        track(p, 1);
+    }
+    return p;
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+    if (p) track(p, -1);
+    void *q = __libc_realloc(p, size);
+    allocations++;
+    if (!p && q) liveBlocks++;
+    else if (p && size == 0) liveBlocks--;
+    if (q) track(q, 1);
+    else if (p && size != 0) track(p, 1); // Failed; the old block is still live
+    return q;
+}
+
+#endif // NATIVE_COUNT_ALLOCATIONS
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps)
+{
+    memset(info, 0, sizeof(*info));
+    info->allocated_blocks = liveBlocks;
+    info->total_allocated_bytes = liveBytes;
+    info->total_free_bytes = HEAP_SIZE - liveBytes;
+    info->minimum_free_bytes = HEAP_SIZE - peakBytes;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) { return HEAP_SIZE - liveBytes; }
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) { return HEAP_SIZE - peakBytes; }
+
+size_t heap_caps_native_allocations(void) { return allocations; }
+
+esp_err_t heap_caps_monitor_local_minimum_free_size_start(void)
+{
+    peakBytes = (long)liveBytes;
+    return ESP_OK;
+}
+
+esp_err_t heap_caps_monitor_local_minimum_free_size_stop(void) { return ESP_OK; }
@@ -0,0 +1,25 @@
+// LittleFS.h - host stand-in for the Arduino-ESP32 LittleFS (native env only)
+//
+// The root defaults to a fresh temp directory; set PASSTXT_FS_ROOT to run
+// against an existing tree (for example a copy of data/).
+
+#pragma once
+
+#include "FS.h"
+
+namespace fs
+{
+
+class LittleFSFS : public FS
+{
+public:
+    bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char *partitionLabel = "spiffs");
+    bool format();
+    size_t totalBytes();
+    size_t usedBytes();
+    void end() {}
+};
+
+} // namespace fs
+
+extern fs::LittleFSFS LittleFS;
@@ -0,0 +1,365 @@
+// MbedTls.cpp - host stand-in for the parts of mbedTLS the firmware uses,
+// on OpenSSL libcrypto (native env only)
+
+#include "mbedtls/aes.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/gcm.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
+#include "mbedtls/platform_util.h"
+#include <cstring>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+// Platform
+
+void mbedtls_platform_zeroize(void *buf, size_t len)
+{
+    volatile unsigned char *p = (volatile unsigned char *)buf;
+    while (len--) *p++ = 0;
+}
+
+// AES
+
+void mbedtls_aes_init(mbedtls_aes_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+
+void mbedtls_aes_free(mbedtls_aes_context *ctx)
+{
+    if (ctx->evp) EVP_CIPHER_CTX_free((EVP_CIPHER_CTX *)ctx->evp);
+    ctx->evp = nullptr;
+}
+
+static int aesSetKey(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits, int mode)
+{
+    const EVP_CIPHER *cipher = keybits == 128 ? EVP_aes_128_ecb() : keybits == 192 ? EVP_aes_192_ecb() : keybits == 256 ? EVP_aes_256_ecb() : nullptr;
+    if (!cipher) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+
+    if (!ctx->evp) ctx->evp = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX *evp = (EVP_CIPHER_CTX *)ctx->evp;
+    if (EVP_CipherInit_ex(evp, cipher, nullptr, key, nullptr, mode == MBEDTLS_AES_ENCRYPT) != 1) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    EVP_CIPHER_CTX_set_padding(evp, 0);
+    ctx->mode = mode;
+    return 0;
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+    return aesSetKey(ctx, key, keybits, MBEDTLS_AES_ENCRYPT);
+}
+
+int mbedtls_aes_setkey_dec(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits)
+{
+    return aesSetKey(ctx, key, keybits, MBEDTLS_AES_DECRYPT);
+}
+
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx, int mode, const unsigned char input[16], unsigned char output[16])
+{
+    // Like mbedTLS, the direction comes from the key schedule
+    int outLen = 0;
+    if (!ctx->evp || EVP_CipherUpdate((EVP_CIPHER_CTX *)ctx->evp, output, &outLen, input, 16) != 1 || outLen != 16) {
+        return MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH;
+    }
+    return 0;
+}
+
+int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16],
+                          const unsigned char *input, unsigned char *output)
+{
+    if (length % 16) return MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH;
+
+    unsigned char block[16];
+    for (size_t offset = 0; offset < length; offset += 16) {
+        if (mode == MBEDTLS_AES_DECRYPT) {
+            unsigned char next[16];
+            memcpy(next, input + offset, 16);
+            int err = mbedtls_aes_crypt_ecb(ctx, mode, input + offset, block);
+            if (err) return err;
+            for (int i = 0; i < 16; i++) output[offset + i] = block[i] ^ iv[i];
+            memcpy(iv, next, 16);
+        } else {
+            for (int i = 0; i < 16; i++) block[i] = input[offset + i] ^ iv[i];
+            int err = mbedtls_aes_crypt_ecb(ctx, mode, block, output + offset);
+            if (err) return err;
+            memcpy(iv, output + offset, 16);
+        }
+    }
+    return 0;
+}
+
+// AES-GCM, one EVP context per call
+
+void mbedtls_gcm_init(mbedtls_gcm_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+
+void mbedtls_gcm_free(mbedtls_gcm_context *ctx) { mbedtls_platform_zeroize(ctx, sizeof(*ctx)); }
+
+int mbedtls_gcm_setkey(mbedtls_gcm_context *ctx, mbedtls_cipher_id_t cipher, const unsigned char *key, unsigned int keybits)
+{
+    if (cipher != MBEDTLS_CIPHER_ID_AES || (keybits != 128 && keybits != 192 && keybits != 256)) return MBEDTLS_ERR_GCM_BAD_INPUT;
+    memcpy(ctx->key, key, keybits / 8);
+    ctx->keyBits = keybits;
+    return 0;
+}
+
+static int gcmRun(mbedtls_gcm_context *ctx, bool encrypt, size_t length, const unsigned char *iv, size_t iv_len,
+                  const unsigned char *add, size_t add_len, const unsigned char *input, unsigned char *output,
+                  size_t tag_len, unsigned char *tag)
+{
+    const EVP_CIPHER *cipher = ctx->keyBits == 128 ? EVP_aes_128_gcm() : ctx->keyBits == 192 ? EVP_aes_192_gcm() : ctx->keyBits == 256 ? EVP_aes_256_gcm() : nullptr;
+    if (!cipher) return MBEDTLS_ERR_GCM_BAD_INPUT;
+
+    EVP_CIPHER_CTX *evp = EVP_CIPHER_CTX_new();
+    int outLen = 0;
+    bool ok = EVP_CipherInit_ex(evp, cipher, nullptr, nullptr, nullptr, encrypt) == 1 &&
+              EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_SET_IVLEN, (int)iv_len, nullptr) == 1 &&
+              EVP_CipherInit_ex(evp, nullptr, nullptr, ctx->key, iv, encrypt) == 1 &&
+              (add_len == 0 || EVP_CipherUpdate(evp, nullptr, &outLen, add, (int)add_len) == 1) &&
+              (length == 0 || EVP_CipherUpdate(evp, output, &outLen, input, (int)length) == 1);
+    if (ok && !encrypt) ok = EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_SET_TAG, (int)tag_len, tag) == 1;
+    bool authenticated = ok && EVP_CipherFinal_ex(evp, output + length, &outLen) == 1;
+    if (authenticated && encrypt) authenticated = EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_GET_TAG, (int)tag_len, tag) == 1;
+    EVP_CIPHER_CTX_free(evp);
+
+    if (!ok) return MBEDTLS_ERR_GCM_BAD_INPUT;
+    if (!authenticated) {
+        if (!encrypt) mbedtls_platform_zeroize(output, length); // Like mbedTLS, release nothing
+        return MBEDTLS_ERR_GCM_AUTH_FAILED;
+    }
+    return 0;
+}
+
+int mbedtls_gcm_crypt_and_tag(mbedtls_gcm_context *ctx, int mode, size_t length,
+                              const unsigned char *iv, size_t iv_len,
+                              const unsigned char *add, size_t add_len,
+                              const unsigned char *input, unsigned char *output,
+                              size_t tag_len, unsigned char *tag)
+{
+    return gcmRun(ctx, mode == MBEDTLS_GCM_ENCRYPT, length, iv, iv_len, add, add_len, input, output, tag_len, tag);
+}
+
+int mbedtls_gcm_auth_decrypt(mbedtls_gcm_context *ctx, size_t length,
+                             const unsigned char *iv, size_t iv_len,
+                             const unsigned char *add, size_t add_len,
+                             const unsigned char *tag, size_t tag_len,
+                             const unsigned char *input, unsigned char *output)
+{
+    return gcmRun(ctx, false, length, iv, iv_len, add, add_len, input, output, tag_len, const_cast<unsigned char *>(tag));
+}
+
+// Message digests and HMAC
+
+struct mbedtls_md_info_t
+{
+    mbedtls_md_type_t type;
+    const EVP_MD *(*evp)();
+    unsigned char size;
+};
+
+static const mbedtls_md_info_t mdInfos[] = {
+    {MBEDTLS_MD_MD5, EVP_md5, 16},
+    {MBEDTLS_MD_SHA1, EVP_sha1, 20},
+    {MBEDTLS_MD_SHA224, EVP_sha224, 28},
+    {MBEDTLS_MD_SHA256, EVP_sha256, 32},
+    {MBEDTLS_MD_SHA384, EVP_sha384, 48},
+    {MBEDTLS_MD_SHA512, EVP_sha512, 64},
+};
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type)
+{
+    for (const mbedtls_md_info_t &info : mdInfos) {
+        if (info.type == md_type) return &info;
+    }
+    return nullptr;
+}
+
+unsigned char mbedtls_md_get_size(const mbedtls_md_info_t *md_info) { return md_info ? md_info->size : 0; }
+mbedtls_md_type_t mbedtls_md_get_type(const mbedtls_md_info_t *md_info) { return md_info ? md_info->type : MBEDTLS_MD_NONE; }
+
+void mbedtls_md_init(mbedtls_md_context_t *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+
+void mbedtls_md_free(mbedtls_md_context_t *ctx)
+{
+    if (ctx->md_ctx) EVP_MD_CTX_free((EVP_MD_CTX *)ctx->md_ctx);
+    if (ctx->hmac_ctx) {
+        memset(ctx->hmac_ctx, 0, ctx->hmac_key_len);
+        free(ctx->hmac_ctx);
+    }
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac)
+{
+    if (!md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    ctx->md_info = md_info;
+    ctx->md_ctx = EVP_MD_CTX_new();
+    ctx->hmac = hmac;
+    return 0;
+}
+
+int mbedtls_md_starts(mbedtls_md_context_t *ctx)
+{
+    if (!ctx->md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    return EVP_DigestInit_ex((EVP_MD_CTX *)ctx->md_ctx, ctx->md_info->evp(), nullptr) == 1 ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+    if (!ctx->md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    return EVP_DigestUpdate((EVP_MD_CTX *)ctx->md_ctx, input, ilen) == 1 ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+    if (!ctx->md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    return EVP_DigestFinal_ex((EVP_MD_CTX *)ctx->md_ctx, output, nullptr) == 1 ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md(const mbedtls_md_info_t *md_info, const unsigned char *input, size_t ilen, unsigned char *output)
+{
+    if (!md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    return EVP_Digest(input, ilen, output, nullptr, md_info->evp(), nullptr) == 1 ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+// HMAC as in RFC 2104, over the EVP digest so the context stays plain data
+
+static int hmacPad(mbedtls_md_context_t *ctx, unsigned char pad)
+{
+    unsigned char block[128];
+    int blockSize = EVP_MD_block_size(ctx->md_info->evp());
+    memset(block, 0, sizeof(block));
+    memcpy(block, ctx->hmac_ctx, ctx->hmac_key_len);
+    for (int i = 0; i < blockSize; i++) block[i] ^= pad;
+    return mbedtls_md_update(ctx, block, blockSize);
+}
+
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen)
+{
+    if (!ctx->md_info || !ctx->hmac) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+    unsigned char digest[MBEDTLS_MD_MAX_SIZE];
+    if (keylen > (size_t)EVP_MD_block_size(ctx->md_info->evp())) {
+        mbedtls_md(ctx->md_info, key, keylen, digest);
+        key = digest;
+        keylen = ctx->md_info->size;
+    }
+    if (ctx->hmac_ctx) free(ctx->hmac_ctx);
+    ctx->hmac_ctx = malloc(keylen ? keylen : 1);
+    memcpy(ctx->hmac_ctx, key, keylen);
+    ctx->hmac_key_len = keylen;
+    return mbedtls_md_hmac_reset(ctx);
+}
+
+int mbedtls_md_hmac_reset(mbedtls_md_context_t *ctx)
+{
+    int err = mbedtls_md_starts(ctx);
+    return err ? err : hmacPad(ctx, 0x36);
+}
+
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+    return mbedtls_md_update(ctx, input, ilen);
+}
+
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+    unsigned char inner[MBEDTLS_MD_MAX_SIZE];
+    int err = mbedtls_md_finish(ctx, inner);
+    if (!err) err = mbedtls_md_starts(ctx);
+    if (!err) err = hmacPad(ctx, 0x5c);
+    if (!err) err = mbedtls_md_update(ctx, inner, ctx->md_info->size);
+    if (!err) err = mbedtls_md_finish(ctx, output);
+    return err;
+}
+
+int mbedtls_md_hmac(const mbedtls_md_info_t *md_info, const unsigned char *key, size_t keylen,
+                    const unsigned char *input, size_t ilen, unsigned char *output)
+{
+    if (!md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    unsigned int outLen = 0;
+    return HMAC(md_info->evp(), key, (int)keylen, input, ilen, output, &outLen) ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+// PBKDF2
+
+int mbedtls_pkcs5_pbkdf2_hmac(mbedtls_md_context_t *ctx, const unsigned char *password, size_t plen,
+                              const unsigned char *salt, size_t slen, unsigned int iteration_count,
+                              uint32_t key_length, unsigned char *output)
+{
+    if (!ctx->md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    return PKCS5_PBKDF2_HMAC((const char *)password, (int)plen, salt, (int)slen, (int)iteration_count,
+                             ctx->md_info->evp(), (int)key_length, output) == 1 ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+// Base64, with mbedTLS's return codes and output lengths
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    size_t needed = ((slen + 2) / 3) * 4;
+    if (!dst || dlen < needed + 1) {
+        *olen = needed + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    unsigned char *out = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t n = (uint32_t)src[i] << 16;
+        if (i + 1 < slen) n |= (uint32_t)src[i + 1] << 8;
+        if (i + 2 < slen) n |= src[i + 2];
+        *out++ = base64Chars[(n >> 18) & 63];
+        *out++ = base64Chars[(n >> 12) & 63];
+        *out++ = i + 1 < slen ? base64Chars[(n >> 6) & 63] : '=';
+        *out++ = i + 2 < slen ? base64Chars[n & 63] : '=';
+    }
+    *out = '\0';
+    *olen = out - dst;
+    return 0;
+}
+
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    // First pass validates and counts, like mbedTLS
+    size_t digits = 0;
+    size_t padding = 0;
+    for (size_t i = 0; i < slen; i++) {
+        unsigned char c = src[i];
+        if (c == ' ' || c == '\r' || c == '\n') continue;
+        if (c == '=') {
+            if (++padding > 2) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+            continue;
+        }
+        if (padding || !strchr(base64Chars, c) || c == '\0') return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+        digits++;
+    }
+    if ((digits + padding) % 4 != 0) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+
+    size_t needed = (digits * 6) / 8;
+    if (!dst || dlen < needed) {
+        *olen = needed;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    uint32_t bits = 0;
+    int count = 0;
+    unsigned char *out = dst;
+    for (size_t i = 0; i < slen; i++) {
+        const char *pos = strchr(base64Chars, src[i]);
+        if (!pos || src[i] == '\0') continue;
+        bits = (bits << 6) | (uint32_t)(pos - base64Chars);
+        if (++count == 4) {
+            *out++ = (bits >> 16) & 0xff;
+            *out++ = (bits >> 8) & 0xff;
+            *out++ = bits & 0xff;
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (count == 3) {
+        *out++ = (bits >> 10) & 0xff;
+        *out++ = (bits >> 2) & 0xff;
+    } else if (count == 2) {
+        *out++ = (bits >> 4) & 0xff;
+    }
+    *olen = out - dst;
+    return 0;
+}
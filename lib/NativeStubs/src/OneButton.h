@@ -0,0 +1,17 @@
+// OneButton.h - host stand-in for the OneButton library; never fires (native env only)
+
+#pragma once
+
+typedef void (*callbackFunction)(void);
+
+class OneButton
+{
+public:
+    OneButton(int pin, bool activeLow = true, bool pullupActive = true) {}
+    void attachClick(callbackFunction) {}
+    void attachDoubleClick(callbackFunction) {}
+    void attachLongPressStart(callbackFunction) {}
+    void attachDuringLongPress(callbackFunction) {}
+    void attachLongPressStop(callbackFunction) {}
+    void tick() {}
+};
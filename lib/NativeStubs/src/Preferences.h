@@ -0,0 +1,97 @@
+// Preferences.h - host stand-in for ESP32 NVS preferences (native env only).
+// Kept in memory; with PASSTXT_FS_ROOT set each namespace is also saved as
+// <root>/.nvs-<name>, so keys such as the crypto vault salt survive restarts
+// the way NVS does.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include "Arduino.h"
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false) { _ns = name; (void)readOnly; load(); return true; }
+    void end() {}
+    bool clear() { store()[_ns].clear(); save(); return true; }
+    bool remove(const char *key) { bool removed = store()[_ns].erase(key) > 0; save(); return removed; }
+    bool isKey(const char *key) { return store()[_ns].count(key) > 0; }
+
+    size_t putString(const char *key, const String &value) { set(key, value.c_str()); return value.length(); }
+    String getString(const char *key, const String &defaultValue = String()) { return isKey(key) ? String(store()[_ns][key]) : defaultValue; }
+    size_t putInt(const char *key, int32_t value) { set(key, std::to_string(value)); return 4; }
+    int32_t getInt(const char *key, int32_t defaultValue = 0) { return isKey(key) ? atoi(store()[_ns][key].c_str()) : defaultValue; }
+    size_t putUInt(const char *key, uint32_t value) { set(key, std::to_string(value)); return 4; }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return isKey(key) ? strtoul(store()[_ns][key].c_str(), nullptr, 10) : defaultValue; }
+    size_t putULong(const char *key, uint32_t value) { return putUInt(key, value); }
+    uint32_t getULong(const char *key, uint32_t defaultValue = 0) { return getUInt(key, defaultValue); }
+    size_t putBool(const char *key, bool value) { set(key, value ? "1" : "0"); return 1; }
+    bool getBool(const char *key, bool defaultValue = false) { return isKey(key) ? store()[_ns][key] == "1" : defaultValue; }
+    size_t putBytes(const char *key, const void *value, size_t len) { set(key, std::string((const char *)value, len)); return len; }
+    size_t getBytes(const char *key, void *buf, size_t maxLen)
+    {
+        if (!isKey(key)) return 0;
+        const std::string &v = store()[_ns][key];
+        size_t n = v.size() < maxLen ? v.size() : maxLen;
+        memcpy(buf, v.data(), n);
+        return n;
+    }
+    size_t getBytesLength(const char *key) { return isKey(key) ? store()[_ns][key].size() : 0; }
+
+private:
+    void set(const char *key, const std::string &value) { store()[_ns][key] = value; save(); }
+
+    std::string backingPath() const
+    {
+        const char *root = getenv("PASSTXT_FS_ROOT");
+        return root && *root ? std::string(root) + "/.nvs-" + _ns : std::string();
+    }
+
+    // Records are <key length><key><value length><value>, lengths as uint32
+    void load()
+    {
+        std::string path = backingPath();
+        FILE *f = path.empty() ? nullptr : fopen(path.c_str(), "rb");
+        if (!f) return;
+        std::map<std::string, std::string> &ns = store()[_ns];
+        ns.clear();
+        uint32_t len;
+        while (fread(&len, sizeof(len), 1, f) == 1)
+        {
+            std::string key(len, '\0');
+            if (fread(&key[0], 1, len, f) != len || fread(&len, sizeof(len), 1, f) != 1) break;
+            std::string value(len, '\0');
+            if (fread(&value[0], 1, len, f) != len) break;
+            ns[key] = value;
+        }
+        fclose(f);
+    }
+
+    void save()
+    {
+        std::string path = backingPath();
+        FILE *f = path.empty() ? nullptr : fopen(path.c_str(), "wb");
+        if (!f) return;
+        for (const auto &entry : store()[_ns])
+        {
+            const std::string *parts[] = {&entry.first, &entry.second};
+            for (const std::string *part : parts)
+            {
+                uint32_t len = part->size();
+                fwrite(&len, sizeof(len), 1, f);
+                fwrite(part->data(), 1, len, f);
+            }
+        }
+        fclose(f);
+    }
+
+    static std::map<std::string, std::map<std::string, std::string>> &store()
+    {
+        static std::map<std::string, std::map<std::string, std::string>> s;
+        return s;
+    }
+    std::string _ns;
+};
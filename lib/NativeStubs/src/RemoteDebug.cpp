@@ -0,0 +1,16 @@
+// RemoteDebug.cpp - host stand-in that prints debug macros to stdout (native env only)
+
+#include <cstdarg>
+#include "RemoteDebug.h"
+
+RemoteDebug Debug;
+
+void passtxtDebugPrintf(const char level, const char *format, ...)
+{
+    printf("(%c) ", level);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
@@ -0,0 +1,39 @@
+// RemoteDebug.h - host stand-in that prints debug macros to stdout (native env only)
+
+#pragma once
+
+#include <cstdio>
+#include "Arduino.h"
+
+class RemoteDebug : public Print
+{
+public:
+    size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+    void handle() {}
+    bool isActive(uint8_t) { return true; }
+    String getLastCommand() { return lastCommand; }
+    void setCallBackProjectCmds(void (*callback)()) { projectCallback = callback; }
+    void setHelpProjectsCmds(String) {}
+    void setResetCmdEnabled(bool) {}
+    void showProfiler(bool) {}
+    void showColors(bool) {}
+    void setSerialEnabled(bool) {}
+    void showTime(bool) {}
+    bool begin(String, uint8_t = 0) { return true; }
+    void stop() {}
+
+    String lastCommand;
+    void (*projectCallback)() = nullptr;
+
+    static const uint8_t ANY = 0;
+};
+
+void passtxtDebugPrintf(const char level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#define debugA(fmt, ...) passtxtDebugPrintf('A', fmt, ##__VA_ARGS__)
+#define debugP(fmt, ...) passtxtDebugPrintf('P', fmt, ##__VA_ARGS__)
+#define debugV(fmt, ...) passtxtDebugPrintf('V', fmt, ##__VA_ARGS__)
+#define debugD(fmt, ...) passtxtDebugPrintf('D', fmt, ##__VA_ARGS__)
+#define debugI(fmt, ...) passtxtDebugPrintf('I', fmt, ##__VA_ARGS__)
+#define debugW(fmt, ...) passtxtDebugPrintf('W', fmt, ##__VA_ARGS__)
+#define debugE(fmt, ...) passtxtDebugPrintf('E', fmt, ##__VA_ARGS__)
@@ -0,0 +1,44 @@
+// Stream.h - host stand-in for the Arduino Stream class (native env only)
+
+#pragma once
+
+#include "Print.h"
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { (void)timeout; }
+
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+        size_t count = 0;
+        while (count < length) {
+            int c = read();
+            if (c < 0) break;
+            *buffer++ = (char)c;
+            count++;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes(reinterpret_cast<char *>(buffer), length); }
+
+    String readString()
+    {
+        String ret;
+        int c;
+        while ((c = read()) >= 0) ret += (char)c;
+        return ret;
+    }
+
+    String readStringUntil(char terminator)
+    {
+        String ret;
+        int c;
+        while ((c = read()) >= 0 && c != terminator) ret += (char)c;
+        return ret;
+    }
+};
@@ -0,0 +1,19 @@
+// USB.h - host stand-in for the ESP32 USB device stack (native env only)
+
+#pragma once
+
+#include "Arduino.h"
+
+class ESPUSB
+{
+public:
+    bool begin() { return true; }
+    void productName(const char *) {}
+    void manufacturerName(const char *) {}
+    void serialNumber(const char *) {}
+    void VID(uint16_t) {}
+    void PID(uint16_t) {}
+    operator bool() const { return true; }
+};
+
+extern ESPUSB USB;
@@ -0,0 +1,66 @@
+// USBHID.cpp - host stand-in for the USB HID devices (native env only)
+
+#include <cstdarg>
+#include "USB.h"
+#include "USBHIDKeyboard.h"
+#include "USBHIDMouse.h"
+
+ESPUSB USB;
+std::vector<KeyReport> USBHIDKeyboard::sentReports;
+std::vector<MouseReport> USBHIDMouse::sentReports;
+
+void USBHIDKeyboard::sendReport(KeyReport *keys)
+{
+    sentReports.push_back(*keys);
+    delayMicroseconds(1000); // One full-speed frame per interrupt report
+}
+
+size_t USBHIDKeyboard::pressRaw(uint8_t k)
+{
+    if (k >= 0xE0 && k < 0xE8) {
+        _keyReport.modifiers |= (1 << (k - 0xE0));
+    } else if (k) {
+        for (uint8_t &slot : _keyReport.keys) {
+            if (slot == k) break;
+            if (slot == 0) { slot = k; break; }
+        }
+    }
+    sendReport(&_keyReport);
+    return 1;
+}
+
+size_t USBHIDKeyboard::releaseRaw(uint8_t k)
+{
+    if (k >= 0xE0 && k < 0xE8) {
+        _keyReport.modifiers &= ~(1 << (k - 0xE0));
+    } else {
+        for (uint8_t &slot : _keyReport.keys) {
+            if (slot == k) slot = 0;
+        }
+    }
+    sendReport(&_keyReport);
+    return 1;
+}
+
+void USBHIDKeyboard::releaseAll(void)
+{
+    _keyReport = KeyReport();
+    sendReport(&_keyReport);
+}
+
+size_t USBHIDKeyboard::press(uint8_t k) { return pressRaw(k); }
+size_t USBHIDKeyboard::release(uint8_t k) { return releaseRaw(k); }
+
+size_t USBHIDKeyboard::write(uint8_t k)
+{
+    press(k);
+    release(k);
+    return 1;
+}
+
+size_t USBHIDKeyboard::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+}
@@ -0,0 +1,36 @@
+// USBHIDMouse.h - host stand-in that records mouse movement (native env only)
+
+#pragma once
+
+#include <vector>
+#include "Arduino.h"
+
+#define MOUSE_LEFT 0x01
+#define MOUSE_RIGHT 0x02
+#define MOUSE_MIDDLE 0x04
+
+struct MouseReport
+{
+    uint8_t buttons;
+    int8_t x;
+    int8_t y;
+    int8_t wheel;
+    int8_t pan;
+};
+
+class USBHIDMouse
+{
+public:
+    void begin() {}
+    void end() {}
+    void click(uint8_t b = MOUSE_LEFT) { press(b); release(b); }
+    void move(int8_t x, int8_t y, int8_t wheel = 0, int8_t pan = 0) { sentReports.push_back({_buttons, x, y, wheel, pan}); }
+    void press(uint8_t b = MOUSE_LEFT) { _buttons |= b; move(0, 0); }
+    void release(uint8_t b = MOUSE_LEFT) { _buttons &= ~b; move(0, 0); }
+    bool isPressed(uint8_t b = MOUSE_LEFT) { return (_buttons & b) != 0; }
+
+    static std::vector<MouseReport> sentReports;
+
+private:
+    uint8_t _buttons = 0;
+};
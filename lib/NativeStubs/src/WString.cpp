@@ -0,0 +1,131 @@
+// WString.cpp - host stand-in for the Arduino String class (native env only)
+
+#include "WString.h"
+#include <cstdio>
+
+static std::string formatInteger(unsigned long long value, bool negative, unsigned char base)
+{
+    if (base < 2 || base > 36) base = 10;
+    char buf[72];
+    char *p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    do {
+        unsigned digit = value % base;
+        *--p = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value);
+    if (negative) *--p = '-';
+    return p;
+}
+
+String::String(long v, unsigned char base) : value(formatInteger(v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v, v < 0 && base == 10, base)) {}
+String::String(unsigned long v, unsigned char base) : value(formatInteger(v, false, base)) {}
+String::String(long long v, unsigned char base) : value(formatInteger(v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v, v < 0 && base == 10, base)) {}
+String::String(unsigned long long v, unsigned char base) : value(formatInteger(v, false, base)) {}
+
+String::String(double v, unsigned int decimalPlaces)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimalPlaces, v);
+    value = buf;
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+    if (value.length() != s.value.length()) return false;
+    for (size_t i = 0; i < value.length(); i++) {
+        if (tolower((unsigned char)value[i]) != tolower((unsigned char)s.value[i])) return false;
+    }
+    return true;
+}
+
+bool String::equalsConstantTime(const String &s) const
+{
+    if (value.length() != s.value.length()) return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < value.length(); i++) diff |= (unsigned char)(value[i] ^ s.value[i]);
+    return diff == 0;
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const
+{
+    if (offset > value.length() || prefix.length() > value.length() - offset) return false;
+    return value.compare(offset, prefix.length(), prefix.value) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    if (suffix.length() > value.length()) return false;
+    return value.compare(value.length() - suffix.length(), suffix.length(), suffix.value) == 0;
+}
+
+void String::getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index) const
+{
+    if (!bufsize || !buf) return;
+    if (index >= value.length()) { buf[0] = 0; return; }
+    size_t n = value.length() - index;
+    if (n > bufsize - 1) n = bufsize - 1;
+    memcpy(buf, value.data() + index, n);
+    buf[n] = 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const
+{
+    size_t pos = value.find(ch, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+    size_t pos = value.find(str.value, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char ch) const
+{
+    size_t pos = value.rfind(ch);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char ch, unsigned int fromIndex) const
+{
+    size_t pos = value.rfind(ch, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String &str) const
+{
+    size_t pos = value.rfind(str.value);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+    if (beginIndex > endIndex) { unsigned int t = beginIndex; beginIndex = endIndex; endIndex = t; }
+    if (beginIndex >= value.length()) return String();
+    if (endIndex > value.length()) endIndex = value.length();
+    return String(value.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::replace(char find, char replaceWith)
+{
+    for (char &c : value) if (c == find) c = replaceWith;
+}
+
+void String::replace(const String &find, const String &replaceWith)
+{
+    if (find.isEmpty()) return;
+    size_t pos = 0;
+    while ((pos = value.find(find.value, pos)) != std::string::npos) {
+        value.replace(pos, find.length(), replaceWith.value);
+        pos += replaceWith.length();
+    }
+}
+
+void String::trim()
+{
+    size_t begin = 0, end = value.length();
+    while (begin < end && isspace((unsigned char)value[begin])) begin++;
+    while (end > begin && isspace((unsigned char)value[end - 1])) end--;
+    value = value.substr(begin, end - begin);
+}
@@ -0,0 +1,124 @@
+// WString.h - host stand-in for the Arduino String class (native env only)
+
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class String
+{
+public:
+    String() {}
+    String(const char *cstr) : value(cstr ? cstr : "") {}
+    String(const char *cstr, unsigned int length) : value(cstr ? std::string(cstr, length) : std::string()) {}
+    String(const uint8_t *cstr, unsigned int length) : value(reinterpret_cast<const char *>(cstr), length) {}
+    String(const std::string &str) : value(str) {}
+    String(const __FlashStringHelper *str) : String(reinterpret_cast<const char *>(str)) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10) : String((unsigned long)value, base) {}
+    explicit String(int value, unsigned char base = 10) : String((long)value, base) {}
+    explicit String(unsigned int value, unsigned char base = 10) : String((unsigned long)value, base) {}
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned int decimalPlaces = 2) : String((double)value, decimalPlaces) {}
+    explicit String(double value, unsigned int decimalPlaces = 2);
+
+    bool reserve(unsigned int size) { value.reserve(size); return true; }
+    unsigned int length() const { return value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    const char *c_str() const { return value.c_str(); }
+    char *begin() { return &value[0]; }
+    char *end() { return &value[0] + value.length(); }
+    const char *begin() const { return value.c_str(); }
+    const char *end() const { return value.c_str() + value.length(); }
+
+    bool concat(const String &str) { value += str.value; return true; }
+    bool concat(const char *cstr) { if (cstr) value += cstr; return true; }
+    bool concat(const char *cstr, unsigned int length) { if (cstr) value.append(cstr, length); return true; }
+    bool concat(const uint8_t *cstr, unsigned int length) { return concat(reinterpret_cast<const char *>(cstr), length); }
+    bool concat(char c) { value += c; return true; }
+    bool concat(unsigned char num) { return concat(String(num)); }
+    bool concat(int num) { return concat(String(num)); }
+    bool concat(unsigned int num) { return concat(String(num)); }
+    bool concat(long num) { return concat(String(num)); }
+    bool concat(unsigned long num) { return concat(String(num)); }
+    bool concat(long long num) { return concat(String(num)); }
+    bool concat(unsigned long long num) { return concat(String(num)); }
+    bool concat(float num) { return concat(String(num)); }
+    bool concat(double num) { return concat(String(num)); }
+
+    template <typename T>
+    String &operator+=(const T &rhs) { concat(rhs); return *this; }
+
+    explicit operator bool() const { return true; }
+
+    int compareTo(const String &s) const { return value.compare(s.value); }
+    bool equals(const String &s) const { return value == s.value; }
+    bool equals(const char *cstr) const { return value == (cstr ? cstr : ""); }
+    bool equalsIgnoreCase(const String &s) const;
+    bool equalsConstantTime(const String &s) const;
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *cstr) const { return equals(cstr); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *cstr) const { return !equals(cstr); }
+    bool operator<(const String &rhs) const { return compareTo(rhs) < 0; }
+    bool operator>(const String &rhs) const { return compareTo(rhs) > 0; }
+    bool operator<=(const String &rhs) const { return compareTo(rhs) <= 0; }
+    bool operator>=(const String &rhs) const { return compareTo(rhs) >= 0; }
+
+    bool startsWith(const String &prefix) const { return value.compare(0, prefix.length(), prefix.value) == 0 && prefix.length() <= length(); }
+    bool startsWith(const String &prefix, unsigned int offset) const;
+    bool endsWith(const String &suffix) const;
+
+    char charAt(unsigned int index) const { return index < value.length() ? value[index] : 0; }
+    void setCharAt(unsigned int index, char c) { if (index < value.length()) value[index] = c; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return value[index]; }
+    void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const;
+    void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const { getBytes(reinterpret_cast<unsigned char *>(buf), bufsize, index); }
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const;
+    int indexOf(const String &str, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char ch) const;
+    int lastIndexOf(char ch, unsigned int fromIndex) const;
+    int lastIndexOf(const String &str) const;
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, length()); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(char find, char replace);
+    void replace(const String &find, const String &replace);
+    void remove(unsigned int index) { if (index < value.length()) value.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < value.length()) value.erase(index, count); }
+    void toLowerCase() { for (char &c : value) c = (char)tolower((unsigned char)c); }
+    void toUpperCase() { for (char &c : value) c = (char)toupper((unsigned char)c); }
+    void trim();
+
+    long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(value.c_str(), nullptr); }
+    double toDouble() const { return strtod(value.c_str(), nullptr); }
+
+    friend String operator+(const String &lhs, const String &rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, const char *rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const char *lhs, const String &rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, char rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, int rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, unsigned int rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, long rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, unsigned long rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, float rhs) { String s(lhs); s.concat(rhs); return s; }
+    friend String operator+(const String &lhs, double rhs) { String s(lhs); s.concat(rhs); return s; }
+
+private:
+    std::string value;
+};
+
+inline bool operator==(const char *lhs, const String &rhs) { return rhs.equals(lhs); }
+inline bool operator!=(const char *lhs, const String &rhs) { return !rhs.equals(lhs); }
@@ -0,0 +1,64 @@
+// aes/esp_aes.h - host stand-in for the ESP32 AES accelerator, on mbedTLS (native env only)
+
+#pragma once
+
+#include <cstring>
+#include "mbedtls/aes.h"
+
+#define ESP_AES_ENCRYPT MBEDTLS_AES_ENCRYPT
+#define ESP_AES_DECRYPT MBEDTLS_AES_DECRYPT
+
+// The accelerator takes one key for both directions; mbedTLS needs to know
+// the direction when the key is set, so keep the key until the first call
+struct esp_aes_context
+{
+    mbedtls_aes_context aes;
+    unsigned char key[32];
+    unsigned int keyBits;
+};
+
+inline void esp_aes_init(esp_aes_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    mbedtls_aes_init(&ctx->aes);
+}
+
+inline void esp_aes_free(esp_aes_context *ctx) { mbedtls_aes_free(&ctx->aes); }
+
+inline int esp_aes_setkey(esp_aes_context *ctx, const unsigned char *key, unsigned int keyBits)
+{
+    if (keyBits != 128 && keyBits != 192 && keyBits != 256) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    memcpy(ctx->key, key, keyBits / 8);
+    ctx->keyBits = keyBits;
+    return 0;
+}
+
+inline int esp_aes_crypt_cbc(esp_aes_context *ctx, int mode, size_t length, unsigned char iv[16],
+                             const unsigned char *input, unsigned char *output)
+{
+    int err = mode == ESP_AES_ENCRYPT ? mbedtls_aes_setkey_enc(&ctx->aes, ctx->key, ctx->keyBits)
+                                      : mbedtls_aes_setkey_dec(&ctx->aes, ctx->key, ctx->keyBits);
+    if (err) return err;
+    return mbedtls_aes_crypt_cbc(&ctx->aes, mode, length, iv, input, output);
+}
+
+// CTR mode runs the key schedule forwards in both directions
+inline int esp_aes_crypt_ctr(esp_aes_context *ctx, size_t length, size_t *nc_off, unsigned char nonce_counter[16],
+                             unsigned char stream_block[16], const unsigned char *input, unsigned char *output)
+{
+    int err = mbedtls_aes_setkey_enc(&ctx->aes, ctx->key, ctx->keyBits);
+    if (err) return err;
+    size_t offset = *nc_off;
+    for (size_t i = 0; i < length; i++) {
+        if (offset == 0) {
+            err = mbedtls_aes_crypt_ecb(&ctx->aes, MBEDTLS_AES_ENCRYPT, nonce_counter, stream_block);
+            if (err) return err;
+            for (int j = 15; j >= 0 && ++nonce_counter[j] == 0; j--) {
+            }
+        }
+        output[i] = input[i] ^ stream_block[offset];
+        offset = (offset + 1) & 15;
+    }
+    *nc_off = offset;
+    return 0;
+}
@@ -0,0 +1,40 @@
+// esp_heap_caps.h - host stand-in for the ESP-IDF heap statistics (native env only)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifndef ESP_OK
+typedef int esp_err_t;
+#define ESP_OK 0
+#endif
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+typedef struct
+{
+    size_t total_free_bytes;
+    size_t total_allocated_bytes;
+    size_t largest_free_block;
+    size_t minimum_free_bytes;
+    size_t allocated_blocks;
+    size_t free_blocks;
+    size_t total_blocks;
+} multi_heap_info_t;
+
+// Blocks and bytes are only counted when built with NATIVE_COUNT_ALLOCATIONS
+// (which replaces malloc/free; leave it off for valgrind and the sanitizers).
+// Free sizes are measured against a pretend 200 KB heap.
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+
+// Not in ESP-IDF: malloc, calloc and realloc calls so far, freed or not
+size_t heap_caps_native_allocations(void);
+
+// As in ESP-IDF 5.1+: restart the minimum free size from the current usage,
+// so the peak of one piece of code can be measured
+esp_err_t heap_caps_monitor_local_minimum_free_size_start(void);
+esp_err_t heap_caps_monitor_local_minimum_free_size_stop(void);
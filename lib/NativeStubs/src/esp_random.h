@@ -0,0 +1,9 @@
+// esp_random.h - host stand-in for the ESP-IDF hardware RNG (native env only)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
@@ -0,0 +1,9 @@
+// esp_system.h - host stand-in for ESP-IDF system calls (native env only)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
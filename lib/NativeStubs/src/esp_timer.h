@@ -0,0 +1,7 @@
+// esp_timer.h - host stand-in for the ESP-IDF high resolution timer (native env only)
+
+#pragma once
+
+#include <cstdint>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,256 @@
+// FreeRTOS.cpp - host stand-in for the FreeRTOS kernel on std::thread (native env only)
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+struct NativeTask
+{
+    char name[16] = "loopTask"; // configMAX_TASK_NAME_LEN; the main thread stands in for loop()
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifyCount = 0;
+};
+
+struct NativeTaskExit
+{
+};
+
+static thread_local NativeTask *currentTask = nullptr;
+
+static NativeTask *mainTask()
+{
+    static NativeTask task;
+    return &task;
+}
+
+template <typename Predicate>
+static bool waitFor(std::unique_lock<std::mutex> &lock, std::condition_variable &cv, TickType_t ticks, Predicate pred)
+{
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, pred);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t coreId)
+{
+    (void)stackDepth;
+    (void)priority;
+    (void)coreId;
+    NativeTask *handle = new NativeTask();
+    strncpy(handle->name, name ? name : "", sizeof(handle->name) - 1);
+    if (createdTask) *createdTask = handle;
+    std::thread([task, parameters, handle]() {
+        currentTask = handle;
+        try {
+            task(parameters);
+        } catch (const NativeTaskExit &) {
+        }
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *createdTask)
+{
+    return xTaskCreatePinnedToCore(task, name, stackDepth, parameters, priority, createdTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr || task == currentTask) throw NativeTaskExit();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return currentTask ? currentTask : mainTask();
+}
+
+char *pcTaskGetTaskName(TaskHandle_t task)
+{
+    return (task ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+TickType_t xTaskGetTickCount()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (TickType_t)duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    NativeTask *self = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(self->mutex);
+    waitFor(lock, self->cv, ticksToWait, [self]() { return self->notifyCount > 0; });
+    uint32_t count = self->notifyCount;
+    if (count) self->notifyCount = clearCountOnExit ? 0 : count - 1;
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifyCount++;
+    }
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    (void)task;
+    return 4096;
+}
+
+void taskYIELD()
+{
+    std::this_thread::yield();
+}
+
+// Like FreeRTOS, the storage is allocated once when the queue is created,
+// so sends and receives (and semaphore takes and gives) never allocate
+struct NativeQueue
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<uint8_t> storage; // Ring of length items
+    size_t head;                  // Index of the oldest item
+    size_t count;
+    size_t length;
+    size_t itemSize;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    NativeQueue *queue = new NativeQueue();
+    queue->storage.resize(length * itemSize);
+    queue->head = 0;
+    queue->count = 0;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait, bool front)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(lock, queue->cv, ticksToWait, [queue]() { return queue->count < queue->length; })) {
+        return pdFAIL;
+    }
+    size_t slot;
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    if (queue->itemSize) memcpy(&queue->storage[slot * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    lock.unlock();
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(lock, queue->cv, ticksToWait, [queue]() { return queue->count > 0; })) {
+        return pdFAIL;
+    }
+    if (queue->itemSize) memcpy(buffer, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    lock.unlock();
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->head = 0;
+    queue->count = 0;
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+// Semaphores are queues of zero-size items: give = send, take = receive
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+    QueueHandle_t queue = xQueueCreate(maxCount, 0);
+    queue->count = initialCount;
+    return queue;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    return xQueueReceive(semaphore, nullptr, ticksToWait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return xQueueSend(semaphore, nullptr, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    vQueueDelete(semaphore);
+}
@@ -0,0 +1,37 @@
+// freertos/FreeRTOS.h - host stand-in for the FreeRTOS kernel types (native env only)
+//
+// Tasks run on std::thread, critical sections are a mutex and tick = 1 ms.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define tskIDLE_PRIORITY 0
+#define configMAX_PRIORITIES 25
+
+struct portMUX_TYPE
+{
+    std::recursive_mutex mutex;
+};
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define taskENTER_CRITICAL(mux) (mux)->mutex.lock()
+#define taskEXIT_CRITICAL(mux) (mux)->mutex.unlock()
+#define portENTER_CRITICAL(mux) taskENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux) taskEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_ISR(mux) taskENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) taskEXIT_CRITICAL(mux)
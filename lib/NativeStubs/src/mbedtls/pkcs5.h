@@ -0,0 +1,9 @@
+// mbedtls/pkcs5.h - host stand-in for mbedTLS PBKDF2, on OpenSSL libcrypto (native env only)
+
+#pragma once
+
+#include "md.h"
+
+int mbedtls_pkcs5_pbkdf2_hmac(mbedtls_md_context_t *ctx, const unsigned char *password, size_t plen,
+                              const unsigned char *salt, size_t slen, unsigned int iteration_count,
+                              uint32_t key_length, unsigned char *output);
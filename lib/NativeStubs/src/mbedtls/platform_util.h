@@ -0,0 +1,7 @@
+// mbedtls/platform_util.h - host stand-in for mbedTLS platform helpers (native env only)
+
+#pragma once
+
+#include <cstddef>
+
+void mbedtls_platform_zeroize(void *buf, size_t len);
@@ -814,12 +814,18 @@ boolean RemoteDebug::isActive(uint8_t debugLevel) {
 	boolean ret = (debugLevel >= _clientDebugLevel &&
 					!_silence &&
 					(_connected || _connectedWS || _serialEnabled));
+	if (!ret && _callbackLogLine && debugLevel >= _logLineLevel && !_silence) {
+		ret = true;
+	}
 
 #else // Telnet only
 
 	boolean ret = (debugLevel >= _clientDebugLevel &&
 					!_silence &&
 					(_connected || _serialEnabled));
+	if (!ret && _callbackLogLine && debugLevel >= _logLineLevel && !_silence) {
+		ret = true;
+	}
 
 #endif
 
@@ -850,6 +856,11 @@ void RemoteDebug::setCallBackNewClient(void (*callback)()) {
 	_callbackNewClient = callback;
 }
 
+void RemoteDebug::setCallBackLogLine(void (*callback)(uint8_t level, const char *line, size_t length), uint8_t minLevel) {
+	_callbackLogLine = callback;
+	_logLineLevel = minLevel;
+}
+
 // Print
 
 size_t RemoteDebug::write(const uint8_t *buffer, size_t size) {
@@ -1178,9 +1189,25 @@ size_t RemoteDebug::write(uint8_t character) {
 
 	if (doPrint) { // Print the buffer
 
-		boolean noPrint = false;
+		// Hand the line to the sketch's tap, without the line ending
+
+		void (*callbackLogLine)(uint8_t, const char *, size_t) = _callbackLogLine; // May be changed from another task
+
+		if (callbackLogLine && _lastDebugLevel >= _logLineLevel) {
+			size_t length = _bufferPrint.length();
+			while (length > 0 && (_bufferPrint[length - 1] == '\n' || _bufferPrint[length - 1] == '\r')) {
+				length--;
+			}
+			callbackLogLine(_lastDebugLevel, _bufferPrint.c_str(), length);
+		}
+
+		// Lines only the tap asked for are not shown on telnet or serial
+
+		boolean noPrint = _lastDebugLevel < _clientDebugLevel;
 
-		if (_showProfiler && elapsed < _minTimeShowProfiler) { // Profiler time Minimal
+		if (noPrint) {
+			;
+		} else if (_showProfiler && elapsed < _minTimeShowProfiler) { // Profiler time Minimal
 			noPrint = true;
 		} else if (_filterActive) { // Check filter before print
 
@@ -261,6 +261,11 @@ class RemoteDebug: public Print
 
 	void setCallBackNewClient(void (*callback)());
 
+	// Tap on every finished line at minLevel or above, whatever the telnet
+	// level is (lines below it only go to the tap). Lets the sketch mirror
+	// the log somewhere else; the callback must not print to Debug itself.
+	void setCallBackLogLine(void (*callback)(uint8_t level, const char *line, size_t length), uint8_t minLevel);
+
 #ifdef ALPHA_VERSION // In test, not good yet
 	void autoProfilerLevel(uint32_t millisElapsed);
 #endif
@@ -362,6 +367,8 @@ private:
 	String _helpProjectCmds = "";		// Help of comands setted by project (sketch)
 	void (*_callbackProjectCmds)() = NULL; // Callable for projects commands
 	void (*_callbackNewClient)() = NULL; // Callable for when have a new client connected
+	void (*_callbackLogLine)(uint8_t, const char *, size_t) = NULL; // Callable for each finished line
+	uint8_t _logLineLevel = ANY;		// Lowest level sent to _callbackLogLine
 
 	String _filter = "";				// Filter
 	boolean _filterActive = false;
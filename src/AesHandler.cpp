@@ -5,6 +5,7 @@
 #include <aes/esp_aes.h>
 #include "mbedtls/md.h"
 #include "mbedtls/pkcs5.h"
+#include "mbedtls/platform_util.h"
 #include "arduino_base64.hpp"
 
 //const size_t AesHandler::iterations = 10000; //Anything above 10000 starts to become really slow
@@ -13,27 +14,26 @@ const size_t AesHandler::saltSize = 16;
 const size_t AesHandler::keySize = 32;
 const size_t AesHandler::blockSize = 16;
 
+// Salt, key and IV live on the stack; the padded text is encrypted in place
+// after its salt, so each call only allocates that buffer and the base64 text
 String AesHandler::encrypt(const String &plainText, const String &password)
 {
-    std::vector<uint8_t> salt = generateRandomBytes(saltSize);
-    std::vector<uint8_t> key(keySize), iv(blockSize);
-    deriveKeyAndIV(password.c_str(), salt.data(), key.data(), iv.data());
-
     size_t paddedLen = getPaddedLength(plainText.length(), blockSize);
-    std::vector<uint8_t> inputBuffer(paddedLen);
-    memcpy(inputBuffer.data(), plainText.c_str(), plainText.length());
-    applyPKCS7Padding(inputBuffer.data(), plainText.length(), blockSize);
+    std::vector<uint8_t> buffer(saltSize + paddedLen);
+    uint8_t *salt = buffer.data();
+    uint8_t *data = buffer.data() + saltSize;
+    esp_fill_random(salt, saltSize);
 
-    std::vector<uint8_t> cipherText(paddedLen);
-    encryptData(inputBuffer.data(), paddedLen, key.data(), iv.data(), cipherText.data());
+    uint8_t key[keySize], iv[blockSize];
+    deriveKeyAndIV(password.c_str(), salt, key, iv);
 
-    std::vector<uint8_t> saltedCipherText;
-    saltedCipherText.reserve(saltSize + paddedLen);
-    saltedCipherText.insert(saltedCipherText.end(), salt.begin(), salt.end());
-    saltedCipherText.insert(saltedCipherText.end(), cipherText.begin(), cipherText.end());
+    memcpy(data, plainText.c_str(), plainText.length());
+    applyPKCS7Padding(data, plainText.length(), blockSize);
+    encryptData(data, paddedLen, key, iv, data);
+    mbedtls_platform_zeroize(key, sizeof(key));
 
-    std::vector<char> encodedText(base64::encodeLength(saltedCipherText.size()));
-    base64::encode(saltedCipherText.data(), saltedCipherText.size(), encodedText.data());
+    std::vector<char> encodedText(base64::encodeLength(buffer.size()));
+    base64::encode(buffer.data(), buffer.size(), encodedText.data());
     return String(encodedText.data());
 }
 
@@ -41,32 +41,27 @@ String AesHandler::decrypt(const String &cipherText, const String &password)
 {
     std::vector<uint8_t> decodedBytes(base64::decodeLength(cipherText.c_str()));
     base64::decode(cipherText.c_str(), decodedBytes.data());
+    if (decodedBytes.size() < saltSize + blockSize || (decodedBytes.size() - saltSize) % blockSize != 0)
+    {
+        return "";
+    }
 
-    std::vector<uint8_t> salt(saltSize);
-    memcpy(salt.data(), decodedBytes.data(), saltSize);
-    std::vector<uint8_t> key(keySize), iv(blockSize);
-    deriveKeyAndIV(password.c_str(), salt.data(), key.data(), iv.data());
+    uint8_t key[keySize], iv[blockSize];
+    deriveKeyAndIV(password.c_str(), decodedBytes.data(), key, iv);
 
-    uint8_t *cipherData = decodedBytes.data() + saltSize;
+    uint8_t *data = decodedBytes.data() + saltSize;
     size_t cipherLen = decodedBytes.size() - saltSize;
+    decryptData(data, cipherLen, key, iv, data);
+    mbedtls_platform_zeroize(key, sizeof(key));
 
-    std::vector<uint8_t> plainTextBuffer(cipherLen);
-    decryptData(cipherData, cipherLen, key.data(), iv.data(), plainTextBuffer.data());
-
-    size_t plainTextLen = removePKCS7Padding(plainTextBuffer.data(), cipherLen);
-    return String(reinterpret_cast<const char *>(plainTextBuffer.data()), plainTextLen);
-}
-
-std::vector<uint8_t> AesHandler::generateRandomBytes(size_t length)
-{
-    std::vector<uint8_t> buffer(length);
-    uint32_t randValue;
-    for (size_t i = 0; i < length; i += 4)
+    size_t plainTextLen = removePKCS7Padding(data, cipherLen);
+    String result;
+    if (plainTextLen != cipherLen) // Otherwise bad padding: wrong password or damaged text
     {
-        randValue = esp_random();
-        memcpy(buffer.data() + i, &randValue, (length - i < 4) ? length - i : 4);
+        result = String(reinterpret_cast<const char *>(data), plainTextLen);
     }
-    return buffer;
+    mbedtls_platform_zeroize(decodedBytes.data(), decodedBytes.size());
+    return result;
 }
 
 size_t AesHandler::getPaddedLength(size_t inputLen, size_t blockSize)
@@ -80,9 +75,22 @@ void AesHandler::applyPKCS7Padding(uint8_t *buffer, size_t inputLen, size_t bloc
     memset(buffer + inputLen, padding, blockSize - (inputLen % blockSize));
 }
 
+// Returns length unchanged if the padding is not valid
 size_t AesHandler::removePKCS7Padding(const uint8_t *buffer, size_t length)
 {
-    return length - buffer[length - 1];
+    uint8_t padding = buffer[length - 1];
+    if (padding == 0 || padding > blockSize || padding > length)
+    {
+        return length;
+    }
+    for (size_t i = length - padding; i < length; i++)
+    {
+        if (buffer[i] != padding)
+        {
+            return length;
+        }
+    }
+    return length - padding;
 }
 
 void AesHandler::deriveKeyAndIV(const char *password, const uint8_t *salt, uint8_t *key, uint8_t *iv)
@@ -92,11 +100,12 @@ void AesHandler::deriveKeyAndIV(const char *password, const uint8_t *salt, uint8
     const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
     mbedtls_md_setup(&ctx, md_info, 1);
 
-    std::vector<uint8_t> keyIV(keySize + blockSize);
+    uint8_t keyIV[keySize + blockSize];
     mbedtls_pkcs5_pbkdf2_hmac(&ctx, reinterpret_cast<const uint8_t *>(password), strlen(password),
-                              salt, saltSize, iterations, keyIV.size(), keyIV.data());
-    memcpy(key, keyIV.data(), keySize);
-    memcpy(iv, keyIV.data() + keySize, blockSize);
+                              salt, saltSize, iterations, sizeof(keyIV), keyIV);
+    memcpy(key, keyIV, keySize);
+    memcpy(iv, keyIV + keySize, blockSize);
+    mbedtls_platform_zeroize(keyIV, sizeof(keyIV));
     mbedtls_md_free(&ctx);
 }
 
@@ -120,34 +129,29 @@ void AesHandler::decryptData(const uint8_t *cipherText, size_t length, const uin
 
 void AesHandler::init()
 {
-    CommandHandler::registerCommand("aes", [](const String &command) {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
-
-        if (cmd == "enc") {
-            int delimiterPos = args.indexOf(' ');
-            if (delimiterPos == -1) {
-                debugW("Invalid arguments for enc. Usage: aes enc <text> <password>");
+    CommandHandler::registerCommand("aes", [](const CommandArgs &args, CommandResult &result) {
+        const CommandToken &cmd = args[0];
+
+        if (cmd.equals("enc")) {
+            if (args[2].isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid arguments for enc. Usage: aes enc <text> <password>");
                 return;
             }
-            String text = args.substring(0, delimiterPos);
-            String password = args.substring(delimiterPos + 1);
-
-            String encryptedText = AesHandler::encrypt(text, password);
-            debugI("Encrypted: %s", encryptedText.c_str());
-        } else if (cmd == "dec") {
-            int delimiterPos = args.indexOf(' ');
-            if (delimiterPos == -1) {
-                debugW("Invalid arguments for dec. Usage: aes dec <text> <password>");
+            String encryptedText = AesHandler::encrypt(args[1].toString(), args.rest(2).toString());
+            result.printf("Encrypted: %s", encryptedText.c_str());
+        } else if (cmd.equals("dec")) {
+            if (args[2].isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid arguments for dec. Usage: aes dec <text> <password>");
                 return;
             }
-            String text = args.substring(0, delimiterPos);
-            String password = args.substring(delimiterPos + 1);
-
-            String decryptedText = AesHandler::decrypt(text, password);
-            debugI("Decrypted: %s", decryptedText.c_str());
+            String decryptedText = AesHandler::decrypt(args[1].toString(), args.rest(2).toString());
+            if (decryptedText.isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Decryption failed: wrong password or invalid text");
+                return;
+            }
+            result.printf("Decrypted: %s", decryptedText.c_str());
         } else {
-            debugW("Unknown aes subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown aes subcommand: %.*s", (int)cmd.length, cmd.data);
         }
     }, "Handles aes commands. Usage: aes <subcommand> [args]\n"
        "Subcommands:\n"
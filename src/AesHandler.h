@@ -21,7 +21,6 @@ private:
     static const size_t keySize;
     static const size_t blockSize;
 
-    static std::vector<uint8_t> generateRandomBytes(size_t length);
     static size_t getPaddedLength(size_t inputLen, size_t blockSize);
     static void applyPKCS7Padding(uint8_t *buffer, size_t inputLen, size_t blockSize);
     static size_t removePKCS7Padding(const uint8_t *buffer, size_t length);
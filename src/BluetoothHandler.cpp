@@ -29,14 +29,19 @@ void BluetoothHandler::RxCallback::onWrite(NimBLECharacteristic *pCharacteristic
     {
         debugI("Received: %s", receivedValue.c_str());
 
-        CommandHandler::handleCommand(receivedValue.c_str());
-
-        // Send the response back using the TX characteristic
-        if (pTxCharacteristic)
+        uint32_t id;
+        if (CommandBus::isBatch(receivedValue.data(), receivedValue.length()))
+        {
+            CommandBatchOptions options = {false, 0};
+            id = CommandBus::submitBatch(receivedValue.data(), receivedValue.length(), CMD_SOURCE_BLE, options, 0, commandDone);
+        }
+        else
         {
-            pTxCharacteristic->setValue(receivedValue);
-            pTxCharacteristic->notify();
-            debugI("Sent response: %s", receivedValue.c_str());
+            id = CommandBus::submit(receivedValue.data(), receivedValue.length(), CMD_SOURCE_BLE, 0, commandDone);
+        }
+        if (!id)
+        {
+            sendResponse(CMD_STATUS_BUSY, "Command queue full", 18);
         }
     }
     else
@@ -45,6 +50,28 @@ void BluetoothHandler::RxCallback::onWrite(NimBLECharacteristic *pCharacteristic
     }
 }
 
+// Runs on the command executor once a command from RX has finished
+void BluetoothHandler::commandDone(uint32_t correlationId, const CommandResult &result, void *ctx)
+{
+    sendResponse(result.status(), result.text(), result.size());
+}
+
+// Send "<status> <text>" back using the TX characteristic
+void BluetoothHandler::sendResponse(CommandStatus status, const char *text, size_t length)
+{
+    if (!pTxCharacteristic)
+    {
+        return;
+    }
+
+    std::string response = std::to_string((int)status);
+    response += ' ';
+    response.append(text, length);
+    pTxCharacteristic->setValue(response);
+    pTxCharacteristic->notify();
+    debugI("Sent response: %s", response.c_str());
+}
+
 // TX characteristic callback implementation
 void BluetoothHandler::TxCallback::onRead(NimBLECharacteristic *pCharacteristic)
 {
@@ -3,6 +3,7 @@
 #ifdef ENABLE_BLUETOOTH_HANDLER
 
 #include <NimBLEDevice.h>
+#include "CommandHandler.h"
 
 class BluetoothHandler
 {
@@ -28,6 +29,9 @@ private:
         void onRead(NimBLECharacteristic *pCharacteristic) override;
     };
 
+    static void commandDone(uint32_t correlationId, const CommandResult &result, void *ctx);
+    static void sendResponse(CommandStatus status, const char *text, size_t length);
+
 public:
     static void init();
     static void loop();
@@ -9,8 +9,10 @@
 #include "CryptoHandler.h"
 #include "DeviceHandler.h"
 #include "DuckyScriptHandler.h"
+#include "DatabaseHandler.h"
+#include "HeapStats.h"
 #include <OneButton.h>
-#include <LittleFS.h>
+#include "mbedtls/platform_util.h"
 
 // Configurable durations (in milliseconds)
 const unsigned long REBOOT_HOLD_DURATION_MS = 5000; // 5 seconds total hold time to reboot
@@ -23,12 +25,16 @@ static_assert(REBOOT_HOLD_DURATION_MS > COUNTDOWN_START_MS, "REBOOT_HOLD_DURATIO
 unsigned long ButtonHandler::longPressStartTime = 0;
 bool ButtonHandler::rebootTriggered = false;
 int ButtonHandler::lastCountdownValue = -1;
+ButtonStore ButtonHandler::store;
+SemaphoreHandle_t ButtonHandler::storeMutex = nullptr;
+bool ButtonHandler::storeLoaded = false;
 static OneButton button(BUTTON_PIN, true);
 
 // Initialize the button
 void ButtonHandler::init()
 {
     debugI("ButtonHandler initialized on pin: %d", BUTTON_PIN);
+    storeMutex = xSemaphoreCreateMutex();
     button.attachClick(handleSingleClick);
     button.attachDoubleClick(handleDoubleClick);
     button.attachLongPressStart(handleLongPress);
@@ -47,19 +53,19 @@ void ButtonHandler::loop()
 void ButtonHandler::handleSingleClick()
 {
     debugI("Single click.");
-    CommandHandler::handleCommand(settings.device.singlePress);
+    CommandBus::submit(settings.device.singlePress, CMD_SOURCE_BUTTON);
 }
 
 void ButtonHandler::handleDoubleClick()
 {
     debugI("Double click.");
-    CommandHandler::handleCommand(settings.device.doublePress);
+    CommandBus::submit(settings.device.doublePress, CMD_SOURCE_BUTTON);
 }
 
 void ButtonHandler::handleLongPress()
 {
     debugI("Long press started.");
-    CommandHandler::handleCommand(settings.device.longPress);
+    CommandBus::submit(settings.device.longPress, CMD_SOURCE_BUTTON);
     longPressStartTime = millis(); // Record the start time of the long press
     rebootTriggered = false; // Reset the reboot flag
     lastCountdownValue = -1; // Reset the countdown value
@@ -112,90 +118,244 @@ void ButtonHandler::handleLongPressStop()
     GfxHandler::printMessage(""); // Clear the display message
 }
 
-void ButtonHandler::runButton(int id) {
-    debugI("Running button with ID: %d", id);
-
-    File file = LittleFS.open(BUTTONS_FILE, "r");
-    if (!file) {
-        debugE("Failed to open buttons file");
-        return;
+bool ButtonHandler::ensureLoaded() {
+    if (!storeLoaded) {
+        store.clear();
+        storeLoaded = DatabaseHandler::buttons.forEach([](uint32_t id, const char *payload, size_t length, void *ctx) {
+            static_cast<ButtonStore *>(ctx)->upsert(payload, length);
+        }, &store);
+        debugI("Loaded %u buttons (%u bytes)", (unsigned)store.size(), (unsigned)store.memoryUsed());
     }
+    return storeLoaded;
+}
 
-    static JsonDocument buttonDoc;
-    DeserializationError error = deserializeJson(buttonDoc, file);
-    file.close();
+bool ButtonHandler::runButton(int id) {
+    debugI("Running button with ID: %d", id);
 
-    if (error) {
-        debugE("Failed to deserialize JSON: %s", error.c_str());
-        return;
+    // Copied out so the store is free again before anything is decrypted or
+    // typed; web edits and the rekey task wait on storeMutex
+    ButtonEntry entry;
+    String userName, password, target;
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    const ButtonEntry *button = ensureLoaded() ? store.find(id) : nullptr;
+    if (button) {
+        entry = *button;
+        userName = store.text(button->userName);
+        password = store.text(button->password);
+        target = store.text(button->target);
     }
+    xSemaphoreGive(storeMutex);
 
-    const JsonArray buttons = buttonDoc["buttons"].as<JsonArray>();
-    for (const JsonObject& button : buttons) {
-        if (button["id"].as<int>() == id) {
-            debugI("Found button with ID: %d", id);
-            executeButtonAction(button);
-            return;
-        }
+    if (!button) {
+        debugW("Button ID not found: %d", id);
+        return false;
     }
+    executeButtonAction(entry, userName, password, target);
+    return true;
+}
 
-    debugW("Button ID not found: %d", id);
+bool ButtonHandler::needsVault(int id) {
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    const ButtonEntry *button = ensureLoaded() ? store.find(id) : nullptr;
+    bool needed = button && button->action == BUTTON_ACTION_LOGIN && button->passwordLength > 0;
+    xSemaphoreGive(storeMutex);
+    return needed;
 }
 
-void ButtonHandler::executeButtonAction(const JsonObject& button) {
-    const String deviceAction = button["deviceAction"].as<String>();
-    const String passwordAction = button["passwordAction"].as<String>();
-    const String usernameAction = button["usernameAction"].as<String>();
-    
-    if (deviceAction == "1") {  // Login credentials
-        
-        DeviceHandler::sendKeys(button["userName"].as<String>());
-        
-        // If usernameAction is 1 (TAB) or 2 (ENTER)
-        if (usernameAction == "1") {
-            DeviceHandler::tapKey("TAB");
-        } else if (usernameAction == "2") {
-            DeviceHandler::tapKey("ENTER");
+// Holds the base64 ciphertext decoded in place: IV, then passwords of up to
+// 223 chars plus padding
+static const size_t PASSWORD_BUFFER_SIZE = 256;
+
+// How long a press waits for the HID queue to drain enough for the next batch
+static const uint32_t HID_SPACE_WAIT_MS = 1000;
+
+// Runs on the executor without storeMutex, from runButton()'s copies. Login
+// text is compiled into reports here and queued as they are, so the
+// plaintext password never leaves this stack frame.
+void ButtonHandler::executeButtonAction(const ButtonEntry &button, const String &userName, const String &cipherText,
+                                        const String &target) {
+    switch (button.action) {
+    case BUTTON_ACTION_LOGIN: {
+        if (!DeviceHandler::typeTextReports(userName.c_str(), userName.length(), HID_SPACE_WAIT_MS)) {
+            debugW("Button %d: user name not typed", (int)button.id);
+            break;
+        }
+        if (button.userNameKey) {
+            DeviceHandler::tapKeyCode(button.userNameKey);
         }
 
-        String decryptedPassword = CryptoHandler::decryptAES(
-            button["userPassword"].as<String>(), 
-            settings.device.userPassword
-        );
-        
-        DeviceHandler::sendKeys(decryptedPassword);
+        // Decrypted on the stack and wiped once its reports are queued
+        char password[PASSWORD_BUFFER_SIZE];
+        size_t passwordLength = 0;
+        bool typed = true;
+        if (cipherText.length() && CryptoHandler::decrypt(cipherText.c_str(), cipherText.length(),
+                                                          password, sizeof(password), passwordLength)) {
+            typed = DeviceHandler::typeTextReports(password, passwordLength, HID_SPACE_WAIT_MS) != 0;
+        } else if (cipherText.length()) {
+            debugW("Could not decrypt the password of button %d", (int)button.id);
+            typed = false;
+        }
+        mbedtls_platform_zeroize(password, sizeof(password));
+        if (!typed) {
+            // No ENTER after a password that never went out
+            break;
+        }
 
-        // If passwordAction is 1 (TAB) or 2 (ENTER)
-        if (passwordAction == "1") {
-            DeviceHandler::tapKey("TAB");
-        } else if (passwordAction == "2") {
-            DeviceHandler::tapKey("ENTER");
+        if (button.passwordKey) {
+            DeviceHandler::tapKeyCode(button.passwordKey);
         }
+        break;
+    }
+    case BUTTON_ACTION_COMMAND:
+        CommandBus::submit(target.c_str(), target.length(), CMD_SOURCE_BUTTON);
+        break;
+    case BUTTON_ACTION_SCRIPT:
+        DuckyScriptHandler::executeScript(target.c_str(), target.length(), "button");
+        break;
+    default:
+        debugW("Button %d has no action", (int)button.id);
+        break;
+    }
+}
+
+void ButtonHandler::buttonSaved(JsonObjectConst button) {
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    if (storeLoaded) {
+        store.upsert(button);
     }
-    else if (deviceAction == "2") {  // Command
-        CommandHandler::handleCommand(button["command"].as<String>());
+    xSemaphoreGive(storeMutex);
+}
+
+void ButtonHandler::buttonDeleted(int id) {
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    if (storeLoaded) {
+        store.remove(id);
     }
-    else if (deviceAction == "3") {  // DuckyScript
-        String filePath = button["script"].as<String>();
-        DuckyScriptHandler::executeScript(filePath);
-        //CommandHandler::handleCommand("script file " + filePath);
+    xSemaphoreGive(storeMutex);
+}
+
+void ButtonHandler::reloadButtons() {
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    store.clear();
+    storeLoaded = false;
+    xSemaphoreGive(storeMutex);
+}
+
+// Time finding a button among 10, 100, ... maxButtons synthetic ones, through
+// the store and by parsing the JSON and scanning it as every press used to.
+// Actions are not run; the JSON is parsed from RAM, so flash reads come on top.
+void ButtonHandler::benchmark(int maxButtons, int iterations, CommandResult &result)
+{
+    size_t before = 0;
+    size_t after = 0;
+    bool counted = HeapStats::allocations(before);
+    result.printf("buttonbench: %d iterations (store x100)%s\n", iterations,
+                  counted ? "" : ", allocations only counted in the native build");
+    for (int buttons = 10; ; buttons *= 10) {
+        if (buttons > maxButtons) buttons = maxButtons;
+        String json;
+        {
+            JsonDocument doc;
+            JsonArray array = doc["buttons"].to<JsonArray>();
+            for (int i = 1; i <= buttons; i++) {
+                JsonObject button = array.add<JsonObject>();
+                button["id"] = i;
+                button["name"] = "Button " + String(i);
+                button["categoryId"] = 1;
+                button["deviceAction"] = "2";
+                button["usernameAction"] = "0";
+                button["passwordAction"] = "0";
+                button["command"] = "led color white";
+                button["script"] = "";
+                button["userName"] = "";
+                button["notes"] = "Synthetic button for the press benchmark";
+            }
+            serializeJson(doc, json);
+        }
+
+        ButtonStore bench;
+        {
+            JsonDocument doc;
+            deserializeJson(doc, json);
+            bench.load(doc["buttons"].as<JsonArrayConst>());
+        }
+
+        // Worst case for the scan: the last button
+        int id = buttons;
+        size_t found = 0;
+        HeapStats::allocations(before);
+        uint32_t start = micros();
+        for (int i = 0; i < iterations * 100; i++) {
+            const ButtonEntry *button = bench.find(id);
+            if (button && button->targetLength > 0) found++;
+        }
+        uint32_t storeUs = micros() - start;
+        HeapStats::allocations(after);
+        size_t storeAllocs = (after - before) / ((size_t)iterations * 100);
+
+        // Allocator calls per press, from the first press
+        size_t jsonAllocs = 0;
+        start = micros();
+        for (int i = 0; i < iterations; i++) {
+            HeapStats::allocations(before);
+            {
+                JsonDocument doc;
+                deserializeJson(doc, json);
+                for (JsonObjectConst button : doc["buttons"].as<JsonArrayConst>()) {
+                    if (button["id"].as<int>() == id) {
+                        if (!button["command"].as<String>().isEmpty()) found++;
+                        break;
+                    }
+                }
+            }
+            HeapStats::allocations(after);
+            if (i == 0) jsonAllocs = after - before;
+        }
+        uint32_t jsonUs = micros() - start;
+
+        result.printf("  %d buttons (%u bytes JSON, %u bytes store): store %lu ns/press, %u allocations; JSON %lu us/press, %u allocations\n",
+                      buttons, (unsigned)json.length(), (unsigned)bench.memoryUsed(),
+                      (unsigned long)((uint64_t)storeUs * 1000 / ((uint64_t)iterations * 100)), (unsigned)storeAllocs,
+                      (unsigned long)(jsonUs / iterations), (unsigned)jsonAllocs);
+        if (found != (size_t)iterations * 101) {
+            result.fail(CMD_STATUS_FAILED, "Button %d not found in the %d button set", id, buttons);
+            return;
+        }
+        if (buttons == maxButtons) break;
     }
 }
 
 void ButtonHandler::registerCommands()
 {
-    CommandHandler::registerCommand("BUTTON", [](const String &command)
+    CommandHandler::registerCommand("BUTTON", [](const CommandArgs &args, CommandResult &result)
                                     {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
+        const CommandToken &cmd = args[0];
 
-        if (CommandHandler::equalsIgnoreCase(cmd, "RUN")) {
-            runButton(args.toInt());
+        if (cmd.equals("RUN")) {
+            int id = args[1].toInt();
+            if (runButton(id)) {
+                result.printf("Button %d run", id);
+            } else {
+                result.fail(CMD_STATUS_NOT_FOUND, "Button %d not found", id);
+            }
+        } else if (cmd.equals("RELOAD")) {
+            reloadButtons();
+            result.printf("Buttons will be reloaded on the next press");
+        } else if (cmd.equals("BENCH")) {
+            int buttons = args[1].isEmpty() ? 100 : args[1].toInt();
+            int iterations = args[2].isEmpty() ? 20 : args[2].toInt();
+            if (buttons < 10 || iterations <= 0) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: BUTTON BENCH [buttons >= 10] [iterations]");
+                return;
+            }
+            benchmark(buttons, iterations, result);
         } else {
-            debugW("Unknown BUTTON subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown BUTTON subcommand: %.*s", (int)cmd.length, cmd.data);
         } }, "Handles BUTTON commands. Usage: BUTTON <subcommand> <args>\n"
                                          "  Subcommands:\n"
-                                         "  run <id> - Finds and runs button by id");
+                                         "  run <id> - Finds and runs button by id\n"
+                                         "  reload - Re-reads the button records on the next press\n"
+                                         "  bench [buttons] [iterations] - Times button lookup against parsing the JSON file");
         
         CommandHandler::registerCommandAlias("BTN", "BUTTON");
 }
@@ -4,12 +4,26 @@
 
 #ifdef ENABLE_BUTTON_HANDLER
 
+#include "ButtonStore.h"
+#include "CommandHandler.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
 // Full implementation of ButtonHandler
 class ButtonHandler {
 public:
     static void init();
     static void loop();
-    static void runButton(int id);
+    // Types or runs the button's action, blocking until its reports are
+    // queued; call from the executor (BUTTON RUN). false if there is no such button.
+    static bool runButton(int id);
+    static bool needsVault(int id); // A login button with a password to decrypt
+
+    // Keep the button store in step with the button records. Call after the
+    // record has been written.
+    static void buttonSaved(JsonObjectConst button);
+    static void buttonDeleted(int id);
+    static void reloadButtons(); // Re-read the records on the next press
 
 private:
     static void handleSingleClick();
@@ -20,8 +34,14 @@ private:
     static unsigned long longPressStartTime; // Track the start time of the long press
     static bool rebootTriggered; // Flag to prevent multiple reboots
     static int lastCountdownValue; // Track the last displayed countdown value
+    static ButtonStore store;
+    static SemaphoreHandle_t storeMutex; // Web edits and presses run on different tasks
+    static bool storeLoaded;
     static void registerCommands();
-    static void executeButtonAction(const JsonObject& button);
+    static bool ensureLoaded();
+    static void executeButtonAction(const ButtonEntry &button, const String &userName, const String &cipherText,
+                                    const String &target);
+    static void benchmark(int maxButtons, int iterations, CommandResult &result);
 };
 
 #else
@@ -31,7 +51,11 @@ class ButtonHandler {
 public:
     static void init() {} // No-op
     static void loop() {} // No-op
-    static void runButton(int id) {} // No-op
+    static bool runButton(int id) { return false; } // No-op
+    static bool needsVault(int id) { return false; } // No-op
+    static void buttonSaved(JsonObjectConst button) {} // No-op
+    static void buttonDeleted(int id) {} // No-op
+    static void reloadButtons() {} // No-op
 };
 
 #endif // ENABLE_BUTTON_HANDLER
@@ -0,0 +1,231 @@
+#include "ButtonStore.h"
+#include "Globals.h"
+#include <USBHIDKeyboard.h>
+
+void ButtonStore::clear()
+{
+    entries.clear();
+    slots.clear();
+    pool.clear();
+    count = 0;
+    wasted = 0;
+}
+
+void ButtonStore::load(JsonArrayConst buttons)
+{
+    clear();
+    entries.reserve(buttons.size());
+    for (JsonObjectConst button : buttons)
+    {
+        upsert(button);
+    }
+    entries.shrink_to_fit();
+    pool.shrink_to_fit();
+}
+
+// Parse one button record, keeping only the fields a press needs
+bool ButtonStore::upsert(const char *json, size_t length)
+{
+    // Names, notes and categories are only for the web UI
+    JsonDocument filter;
+    for (const char *field : {"id", "deviceAction", "usernameAction", "passwordAction", "userName", "userPassword", "command", "script"})
+    {
+        filter[field] = true;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, json, length, DeserializationOption::Filter(filter));
+    if (error)
+    {
+        debugE("Failed to deserialize button: %s", error.c_str());
+        return false;
+    }
+    return upsert(doc.as<JsonObjectConst>());
+}
+
+ButtonAction ButtonStore::parseAction(JsonVariantConst value)
+{
+    // The web UI stores these as strings ("1"), older files as numbers
+    int action = value.is<const char *>() ? atoi(value.as<const char *>()) : value.as<int>();
+    switch (action)
+    {
+    case 1:
+        return BUTTON_ACTION_LOGIN;
+    case 2:
+        return BUTTON_ACTION_COMMAND;
+    case 3:
+        return BUTTON_ACTION_SCRIPT;
+    default:
+        return BUTTON_ACTION_NONE;
+    }
+}
+
+uint8_t ButtonStore::parseAfterKey(JsonVariantConst value)
+{
+    int key = value.is<const char *>() ? atoi(value.as<const char *>()) : value.as<int>();
+    return key == 1 ? HID_KEY_TAB : key == 2 ? HID_KEY_ENTER : 0;
+}
+
+uint32_t ButtonStore::addText(JsonVariantConst value, uint16_t &length)
+{
+    const char *text = value.as<const char *>();
+    size_t len = text ? strlen(text) : 0;
+    if (len > UINT16_MAX)
+    {
+        len = UINT16_MAX;
+    }
+
+    uint32_t offset = pool.size();
+    pool.insert(pool.end(), text, text + len);
+    pool.push_back('\0');
+    length = len;
+    return offset;
+}
+
+void ButtonStore::fill(ButtonEntry &entry, JsonObjectConst button)
+{
+    entry.action = parseAction(button["deviceAction"]);
+    entry.userNameKey = parseAfterKey(button["usernameAction"]);
+    entry.passwordKey = parseAfterKey(button["passwordAction"]);
+    entry.userName = addText(button["userName"], entry.userNameLength);
+    entry.password = addText(button["userPassword"], entry.passwordLength);
+    entry.target = addText(button[entry.action == BUTTON_ACTION_SCRIPT ? "script" : "command"], entry.targetLength);
+}
+
+void ButtonStore::index(size_t entryIndex)
+{
+    int32_t id = entries[entryIndex].id;
+    if (id > MAX_INDEXED_ID)
+    {
+        return; // Found by find()'s scan
+    }
+    if ((size_t)id >= slots.size())
+    {
+        slots.resize(id + 1, 0);
+    }
+    slots[id] = entryIndex + 1;
+}
+
+void ButtonStore::releaseText(const ButtonEntry &entry)
+{
+    wasted += entry.userNameLength + entry.passwordLength + entry.targetLength + 3;
+}
+
+bool ButtonStore::upsert(JsonObjectConst button)
+{
+    int32_t id = button["id"].is<const char *>() ? atoi(button["id"].as<const char *>()) : button["id"].as<int32_t>();
+    if (id <= 0)
+    {
+        debugW("Skipping button without a valid id");
+        return false;
+    }
+
+    ButtonEntry *existing = const_cast<ButtonEntry *>(find(id));
+    if (existing)
+    {
+        releaseText(*existing);
+        fill(*existing, button);
+        if (wasted > pool.size() / 2)
+        {
+            compact();
+        }
+        return true;
+    }
+
+    if (entries.size() >= UINT16_MAX)
+    {
+        debugE("Too many buttons");
+        return false;
+    }
+
+    ButtonEntry entry = {};
+    entry.id = id;
+    fill(entry, button);
+    entries.push_back(entry);
+    index(entries.size() - 1);
+    count++;
+    return true;
+}
+
+bool ButtonStore::remove(int32_t id)
+{
+    ButtonEntry *entry = const_cast<ButtonEntry *>(find(id));
+    if (!entry)
+    {
+        return false;
+    }
+
+    if (id <= MAX_INDEXED_ID)
+    {
+        slots[id] = 0;
+    }
+    releaseText(*entry);
+    entry->id = 0;
+    count--;
+    if (wasted > pool.size() / 2 || count < entries.size() / 2)
+    {
+        compact();
+    }
+    return true;
+}
+
+const ButtonEntry *ButtonStore::find(int32_t id) const
+{
+    if (id <= 0)
+    {
+        return nullptr;
+    }
+    if (id <= MAX_INDEXED_ID)
+    {
+        uint16_t slot = (size_t)id < slots.size() ? slots[id] : 0;
+        return slot ? &entries[slot - 1] : nullptr;
+    }
+    for (const ButtonEntry &entry : entries)
+    {
+        if (entry.id == id)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Drop deleted entries and text that is no longer referenced
+void ButtonStore::compact()
+{
+    std::vector<ButtonEntry> liveEntries;
+    std::vector<char> livePool;
+    liveEntries.reserve(count);
+    livePool.reserve(pool.size() - wasted);
+
+    for (ButtonEntry entry : entries)
+    {
+        if (entry.id == 0)
+        {
+            continue;
+        }
+        uint32_t *fields[] = {&entry.userName, &entry.password, &entry.target};
+        uint16_t lengths[] = {entry.userNameLength, entry.passwordLength, entry.targetLength};
+        for (size_t i = 0; i < 3; i++)
+        {
+            uint32_t offset = livePool.size();
+            livePool.insert(livePool.end(), pool.begin() + *fields[i], pool.begin() + *fields[i] + lengths[i] + 1);
+            *fields[i] = offset;
+        }
+        liveEntries.push_back(entry);
+    }
+
+    entries.swap(liveEntries);
+    pool.swap(livePool);
+    wasted = 0;
+    slots.assign(slots.size(), 0);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        index(i);
+    }
+}
+
+size_t ButtonStore::memoryUsed() const
+{
+    return entries.capacity() * sizeof(ButtonEntry) + slots.capacity() * sizeof(uint16_t) + pool.capacity();
+}
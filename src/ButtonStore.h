@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <vector>
+
+// What pressing a button does, decoded from its "deviceAction" string
+enum ButtonAction : uint8_t {
+    BUTTON_ACTION_NONE,    // "0" or unknown
+    BUTTON_ACTION_LOGIN,   // "1": type user name and password
+    BUTTON_ACTION_COMMAND, // "2": run a command line
+    BUTTON_ACTION_SCRIPT   // "3": run a DuckyScript file
+};
+
+// One button, reduced to what a press needs. Text fields are offsets into
+// the store's text pool so entries stay small and fixed size.
+struct ButtonEntry {
+    int32_t id;              // 0 = deleted
+    ButtonAction action;
+    uint8_t userNameKey;     // HID key tapped after the user name, 0 = none
+    uint8_t passwordKey;     // HID key tapped after the password, 0 = none
+    uint16_t userNameLength;
+    uint16_t passwordLength; // Encrypted, as stored in the file
+    uint16_t targetLength;
+    uint32_t userName;
+    uint32_t password;
+    uint32_t target;         // Command line or script path
+};
+
+// Buttons indexed by id, built from the button records once instead of
+// parsing them on every press. Ids up to MAX_INDEXED_ID are looked
+// up through a direct table; larger ones fall back to a scan.
+class ButtonStore
+{
+public:
+    static const int32_t MAX_INDEXED_ID = 4096;
+
+    // Replace the contents with the buttons in a {"buttons": [...]} array
+    void load(JsonArrayConst buttons);
+    void clear();
+
+    // Add or replace one button; returns false if it has no usable id
+    bool upsert(JsonObjectConst button);
+    bool upsert(const char *json, size_t length);
+    bool remove(int32_t id);
+
+    // nullptr if there is no such button. Valid until the store changes.
+    const ButtonEntry *find(int32_t id) const;
+    const char *text(uint32_t offset) const { return pool.data() + offset; }
+
+    size_t size() const { return count; }
+    size_t memoryUsed() const;
+
+private:
+    std::vector<ButtonEntry> entries;
+    std::vector<uint16_t> slots; // id -> entry index + 1, 0 = none
+    std::vector<char> pool;      // NUL terminated text fields
+    size_t count = 0;
+    size_t wasted = 0;           // Pool bytes left behind by updates and deletes
+
+    static ButtonAction parseAction(JsonVariantConst value);
+    static uint8_t parseAfterKey(JsonVariantConst value);
+    uint32_t addText(JsonVariantConst value, uint16_t &length);
+    void fill(ButtonEntry &entry, JsonObjectConst button);
+    void index(size_t entryIndex);
+    void releaseText(const ButtonEntry &entry);
+    void compact();
+};
@@ -0,0 +1,416 @@
+#include "CommandBus.h"
+#include "Globals.h"
+#include <ArduinoJson.h>
+
+const size_t CommandBus::QUEUE_DEPTH[CMD_PRIORITY_COUNT] = {4, 8, 8, 8};
+
+TaskHandle_t CommandBus::executorHandle = nullptr;
+QueueHandle_t CommandBus::queues[CMD_PRIORITY_COUNT] = {};
+SemaphoreHandle_t CommandBus::pending = nullptr;
+portMUX_TYPE CommandBus::statsMux = portMUX_INITIALIZER_UNLOCKED;
+CommandBusStats CommandBus::stats = {};
+uint32_t CommandBus::nextCorrelationId = 1;
+char CommandBus::resultBuffer[CommandBus::RESULT_SIZE];
+SemaphoreHandle_t CommandBus::resultsMutex = nullptr;
+CommandBus::StoredResult CommandBus::recent[CommandBus::RECENT_RESULTS] = {};
+CommandBus::StoredResult CommandBus::webResults[CommandBus::WEB_RESULTS] = {};
+size_t CommandBus::recentNext = 0;
+size_t CommandBus::webNext = 0;
+
+void CommandBus::init() {
+    size_t total = 0;
+    for (int i = 0; i < CMD_PRIORITY_COUNT; i++) {
+        queues[i] = xQueueCreate(QUEUE_DEPTH[i], sizeof(CommandRequest));
+        stats.capacity[i] = QUEUE_DEPTH[i];
+        total += QUEUE_DEPTH[i];
+    }
+    pending = xSemaphoreCreateCounting(total, 0);
+    resultsMutex = xSemaphoreCreateMutex();
+
+    xTaskCreatePinnedToCore(
+        executorTask,       // Task function
+        "CommandTask",      // Task name
+        8192,               // Stack size (handlers do file, TLS and crypto work)
+        nullptr,            // Parameters
+        1,                  // Priority (same as loop())
+        &executorHandle,    // Task handle
+        tskNO_AFFINITY      // Run on any core
+    );
+
+    registerCommands();
+    debugI("CommandBus initialized");
+}
+
+CommandPriority CommandBus::priorityOf(CommandSource source) {
+    switch (source) {
+    case CMD_SOURCE_BUTTON:
+        return CMD_PRIORITY_BUTTON;
+    case CMD_SOURCE_WEB:
+    case CMD_SOURCE_CONSOLE:
+    case CMD_SOURCE_BLE:
+    case CMD_SOURCE_BOOT:
+        return CMD_PRIORITY_INTERACTIVE;
+    case CMD_SOURCE_MQTT:
+        return CMD_PRIORITY_MQTT;
+    default:
+        return CMD_PRIORITY_BACKGROUND;
+    }
+}
+
+const char *CommandBus::sourceName(CommandSource source) {
+    switch (source) {
+    case CMD_SOURCE_BUTTON: return "button";
+    case CMD_SOURCE_WEB: return "web";
+    case CMD_SOURCE_CONSOLE: return "console";
+    case CMD_SOURCE_BLE: return "ble";
+    case CMD_SOURCE_MQTT: return "mqtt";
+    case CMD_SOURCE_CRON: return "cron";
+    case CMD_SOURCE_SCRIPT: return "script";
+    case CMD_SOURCE_BOOT: return "boot";
+    default: return "unknown";
+    }
+}
+
+bool CommandBus::isExecutorTask() {
+    return executorHandle && xTaskGetCurrentTaskHandle() == executorHandle;
+}
+
+uint32_t CommandBus::submit(const String &line, CommandSource source, uint32_t correlationId, CommandDoneCallback callback, void *ctx) {
+    return submit(line.c_str(), line.length(), source, correlationId, callback, ctx);
+}
+
+uint32_t CommandBus::submit(const char *line, size_t length, CommandSource source, uint32_t correlationId, CommandDoneCallback callback, void *ctx) {
+    CommandBatchOptions none = {false, 0};
+    return enqueue(line, length, MAX_COMMAND_LENGTH, source, correlationId, callback, ctx, false, none);
+}
+
+uint32_t CommandBus::submitBatch(const char *body, size_t length, CommandSource source, const CommandBatchOptions &options,
+                                 uint32_t correlationId, CommandDoneCallback callback, void *ctx) {
+    return enqueue(body, length, MAX_BATCH_LENGTH, source, correlationId, callback, ctx, true, options);
+}
+
+bool CommandBus::isBatch(const char *text, size_t length) {
+    while (length > 0 && isspace((unsigned char)text[length - 1])) length--;
+    while (length > 0 && isspace((unsigned char)*text)) {
+        text++;
+        length--;
+    }
+    if (length == 0) return false;
+    return text[0] == '[' || text[0] == '{' || memchr(text, '\n', length) != nullptr;
+}
+
+uint32_t CommandBus::enqueue(const char *line, size_t length, size_t maxLength, CommandSource source, uint32_t correlationId,
+                             CommandDoneCallback callback, void *ctx, bool isBatch, const CommandBatchOptions &batch) {
+    CommandPriority priority = priorityOf(source);
+
+    // Blank lines never reach a handler
+    while (length > 0 && isspace((unsigned char)line[length - 1])) length--;
+    if (length == 0) return 0;
+
+    CommandRequest request;
+    request.line = nullptr;
+    if (queues[priority] && length <= maxLength) {
+        request.line = (char *)malloc(length + 1);
+    }
+    if (!request.line) {
+        taskENTER_CRITICAL(&statsMux);
+        stats.rejected[priority]++;
+        taskEXIT_CRITICAL(&statsMux);
+        debugE("Command from %s rejected (%u bytes)", sourceName(source), (unsigned)length);
+        return 0;
+    }
+    memcpy(request.line, line, length);
+    request.line[length] = '\0';
+    request.length = length;
+    request.isBatch = isBatch;
+    request.batch = batch;
+    request.source = source;
+    request.queuedAt = millis();
+    request.callback = callback;
+    request.ctx = ctx;
+
+    taskENTER_CRITICAL(&statsMux);
+    if (correlationId == 0) {
+        correlationId = nextCorrelationId++;
+        if (nextCorrelationId == 0) nextCorrelationId = 1;
+    }
+    taskEXIT_CRITICAL(&statsMux);
+    request.correlationId = correlationId;
+
+    if (xQueueSend(queues[priority], &request, 0) != pdTRUE) {
+        free(request.line);
+        taskENTER_CRITICAL(&statsMux);
+        stats.rejected[priority]++;
+        taskEXIT_CRITICAL(&statsMux);
+        debugW("Command queue full, rejected command from %s", sourceName(source));
+        return 0;
+    }
+
+    taskENTER_CRITICAL(&statsMux);
+    stats.accepted++;
+    taskEXIT_CRITICAL(&statsMux);
+    xSemaphoreGive(pending);
+    return correlationId;
+}
+
+void CommandBus::notifyWaiter(uint32_t correlationId, const CommandResult &result, void *ctx) {
+    xTaskNotifyGive((TaskHandle_t)ctx);
+}
+
+bool CommandBus::submitAndWait(const String &line, CommandSource source) {
+    if (isExecutorTask()) {
+        CommandHandler::handleCommand(line);
+        return true;
+    }
+    if (!submit(line, source, 0, notifyWaiter, xTaskGetCurrentTaskHandle())) {
+        return false;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return true;
+}
+
+void CommandBus::executorTask(void *pvParameters) {
+    CommandRequest request;
+    while (true) {
+        xSemaphoreTake(pending, portMAX_DELAY);
+
+        // Highest priority first, FIFO within a priority
+        for (int i = 0; i < CMD_PRIORITY_COUNT; i++) {
+            if (xQueueReceive(queues[i], &request, 0) == pdTRUE) {
+                execute(request);
+                break;
+            }
+        }
+    }
+}
+
+void CommandBus::execute(CommandRequest &request) {
+    uint32_t startedAt = millis();
+    uint32_t waitMs = startedAt - request.queuedAt;
+    stats.busy = true;
+
+    debugV("Command %lu from %s: %s", (unsigned long)request.correlationId, sourceName(request.source), request.line);
+    CommandResult result(resultBuffer, sizeof(resultBuffer));
+    if (request.isBatch) {
+        executeBatch(request, result);
+    } else {
+        CommandHandler::handleCommand(request.line, request.length, result);
+    }
+    free(request.line);
+    record(request, result);
+
+    uint32_t runMs = millis() - startedAt;
+    taskENTER_CRITICAL(&statsMux);
+    stats.executed++;
+    if (waitMs > stats.maxWaitMs) stats.maxWaitMs = waitMs;
+    if (runMs > stats.maxRunMs) stats.maxRunMs = runMs;
+    taskEXIT_CRITICAL(&statsMux);
+    stats.busy = false;
+
+    if (request.callback) {
+        request.callback(request.correlationId, result, request.ctx);
+    }
+}
+
+// Splits the batch into commands, in place for line-delimited text and via
+// ArduinoJson for JSON, then runs them in order
+void CommandBus::executeBatch(CommandRequest &request, CommandResult &result) {
+    uint32_t start = micros();
+    bool stopOnError = request.batch.stopOnError;
+    uint32_t delayMs = request.batch.delayMs;
+    std::vector<CommandToken> commands;
+    JsonDocument input;
+
+    const char *body = request.line;
+    while (isspace((unsigned char)*body)) body++;
+
+    if (*body == '[' || *body == '{') {
+        DeserializationError error = deserializeJson(input, body);
+        if (error) {
+            result.fail(CMD_STATUS_BAD_REQUEST, "Invalid batch JSON: %s", error.c_str());
+            return;
+        }
+        JsonArray list;
+        if (input.is<JsonArray>()) {
+            list = input.as<JsonArray>();
+        } else {
+            list = input["commands"].as<JsonArray>();
+            stopOnError = input["stopOnError"] | stopOnError;
+            delayMs = input["delayMs"] | delayMs;
+        }
+        for (JsonVariant item : list) {
+            const char *command = item.as<const char *>();
+            if (command) commands.push_back({command, strlen(command)});
+        }
+    } else {
+        const char *line = request.line;
+        const char *end = request.line + request.length;
+        while (line < end) {
+            const char *next = (const char *)memchr(line, '\n', end - line);
+            if (!next) next = end;
+            commands.push_back({line, (size_t)(next - line)});
+            line = next + 1;
+        }
+    }
+
+    // Blank lines and comments are not commands
+    for (size_t i = commands.size(); i-- > 0;) {
+        CommandToken &command = commands[i];
+        while (command.length > 0 && isspace((unsigned char)*command.data)) {
+            command.data++;
+            command.length--;
+        }
+        while (command.length > 0 && isspace((unsigned char)command.data[command.length - 1])) command.length--;
+        if (command.length == 0 || command.data[0] == '#') {
+            commands.erase(commands.begin() + i);
+        }
+    }
+
+    if (commands.empty()) {
+        result.fail(CMD_STATUS_BAD_REQUEST, "Batch has no commands");
+        return;
+    }
+    if (commands.size() > MAX_BATCH_COMMANDS) {
+        result.fail(CMD_STATUS_BAD_REQUEST, "Batch has %u commands, limit is %u", (unsigned)commands.size(), (unsigned)MAX_BATCH_COMMANDS);
+        return;
+    }
+    if (delayMs > MAX_BATCH_DELAY_MS) delayMs = MAX_BATCH_DELAY_MS;
+
+    JsonDocument output;
+    output["count"] = commands.size();
+    JsonArray results = output["results"].to<JsonArray>();
+    CommandStatus firstFailure = CMD_STATUS_OK;
+    size_t executed = 0;
+    size_t failed = 0;
+    char itemBuffer[CommandHandler::RESULT_SIZE];
+    CommandResult item(itemBuffer, sizeof(itemBuffer));
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (i > 0 && delayMs > 0) vTaskDelay(pdMS_TO_TICKS(delayMs));
+
+        CommandHandler::handleCommand(commands[i].data, commands[i].length, item);
+        executed++;
+
+        JsonObject entry = results.add<JsonObject>();
+        entry["status"] = (int)item.status();
+        entry["durationUs"] = item.durationUs();
+        if (item.size() > 0) {
+            size_t length = item.size() < BATCH_ITEM_TEXT ? item.size() : BATCH_ITEM_TEXT;
+            entry["result"] = JsonString(item.text(), length); // Copied into the document
+        }
+
+        if (!item.ok()) {
+            if (failed++ == 0) firstFailure = item.status();
+            if (stopOnError) break;
+        }
+    }
+
+    output["executed"] = executed;
+    output["failed"] = failed;
+    output["stopped"] = executed < commands.size();
+
+    // Keep the summary valid JSON: drop the text of successful commands
+    // first, then all of it, until it fits the result buffer
+    for (int pass = 0; pass < 2 && measureJson(output) >= sizeof(resultBuffer); pass++) {
+        for (JsonObject entry : results) {
+            if (pass == 1 || entry["status"].as<int>() < 300) entry.remove("result");
+        }
+    }
+    result.json(output);
+    result.setStatus(firstFailure);
+    result.setDuration(micros() - start);
+}
+
+// A web client polls /command/result for its command, so web results get
+// a ring of their own that button, cron and MQTT traffic cannot flush
+void CommandBus::record(const CommandRequest &request, const CommandResult &result) {
+    StoredResult entry;
+    entry.correlationId = request.correlationId;
+    entry.source = request.source;
+    entry.status = result.status();
+    entry.durationUs = result.durationUs();
+    entry.isJson = result.isJson();
+    size_t length = result.size() < CommandRecord::TEXT_SIZE - 1 ? result.size() : CommandRecord::TEXT_SIZE - 1;
+    entry.truncated = result.truncated() || length < result.size();
+    entry.text = length > 0 ? (char *)malloc(length) : nullptr;
+    if (entry.text) {
+        memcpy(entry.text, result.text(), length);
+    } else {
+        entry.truncated = entry.truncated || length > 0;
+        length = 0;
+    }
+    entry.length = length;
+
+    bool web = request.source == CMD_SOURCE_WEB;
+    StoredResult *ring = web ? webResults : recent;
+    size_t &next = web ? webNext : recentNext;
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    char *old = ring[next].text;
+    ring[next] = entry;
+    next = (next + 1) % (web ? WEB_RESULTS : RECENT_RESULTS);
+    xSemaphoreGive(resultsMutex);
+    free(old);
+}
+
+CommandBus::StoredResult *CommandBus::findResult(uint32_t correlationId) {
+    for (size_t i = 0; i < WEB_RESULTS; i++) {
+        if (webResults[i].correlationId == correlationId) return &webResults[i];
+    }
+    for (size_t i = 0; i < RECENT_RESULTS; i++) {
+        if (recent[i].correlationId == correlationId) return &recent[i];
+    }
+    return nullptr;
+}
+
+bool CommandBus::getResult(uint32_t correlationId, CommandRecord &out) {
+    if (correlationId == 0 || !resultsMutex) {
+        return false;
+    }
+    // A mutex, not statsMux: copying up to TEXT_SIZE bytes is too long to
+    // keep interrupts off for
+    xSemaphoreTake(resultsMutex, portMAX_DELAY);
+    StoredResult *slot = findResult(correlationId);
+    if (slot) {
+        out.correlationId = slot->correlationId;
+        out.source = slot->source;
+        out.status = slot->status;
+        out.durationUs = slot->durationUs;
+        out.isJson = slot->isJson;
+        out.truncated = slot->truncated;
+        if (slot->length > 0) memcpy(out.text, slot->text, slot->length);
+        out.text[slot->length] = '\0';
+    }
+    xSemaphoreGive(resultsMutex);
+    return slot != nullptr;
+}
+
+CommandBusStats CommandBus::getStats() {
+    taskENTER_CRITICAL(&statsMux);
+    CommandBusStats snapshot = stats;
+    taskEXIT_CRITICAL(&statsMux);
+    for (int i = 0; i < CMD_PRIORITY_COUNT; i++) {
+        snapshot.depth[i] = queues[i] ? uxQueueMessagesWaiting(queues[i]) : 0;
+    }
+    return snapshot;
+}
+
+void CommandBus::registerCommands() {
+    CommandHandler::registerCommand("cmdbus", [](const CommandArgs &args, CommandResult &result) {
+        if (args[0].equals("status")) {
+            CommandBusStats snapshot = getStats();
+            result.printf("Command bus: %u/%u button, %u/%u interactive, %u/%u mqtt, %u/%u background",
+                   (unsigned)snapshot.depth[CMD_PRIORITY_BUTTON], (unsigned)snapshot.capacity[CMD_PRIORITY_BUTTON],
+                   (unsigned)snapshot.depth[CMD_PRIORITY_INTERACTIVE], (unsigned)snapshot.capacity[CMD_PRIORITY_INTERACTIVE],
+                   (unsigned)snapshot.depth[CMD_PRIORITY_MQTT], (unsigned)snapshot.capacity[CMD_PRIORITY_MQTT],
+                   (unsigned)snapshot.depth[CMD_PRIORITY_BACKGROUND], (unsigned)snapshot.capacity[CMD_PRIORITY_BACKGROUND]);
+            result.printf("\n  accepted: %lu, executed: %lu, rejected: %lu/%lu/%lu/%lu",
+                   (unsigned long)snapshot.accepted, (unsigned long)snapshot.executed,
+                   (unsigned long)snapshot.rejected[CMD_PRIORITY_BUTTON], (unsigned long)snapshot.rejected[CMD_PRIORITY_INTERACTIVE],
+                   (unsigned long)snapshot.rejected[CMD_PRIORITY_MQTT], (unsigned long)snapshot.rejected[CMD_PRIORITY_BACKGROUND]);
+            result.printf("\n  max queue wait: %lu ms, slowest command: %lu ms",
+                   (unsigned long)snapshot.maxWaitMs, (unsigned long)snapshot.maxRunMs);
+        } else {
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown cmdbus subcommand: %.*s", (int)args[0].length, args[0].data);
+        }
+    }, "Shows the command executor queue. Usage: cmdbus status");
+}
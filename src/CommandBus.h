@@ -0,0 +1,164 @@
+#pragma once
+
+#include <Arduino.h>
+#include "CommandHandler.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// Where a command came from; decides its priority on the bus
+enum CommandSource : uint8_t {
+    CMD_SOURCE_BUTTON,  // Physical button
+    CMD_SOURCE_WEB,     // POST /command/set
+    CMD_SOURCE_CONSOLE, // RemoteDebug telnet
+    CMD_SOURCE_BLE,     // Bluetooth RX characteristic
+    CMD_SOURCE_MQTT,    // Subscribed topic
+    CMD_SOURCE_CRON,    // Scheduled job
+    CMD_SOURCE_SCRIPT,  // SCRIPT and DuckyScript COMMAND lines
+    CMD_SOURCE_BOOT,    // settings.device.bootCommand
+    CMD_SOURCE_COUNT
+};
+
+enum CommandPriority : uint8_t {
+    CMD_PRIORITY_BUTTON, // Highest
+    CMD_PRIORITY_INTERACTIVE,
+    CMD_PRIORITY_MQTT,
+    CMD_PRIORITY_BACKGROUND,
+    CMD_PRIORITY_COUNT
+};
+
+// Called on the executor task once the command has run. Keep it short; the
+// next command waits for it. result is only valid during the call.
+typedef void (*CommandDoneCallback)(uint32_t correlationId, const CommandResult &result, void *ctx);
+
+// Defaults for a batch; a JSON batch body can override both
+struct CommandBatchOptions {
+    bool stopOnError;  // Skip the rest of the batch after the first failure
+    uint16_t delayMs;  // Pause between commands (typing into a slow target)
+};
+
+// Copy of a finished command's result, kept for callers that pick it up later
+struct CommandRecord {
+    static const size_t TEXT_SIZE = 2048; // Room for a batch's per-command results
+
+    uint32_t correlationId; // 0 = empty slot
+    CommandSource source;
+    CommandStatus status;
+    uint32_t durationUs;
+    bool isJson;
+    bool truncated;
+    char text[TEXT_SIZE];
+};
+
+struct CommandBusStats {
+    size_t depth[CMD_PRIORITY_COUNT];      // Waiting right now, per priority
+    size_t capacity[CMD_PRIORITY_COUNT];
+    uint32_t accepted;
+    uint32_t rejected[CMD_PRIORITY_COUNT]; // Queue full, too long or out of memory
+    uint32_t executed;
+    uint32_t maxWaitMs;                    // Longest time a command sat in the queue
+    uint32_t maxRunMs;                     // Slowest handler
+    bool busy;
+};
+
+// Every command runs on one executor task, fed by a bounded queue per
+// priority. Producers (web, BLE, MQTT, cron, buttons, scripts) only copy the
+// line in and get an immediate accept or reject, so network callbacks stay
+// short and handlers never race each other on their static state.
+class CommandBus
+{
+private:
+    static const size_t MAX_BATCH_COMMANDS = 32;
+    static const size_t MAX_BATCH_DELAY_MS = 10000;
+    static const size_t BATCH_ITEM_TEXT = 64; // Per-command result text kept in a batch result
+    static const size_t QUEUE_DEPTH[CMD_PRIORITY_COUNT];
+    static const size_t RESULT_SIZE = CommandRecord::TEXT_SIZE;
+    static const size_t RECENT_RESULTS = 4;
+    static const size_t WEB_RESULTS = 16;
+
+    struct CommandRequest {
+        char *line;      // Heap copy, freed on the executor
+        uint16_t length;
+        bool isBatch;    // line holds a whole batch, see submitBatch()
+        CommandBatchOptions batch;
+        CommandSource source;
+        uint32_t correlationId;
+        uint32_t queuedAt;
+        CommandDoneCallback callback;
+        void *ctx;
+    };
+
+    // A finished command's result, with the text on the heap sized to fit
+    struct StoredResult {
+        uint32_t correlationId; // 0 = empty slot
+        CommandSource source;
+        CommandStatus status;
+        uint32_t durationUs;
+        bool isJson;
+        bool truncated;
+        uint16_t length;
+        char *text;             // nullptr when empty or out of memory
+    };
+
+    static TaskHandle_t executorHandle;
+    static QueueHandle_t queues[CMD_PRIORITY_COUNT];
+    static SemaphoreHandle_t pending; // Counts requests across all queues
+    static portMUX_TYPE statsMux;
+    static CommandBusStats stats;
+    static uint32_t nextCorrelationId;
+    static char resultBuffer[RESULT_SIZE];
+    static SemaphoreHandle_t resultsMutex;       // Guards the result rings; statsMux is for the counters
+    static StoredResult recent[RECENT_RESULTS];
+    static StoredResult webResults[WEB_RESULTS]; // Kept apart: web clients poll for theirs
+    static size_t recentNext;
+    static size_t webNext;
+
+    static void executorTask(void *pvParameters);
+    static void execute(CommandRequest &request);
+    static void executeBatch(CommandRequest &request, CommandResult &result);
+    static uint32_t enqueue(const char *line, size_t length, size_t maxLength, CommandSource source, uint32_t correlationId,
+                            CommandDoneCallback callback, void *ctx, bool isBatch, const CommandBatchOptions &batch);
+    static void notifyWaiter(uint32_t correlationId, const CommandResult &result, void *ctx);
+    static void record(const CommandRequest &request, const CommandResult &result);
+    static StoredResult *findResult(uint32_t correlationId);
+    static void registerCommands();
+
+public:
+    static const size_t MAX_COMMAND_LENGTH = 2048;
+    static const size_t MAX_BATCH_LENGTH = 4096;
+
+    static void init();
+
+    // Queue a command. Returns its correlation id (the one passed in, or a
+    // new one if 0), or 0 if it was rejected.
+    static uint32_t submit(const char *line, size_t length, CommandSource source,
+                           uint32_t correlationId = 0, CommandDoneCallback callback = nullptr, void *ctx = nullptr);
+    static uint32_t submit(const String &line, CommandSource source,
+                           uint32_t correlationId = 0, CommandDoneCallback callback = nullptr, void *ctx = nullptr);
+
+    // Queue several commands to run back to back on the executor, with
+    // nothing else in between. body is a JSON array of command strings, a
+    // JSON object {"commands": [...], "stopOnError": bool, "delayMs": n} or
+    // one command per line. The result is a JSON summary with the status,
+    // duration and (shortened) result of each command.
+    static uint32_t submitBatch(const char *body, size_t length, CommandSource source, const CommandBatchOptions &options,
+                                uint32_t correlationId = 0, CommandDoneCallback callback = nullptr, void *ctx = nullptr);
+    // True if text looks like a batch (JSON, or more than one line) rather
+    // than a single command. Lets MQTT and BLE take both on one channel.
+    static bool isBatch(const char *text, size_t length);
+
+    // Run a command and block until it has finished. On the executor itself
+    // (a SCRIPT running its lines) the command runs inline.
+    static bool submitAndWait(const String &line, CommandSource source);
+
+    // Result of one of the last few commands (the last WEB_RESULTS from the
+    // web, the last RECENT_RESULTS from anywhere else). Returns false if the
+    // command has not finished (or its result has already been pushed out).
+    static bool getResult(uint32_t correlationId, CommandRecord &out);
+
+    static bool isExecutorTask();
+    static CommandPriority priorityOf(CommandSource source);
+    static const char *sourceName(CommandSource source);
+    static CommandBusStats getStats();
+};
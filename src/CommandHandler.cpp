@@ -2,11 +2,146 @@
 
 #include "CommandHandler.h"
 #include "Globals.h"
+#include "HeapStats.h"
+#include <map>
+#include <stdarg.h>
 
-std::map<String, std::function<void(const String &)>> CommandHandler::commandRegistry;
-std::map<String, String> CommandHandler::commandDescriptions;
+const CommandToken CommandArgs::emptyToken = {"", 0};
+
+std::vector<CommandHandler::CommandEntry> CommandHandler::commandEntries;
+std::vector<CommandHandler::CommandName> CommandHandler::commandNames;
 std::function<void(const String &)> CommandHandler::defaultHandler = nullptr;
 
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool CommandToken::equals(const char *keyword) const
+{
+    return strncasecmp(data, keyword, length) == 0 && keyword[length] == '\0';
+}
+
+long CommandToken::toInt() const
+{
+    char buffer[16];
+    size_t n = length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1;
+    memcpy(buffer, data, n);
+    buffer[n] = '\0';
+    return strtol(buffer, nullptr, 10);
+}
+
+String CommandToken::toString() const
+{
+    String result;
+    if (length > 0 && result.reserve(length))
+    {
+        result.concat(data, length);
+    }
+    return result;
+}
+
+CommandArgs::CommandArgs(const char *line, size_t length) : tokenCount(0)
+{
+    end = line + length;
+    while (end > line && isSpace(end[-1])) end--;
+
+    nameToken = emptyToken;
+    const char *p = line;
+    bool first = true;
+    while (p < end)
+    {
+        while (p < end && isSpace(*p)) p++;
+        if (p == end) break;
+        const char *start = p;
+        while (p < end && !isSpace(*p)) p++;
+
+        CommandToken token = {start, (size_t)(p - start)};
+        if (first)
+        {
+            nameToken = token;
+            first = false;
+        }
+        else if (tokenCount < MAX_TOKENS)
+        {
+            tokens[tokenCount++] = token;
+        }
+        else
+        {
+            break; // Still reachable through rest()
+        }
+    }
+}
+
+CommandToken CommandArgs::rest(size_t i) const
+{
+    if (i >= tokenCount) return emptyToken;
+    CommandToken token = {tokens[i].data, (size_t)(end - tokens[i].data)};
+    return token;
+}
+
+CommandResult::CommandResult(char *buffer, size_t capacity) : buffer(buffer), capacity(capacity)
+{
+    reset();
+}
+
+void CommandResult::reset()
+{
+    length = 0;
+    if (capacity > 0) buffer[0] = '\0';
+    resultStatus = CMD_STATUS_OK;
+    elapsedUs = 0;
+    jsonPayload = false;
+    overflow = false;
+}
+
+void CommandResult::append(const char *text, size_t textLength)
+{
+    if (capacity == 0) return;
+    size_t room = capacity - 1 - length;
+    if (textLength > room)
+    {
+        textLength = room;
+        overflow = true;
+    }
+    memcpy(buffer + length, text, textLength);
+    length += textLength;
+    buffer[length] = '\0';
+}
+
+void CommandResult::printf(const char *format, ...)
+{
+    if (capacity == 0) return;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, capacity - length, format, args);
+    va_end(args);
+    if (written < 0) return;
+    if ((size_t)written >= capacity - length)
+    {
+        length = capacity - 1;
+        overflow = true;
+    }
+    else
+    {
+        length += written;
+    }
+}
+
+void CommandResult::fail(CommandStatus status, const char *format, ...)
+{
+    resultStatus = status;
+    jsonPayload = false;
+    overflow = false;
+    if (capacity == 0) return;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer, capacity, format, args);
+    va_end(args);
+    length = written < 0 ? 0 : ((size_t)written < capacity ? written : capacity - 1);
+    overflow = written >= 0 && (size_t)written >= capacity;
+}
+
 void CommandHandler::parseCommand(const String &input, String &cmd, String &args)
 {
     int spaceIndex = input.indexOf(' ');
@@ -24,65 +159,165 @@ void CommandHandler::parseCommand(const String &input, String &cmd, String &args
     cmd.toLowerCase(); // Normalize command case
 }
 
+// Names are stored lowercase, so only the token needs folding
+int CommandHandler::compareName(const char *token, size_t length, const String &name)
+{
+    const char *p = name.c_str();
+    for (size_t i = 0; i < length; i++)
+    {
+        int diff = tolower((unsigned char)token[i]) - (unsigned char)p[i];
+        if (diff != 0 || p[i] == '\0') return diff;
+    }
+    return p[length] == '\0' ? 0 : -1;
+}
+
+const CommandHandler::CommandName *CommandHandler::findName(const char *token, size_t length)
+{
+    size_t low = 0, high = commandNames.size();
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        int cmp = compareName(token, length, commandNames[mid].name);
+        if (cmp == 0) return &commandNames[mid];
+        if (cmp < 0) high = mid;
+        else low = mid + 1;
+    }
+    return nullptr;
+}
+
 void CommandHandler::handleCommand(const String &command)
 {
-    String cmd, args;
-    parseCommand(command, cmd, args);
+    char buffer[RESULT_SIZE];
+    CommandResult result(buffer, sizeof(buffer));
+    handleCommand(command.c_str(), command.length(), result);
+}
+
+void CommandHandler::handleCommand(const char *command, size_t length, CommandResult &result)
+{
+    CommandArgs args(command, length);
+    const CommandToken &cmd = args.name();
+    const CommandName *found = cmd.isEmpty() ? nullptr : findName(cmd.data, cmd.length);
+    result.reset();
 
-    auto it = commandRegistry.find(cmd);
-    if (it != commandRegistry.end())
+    if (found)
+    {
+        CommandToken rest = args.rest();
+        debugV("* Executing command: %s with args: %.*s", found->name.c_str(), (int)rest.length, rest.data);
+        uint32_t start = micros();
+        commandEntries[found->entry].handler(args, result); // Call the registered handler
+        result.setDuration(micros() - start);
+    }
+    else if (cmd.isEmpty())
+    {
+        result.fail(CMD_STATUS_BAD_REQUEST, "Empty command");
+    }
+    else
     {
-        debugV("* Executing command: %s with args: %s", cmd.c_str(), args.c_str());
-        it->second(args); // Call the registered handler
+        result.fail(CMD_STATUS_NOT_FOUND, "Unknown command: %.*s", (int)cmd.length, cmd.data);
+        if (defaultHandler)
+        {
+            debugV("* Calling default handler for command: %.*s", (int)length, command);
+            CommandToken line = {command, length};
+            defaultHandler(line.toString());
+        }
     }
-    else if (defaultHandler)
+    logResult(cmd, result);
+}
+
+// Results used to be printed by each handler; they still reach the console
+void CommandHandler::logResult(const CommandToken &name, const CommandResult &result)
+{
+    if (result.ok())
     {
-        debugV("* Calling default handler for command: %s", command.c_str());
-        defaultHandler(command);
+        if (result.size() > 0) debugI("%s", result.text());
     }
     else
     {
-        debugE("* Unknown command received: %s", cmd.c_str());
+        debugW("* %.*s failed (%u): %s", (int)name.length, name.data, (unsigned)result.status(), result.text());
     }
 }
 
-void CommandHandler::registerCommand(const String &name, std::function<void(const String &)> handler, const String &description)
+// Find or create the entry for name, keeping commandNames sorted
+CommandHandler::CommandEntry &CommandHandler::addEntry(const String &name, const String &description)
 {
     String lowerName = name;
     lowerName.toLowerCase();
-    if (commandRegistry.find(lowerName) != commandRegistry.end())
+
+    const CommandName *existing = findName(lowerName.c_str(), lowerName.length());
+    if (existing && !existing->isAlias)
     {
         debugW("* Warning: Command '%s' is being overwritten.", lowerName.c_str());
+        CommandEntry &entry = commandEntries[existing->entry];
+        entry.handler = nullptr;
+        entry.description = description;
+        return entry;
+    }
+
+    commandEntries.push_back(CommandEntry());
+    commandEntries.back().description = description;
+    uint16_t index = commandEntries.size() - 1;
+
+    if (existing)
+    {
+        // A command replacing an alias of the same name takes the slot over
+        CommandName &slot = commandNames[existing - commandNames.data()];
+        slot.entry = index;
+        slot.isAlias = false;
+    }
+    else
+    {
+        CommandName newName = {lowerName, index, false};
+        auto it = commandNames.begin();
+        while (it != commandNames.end() && it->name < lowerName) ++it;
+        commandNames.insert(it, newName);
     }
-    commandRegistry[lowerName] = handler;
-    commandDescriptions[lowerName] = description;
     debugD("* Command '%s' registered with description: %s", lowerName.c_str(), description.c_str());
+    return commandEntries.back();
+}
+
+void CommandHandler::registerCommand(const String &name, CommandFunction handler, const String &description)
+{
+    addEntry(name, description).handler = handler;
 }
 
 void CommandHandler::registerCommandAlias(const String &alias, const String &existingCommand)
 {
     String lowerAlias = alias;
-    String lowerCommand = existingCommand;
     lowerAlias.toLowerCase();
-    lowerCommand.toLowerCase();
 
-    if (commandRegistry.find(lowerCommand) != commandRegistry.end())
+    const CommandName *target = findName(existingCommand.c_str(), existingCommand.length());
+    if (!target)
+    {
+        debugE("* Error: Command '%s' not found for alias registration.", existingCommand.c_str());
+        return;
+    }
+    uint16_t entry = target->entry;
+
+    // The alias shares the entry, so the handler is never copied
+    const CommandName *existing = findName(lowerAlias.c_str(), lowerAlias.length());
+    if (existing)
     {
-        commandRegistry[lowerAlias] = commandRegistry[lowerCommand];
-        debugV("* Alias '%s' registered for command '%s'.", lowerAlias.c_str(), lowerCommand.c_str());
+        CommandName &slot = commandNames[existing - commandNames.data()];
+        slot.entry = entry;
+        slot.isAlias = true;
     }
     else
     {
-        debugE("* Error: Command '%s' not found for alias registration.", existingCommand.c_str());
+        CommandName newName = {lowerAlias, entry, true};
+        auto it = commandNames.begin();
+        while (it != commandNames.end() && it->name < lowerAlias) ++it;
+        commandNames.insert(it, newName);
     }
+    debugV("* Alias '%s' registered for command '%s'.", lowerAlias.c_str(), existingCommand.c_str());
 }
 
 void CommandHandler::listCommands()
 {
     debugI("* Listing all available commands:");
-    for (const auto &pair : commandDescriptions)
+    for (const auto &name : commandNames)
     {
-        debugI("* Command: %s - %s", pair.first.c_str(), pair.second.c_str());
+        if (name.isAlias) continue;
+        debugI("* Command: %s - %s", name.name.c_str(), commandEntries[name.entry].description.c_str());
     }
 }
 
@@ -97,6 +332,98 @@ bool CommandHandler::equalsIgnoreCase(const String &a, const String &b)
     return a.equalsIgnoreCase(b);
 }
 
+// Resolve every registered name (with arguments, as from a button or MQTT) through the dispatch table and through the String and
+// std::map path it replaced. Handlers are not run; this is the cost paid
+// before one is reached.
+void CommandHandler::benchmark(int iterations, CommandResult &result)
+{
+    std::vector<String> lines;
+    std::map<String, uint16_t> legacyRegistry;
+    for (const auto &name : commandNames)
+    {
+        String line = name.name;
+        line.toUpperCase();
+        lines.push_back(line + " print Hello from the command bench");
+        legacyRegistry[name.name] = name.entry;
+    }
+    if (lines.empty())
+    {
+        result.fail(CMD_STATUS_FAILED, "No commands registered");
+        return;
+    }
+
+    auto resolveTable = [&](const String &line) {
+        CommandArgs args(line.c_str(), line.length());
+        const CommandName *name = findName(args.name().data, args.name().length);
+        return name && args.rest().length > 0;
+    };
+    auto resolveLegacy = [&](const String &line) {
+        String cmd, args;
+        parseCommand(line, cmd, args);
+        return legacyRegistry.find(cmd) != legacyRegistry.end() && !args.isEmpty();
+    };
+
+    // Allocator calls are counted on a pass of their own, outside the timing
+    size_t before = 0;
+    size_t after = 0;
+    bool counted = HeapStats::allocations(before);
+    for (const auto &line : lines)
+    {
+        resolveTable(line);
+    }
+    HeapStats::allocations(after);
+    size_t tableAllocs = after - before;
+    HeapStats::allocations(before);
+    for (const auto &line : lines)
+    {
+        resolveLegacy(line);
+    }
+    HeapStats::allocations(after);
+    size_t legacyAllocs = after - before;
+
+    size_t tableFound = 0;
+    uint32_t start = micros();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (const auto &line : lines)
+        {
+            if (resolveTable(line)) tableFound++;
+        }
+    }
+    uint32_t tableUs = micros() - start;
+
+    size_t legacyFound = 0;
+    start = micros();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (const auto &line : lines)
+        {
+            if (resolveLegacy(line)) legacyFound++;
+        }
+    }
+    uint32_t legacyUs = micros() - start;
+
+    size_t dispatches = (size_t)iterations * lines.size();
+    result.printf("cmdbench: %u names, %d iterations, %u/%u resolved\n", (unsigned)lines.size(), iterations,
+           (unsigned)tableFound, (unsigned)legacyFound);
+    const char *paths[] = {"table", "String + std::map"};
+    uint32_t times[] = {tableUs, legacyUs};
+    size_t allocs[] = {tableAllocs, legacyAllocs};
+    for (int i = 0; i < 2; i++)
+    {
+        result.printf("%s  %s: %lu ns/command, ", i ? "\n" : "", paths[i], (unsigned long)((uint64_t)times[i] * 1000 / dispatches));
+        if (counted)
+        {
+            result.printf("%u.%02u allocations per dispatch", (unsigned)(allocs[i] / lines.size()),
+                   (unsigned)(allocs[i] * 100 / lines.size() % 100));
+        }
+        else
+        {
+            result.printf("allocations only counted in the native build");
+        }
+    }
+}
+
 void CommandHandler::init()
 {
     CommandHandler::setDefaultHandler([](const String &command) { // Set the default handler to call the 'help' command
@@ -108,36 +435,38 @@ void CommandHandler::init()
     //     CommandHandler::listCommands();
     // },"Lists all available commands.");
 
-    CommandHandler::registerCommand("help", [](const String &args)
+    CommandHandler::registerCommand("help", [](const CommandArgs &args, CommandResult &result)
                                     {
-    if (args.isEmpty())
+    if (args.count() == 0)
     {
         // List all command names
-        debugI("Available commands:");
-        for (const auto &pair : commandDescriptions)
+        result.printf("Available commands:");
+        for (const auto &name : commandNames)
         {
-            debugI("* %s", pair.first.c_str());
+            if (!name.isAlias) result.printf(" %s", name.name.c_str());
         }
-        debugI("Type 'help <command>' for more details on a specific command.");
+        result.printf("\nType 'help <command>' for more details on a specific command.");
     }
     else
     {
         // Show details for a specific command
-        String lowerArgs = args;
-        lowerArgs.toLowerCase();
-        auto it = commandDescriptions.find(lowerArgs);
-        if (it != commandDescriptions.end())
+        const CommandName *found = findName(args[0].data, args[0].length);
+        if (found)
         {
-            debugI("Command: %s", it->first.c_str());
-            debugI("Description: %s", it->second.c_str());
+            result.printf("Command: %s\nDescription: %s", found->name.c_str(), commandEntries[found->entry].description.c_str());
         }
         else
         {
-            debugE("Unknown command: %s. Use 'help' to list all commands.", args.c_str());
+            result.fail(CMD_STATUS_NOT_FOUND, "Unknown command: %.*s. Use 'help' to list all commands.", (int)args[0].length, args[0].data);
         }
     } }, "Lists all available commands or shows details for a specific command. Usage: help [command]");
 
-    CommandHandler::registerCommand("reboot", [](const String &) { // Register a "reboot" command
+    CommandHandler::registerCommand("cmdbench", [](const CommandArgs &args, CommandResult &result)
+                                    {
+        long iterations = args[0].toInt();
+        benchmark(iterations > 0 ? iterations : 1000, result); }, "Times command lookup against the old String/std::map dispatch. Usage: cmdbench [iterations]");
+
+    CommandHandler::registerCommand("reboot", [](const CommandArgs &, CommandResult &) { // Register a "reboot" command
         ESP.restart();
     },
                                     "Reboot the device.");
@@ -3,22 +3,134 @@
 #pragma once
 
 #include <Arduino.h>
-#include <map>
+#include <vector>
 #include <functional>
 
+// A word of the command line, pointing into the caller's buffer
+struct CommandToken {
+    const char *data;
+    size_t length;
+
+    bool isEmpty() const { return length == 0; }
+    bool equals(const char *keyword) const; // Case-insensitive
+    long toInt() const;
+    String toString() const;
+};
+
+// Command line split in place: the command name followed by its arguments.
+// Nothing is copied, so it is only valid while the line it was built from is.
+class CommandArgs {
+public:
+    static const size_t MAX_TOKENS = 8;
+
+    CommandArgs(const char *line, size_t length);
+
+    const CommandToken &name() const { return nameToken; }
+    size_t count() const { return tokenCount; }
+    // Argument i (0 is the first word after the command name), empty past the end
+    const CommandToken &operator[](size_t i) const { return i < tokenCount ? tokens[i] : emptyToken; }
+    // Everything from argument i to the end of the line, inner spacing kept
+    CommandToken rest(size_t i = 0) const;
+
+private:
+    static const CommandToken emptyToken;
+
+    CommandToken nameToken;
+    CommandToken tokens[MAX_TOKENS];
+    size_t tokenCount;
+    const char *end;
+};
+
+// HTTP-style codes so web callers can pass them straight through
+enum CommandStatus : uint16_t {
+    CMD_STATUS_OK = 200,
+    CMD_STATUS_ACCEPTED = 202,    // Queued work (typing, scripts) that finishes later
+    CMD_STATUS_BAD_REQUEST = 400, // Bad or missing arguments
+    CMD_STATUS_NOT_FOUND = 404,   // Unknown command or missing file
+    CMD_STATUS_FAILED = 500,
+    CMD_STATUS_BUSY = 503         // Queue full
+};
+
+// What a command did, written into a buffer owned by the caller. The text is
+// always NUL terminated and cut short (truncated()) if it does not fit.
+class CommandResult {
+public:
+    CommandResult(char *buffer, size_t capacity);
+
+    void reset();
+    void setStatus(CommandStatus status) { resultStatus = status; }
+    void setDuration(uint32_t us) { elapsedUs = us; }
+    // Append text to the payload
+    void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void append(const char *text, size_t length);
+    // Set an error status and message
+    void fail(CommandStatus status, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+    // Replace the payload with a serialized ArduinoJson document
+    template <typename TDocument>
+    void json(const TDocument &document) {
+        size_t needed = measureJson(document);
+        length = serializeJson(document, buffer, capacity);
+        jsonPayload = true;
+        overflow = needed >= capacity;
+    }
+
+    CommandStatus status() const { return resultStatus; }
+    bool ok() const { return resultStatus < 300; }
+    const char *text() const { return buffer; }
+    size_t size() const { return length; }
+    bool isJson() const { return jsonPayload; }
+    bool truncated() const { return overflow; }
+    uint32_t durationUs() const { return elapsedUs; }
+
+private:
+    char *buffer;
+    size_t capacity;
+    size_t length;
+    CommandStatus resultStatus;
+    uint32_t elapsedUs;
+    bool jsonPayload;
+    bool overflow;
+};
+
+typedef std::function<void(const CommandArgs&, CommandResult&)> CommandFunction;
+
 class CommandHandler {
 public:
+    static const size_t RESULT_SIZE = 256; // Result buffer used when the caller does not need one
+
+    // Run a command and log its result
     static void handleCommand(const String& command);
-    static void registerCommand(const String& name, std::function<void(const String&)> handler, const String& description = "");
+    // Run a command; the result is logged and left in result for the caller
+    static void handleCommand(const char *command, size_t length, CommandResult &result);
+    static void registerCommand(const String& name, CommandFunction handler, const String& description = "");
     static void registerCommandAlias(const String& alias, const String& existingCommand);
     static void listCommands();
     static void setDefaultHandler(std::function<void(const String&)> handler);
     static void parseCommand(const String& input, String& cmd, String& args);
     static bool equalsIgnoreCase(const String &a, const String &b);
+    static void benchmark(int iterations, CommandResult &result);
     static void init();
 
 private:
-    static std::map<String, std::function<void(const String&)>> commandRegistry;
-    static std::map<String, String> commandDescriptions;
+    struct CommandEntry {
+        CommandFunction handler;
+        String description;
+    };
+
+    // Sorted by lowercase name; aliases point at the same entry
+    struct CommandName {
+        String name;
+        uint16_t entry;
+        bool isAlias;
+    };
+
+    static std::vector<CommandEntry> commandEntries;
+    static std::vector<CommandName> commandNames;
     static std::function<void(const String&)> defaultHandler;
+
+    static int compareName(const char *token, size_t length, const String &name);
+    static const CommandName *findName(const char *token, size_t length);
+    static CommandEntry &addEntry(const String& name, const String& description);
+    static void logResult(const CommandToken &name, const CommandResult &result);
 };
@@ -7,6 +7,8 @@ Settings settings;
 
 // Preferences instance
 Preferences ConfigManager::preferences;
+uint32_t ConfigManager::generation = 0;
+uint32_t ConfigManager::filesGeneration = 0;
 
 // Namespace for preferences
 const char *ns = "config";
@@ -53,6 +55,7 @@ void ConfigManager::load() {
     
     // Device boot command
     if (doc["device"]["bootCommand"]) settings.device.bootCommand = doc["device"]["bootCommand"].as<String>();
+    if (doc["device"]["telemetryInterval"]) settings.device.telemetryInterval = doc["device"]["telemetryInterval"].as<int>();
     
     // WiFi
     if (doc["wifi"]["ssid"]) settings.wifi.ssid = doc["wifi"]["ssid"].as<String>();
@@ -105,6 +108,7 @@ void ConfigManager::save() {
 
     // Device boot command
     doc["device"]["bootCommand"] = settings.device.bootCommand;
+    doc["device"]["telemetryInterval"] = settings.device.telemetryInterval;
     
     // WiFi
     doc["wifi"]["ssid"] = settings.wifi.ssid;
@@ -138,6 +142,8 @@ void ConfigManager::save() {
 
     size_t written = serializeJsonPretty(doc, file);
     file.close();
+    generation++;
+    filesGeneration++;
 
     if (written == 0) {
         debugE("Failed to write JSON to %s", SETTINGS_FILE);
@@ -146,10 +152,31 @@ void ConfigManager::save() {
     }
 }
 
+uint32_t ConfigManager::getGeneration() {
+    return generation;
+}
+
+uint32_t ConfigManager::getFilesGeneration() {
+    return filesGeneration;
+}
+
+void ConfigManager::fileChanged(const char *path) {
+    filesGeneration++;
+    // Paths from the file API may come without the leading slash
+    if (path && *path == '/') {
+        path++;
+    }
+    if (!path || strcmp(path, SETTINGS_FILE + 1) == 0) {
+        generation++;
+    }
+}
+
 // Clear all LittleFS
 void ConfigManager::clear() {
     if (LittleFS.exists(SETTINGS_FILE)) {
         LittleFS.remove(SETTINGS_FILE);
+        generation++;
+        filesGeneration++;
         debugI("Settings file %s removed", SETTINGS_FILE);
     } else {
         debugW("Settings file %s not found", SETTINGS_FILE);
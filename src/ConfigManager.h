@@ -20,6 +20,7 @@ struct DeviceSettings {
     String doublePress;
     String longPress;
     String bootCommand;
+    int telemetryInterval; // ms between /device/events updates; 0 = default
 };
 
 // Sub-struct for Wi-Fi
@@ -75,9 +76,19 @@ public:
     static void clear();
     static void savePreferences();
     static void clearPreferences();
+    // Counts writes of the settings file since boot, for telling whether a
+    // copy served earlier is still current
+    static uint32_t getGeneration();
+    // Call after writing, renaming or removing a file other than through
+    // save(); nullptr means any file may have changed (e.g. a format)
+    static void fileChanged(const char *path);
+    // Like getGeneration(), but counts changes to any file
+    static uint32_t getFilesGeneration();
 
 private:
     static void load();
     static void loadPreferences();
     static Preferences preferences;
+    static uint32_t generation;
+    static uint32_t filesGeneration;
 };
\ No newline at end of file
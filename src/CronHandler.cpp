@@ -30,7 +30,7 @@ void CronHandler::executeJobs()
         if (now >= job.nextExecution)
         {
             debugV("Executing cron job: %s -> %s", job.schedule.c_str(), job.command.c_str());
-            CommandHandler::handleCommand(job.command.c_str());
+            CommandBus::submit(job.command.c_str(), job.command.length(), CMD_SOURCE_CRON);
             updateNextExecution(job);
         }
     }
@@ -46,33 +46,33 @@ void CronHandler::updateNextExecution(CronJob &job)
     }
 }
 
-void CronHandler::listJobs()
+void CronHandler::listJobs(CommandResult &result)
 {
     if (cronJobs.empty()) {
-        debugI("No cron jobs registered.");
+        result.printf("No cron jobs registered.");
         return;
     }
 
-    time_t now = time(nullptr);
     for (size_t i = 0; i < cronJobs.size(); ++i) {
         const auto &job = cronJobs[i];
-        debugI("[%d] Schedule: %s, Command: %s, Next Execution: %s", 
-               i, job.schedule.c_str(), job.command.c_str(), ctime(&job.nextExecution));
+        // ctime() ends with a newline, which separates the entries
+        result.printf("[%d] Schedule: %s, Command: %s, Next Execution: %s",
+                      (int)i, job.schedule.c_str(), job.command.c_str(), ctime(&job.nextExecution));
     }
 }
 
-void CronHandler::removeJob(int jobId)
+void CronHandler::removeJob(int jobId, CommandResult &result)
 {
     if (jobId < 0 || static_cast<size_t>(jobId) >= cronJobs.size()) {
-        debugE("Invalid cron job ID: %d", jobId);
+        result.fail(CMD_STATUS_NOT_FOUND, "Invalid cron job ID: %d", jobId);
         return;
     }
 
     cronJobs.erase(cronJobs.begin() + jobId);
-    debugI("Cron job [%d] removed successfully.", jobId);
+    result.printf("Cron job [%d] removed successfully.", jobId);
 }
 
-void CronHandler::registerJob(const String &command)
+void CronHandler::registerJob(const String &command, CommandResult &result)
 {
     debugI("Full Command Received: %s", command.c_str());
 
@@ -82,7 +82,7 @@ void CronHandler::registerJob(const String &command)
     debugI("First Quote Start: %d, First Quote End: %d", firstQuoteStart, firstQuoteEnd);
 
     if (firstQuoteStart == -1 || firstQuoteEnd == -1) {
-        debugE("Invalid syntax. Schedule must be enclosed in double quotes.");
+        result.fail(CMD_STATUS_BAD_REQUEST, "Invalid syntax. Schedule must be enclosed in double quotes.");
         return;
     }
 
@@ -97,7 +97,7 @@ void CronHandler::registerJob(const String &command)
     debugI("Second Quote Start: %d, Second Quote End: %d", secondQuoteStart, secondQuoteEnd);
 
     if (secondQuoteStart == -1 || secondQuoteEnd == -1) {
-        debugE("Invalid syntax. Command must be enclosed in double quotes.");
+        result.fail(CMD_STATUS_BAD_REQUEST, "Invalid syntax. Command must be enclosed in double quotes.");
         return;
     }
 
@@ -108,7 +108,7 @@ void CronHandler::registerJob(const String &command)
 
     // Validate that both schedule and command are non-empty
     if (schedule.isEmpty() || cronCommand.isEmpty()) {
-        debugE("Invalid syntax. Both schedule and command must be provided.");
+        result.fail(CMD_STATUS_BAD_REQUEST, "Invalid syntax. Both schedule and command must be provided.");
         return;
     }
 
@@ -117,7 +117,7 @@ void CronHandler::registerJob(const String &command)
     const char *error = nullptr;
     cron_parse_expr(schedule.c_str(), &expr, &error);
     if (error) {
-        debugE("Invalid cron schedule: %s. Expected 5 or 6 fields (e.g., '* * * * * *').", error);
+        result.fail(CMD_STATUS_BAD_REQUEST, "Invalid cron schedule: %s. Expected 5 or 6 fields (e.g., '* * * * * *').", error);
         return;
     }
 
@@ -125,7 +125,7 @@ void CronHandler::registerJob(const String &command)
     time_t now = time(nullptr);
     time_t nextExecution = cron_next(&expr, now);
     if (nextExecution == (time_t)-1) {
-        debugE("Failed to calculate the next execution time for schedule: %s", schedule.c_str());
+        result.fail(CMD_STATUS_BAD_REQUEST, "Failed to calculate the next execution time for schedule: %s", schedule.c_str());
         return;
     }
 
@@ -133,27 +133,23 @@ void CronHandler::registerJob(const String &command)
     CronJob job = {schedule.c_str(), cronCommand.c_str(), expr, nextExecution};
     cronJobs.push_back(job);
 
-    debugI("Cron job registered: %s -> %s", schedule.c_str(), cronCommand.c_str());
+    result.printf("Cron job registered: %s -> %s", schedule.c_str(), cronCommand.c_str());
 }
 
 void CronHandler::registerCommands()
 {
-    CommandHandler::registerCommand("crontab", [](const String &command)
+    CommandHandler::registerCommand("crontab", [](const CommandArgs &args, CommandResult &result)
                                     {
-        debugI("Full Command Received: %s", command.c_str());
-
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
-
-        if (cmd == "add") {
-            registerJob(command);
-        } else if (cmd == "list") {
-            listJobs();
-        } else if (cmd == "remove") {
-            int jobId = args.toInt();
-            removeJob(jobId);
+        const CommandToken &cmd = args[0];
+
+        if (cmd.equals("add")) {
+            registerJob(args.rest(1).toString(), result);
+        } else if (cmd.equals("list")) {
+            listJobs(result);
+        } else if (cmd.equals("remove")) {
+            removeJob(args[1].toInt(), result);
         } else {
-            debugW("Unknown crontab subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown crontab subcommand: %.*s", (int)cmd.length, cmd.data);
         } }, "Handles led commands. Usage: led <subcommand> [args]\n"
                                          "  Subcommands:\n"
                                          "Example: crontab add \"*/15 * * * * *\" \"tft print hello\"\n"
@@ -19,9 +19,9 @@ private:
 
     static std::vector<CronJob> cronJobs;
     static void updateNextExecution(CronJob &job);
-    static void listJobs();
-    static void removeJob(int jobId);
-    static void registerJob(const String &command);
+    static void listJobs(CommandResult &result);
+    static void removeJob(int jobId, CommandResult &result);
+    static void registerJob(const String &command, CommandResult &result);
     static void registerCommands();
 
 public:
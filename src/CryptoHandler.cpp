@@ -2,16 +2,50 @@
 
 #include "CryptoHandler.h"
 #include "Globals.h"
-#include "mbedtls/base64.h"
 #include "mbedtls/md.h"
 #include "mbedtls/aes.h"
+#include "mbedtls/pkcs5.h"
+#include "mbedtls/platform_util.h"
 #include "CommandHandler.h"
+#include "ConfigManager.h"
+#include "SecureFile.h"
+#include <Preferences.h>
+#include <esp_heap_caps.h>
+#include <freertos/task.h>
 
 #define AES_KEY_SIZE 32   // AES-256 key size (256 bits)
 #define AES_BLOCK_SIZE 16 // Block size for AES CBC mode
 
+#define VAULT_NAMESPACE "crypto" // Preferences holding the KDF salt, rounds and check value
+#define VAULT_PREFIX "$2$"       // Marks text encrypted with the vault key
+#define VAULT_SALT_SIZE 16
+#define VAULT_CHECK_SIZE 16
+#define VAULT_PREFIX_MAX 14      // "$2$4294967295$"
+#define WRAP_KEY_LABEL "PassTxt key wrap v1" // Separates the key-sealing key from the text key
+#define WRAP_NONCE_SIZE 12
+#define WRAP_TAG_SIZE 16
+
+// Longest CRYPTO_NO_UNLOCK_TASK waits for the session lock
+static const TickType_t NO_UNLOCK_WAIT_TICKS = pdMS_TO_TICKS(50);
+
+SemaphoreHandle_t CryptoHandler::sessionMutex = nullptr;
+bool CryptoHandler::unlocked = false;
+bool CryptoHandler::lockedByUser = false;
+uint32_t CryptoHandler::lastUsed = 0;
+uint32_t CryptoHandler::unlockMs = 0;
+uint32_t CryptoHandler::iterations = 0;
+mbedtls_aes_context CryptoHandler::encContext;
+mbedtls_aes_context CryptoHandler::decContext;
+mbedtls_aes_context CryptoHandler::legacyDecContext;
+mbedtls_aes_context CryptoHandler::previousDecContext;
+mbedtls_gcm_context CryptoHandler::fileContext;
+uint32_t CryptoHandler::generation = 0;
+bool CryptoHandler::rekeyPending = false;
+bool CryptoHandler::legacyKeyLoaded = false;
+std::atomic<bool> CryptoHandler::unlockRequested(false);
+
 // Derive a 32-byte key from a password using SHA-256
-void deriveKey(const String &password, uint8_t *keyOut) {
+static void deriveKey(const String &password, uint8_t *keyOut) {
     mbedtls_md_context_t ctx;
     mbedtls_md_init(&ctx);
     mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0);
@@ -20,195 +54,954 @@ void deriveKey(const String &password, uint8_t *keyOut) {
     mbedtls_md_finish(&ctx, keyOut);
     mbedtls_md_free(&ctx);
 }
-String CryptoHandler::encryptAES(const String &plainText, const String &password) {
-    uint8_t aesKey[AES_KEY_SIZE];
-    deriveKey(password, aesKey);
 
-    uint8_t iv[AES_BLOCK_SIZE];
-    esp_fill_random(iv, AES_BLOCK_SIZE);
-    uint8_t iv_copy[AES_BLOCK_SIZE]; // Preserve original IV
-    memcpy(iv_copy, iv, AES_BLOCK_SIZE);
+static const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-    size_t inputLen = plainText.length();
-    size_t paddedLen = ((inputLen / AES_BLOCK_SIZE) + 1) * AES_BLOCK_SIZE;
-    uint8_t *input = (uint8_t *)calloc(paddedLen, 1);
-    memcpy(input, plainText.c_str(), inputLen);
+static size_t base64Length(size_t length) {
+    return (length + 2) / 3 * 4;
+}
 
-    uint8_t padVal = paddedLen - inputLen;
-    for (size_t i = inputLen; i < paddedLen; i++) {
-        input[i] = padVal;
+// Encode length bytes at src into dst, which may start up to
+// base64Length(length) - length bytes before src in the same buffer: each
+// group of 4 output chars then only overwrites input that was already read
+static void base64Encode(const uint8_t *src, size_t length, char *dst) {
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)src[i] << 16;
+        size_t remaining = length - i;
+        if (remaining > 1) group |= (uint32_t)src[i + 1] << 8;
+        if (remaining > 2) group |= src[i + 2];
+        *dst++ = BASE64_CHARS[(group >> 18) & 0x3f];
+        *dst++ = BASE64_CHARS[(group >> 12) & 0x3f];
+        *dst++ = remaining > 1 ? BASE64_CHARS[(group >> 6) & 0x3f] : '=';
+        *dst++ = remaining > 2 ? BASE64_CHARS[group & 0x3f] : '=';
     }
+}
+
+static int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
 
-    uint8_t *output = (uint8_t *)calloc(paddedLen, 1);
+// Decode padded base64; dst may be src itself, since output never overtakes input
+static bool base64Decode(const char *src, size_t length, uint8_t *dst, size_t capacity, size_t &written) {
+    written = 0;
+    if (length % 4 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i += 4) {
+        int padding = src[i + 3] == '=' ? (src[i + 2] == '=' ? 2 : 1) : 0;
+        if (padding && i + 4 != length) {
+            return false;
+        }
+        uint32_t group = 0;
+        for (size_t j = 0; j < 4; j++) {
+            int value = j >= 4 - (size_t)padding ? 0 : base64Value(src[i + j]);
+            if (value < 0) {
+                return false;
+            }
+            group = group << 6 | value;
+        }
+        size_t bytes = 3 - padding;
+        if (written + bytes > capacity) {
+            return false;
+        }
+        dst[written++] = group >> 16;
+        if (bytes > 1) dst[written++] = group >> 8;
+        if (bytes > 2) dst[written++] = group;
+    }
+    return true;
+}
+
+size_t CryptoHandler::encryptedSize(size_t plainLength) {
+    size_t paddedLen = (plainLength / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE;
+    return VAULT_PREFIX_MAX + base64Length(AES_BLOCK_SIZE + paddedLen) + 1;
+}
+
+size_t CryptoHandler::decryptedSize(size_t cipherLength) {
+    return cipherLength / 4 * 3 + 1;
+}
+
+// Write prefix + base64(IV || CBC ciphertext) into out. The ciphertext is
+// built at the tail of out and encoded forwards over itself, so no scratch
+// buffer is needed and plainText may live in out.
+static bool encryptInto(mbedtls_aes_context *aes, const char *prefix, const char *plainText, size_t length,
+                        char *out, size_t outSize, size_t &outLength) {
+    size_t prefixLen = strlen(prefix);
+    size_t paddedLen = (length / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE;
+    size_t rawLen = AES_BLOCK_SIZE + paddedLen;
+    size_t encodedLen = base64Length(rawLen);
+    if (prefixLen + encodedLen + 1 > outSize) {
+        debugE("Encryption buffer too small: %u < %u", (unsigned int)outSize, (unsigned int)(prefixLen + encodedLen + 1));
+        return false;
+    }
+
+    char *text = out + prefixLen;
+    uint8_t *raw = (uint8_t *)text + encodedLen - rawLen;
+    memmove(raw + AES_BLOCK_SIZE, plainText, length);
+    uint8_t padVal = paddedLen - length;
+    memset(raw + AES_BLOCK_SIZE + length, padVal, padVal);
+
+    esp_fill_random(raw, AES_BLOCK_SIZE);
+    uint8_t iv[AES_BLOCK_SIZE]; // CBC updates it; the original goes out with the text
+    memcpy(iv, raw, AES_BLOCK_SIZE);
+    int ret = mbedtls_aes_crypt_cbc(aes, MBEDTLS_AES_ENCRYPT, paddedLen, iv, raw + AES_BLOCK_SIZE, raw + AES_BLOCK_SIZE);
+    if (ret != 0) {
+        debugE("Encryption failed: %d", ret);
+        mbedtls_platform_zeroize(out, outSize);
+        return false;
+    }
+
+    base64Encode(raw, rawLen, text);
+    memcpy(out, prefix, prefixLen);
+    text[encodedLen] = '\0';
+    outLength = prefixLen + encodedLen;
+    return true;
+}
+
+// Decode and decrypt base64(IV || CBC ciphertext) into out; out may be the
+// cipherText buffer itself
+static bool decryptInto(mbedtls_aes_context *aes, const char *cipherText, size_t length,
+                        char *out, size_t outSize, size_t &outLength) {
+    size_t decodedLen = 0;
+    uint8_t *raw = (uint8_t *)out;
+    if (outSize == 0 || !base64Decode(cipherText, length, raw, outSize - 1, decodedLen)) {
+        debugE("Base64 decode failed, len: %u", (unsigned int)length);
+        return false;
+    }
+
+    size_t cipherLen = decodedLen - AES_BLOCK_SIZE;
+    if (decodedLen < 2 * AES_BLOCK_SIZE || cipherLen % AES_BLOCK_SIZE != 0) {
+        debugE("Invalid ciphertext length: %u", (unsigned int)decodedLen);
+        return false;
+    }
+
+    uint8_t iv[AES_BLOCK_SIZE];
+    memcpy(iv, raw, AES_BLOCK_SIZE);
+    memmove(raw, raw + AES_BLOCK_SIZE, cipherLen);
+    int ret = mbedtls_aes_crypt_cbc(aes, MBEDTLS_AES_DECRYPT, cipherLen, iv, raw, raw);
+    if (ret != 0) {
+        debugE("Decryption failed: %d", ret);
+        mbedtls_platform_zeroize(out, outSize);
+        return false;
+    }
+
+    // Bad padding almost always means the wrong key; typing the garbage
+    // would be worse than typing nothing
+    uint8_t padVal = raw[cipherLen - 1];
+    bool validPadding = padVal > 0 && padVal <= AES_BLOCK_SIZE;
+    for (size_t i = cipherLen - (validPadding ? padVal : 0); i < cipherLen; i++) {
+        validPadding = validPadding && raw[i] == padVal;
+    }
+    if (!validPadding) {
+        debugE("Invalid PKCS7 padding");
+        mbedtls_platform_zeroize(out, outSize);
+        return false;
+    }
+
+    outLength = cipherLen - padVal;
+    out[outLength] = '\0';
+    return true;
+}
+
+// One-shot calls with a SHA-256 password key; thin String adapters over the
+// span code
+String CryptoHandler::encryptAES(const String &plainText, const String &password) {
+    uint8_t aesKey[AES_KEY_SIZE];
+    deriveKey(password, aesKey);
 
     mbedtls_aes_context aes;
     mbedtls_aes_init(&aes);
     int ret = mbedtls_aes_setkey_enc(&aes, aesKey, AES_KEY_SIZE * 8);
+    mbedtls_platform_zeroize(aesKey, sizeof(aesKey));
     if (ret != 0) {
         debugE("Key setup failed: %d", ret);
-        free(input);
-        free(output);
         mbedtls_aes_free(&aes);
         return "";
     }
-    ret = mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, paddedLen, iv, input, output);
+
+    String result;
+    size_t size = encryptedSize(plainText.length());
+    size_t length = 0;
+    char *buffer = (char *)malloc(size);
+    if (buffer && encryptInto(&aes, "", plainText.c_str(), plainText.length(), buffer, size, length)) {
+        result = buffer;
+    }
+    free(buffer);
+    mbedtls_aes_free(&aes);
+    return result;
+}
+
+String CryptoHandler::decryptAES(const String &cipherText, const String &password) {
+    uint8_t aesKey[AES_KEY_SIZE];
+    deriveKey(password, aesKey);
+
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    int ret = mbedtls_aes_setkey_dec(&aes, aesKey, AES_KEY_SIZE * 8);
+    mbedtls_platform_zeroize(aesKey, sizeof(aesKey));
     if (ret != 0) {
-        debugE("Encryption failed: %d", ret);
-        free(input);
-        free(output);
+        debugE("Key setup failed: %d", ret);
         mbedtls_aes_free(&aes);
         return "";
     }
+
+    String result;
+    size_t size = decryptedSize(cipherText.length());
+    size_t length = 0;
+    char *buffer = (char *)malloc(size);
+    if (buffer && decryptInto(&aes, cipherText.c_str(), cipherText.length(), buffer, size, length)) {
+        result = String(buffer, length);
+        mbedtls_platform_zeroize(buffer, size);
+    }
+    free(buffer);
     mbedtls_aes_free(&aes);
+    return result;
+}
+
+// PBKDF2-HMAC-SHA256 of a password into a 32-byte vault key
+static bool deriveVaultKey(const String &password, const uint8_t *salt, uint32_t rounds, uint8_t *key) {
+    mbedtls_md_context_t md;
+    mbedtls_md_init(&md);
+    mbedtls_md_setup(&md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    int ret = mbedtls_pkcs5_pbkdf2_hmac(&md, (const uint8_t *)password.c_str(), password.length(),
+                                        salt, VAULT_SALT_SIZE, rounds, AES_KEY_SIZE, key);
+    mbedtls_md_free(&md);
+    if (ret != 0) {
+        debugE("Key derivation failed: %d", ret);
+        mbedtls_platform_zeroize(key, AES_KEY_SIZE);
+        return false;
+    }
+    return true;
+}
+
+// The check value is a hash of the key, so a wrong password is refused at
+// unlock instead of producing garbage on every press
+static void keyCheck(const uint8_t *key, uint8_t *check) {
+    uint8_t digest[32];
+    mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, AES_KEY_SIZE, digest);
+    memcpy(check, digest, VAULT_CHECK_SIZE);
+}
 
-    // Log raw encrypted output
-    char rawHex[33];
-    for (int i = 0; i < paddedLen; i++) {
-        sprintf(rawHex + i * 2, "%02x", output[i]);
+static bool checkMatches(Preferences &prefs, const char *name, const uint8_t *key) {
+    uint8_t stored[VAULT_CHECK_SIZE] = {0};
+    uint8_t check[VAULT_CHECK_SIZE];
+    prefs.getBytes(name, stored, sizeof(stored));
+    keyCheck(key, check);
+    uint8_t diff = 0;
+    for (size_t i = 0; i < VAULT_CHECK_SIZE; i++) {
+        diff |= stored[i] ^ check[i];
     }
-    debugV("Raw encrypted: %s", rawHex);
+    return diff == 0;
+}
 
-    size_t finalLen = AES_BLOCK_SIZE + paddedLen;
-    uint8_t *finalOutput = (uint8_t *)malloc(finalLen);
-    memcpy(finalOutput, iv_copy, AES_BLOCK_SIZE); // Use original IV
-    memcpy(finalOutput + AES_BLOCK_SIZE, output, paddedLen);
+// Keys kept in preferences are sealed with AES-GCM under a key derived from
+// the vault key: nonce || ciphertext || tag
+static void wrapKey(const uint8_t *vaultKey, const uint8_t *plain, size_t length, uint8_t *out) {
+    uint8_t kek[AES_KEY_SIZE];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), vaultKey, AES_KEY_SIZE,
+                    (const uint8_t *)WRAP_KEY_LABEL, strlen(WRAP_KEY_LABEL), kek);
+    mbedtls_gcm_context gcm;
+    mbedtls_gcm_init(&gcm);
+    mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, kek, AES_KEY_SIZE * 8);
+    esp_fill_random(out, WRAP_NONCE_SIZE);
+    mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, length, out, WRAP_NONCE_SIZE, nullptr, 0,
+                              plain, out + WRAP_NONCE_SIZE, WRAP_TAG_SIZE, out + WRAP_NONCE_SIZE + length);
+    mbedtls_gcm_free(&gcm);
+    mbedtls_platform_zeroize(kek, sizeof(kek));
+}
 
-    size_t base64Len = 0;
-    size_t maxBase64Len = ((finalLen + 2) / 3) * 4 + 1;
-    uint8_t *base64Output = (uint8_t *)malloc(maxBase64Len);
-    ret = mbedtls_base64_encode(base64Output, maxBase64Len, &base64Len, finalOutput, finalLen);
+static bool unwrapKey(Preferences &prefs, const char *name, const uint8_t *vaultKey, uint8_t *plain, size_t length) {
+    uint8_t wrapped[WRAP_NONCE_SIZE + 2 * AES_KEY_SIZE + WRAP_TAG_SIZE];
+    size_t wrappedLen = WRAP_NONCE_SIZE + length + WRAP_TAG_SIZE;
+    if (wrappedLen > sizeof(wrapped) || prefs.getBytes(name, wrapped, wrappedLen) != wrappedLen) {
+        return false;
+    }
+    uint8_t kek[AES_KEY_SIZE];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), vaultKey, AES_KEY_SIZE,
+                    (const uint8_t *)WRAP_KEY_LABEL, strlen(WRAP_KEY_LABEL), kek);
+    mbedtls_gcm_context gcm;
+    mbedtls_gcm_init(&gcm);
+    mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, kek, AES_KEY_SIZE * 8);
+    int ret = mbedtls_gcm_auth_decrypt(&gcm, length, wrapped, WRAP_NONCE_SIZE, nullptr, 0,
+                                       wrapped + WRAP_NONCE_SIZE + length, WRAP_TAG_SIZE,
+                                       wrapped + WRAP_NONCE_SIZE, plain);
+    mbedtls_gcm_free(&gcm);
+    mbedtls_platform_zeroize(kek, sizeof(kek));
     if (ret != 0) {
-        debugE("Base64 encode failed: %d", ret);
-        free(input);
-        free(output);
-        free(finalOutput);
-        free(base64Output);
-        return "";
+        debugE("Stored key %s failed to unwrap: %d", name, ret);
+        return false;
     }
+    return true;
+}
 
-    String result = String((char *)base64Output);
+static void putWrappedKey(Preferences &prefs, const char *name, const uint8_t *vaultKey, const uint8_t *plain, size_t length) {
+    uint8_t wrapped[WRAP_NONCE_SIZE + 2 * AES_KEY_SIZE + WRAP_TAG_SIZE];
+    wrapKey(vaultKey, plain, length, wrapped);
+    prefs.putBytes(name, wrapped, WRAP_NONCE_SIZE + length + WRAP_TAG_SIZE);
+}
 
-    free(input);
-    free(output);
-    free(finalOutput);
-    free(base64Output);
+// Ciphertext prefix for a key generation: "$2$" for the first vault key,
+// "$2$<generation>$" after each password change
+static void formatPrefix(uint32_t generation, char *prefix) {
+    if (generation == 0) {
+        strcpy(prefix, VAULT_PREFIX);
+    } else {
+        snprintf(prefix, VAULT_PREFIX_MAX + 1, VAULT_PREFIX "%u$", (unsigned int)generation);
+    }
+}
 
-    return result;
+// False for legacy text. Base64 has no '$', so digits followed by '$' after
+// the prefix can only be a generation.
+static bool parsePrefix(const char *text, size_t length, uint32_t &generation, size_t &prefixLen) {
+    size_t baseLen = strlen(VAULT_PREFIX);
+    if (length < baseLen || memcmp(text, VAULT_PREFIX, baseLen) != 0) {
+        return false;
+    }
+    generation = 0;
+    prefixLen = baseLen;
+    size_t i = baseLen;
+    uint32_t value = 0;
+    while (i < length && i < VAULT_PREFIX_MAX && isdigit((unsigned char)text[i])) {
+        value = value * 10 + (text[i] - '0');
+        i++;
+    }
+    if (i > baseLen && i < length && text[i] == '$') {
+        generation = value;
+        prefixLen = i + 1;
+    }
+    return true;
 }
 
-String CryptoHandler::decryptAES(const String &cipherText, const String &password) {
-    uint8_t aesKey[AES_KEY_SIZE];
-    deriveKey(password, aesKey);
+// Set the session contexts; previousKey is the key being rotated away from
+void CryptoHandler::loadKeys(const uint8_t *vaultKey, const uint8_t *legacyKey, const uint8_t *fileKey,
+                             const uint8_t *previousKey, uint32_t keyGeneration) {
+    mbedtls_aes_setkey_enc(&encContext, vaultKey, AES_KEY_SIZE * 8);
+    mbedtls_aes_setkey_dec(&decContext, vaultKey, AES_KEY_SIZE * 8);
+    mbedtls_aes_setkey_dec(&legacyDecContext, legacyKey, AES_KEY_SIZE * 8);
+    mbedtls_gcm_setkey(&fileContext, MBEDTLS_CIPHER_ID_AES, fileKey, AES_KEY_SIZE * 8);
+    if (previousKey) {
+        mbedtls_aes_setkey_dec(&previousDecContext, previousKey, AES_KEY_SIZE * 8);
+    }
+    generation = keyGeneration;
+    legacyKeyLoaded = true;
+    unlocked = true;
+    lastUsed = millis();
+}
 
-    size_t decodedLen = 0;
-    size_t maxDecodedLen = ((cipherText.length() + 3) / 4) * 3;
-    uint8_t *decoded = (uint8_t *)malloc(maxDecodedLen);
-    int ret = mbedtls_base64_decode(decoded, maxDecodedLen, &decodedLen, (const uint8_t *)cipherText.c_str(), cipherText.length());
-    if (ret != 0 || decodedLen < AES_BLOCK_SIZE) {
-        debugE("Base64 decode failed: %d, len: %d", ret, decodedLen);
-        free(decoded);
-        return "";
+// Derive the vault key with PBKDF2 and check it against the stored check
+// value. A device without a vault gets a new salt on its first unlock.
+// While a password change is in progress only the new password unlocks; the
+// old keys come out of the blob beginRekey() sealed under the new one.
+bool CryptoHandler::unlockLocked(const String &password) {
+    lockLocked();
+
+    Preferences prefs;
+    if (!prefs.begin(VAULT_NAMESPACE, false)) {
+        debugE("Failed to open preferences namespace: %s", VAULT_NAMESPACE);
+        return false;
     }
 
-    uint8_t iv[AES_BLOCK_SIZE];
-    memcpy(iv, decoded, AES_BLOCK_SIZE);
-    size_t cipherLen = decodedLen - AES_BLOCK_SIZE;
-    uint8_t *ciphertext = decoded + AES_BLOCK_SIZE;
+    uint8_t salt[VAULT_SALT_SIZE];
+    rekeyPending = prefs.getBytes("rkSalt", salt, sizeof(salt)) == sizeof(salt);
+    bool newVault = !rekeyPending && prefs.getBytes("kdfSalt", salt, sizeof(salt)) != sizeof(salt);
+    uint32_t rounds = newVault ? CRYPTO_KDF_ITERATIONS : prefs.getUInt(rekeyPending ? "rkIter" : "kdfIter", CRYPTO_KDF_ITERATIONS);
+    uint32_t keyGeneration = prefs.getUInt(rekeyPending ? "rkGen" : "kdfGen", 0);
+    if (newVault) {
+        esp_fill_random(salt, sizeof(salt));
+    }
 
-    if (cipherLen % AES_BLOCK_SIZE != 0) {
-        debugE("Invalid ciphertext length: %d", cipherLen);
-        free(decoded);
-        return "";
+    uint32_t start = millis();
+    uint8_t vaultKey[AES_KEY_SIZE];
+    if (!deriveVaultKey(password, salt, rounds, vaultKey)) {
+        prefs.end();
+        return false;
     }
 
-    uint8_t *output = (uint8_t *)malloc(cipherLen);
+    if (newVault) {
+        uint8_t check[VAULT_CHECK_SIZE];
+        keyCheck(vaultKey, check);
+        prefs.putBytes("kdfSalt", salt, sizeof(salt));
+        prefs.putUInt("kdfIter", rounds);
+        prefs.putBytes("kdfCheck", check, sizeof(check));
+        debugI("Created crypto vault with %u iterations", (unsigned int)rounds);
+    } else if (!checkMatches(prefs, rekeyPending ? "rkCheck" : "kdfCheck", vaultKey)) {
+        debugW(rekeyPending ? "Unlock failed: a password change is in progress, unlock with the new password"
+                            : "Unlock failed: wrong password");
+        mbedtls_platform_zeroize(vaultKey, sizeof(vaultKey));
+        prefs.end();
+        return false;
+    }
 
-    mbedtls_aes_context aes;
-    mbedtls_aes_init(&aes);
-    ret = mbedtls_aes_setkey_dec(&aes, aesKey, AES_KEY_SIZE * 8);
-    if (ret != 0) {
-        debugE("Key setup failed: %d", ret);
-        free(output);
-        free(decoded);
-        return "";
+    // keys[0] is the file key; during a rotation keys[1..2] are the old
+    // vault and legacy keys
+    uint8_t keys[3][AES_KEY_SIZE];
+    bool ok = true;
+    if (rekeyPending) {
+        ok = unwrapKey(prefs, "rkFile", vaultKey, keys[0], AES_KEY_SIZE) &&
+             unwrapKey(prefs, "rkOld", vaultKey, keys[1], 2 * AES_KEY_SIZE);
+    } else if (!prefs.isKey("fileKey")) {
+        // First unlock of this vault: the file key is random, so a password
+        // change only has to re-seal it, not re-encrypt every file
+        esp_fill_random(keys[0], AES_KEY_SIZE);
+        putWrappedKey(prefs, "fileKey", vaultKey, keys[0], AES_KEY_SIZE);
+    } else {
+        ok = unwrapKey(prefs, "fileKey", vaultKey, keys[0], AES_KEY_SIZE);
     }
-    uint8_t iv_copy[AES_BLOCK_SIZE]; // Copy IV to avoid modification
-    memcpy(iv_copy, iv, AES_BLOCK_SIZE);
-    ret = mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_DECRYPT, cipherLen, iv_copy, ciphertext, output);
-    if (ret != 0) {
-        debugE("Decryption failed: %d", ret);
-        free(output);
-        free(decoded);
-        return "";
+    prefs.end();
+
+    if (ok) {
+        if (!rekeyPending) {
+            deriveKey(password, keys[2]);
+        }
+        loadKeys(vaultKey, keys[2], keys[0], rekeyPending ? keys[1] : nullptr, keyGeneration);
+        iterations = rounds;
+        unlockMs = millis() - start;
+        debugI("Crypto session unlocked (%u iterations, %u ms)", (unsigned int)rounds, (unsigned int)unlockMs);
     }
-    mbedtls_aes_free(&aes);
+    mbedtls_platform_zeroize(vaultKey, sizeof(vaultKey));
+    mbedtls_platform_zeroize(keys, sizeof(keys));
+    return ok;
+}
 
-    // Log raw decrypted output
-    char rawHex[33];
-    for (int i = 0; i < cipherLen; i++) {
-        sprintf(rawHex + i * 2, "%02x", output[i]);
-    }
-    debugV("Raw decrypted: %s", rawHex);
-
-    uint8_t padVal = output[cipherLen - 1];
-    size_t unpaddedLen = cipherLen;
-    if (padVal > 0 && padVal <= AES_BLOCK_SIZE) {
-        bool validPadding = true;
-        for (size_t i = cipherLen - padVal; i < cipherLen; i++) {
-            if (output[i] != padVal) {
-                validPadding = false;
-                break;
-            }
+void CryptoHandler::lockLocked() {
+    // mbedtls_aes_free() zeroizes the key schedules
+    mbedtls_aes_free(&encContext);
+    mbedtls_aes_free(&decContext);
+    mbedtls_aes_free(&legacyDecContext);
+    mbedtls_aes_free(&previousDecContext);
+    mbedtls_gcm_free(&fileContext);
+    mbedtls_aes_init(&encContext);
+    mbedtls_aes_init(&decContext);
+    mbedtls_aes_init(&legacyDecContext);
+    mbedtls_aes_init(&previousDecContext);
+    mbedtls_gcm_init(&fileContext);
+    legacyKeyLoaded = false;
+    unlocked = false;
+}
+
+// Seal the old vault key, legacy key and file key under a key derived from
+// newPassword, then switch the session to it. Text is encrypted under the
+// new generation from here on; the old keys stay readable until
+// finishRekey(), so nothing is lost if the device restarts part way.
+bool CryptoHandler::beginRekey(const String &oldPassword, const String &newPassword) {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    Preferences prefs;
+    if (!prefs.begin(VAULT_NAMESPACE, false)) {
+        debugE("Failed to open preferences namespace: %s", VAULT_NAMESPACE);
+        xSemaphoreGive(sessionMutex);
+        return false;
+    }
+
+    uint8_t salt[VAULT_SALT_SIZE];
+    if (prefs.getBytes("rkSalt", salt, sizeof(salt)) == sizeof(salt)) {
+        debugW("A password change is already in progress");
+        prefs.end();
+        xSemaphoreGive(sessionMutex);
+        return false;
+    }
+    bool hasVault = prefs.getBytes("kdfSalt", salt, sizeof(salt)) == sizeof(salt);
+    uint32_t oldGeneration = prefs.getUInt("kdfGen", 0);
+    prefs.end();
+    if (!hasVault) {
+        // Nothing to rotate away from yet besides legacy text; create the
+        // vault under the old password first so the same path applies
+        bool created = unlockLocked(oldPassword);
+        if (!created) {
+            xSemaphoreGive(sessionMutex);
+            return false;
         }
-        if (validPadding) {
-            unpaddedLen = cipherLen - padVal;
+    }
+
+    prefs.begin(VAULT_NAMESPACE, false);
+    prefs.getBytes("kdfSalt", salt, sizeof(salt));
+    uint8_t oldKey[AES_KEY_SIZE];
+    uint8_t keys[2][AES_KEY_SIZE]; // Old vault key and old legacy key, sealed together
+    uint8_t fileKey[AES_KEY_SIZE];
+    uint8_t newKey[AES_KEY_SIZE];
+    bool ok = deriveVaultKey(oldPassword, salt, prefs.getUInt("kdfIter", CRYPTO_KDF_ITERATIONS), oldKey) &&
+              checkMatches(prefs, "kdfCheck", oldKey);
+    if (!ok) {
+        debugW("Password change refused: the current password does not unlock the vault");
+    } else {
+        memcpy(keys[0], oldKey, AES_KEY_SIZE);
+        deriveKey(oldPassword, keys[1]);
+        if (!prefs.isKey("fileKey")) {
+            esp_fill_random(fileKey, AES_KEY_SIZE);
+            putWrappedKey(prefs, "fileKey", oldKey, fileKey, AES_KEY_SIZE);
         } else {
-            debugE("Invalid PKCS7 padding");
+            ok = unwrapKey(prefs, "fileKey", oldKey, fileKey, AES_KEY_SIZE);
+        }
+    }
+    if (ok) {
+        uint8_t newSalt[VAULT_SALT_SIZE];
+        uint8_t check[VAULT_CHECK_SIZE];
+        esp_fill_random(newSalt, sizeof(newSalt));
+        uint32_t start = millis();
+        ok = deriveVaultKey(newPassword, newSalt, CRYPTO_KDF_ITERATIONS, newKey);
+        if (ok) {
+            keyCheck(newKey, check);
+            prefs.putUInt("rkIter", CRYPTO_KDF_ITERATIONS);
+            prefs.putBytes("rkCheck", check, sizeof(check));
+            prefs.putUInt("rkGen", oldGeneration + 1);
+            putWrappedKey(prefs, "rkOld", newKey, keys[0], sizeof(keys));
+            putWrappedKey(prefs, "rkFile", newKey, fileKey, AES_KEY_SIZE);
+            // Written last: its presence is what marks the rotation as pending
+            prefs.putBytes("rkSalt", newSalt, sizeof(newSalt));
+
+            lockLocked();
+            loadKeys(newKey, keys[1], fileKey, keys[0], oldGeneration + 1);
+            rekeyPending = true;
+            lockedByUser = false;
+            iterations = CRYPTO_KDF_ITERATIONS;
+            unlockMs = millis() - start;
+            // Unlocks on demand read it under this mutex and now need the new one
+            settings.device.userPassword = newPassword;
+            debugI("Password change started, text now encrypted under key generation %u", (unsigned int)generation);
+        }
+    }
+    prefs.end();
+    mbedtls_platform_zeroize(oldKey, sizeof(oldKey));
+    mbedtls_platform_zeroize(keys, sizeof(keys));
+    mbedtls_platform_zeroize(fileKey, sizeof(fileKey));
+    mbedtls_platform_zeroize(newKey, sizeof(newKey));
+    xSemaphoreGive(sessionMutex);
+    return ok;
+}
+
+// Make the new key the vault key and forget the old one. The rotation
+// entries are removed last, with rkSalt after everything else, so a restart
+// part way through simply finishes again.
+bool CryptoHandler::finishRekey() {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    Preferences prefs;
+    uint8_t salt[VAULT_SALT_SIZE];
+    uint8_t check[VAULT_CHECK_SIZE];
+    uint8_t wrapped[WRAP_NONCE_SIZE + AES_KEY_SIZE + WRAP_TAG_SIZE];
+    bool ok = prefs.begin(VAULT_NAMESPACE, false) &&
+              prefs.getBytes("rkSalt", salt, sizeof(salt)) == sizeof(salt) &&
+              prefs.getBytes("rkCheck", check, sizeof(check)) == sizeof(check) &&
+              prefs.getBytes("rkFile", wrapped, sizeof(wrapped)) == sizeof(wrapped);
+    if (ok) {
+        uint32_t newGeneration = prefs.getUInt("rkGen", 0);
+        prefs.putBytes("kdfSalt", salt, sizeof(salt));
+        prefs.putUInt("kdfIter", prefs.getUInt("rkIter", CRYPTO_KDF_ITERATIONS));
+        prefs.putBytes("kdfCheck", check, sizeof(check));
+        prefs.putUInt("kdfGen", newGeneration);
+        prefs.putBytes("fileKey", wrapped, sizeof(wrapped));
+        for (const char *name : {"rkIter", "rkCheck", "rkGen", "rkOld", "rkFile", "rkSalt"}) {
+            prefs.remove(name);
         }
+
+        // Legacy and old-generation text is gone, and so are their keys
+        mbedtls_aes_free(&previousDecContext);
+        mbedtls_aes_free(&legacyDecContext);
+        mbedtls_aes_init(&previousDecContext);
+        mbedtls_aes_init(&legacyDecContext);
+        legacyKeyLoaded = false;
+        rekeyPending = false;
+        debugI("Password change finished, vault is at key generation %u", (unsigned int)newGeneration);
     } else {
-        debugE("Invalid padding value: %d", padVal);
+        debugE("No password change to finish");
+    }
+    prefs.end();
+    xSemaphoreGive(sessionMutex);
+    return ok;
+}
+
+bool CryptoHandler::isRekeying() {
+    return rekeyPending;
+}
+
+// Takes sessionMutex. A derivation holds it for about a second, so
+// CRYPTO_NO_UNLOCK_TASK only waits briefly and then gives up.
+bool CryptoHandler::takeSession() {
+    if (xSemaphoreTake(sessionMutex, mayDeriveHere() ? portMAX_DELAY : NO_UNLOCK_WAIT_TICKS) == pdTRUE) {
+        return true;
+    }
+    debugW("Crypto session busy unlocking");
+    return false;
+}
+
+bool CryptoHandler::mayDeriveHere() {
+    return strcmp(pcTaskGetTaskName(nullptr), CRYPTO_NO_UNLOCK_TASK) != 0;
+}
+
+// Called with sessionMutex held
+bool CryptoHandler::ensureUnlocked() {
+    if (!unlocked) {
+        if (lockedByUser) {
+            debugW("Crypto session is locked; run CRYPTO UNLOCK <password>");
+            return false;
+        }
+        if (!mayDeriveHere()) {
+            debugW("Crypto session is locked; unlocking in the background");
+            unlockRequested = true;
+            return false;
+        }
+        if (!unlockLocked(settings.device.userPassword)) {
+            return false;
+        }
+    }
+    lastUsed = millis();
+    return true;
+}
+
+bool CryptoHandler::unlockInBackground() {
+    if (unlocked) {
+        return true;
+    }
+    if (!lockedByUser) {
+        unlockRequested = true;
+    }
+    return false;
+}
+
+bool CryptoHandler::unlock(const String &password) {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    bool ok = unlockLocked(password);
+    if (ok) {
+        lockedByUser = false;
+    }
+    xSemaphoreGive(sessionMutex);
+    return ok;
+}
+
+void CryptoHandler::lock() {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    lockLocked();
+    lockedByUser = true;
+    xSemaphoreGive(sessionMutex);
+    debugI("Crypto session locked");
+}
+
+bool CryptoHandler::isUnlocked() {
+    return unlocked;
+}
+
+bool CryptoHandler::isLockedByUser() {
+    return lockedByUser;
+}
+
+CryptoStatus CryptoHandler::getStatus() {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    CryptoStatus status;
+    status.unlocked = unlocked;
+    status.lockedByUser = lockedByUser;
+    status.iterations = iterations;
+    status.unlockMs = unlockMs;
+    status.idleMs = unlocked ? millis() - lastUsed : 0;
+    xSemaphoreGive(sessionMutex);
+    return status;
+}
+
+// Called with sessionMutex held and the session unlocked
+bool CryptoHandler::encryptLocked(const char *plainText, size_t length, char *out, size_t outSize, size_t &outLength) {
+    char prefix[VAULT_PREFIX_MAX + 1];
+    formatPrefix(generation, prefix);
+    return encryptInto(&encContext, prefix, plainText, length, out, outSize, outLength);
+}
+
+// Called with sessionMutex held and the session unlocked
+bool CryptoHandler::decryptLocked(const char *cipherText, size_t length, char *out, size_t outSize, size_t &outLength) {
+    uint32_t textGeneration;
+    size_t prefixLen;
+    if (!parsePrefix(cipherText, length, textGeneration, prefixLen)) {
+        if (!legacyKeyLoaded) {
+            debugE("Legacy text cannot be decrypted once the password has been changed");
+            return false;
+        }
+        return decryptInto(&legacyDecContext, cipherText, length, out, outSize, outLength);
+    }
+    if (textGeneration == generation) {
+        return decryptInto(&decContext, cipherText + prefixLen, length - prefixLen, out, outSize, outLength);
+    }
+    if (rekeyPending && textGeneration + 1 == generation) {
+        return decryptInto(&previousDecContext, cipherText + prefixLen, length - prefixLen, out, outSize, outLength);
+    }
+    debugE("Text is from key generation %u, the vault is at %u", (unsigned int)textGeneration, (unsigned int)generation);
+    return false;
+}
+
+bool CryptoHandler::encrypt(const char *plainText, size_t length, char *out, size_t outSize, size_t &outLength) {
+    if (!takeSession()) {
+        return false;
+    }
+    bool ok = ensureUnlocked() && encryptLocked(plainText, length, out, outSize, outLength);
+    xSemaphoreGive(sessionMutex);
+    return ok;
+}
+
+bool CryptoHandler::decrypt(const char *cipherText, size_t length, char *out, size_t outSize, size_t &outLength) {
+    if (!takeSession()) {
+        return false;
+    }
+    bool ok = false;
+    if (ensureUnlocked()) {
+        ok = decryptLocked(cipherText, length, out, outSize, outLength);
+    }
+    xSemaphoreGive(sessionMutex);
+    return ok;
+}
+
+String CryptoHandler::encrypt(const String &plainText) {
+    String result;
+    size_t size = encryptedSize(plainText.length());
+    size_t length = 0;
+    char *buffer = (char *)malloc(size);
+    if (buffer && encrypt(plainText.c_str(), plainText.length(), buffer, size, length)) {
+        result = buffer;
+    }
+    free(buffer);
+    return result;
+}
+
+String CryptoHandler::decrypt(const String &cipherText) {
+    String result;
+    size_t size = decryptedSize(cipherText.length());
+    size_t length = 0;
+    char *buffer = (char *)malloc(size);
+    if (buffer && decrypt(cipherText.c_str(), cipherText.length(), buffer, size, length)) {
+        result = String(buffer, length);
+        mbedtls_platform_zeroize(buffer, size);
+    }
+    free(buffer);
+    return result;
+}
+
+bool CryptoHandler::needsRekey(const char *cipherText, size_t length) {
+    uint32_t textGeneration;
+    size_t prefixLen;
+    if (!takeSession()) {
+        return true; // Unknown, so it must not be stored as it is
+    }
+    bool stale = !parsePrefix(cipherText, length, textGeneration, prefixLen) || textGeneration != generation;
+    xSemaphoreGive(sessionMutex);
+    return stale;
+}
+
+// Decrypt and encrypt again in one buffer, under the mutex so the key
+// cannot change in between
+bool CryptoHandler::reencrypt(String &cipherText) {
+    size_t size = max(decryptedSize(cipherText.length()), encryptedSize(cipherText.length()));
+    char *buffer = (char *)malloc(size);
+    if (!buffer) {
+        return false;
+    }
+    memcpy(buffer, cipherText.c_str(), cipherText.length() + 1);
+
+    size_t length = 0;
+    bool ok = false;
+    if (takeSession()) {
+        ok = ensureUnlocked() &&
+             decryptLocked(buffer, cipherText.length(), buffer, size, length) &&
+             encryptLocked(buffer, length, buffer, size, length);
+        xSemaphoreGive(sessionMutex);
+    }
+
+    if (ok) {
+        cipherText = String(buffer, length);
+    }
+    mbedtls_platform_zeroize(buffer, size);
+    free(buffer);
+    return ok;
+}
+
+bool CryptoHandler::sealChunk(const uint8_t *nonce, const uint8_t *aad, size_t aadLength, uint8_t *data, size_t length, uint8_t *tag) {
+    if (!takeSession()) {
+        return false;
+    }
+    bool ok = false;
+    if (ensureUnlocked()) {
+        int ret = mbedtls_gcm_crypt_and_tag(&fileContext, MBEDTLS_GCM_ENCRYPT, length, nonce, CHUNK_NONCE_SIZE,
+                                            aad, aadLength, data, data, CHUNK_TAG_SIZE, tag);
+        if (ret != 0) {
+            debugE("Chunk encryption failed: %d", ret);
+        }
+        ok = ret == 0;
+    }
+    xSemaphoreGive(sessionMutex);
+    return ok;
+}
+
+bool CryptoHandler::openChunk(const uint8_t *nonce, const uint8_t *aad, size_t aadLength, uint8_t *data, size_t length, const uint8_t *tag) {
+    if (!takeSession()) {
+        return false;
+    }
+    bool ok = false;
+    if (ensureUnlocked()) {
+        int ret = mbedtls_gcm_auth_decrypt(&fileContext, length, nonce, CHUNK_NONCE_SIZE,
+                                           aad, aadLength, tag, CHUNK_TAG_SIZE, data, data);
+        if (ret == MBEDTLS_ERR_GCM_AUTH_FAILED) {
+            debugE("Chunk failed authentication: wrong key or damaged file");
+        } else if (ret != 0) {
+            debugE("Chunk decryption failed: %d", ret);
+        }
+        ok = ret == 0;
+    }
+    xSemaphoreGive(sessionMutex);
+    return ok;
+}
+
+void CryptoHandler::loop() {
+    if (unlockRequested) {
+        xSemaphoreTake(sessionMutex, portMAX_DELAY);
+        if (!unlocked && !lockedByUser) {
+            unlockLocked(settings.device.userPassword);
+        }
+        unlockRequested = false;
+        xSemaphoreGive(sessionMutex);
+    }
+
+    if (!unlocked || millis() - lastUsed < CRYPTO_IDLE_TIMEOUT_MS) {
+        return;
+    }
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    if (unlocked && millis() - lastUsed >= CRYPTO_IDLE_TIMEOUT_MS) {
+        lockLocked();
+        debugI("Crypto session locked after %u ms idle", (unsigned int)CRYPTO_IDLE_TIMEOUT_MS);
+    }
+    xSemaphoreGive(sessionMutex);
+}
+
+// Run fn iterations times and report ops/sec. Only the host build can
+// restart the heap low-water mark, so peak heap is reported there.
+template <typename Fn>
+static void benchCase(const char *name, int iterations, CommandResult &result, Fn fn) {
+#ifdef NATIVE_BUILD
+    heap_caps_monitor_local_minimum_free_size_start();
+#endif
+    size_t startFree = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t start = micros();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    uint32_t elapsed = micros() - start;
+    size_t peak = startFree - heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    result.printf("%s: %u ops/s", name, (unsigned int)((uint64_t)iterations * 1000000 / (elapsed ? elapsed : 1)));
+#ifdef NATIVE_BUILD
+    result.printf(", peak heap %u bytes", (unsigned int)peak);
+#else
+    (void)peak;
+#endif
+    result.printf("\n");
+}
+
+// Encrypt and decrypt a password through the span API, the String adapters
+// and the one-shot path that hashes the password on every call
+static void benchmark(int iterations, CommandResult &result) {
+    static const char sample[] = "benchmark password";
+    char cipherText[96];
+    char plainText[96];
+    size_t length = 0;
+    if (!CryptoHandler::encrypt(sample, strlen(sample), cipherText, sizeof(cipherText), length)) {
+        result.fail(CMD_STATUS_FAILED, "Encryption failed; is the session locked?");
+        return;
     }
 
-    String decryptedText((char *)output, unpaddedLen);
-    free(output);
-    free(decoded);
+    CryptoStatus status = CryptoHandler::getStatus();
+    result.printf("cryptobench: %d iterations, unlock %u ms (%u iterations)\n", iterations,
+                  (unsigned int)status.unlockMs, (unsigned int)status.iterations);
 
-    debugV("Decrypted length: %d, text: %s", unpaddedLen, decryptedText.c_str());
-    return decryptedText;
+    bool ok = true;
+    benchCase("span", iterations, result, [&]() {
+        size_t cipherLength = 0, plainLength = 0;
+        ok &= CryptoHandler::encrypt(sample, strlen(sample), cipherText, sizeof(cipherText), cipherLength);
+        ok &= CryptoHandler::decrypt(cipherText, cipherLength, plainText, sizeof(plainText), plainLength);
+    });
+    benchCase("string", iterations, result, [&]() {
+        ok &= CryptoHandler::decrypt(CryptoHandler::encrypt(sample)) == sample;
+    });
+    benchCase("one-shot", iterations, result, [&]() {
+        String key = settings.device.userPassword;
+        ok &= CryptoHandler::decryptAES(CryptoHandler::encryptAES(sample, key), key) == sample;
+    });
+    mbedtls_platform_zeroize(plainText, sizeof(plainText));
+
+    if (!ok) {
+        result.fail(CMD_STATUS_FAILED, "Round trip failed");
+    }
 }
 
 void CryptoHandler::init() {
-    CommandHandler::registerCommand("CRYPTO", [](const String &command) {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
-
-        if (CommandHandler::equalsIgnoreCase(cmd, "ENC")) {
-            int spaceIndex = args.indexOf(' ');
-            if (spaceIndex > 0) {
-                String key = args.substring(0, spaceIndex);
-                String text = args.substring(spaceIndex + 1);
-                String encrypted = encryptAES(text, key);
-                debugI("Encrypted: %s", encrypted.c_str());
+    sessionMutex = xSemaphoreCreateMutex();
+    mbedtls_aes_init(&encContext);
+    mbedtls_aes_init(&decContext);
+    mbedtls_aes_init(&legacyDecContext);
+    mbedtls_aes_init(&previousDecContext);
+    mbedtls_gcm_init(&fileContext);
+
+    Preferences prefs;
+    if (prefs.begin(VAULT_NAMESPACE, true)) {
+        rekeyPending = prefs.isKey("rkSalt");
+        generation = prefs.getUInt("kdfGen", 0);
+        prefs.end();
+    }
+
+    CommandHandler::registerCommand("CRYPTO", [](const CommandArgs &args, CommandResult &result) {
+        const CommandToken &cmd = args[0];
+
+        if (cmd.equals("ENC")) {
+            if (!args[2].isEmpty()) {
+                String encrypted = encryptAES(args.rest(2).toString(), args[1].toString());
+                result.printf("Encrypted: %s", encrypted.c_str());
             } else {
-                debugW("Usage: CRYPTO ENC <key> <text>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: CRYPTO ENC <key> <text>");
             }
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "DEC")) {
-            int spaceIndex = args.indexOf(' ');
-            if (spaceIndex > 0) {
-                String key = args.substring(0, spaceIndex);
-                String text = args.substring(spaceIndex + 1);
-                String decrypted = decryptAES(text, key);
-                debugI("Decrypted: %s", decrypted.c_str());
+        } else if (cmd.equals("DEC")) {
+            if (!args[2].isEmpty()) {
+                String decrypted = decryptAES(args.rest(2).toString(), args[1].toString());
+                result.printf("Decrypted: %s", decrypted.c_str());
             } else {
-                debugW("Usage: CRYPTO DEC <key> <ciphertext>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: CRYPTO DEC <key> <ciphertext>");
+            }
+        } else if (cmd.equals("UNLOCK")) {
+            if (args[1].isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: CRYPTO UNLOCK <password>");
+            } else if (unlock(args.rest(1).toString())) {
+                result.printf("Unlocked in %u ms", (unsigned int)unlockMs);
+            } else {
+                result.fail(CMD_STATUS_FAILED, "Unlock failed");
+            }
+        } else if (cmd.equals("LOCK")) {
+            lock();
+            result.printf("Locked");
+        } else if (cmd.equals("STATUS")) {
+            CryptoStatus status = getStatus();
+            result.printf("%s%s, %u iterations, last unlock %u ms, idle %u ms of %u ms",
+                          status.unlocked ? "Unlocked" : "Locked",
+                          status.lockedByUser ? " by user" : "",
+                          (unsigned int)status.iterations, (unsigned int)status.unlockMs,
+                          (unsigned int)status.idleMs, (unsigned int)CRYPTO_IDLE_TIMEOUT_MS);
+        } else if (cmd.equals("BENCH")) {
+            int count = args[1].isEmpty() ? 100 : args[1].toInt();
+            if (count <= 0) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: CRYPTO BENCH [iterations]");
+                return;
+            }
+            benchmark(count, result);
+        } else if (cmd.equals("FILEBENCH")) {
+            int kilobytes = args[1].isEmpty() ? 64 : args[1].toInt();
+            if (kilobytes <= 0) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: CRYPTO FILEBENCH [kilobytes]");
+                return;
             }
+            SecureFile::benchmark(kilobytes, result);
         } else {
-            debugW("Unknown CRYPTO subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown CRYPTO subcommand: %.*s", (int)cmd.length, cmd.data);
         }
     }, "Handles CRYPTO commands. Usage: CRYPTO <subcommand> <args>\n"
        "  Subcommands:\n"
        "  enc <key> <text> - Encrypts a string\n"
-       "  dec <key> <ciphertext> - Decrypts a string");
+       "  dec <key> <ciphertext> - Decrypts a string\n"
+       "  unlock <password> - Derives the vault key and keeps it until lock or idle timeout\n"
+       "  lock - Drops the vault key until the next unlock\n"
+       "  status - Shows whether the vault key is held\n"
+       "  bench [iterations] - Times the span API against the String and one-shot calls\n"
+       "  filebench [kilobytes] - Times the AES engine, GCM chunks and encrypted file streaming");
 
     debugI("CryptoHandler initialized");
 }
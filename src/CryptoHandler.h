@@ -4,23 +4,172 @@
 
 #include <Arduino.h>
 #include "mbedtls/aes.h"
+#include "mbedtls/gcm.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <atomic>
+
+// PBKDF2-HMAC-SHA256 rounds for a new vault. Only paid once per unlock, so it
+// can be far higher than a per-press KDF could afford.
+#ifndef CRYPTO_KDF_ITERATIONS
+#define CRYPTO_KDF_ITERATIONS 100000
+#endif
+
+// Drop the cached key after this long without a decrypt or encrypt
+#ifndef CRYPTO_IDLE_TIMEOUT_MS
+#define CRYPTO_IDLE_TIMEOUT_MS (15 * 60 * 1000)
+#endif
+
+// Task that must never stall for a key derivation. Web callbacks run there,
+// and every connection waits while it is busy.
+#ifndef CRYPTO_NO_UNLOCK_TASK
+#define CRYPTO_NO_UNLOCK_TASK "async_tcp"
+#endif
+
+struct CryptoStatus {
+    bool unlocked;
+    bool lockedByUser;   // Stays locked until an explicit unlock
+    uint32_t iterations; // Of the vault key
+    uint32_t unlockMs;   // How long the last derivation took
+    uint32_t idleMs;     // Since the session key was last used
+};
 
 class CryptoHandler
 {
 public:
     static void init();
+    static void loop();
+
+    // One-shot encryption with a SHA-256 password key (legacy format)
     static String encryptAES(const String &plainText, const String &key);
     static String decryptAES(const String &cipherText, const String &key);
+
+    // Unlock session: the vault key is derived once and kept as expanded AES
+    // key schedules until lock() or the idle timeout. encrypt()/decrypt()
+    // unlock on demand with the device password unless the user locked it,
+    // except on CRYPTO_NO_UNLOCK_TASK: there they fail at once and leave the
+    // derivation to loop().
+    static bool unlock(const String &password);
+    static void lock();
+    static bool isUnlocked();
+    static bool isLockedByUser(); // Locked with lock(); only unlock() opens it again
+    // For callers that must not block: true if the key is held. Otherwise
+    // asks loop() to unlock with the device password (unless the user locked
+    // the vault) and returns false.
+    static bool unlockInBackground();
+    static CryptoStatus getStatus();
+
+    // New text is written as "$2$" + base64(IV || CBC ciphertext) under the
+    // vault key; text without the prefix is the legacy format.
+    //
+    // The span calls work in caller buffers and do not touch the heap. Output
+    // is NUL terminated and outLength excludes the NUL. out may be the input
+    // buffer itself, so a record can be re-encrypted in place.
+    static size_t encryptedSize(size_t plainLength);  // Buffer encrypt() needs
+    static size_t decryptedSize(size_t cipherLength); // Buffer decrypt() needs
+    static bool encrypt(const char *plainText, size_t length, char *out, size_t outSize, size_t &outLength);
+    static bool decrypt(const char *cipherText, size_t length, char *out, size_t outSize, size_t &outLength);
+
+    // String adapters over the span calls
+    static String encrypt(const String &plainText);
+    static String decrypt(const String &cipherText);
+
+    // Master password change. beginRekey() moves the vault to a key derived
+    // from newPassword (a new key generation, "$2$<n>$" text) while keeping
+    // the old key able to decrypt; stored text is then re-encrypted with
+    // reencrypt() and finishRekey() drops the old key. The pending state is
+    // kept in preferences, so a restart part way resumes with the new password.
+    // beginRekey() also sets settings.device.userPassword, under sessionMutex.
+    static bool beginRekey(const String &oldPassword, const String &newPassword);
+    static bool finishRekey();
+    static bool isRekeying();
+    static bool needsRekey(const char *cipherText, size_t length); // Not under the current key
+    static bool reencrypt(String &cipherText);
+
+    // AES-256-GCM in place under the file key, for the chunks of encrypted
+    // files. The file key is random and kept sealed under the vault key, so
+    // a password change does not touch the files. openChunk() fails, leaving nothing of the
+    // plaintext behind, if the tag does not match.
+    static const size_t CHUNK_NONCE_SIZE = 12;
+    static const size_t CHUNK_TAG_SIZE = 16;
+    static bool sealChunk(const uint8_t *nonce, const uint8_t *aad, size_t aadLength, uint8_t *data, size_t length, uint8_t *tag);
+    static bool openChunk(const uint8_t *nonce, const uint8_t *aad, size_t aadLength, uint8_t *data, size_t length, const uint8_t *tag);
+
+private:
+    static SemaphoreHandle_t sessionMutex;
+    static bool unlocked;
+    static bool lockedByUser;
+    static uint32_t lastUsed;
+    static uint32_t unlockMs;
+    static uint32_t iterations;
+    static mbedtls_aes_context encContext;
+    static mbedtls_aes_context decContext;
+    static mbedtls_aes_context legacyDecContext;
+    static mbedtls_aes_context previousDecContext; // Generation before this one, while rekeying
+    static mbedtls_gcm_context fileContext;
+    static uint32_t generation;
+    static bool rekeyPending;
+    static bool legacyKeyLoaded;
+    static std::atomic<bool> unlockRequested;
+
+    static bool unlockLocked(const String &password);
+    static void lockLocked();
+    static bool takeSession();
+    static bool ensureUnlocked();
+    static bool mayDeriveHere();
+    static void loadKeys(const uint8_t *vaultKey, const uint8_t *legacyKey, const uint8_t *fileKey,
+                         const uint8_t *previousKey, uint32_t keyGeneration);
+    static bool encryptLocked(const char *plainText, size_t length, char *out, size_t outSize, size_t &outLength);
+    static bool decryptLocked(const char *cipherText, size_t length, char *out, size_t outSize, size_t &outLength);
 };
 
 #else
 
+struct CryptoStatus {
+    bool unlocked;
+    bool lockedByUser;
+    uint32_t iterations;
+    uint32_t unlockMs;
+    uint32_t idleMs;
+};
+
 class CryptoHandler
 {
 public:
     static void init() {}
+    static void loop() {}
     static String encryptAES(const String &plainText, const String &key) { return plainText; }
     static String decryptAES(const String &cipherText, const String &key) { return cipherText; }
+    static bool unlock(const String &password) { return true; }
+    static void lock() {}
+    static bool isUnlocked() { return true; }
+    static bool isLockedByUser() { return false; }
+    static bool unlockInBackground() { return true; }
+    static CryptoStatus getStatus() { return CryptoStatus(); }
+    static size_t encryptedSize(size_t plainLength) { return plainLength + 1; }
+    static size_t decryptedSize(size_t cipherLength) { return cipherLength + 1; }
+    static bool encrypt(const char *plainText, size_t length, char *out, size_t outSize, size_t &outLength) { return copySpan(plainText, length, out, outSize, outLength); }
+    static bool decrypt(const char *cipherText, size_t length, char *out, size_t outSize, size_t &outLength) { return copySpan(cipherText, length, out, outSize, outLength); }
+    static String encrypt(const String &plainText) { return plainText; }
+    static String decrypt(const String &cipherText) { return cipherText; }
+    static bool beginRekey(const String &oldPassword, const String &newPassword) { return false; }
+    static bool finishRekey() { return false; }
+    static bool isRekeying() { return false; }
+    static bool needsRekey(const char *cipherText, size_t length) { return false; }
+    static bool reencrypt(String &cipherText) { return true; }
+    static const size_t CHUNK_NONCE_SIZE = 12;
+    static const size_t CHUNK_TAG_SIZE = 16;
+    static bool sealChunk(const uint8_t *nonce, const uint8_t *aad, size_t aadLength, uint8_t *data, size_t length, uint8_t *tag) { return false; }
+    static bool openChunk(const uint8_t *nonce, const uint8_t *aad, size_t aadLength, uint8_t *data, size_t length, const uint8_t *tag) { return false; }
+
+private:
+    static bool copySpan(const char *in, size_t length, char *out, size_t outSize, size_t &outLength) {
+        if (length + 1 > outSize) return false;
+        memmove(out, in, length);
+        out[length] = '\0';
+        outLength = length;
+        return true;
+    }
 };
 
 #endif // ENABLE_CRYPTO_HANDLER
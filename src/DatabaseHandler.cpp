@@ -0,0 +1,112 @@
+#include "DatabaseHandler.h"
+#include "Globals.h"
+#include "ButtonHandler.h"
+
+RecordStore DatabaseHandler::buttons(BUTTONS_LOG, BUTTONS_FILE, "buttons");
+RecordStore DatabaseHandler::categories(CATEGORIES_LOG, CATEGORIES_FILE, "categories");
+TaskHandle_t DatabaseHandler::compactTaskHandle = nullptr;
+
+void DatabaseHandler::init()
+{
+    buttons.open();
+    categories.open();
+
+    xTaskCreatePinnedToCore(
+        compactTask,        // Task function
+        "CompactTask",      // Task name
+        4096,               // Stack size (record buffers are on the heap)
+        nullptr,            // Parameters
+        0,                  // Priority (below loop())
+        &compactTaskHandle, // Task handle
+        tskNO_AFFINITY      // Run on any core
+    );
+
+    registerCommands();
+    debugI("DatabaseHandler initialized");
+}
+
+void DatabaseHandler::recordChanged(RecordStore &store)
+{
+    if (compactTaskHandle && store.needsCompaction())
+    {
+        xTaskNotifyGive(compactTaskHandle);
+    }
+}
+
+void DatabaseHandler::compactTask(void *pvParameters)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (RecordStore *store : {&buttons, &categories})
+        {
+            if (store->needsCompaction())
+            {
+                store->compact();
+            }
+        }
+    }
+}
+
+RecordStore *DatabaseHandler::storeByName(const CommandToken &name)
+{
+    if (name.equals("buttons")) return &buttons;
+    if (name.equals("categories")) return &categories;
+    return nullptr;
+}
+
+void DatabaseHandler::registerCommands()
+{
+    CommandHandler::registerCommand("db", [](const CommandArgs &args, CommandResult &result) {
+        const CommandToken &cmd = args[0];
+
+        if (cmd.equals("status")) {
+            for (RecordStore *store : {&buttons, &categories}) {
+                RecordStoreStats stats = store->getStats();
+                result.printf("%s: %u records, %u bytes, %u garbage, %lu compactions (last %lu ms)\n", store->name(),
+                              (unsigned)stats.records, (unsigned)stats.fileSize, (unsigned)stats.garbage,
+                              (unsigned long)stats.compactions, (unsigned long)stats.lastCompactMs);
+            }
+            return;
+        }
+
+        RecordStore *store = storeByName(args[1]);
+        if (!store) {
+            result.fail(CMD_STATUS_BAD_REQUEST, "Usage: db <status|compact|export|import> <buttons|categories>");
+            return;
+        }
+
+        if (cmd.equals("compact")) {
+            if (!store->compact()) {
+                result.fail(CMD_STATUS_FAILED, "Compacting %s failed", store->name());
+                return;
+            }
+            RecordStoreStats stats = store->getStats();
+            result.printf("Compacted %s to %u bytes in %lu ms", store->name(), (unsigned)stats.fileSize, (unsigned long)stats.lastCompactMs);
+        } else if (cmd.equals("export")) {
+            const char *path = store == &buttons ? BUTTONS_FILE : CATEGORIES_FILE;
+            if (!store->exportJson(path)) {
+                result.fail(CMD_STATUS_FAILED, "Exporting %s to %s failed", store->name(), path);
+                return;
+            }
+            result.printf("Exported %s to %s", store->name(), path);
+        } else if (cmd.equals("import")) {
+            const char *path = store == &buttons ? BUTTONS_FILE : CATEGORIES_FILE;
+            if (!store->importJson(path)) {
+                result.fail(CMD_STATUS_FAILED, "Importing %s from %s failed", store->name(), path);
+                return;
+            }
+            if (store == &buttons) {
+                ButtonHandler::reloadButtons();
+            }
+            result.printf("Imported %u %s from %s", (unsigned)store->getStats().records, store->name(), path);
+        } else {
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown db subcommand: %.*s", (int)cmd.length, cmd.data);
+        }
+    }, "Manages the button and category record logs. Usage: db <subcommand> [buttons|categories]\n"
+       "  Subcommands:\n"
+       "  status - Shows records, file size and garbage of each log\n"
+       "  compact <store> - Rewrites the log with only the live records\n"
+       "  export <store> - Writes the records to the JSON file\n"
+       "  import <store> - Replaces the records with the ones in the JSON file");
+}
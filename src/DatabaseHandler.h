@@ -0,0 +1,27 @@
+#pragma once
+
+#include "RecordStore.h"
+#include "CommandHandler.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Owns the button and category record stores and compacts them on a
+// low-priority task, so the web request that pushed garbage over the
+// threshold does not pay for the rewrite.
+class DatabaseHandler
+{
+public:
+    static RecordStore buttons;
+    static RecordStore categories;
+
+    static void init();
+    // Call after an edit; wakes the compaction task if the log needs it
+    static void recordChanged(RecordStore &store);
+
+private:
+    static TaskHandle_t compactTaskHandle;
+
+    static void compactTask(void *pvParameters);
+    static void registerCommands();
+    static RecordStore *storeByName(const CommandToken &name);
+};
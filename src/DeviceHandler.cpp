@@ -4,22 +4,54 @@
 #include "Globals.h"
 #include "DeviceDescriptors.h"
 #include "KeyMappings.h"
+#include "SecureFile.h"
 #include <USB.h>
 #include <LittleFS.h>
+#include <ArduinoJson.h>
 
-int DeviceHandler::keyPressDelay = 50;
+// Reports compiled per batch; text is typed in batches so long strings and
+// files never need a buffer proportional to their length
+static const size_t TYPE_BATCH = 48;
+
+// Bytes read from LittleFS per chunk when typing a file
+static const size_t FILE_CHUNK = 64;
+
+// Largest number of raw reports accepted by sendReports() in one job
+static const size_t MAX_REPORTS_PER_JOB = 16;
+
+int DeviceHandler::keyPressDelay = 1;
 //int DeviceHandler::keyPressDelay = settings.device.keyPressDelay;
 USBHIDMouse DeviceHandler::mouse;
 USBHIDKeyboard DeviceHandler::keyboard;
-
-USBHIDKeyboard &DeviceHandler::getKeyboard() {
-    return keyboard;
-}
+TaskHandle_t DeviceHandler::hidTaskHandle = nullptr;
+HidReportRing<HidEntry, DeviceHandler::QUEUE_SIZE> DeviceHandler::queue;
+portMUX_TYPE DeviceHandler::queueMux = portMUX_INITIALIZER_UNLOCKED;
+KeyReport DeviceHandler::heldReport = {0, 0, {0, 0, 0, 0, 0, 0}};
+std::atomic<bool> DeviceHandler::cancelRequested(false);
+std::atomic<bool> DeviceHandler::busy(false);
+uint32_t DeviceHandler::nextJobId = 1;
+HidQueueStats DeviceHandler::queueStats = {0, 0, 0, 0, 0, 0, 0, false};
+uint32_t DeviceHandler::lastReportUs = 0;
+TypingStats DeviceHandler::lastTyping = {0, 0, 0};
 
 void DeviceHandler::setKeyPressDelay(int delay) {
-    keyPressDelay = delay > 0 ? delay : 20;
+    keyPressDelay = delay >= 0 ? delay : 1;
     //keyPressDelay = delay > 0 ? delay : settings.device.keyPressDelay; // Fallback to default from settings
-    debugI("Key press delay set to %d ms", keyPressDelay);
+    debugI("Key report gap set to %d ms", keyPressDelay);
+}
+
+const TypingStats &DeviceHandler::getTypingStats() {
+    return lastTyping;
+}
+
+HidQueueStats DeviceHandler::getQueueStats() {
+    taskENTER_CRITICAL(&queueMux);
+    HidQueueStats stats = queueStats;
+    taskEXIT_CRITICAL(&queueMux);
+    stats.depth = queue.size();
+    stats.capacity = queue.capacity();
+    stats.busy = busy;
+    return stats;
 }
 
 void DeviceHandler::loop() {}
@@ -28,46 +60,440 @@ void DeviceHandler::init() {
     USB.begin();
     mouse.begin();
     keyboard.begin();
+
+    // The HID task owns the keyboard and mouse from here on
+    xTaskCreatePinnedToCore(
+        hidTask,            // Task function
+        "HidTask",          // Task name
+        4096,               // Stack size
+        nullptr,            // Parameters
+        2,                  // Priority (above loop() so typing stays smooth)
+        &hidTaskHandle,     // Task handle
+        tskNO_AFFINITY      // Run on any core
+    );
+
     registerCommands();
     debugI("DeviceHandler initialized");
     // Note: Ensure LittleFS.begin() is called somewhere in the setup process if not already done
 }
 
-void DeviceHandler::sendMouseMovement(int x, int y) {
-    mouse.move(x, y);
-    debugI("Mouse moved: x=%d, y=%d", x, y);
+// ---------------------------------------------------------------------------
+// Producer side: runs in loop(), web callbacks, MQTT, ...
+// ---------------------------------------------------------------------------
+
+uint32_t DeviceHandler::enqueue(HidEntry *entries, size_t count, HidJobCallback callback, void *ctx) {
+    size_t needed = count + (callback ? 1 : 0);
+    uint32_t jobId = 0;
+
+    taskENTER_CRITICAL(&queueMux);
+    if (hidTaskHandle && queue.available() >= needed) {
+        jobId = nextJobId++;
+        if (nextJobId == 0) nextJobId = 1;
+
+        for (size_t i = 0; i < count; i++) {
+            queue.push(entries[i]);
+        }
+        if (callback) {
+            HidEntry done;
+            done.type = HID_ENTRY_DONE;
+            done.done.callback = callback;
+            done.done.ctx = ctx;
+            done.done.jobId = jobId;
+            queue.push(done);
+        }
+
+        queueStats.jobsQueued++;
+        size_t depth = queue.size();
+        if (depth > queueStats.highWater) queueStats.highWater = depth;
+    } else {
+        queueStats.jobsRejected++;
+    }
+    taskEXIT_CRITICAL(&queueMux);
+
+    if (jobId == 0) {
+        // Heap copies were never handed to the HID task
+        for (size_t i = 0; i < count; i++) {
+            releaseEntry(entries[i], false);
+        }
+        debugW("HID queue full, job rejected (%u entries)", (unsigned)needed);
+        return 0;
+    }
+
+    xTaskNotifyGive(hidTaskHandle);
+    return jobId;
 }
 
-void DeviceHandler::sendKeys(const String &text) {
-    for (size_t i = 0; i < text.length(); i++) {
-        keyboard.write(text[i]);
-        delay(keyPressDelay); // Configurable delay between key presses
+uint32_t DeviceHandler::sendMouseMovement(int x, int y) {
+    HidEntry entry;
+    entry.type = HID_ENTRY_MOUSE;
+    entry.mouse.x = (int8_t)constrain(x, -127, 127);
+    entry.mouse.y = (int8_t)constrain(y, -127, 127);
+    debugI("Mouse move queued: x=%d, y=%d", x, y);
+    return enqueue(&entry, 1, nullptr, nullptr);
+}
+
+uint32_t DeviceHandler::typeText(const char *text, size_t len, HidJobCallback callback, void *ctx) {
+    if (len == 0) {
+        return enqueue(nullptr, 0, callback, ctx);
+    }
+
+    char *copy = (char *)malloc(len);
+    if (!copy) {
+        debugE("No memory to queue %u chars", (unsigned)len);
+        return 0;
     }
-    debugI("Keys sent: %s", text.c_str());
+    memcpy(copy, text, len);
+
+    HidEntry entry;
+    entry.type = HID_ENTRY_TEXT;
+    entry.text.data = copy;
+    entry.text.len = len;
+    return enqueue(&entry, 1, callback, ctx);
+}
+
+uint32_t DeviceHandler::typeTextRef(const char *text, size_t len, HidJobCallback callback, void *ctx) {
+    if (len == 0) {
+        return enqueue(nullptr, 0, callback, ctx);
+    }
+
+    HidEntry entry;
+    entry.type = HID_ENTRY_TEXT_REF;
+    entry.text.data = const_cast<char *>(text);
+    entry.text.len = len;
+    return enqueue(&entry, 1, callback, ctx);
 }
 
-void DeviceHandler::processKey(const String &keyName, bool press) {
+uint32_t DeviceHandler::typeTextReports(const char *text, size_t len, uint32_t timeoutMs) {
+    HidReportStream stream;
+    HidKeyStroke strokes[TYPE_BATCH];
+    HidEntry entries[TYPE_BATCH];
+    uint32_t jobId = 0;
+    bool finished = false;
+    bool rejected = false;
+    bool queued = false;
+
+    while (!finished && !rejected) {
+        size_t produced = 0;
+        if (len > 0) {
+            size_t consumed = stream.compile(text, len, strokes, TYPE_BATCH, produced);
+            text += consumed;
+            len -= consumed;
+        } else {
+            produced = stream.finish(strokes, TYPE_BATCH);
+            finished = true;
+        }
+        if (produced == 0) continue;
+
+        for (size_t i = 0; i < produced; i++) {
+            entries[i].type = HID_ENTRY_REPORT;
+            entries[i].report = {strokes[i].modifiers, 0, {strokes[i].keyCode, 0, 0, 0, 0, 0}};
+        }
+        jobId = waitForSpace(produced, timeoutMs) ? enqueue(entries, produced, nullptr, nullptr) : 0;
+        rejected = jobId == 0;
+        queued = queued || !rejected;
+    }
+
+    // The reports spell out the text, which may be a password
+    memset(strokes, 0, sizeof(strokes));
+    memset(entries, 0, sizeof(entries));
+
+    if (rejected) {
+        debugW("HID queue stayed full, %u chars not typed", (unsigned)len);
+        if (queued) {
+            // Flush the batches already in, rather than type half the text
+            cancel();
+        }
+        return 0;
+    }
+    return jobId ? jobId : enqueue(nullptr, 0, nullptr, nullptr); // Nothing to type
+}
+
+uint32_t DeviceHandler::sendKeys(const String &text, HidJobCallback callback, void *ctx) {
+    return typeText(text.c_str(), text.length(), callback, ctx);
+}
+
+uint32_t DeviceHandler::typeFile(const char *filePath, HidJobCallback callback, void *ctx) {
+    char *path = strdup(filePath);
+    if (!path) {
+        debugE("No memory to queue file %s", filePath);
+        return 0;
+    }
+
+    HidEntry entry;
+    entry.type = HID_ENTRY_FILE;
+    entry.path = path;
+    return enqueue(&entry, 1, callback, ctx);
+}
+
+uint32_t DeviceHandler::sendReports(const KeyReport *reports, size_t count, HidJobCallback callback, void *ctx) {
+    if (count > MAX_REPORTS_PER_JOB) {
+        debugW("Too many reports in one job: %u", (unsigned)count);
+        return 0;
+    }
+
+    HidEntry entries[MAX_REPORTS_PER_JOB];
+    for (size_t i = 0; i < count; i++) {
+        entries[i].type = HID_ENTRY_REPORT;
+        entries[i].report = reports[i];
+    }
+    return enqueue(entries, count, callback, ctx);
+}
+
+uint32_t DeviceHandler::queueDelay(uint32_t ms) {
+    HidEntry entry;
+    entry.type = HID_ENTRY_DELAY;
+    entry.delayMs = ms;
+    return enqueue(&entry, 1, nullptr, nullptr);
+}
+
+uint32_t DeviceHandler::processKey(const String &keyName, bool press) {
     std::string key = keyName.c_str();
     auto it = KeyMappings::keyMap.find(key);
-    if (it != KeyMappings::keyMap.end()) {
-        uint8_t keyCode = it->second;
-        if (press) {
-            keyboard.pressRaw(keyCode); // Press the raw HID key code
-            debugI("Pressed key: %s (code: %d)", keyName.c_str(), keyCode);
-        } else {
-            keyboard.releaseAll(); // Release all keys
-            debugI("Released all keys");
+    if (it == KeyMappings::keyMap.end()) {
+        debugW("Invalid key: %s", keyName.c_str());
+        return 0;
+    }
+
+    uint8_t keyCode = it->second;
+    HidEntry entry;
+    entry.type = HID_ENTRY_REPORT;
+
+    // Same bookkeeping as USBHIDKeyboard::pressRaw()/releaseAll()
+    taskENTER_CRITICAL(&queueMux);
+    if (!press) {
+        heldReport = {0, 0, {0, 0, 0, 0, 0, 0}};
+    } else if (keyCode >= HID_KEY_CONTROL_LEFT && keyCode <= HID_KEY_GUI_RIGHT) {
+        heldReport.modifiers |= (1 << (keyCode - HID_KEY_CONTROL_LEFT));
+    } else {
+        for (uint8_t &slot : heldReport.keys) {
+            if (slot == keyCode) break;
+            if (slot == 0) {
+                slot = keyCode;
+                break;
+            }
         }
+    }
+    entry.report = heldReport;
+    taskEXIT_CRITICAL(&queueMux);
+
+    if (press) {
+        debugI("Pressed key: %s (code: %d)", keyName.c_str(), keyCode);
     } else {
+        debugI("Released all keys");
+    }
+    return enqueue(&entry, 1, nullptr, nullptr);
+}
+
+uint32_t DeviceHandler::tapKey(const String &keyName) {
+    uint8_t keyCode = KeyMappings::getKeyCode(keyName.c_str());
+    if (keyCode == 0) {
         debugW("Invalid key: %s", keyName.c_str());
+        return 0;
+    }
+    return tapKeyCode(keyCode);
+}
+
+uint32_t DeviceHandler::tapKeyCode(uint8_t keyCode) {
+    // Modifier usages (0xE0-0xE7) travel in the modifier byte, not the key array
+    KeyReport reports[2] = {{0, 0, {keyCode, 0, 0, 0, 0, 0}}, {0, 0, {0, 0, 0, 0, 0, 0}}};
+    if (keyCode >= HID_KEY_CONTROL_LEFT && keyCode <= HID_KEY_GUI_RIGHT) {
+        reports[0] = {(uint8_t)(1 << (keyCode - HID_KEY_CONTROL_LEFT)), 0, {0, 0, 0, 0, 0, 0}};
+    }
+    return sendReports(reports, 2);
+}
+
+void DeviceHandler::cancel() {
+    if (!hidTaskHandle) return;
+    cancelRequested = true;
+    xTaskNotifyGive(hidTaskHandle);
+    debugI("HID cancel requested");
+}
+
+bool DeviceHandler::isIdle() {
+    return queue.size() == 0 && !busy;
+}
+
+bool DeviceHandler::waitForSpace(size_t count, uint32_t timeoutMs) {
+    if (count > queue.capacity()) return false;
+
+    uint32_t start = millis();
+    while (queue.available() < count) {
+        if (millis() - start >= timeoutMs) return false;
+        delay(1);
     }
+    return true;
 }
 
-void DeviceHandler::tapKey(const String &keyName) {
-    processKey(keyName, true);  // Press
-    delay(50);                  // Hold duration
-    //delay(settings.device.keyPressDelay); // Use the configured delay for consistency
-    processKey(keyName, false); // Release
+// ---------------------------------------------------------------------------
+// Consumer side: only ever runs on the HID task
+// ---------------------------------------------------------------------------
+
+void DeviceHandler::hidTask(void *pvParameters) {
+    HidEntry entry;
+    while (true) {
+        if (cancelRequested) {
+            flushQueue();
+            continue;
+        }
+
+        busy = true;
+        if (!queue.pop(entry)) {
+            busy = false;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // Woken by enqueue() or cancel()
+            continue;
+        }
+
+        runEntry(entry);
+        releaseEntry(entry, !cancelRequested);
+        busy = false;
+    }
+}
+
+void DeviceHandler::runEntry(const HidEntry &entry) {
+    switch (entry.type) {
+    case HID_ENTRY_REPORT:
+        sendKeyReport(entry.report);
+        break;
+    case HID_ENTRY_MOUSE:
+        mouse.move(entry.mouse.x, entry.mouse.y);
+        queueStats.reportsSent++;
+        break;
+    case HID_ENTRY_DELAY:
+        waitMs(entry.delayMs);
+        break;
+    case HID_ENTRY_TEXT:
+    case HID_ENTRY_TEXT_REF:
+        typeQueuedText(entry.text.data, entry.text.len);
+        break;
+    case HID_ENTRY_FILE:
+        printFile(entry.path);
+        break;
+    case HID_ENTRY_DONE:
+        break; // Handled by releaseEntry()
+    }
+}
+
+// Frees what the producer copied and fires completion callbacks
+void DeviceHandler::releaseEntry(const HidEntry &entry, bool completed) {
+    switch (entry.type) {
+    case HID_ENTRY_TEXT:
+        memset(entry.text.data, 0, entry.text.len); // May be a password
+        free(entry.text.data);
+        break;
+    case HID_ENTRY_FILE:
+        free(entry.path);
+        break;
+    case HID_ENTRY_DONE:
+        entry.done.callback(entry.done.jobId, completed, entry.done.ctx);
+        break;
+    default:
+        break;
+    }
+}
+
+void DeviceHandler::flushQueue() {
+    HidEntry entry;
+    size_t dropped = 0;
+    while (queue.pop(entry)) {
+        releaseEntry(entry, false);
+        dropped++;
+    }
+
+    taskENTER_CRITICAL(&queueMux);
+    heldReport = {0, 0, {0, 0, 0, 0, 0, 0}};
+    queueStats.jobsCancelled++;
+    taskEXIT_CRITICAL(&queueMux);
+
+    KeyReport none = {0, 0, {0, 0, 0, 0, 0, 0}};
+    keyboard.sendReport(&none);
+    lastReportUs = micros();
+
+    cancelRequested = false;
+    debugI("HID queue flushed, %u entries dropped", (unsigned)dropped);
+}
+
+// Sleep on the task notification so cancel() cuts the wait short.
+// Returns false if cancelled.
+bool DeviceHandler::waitMs(uint32_t ms) {
+    uint32_t start = millis();
+    while (!cancelRequested) {
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= ms) return true;
+        TickType_t ticks = pdMS_TO_TICKS(ms - elapsed);
+        ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+    }
+    return false;
+}
+
+// Send one keyboard report, keeping at least keyPressDelay ms since the
+// previous one. sendReport itself blocks until the host has polled the
+// endpoint, so a gap of 0 types at the USB poll rate. Returns false if
+// cancelled.
+bool DeviceHandler::sendKeyReport(const KeyReport &report) {
+    if (cancelRequested) return false;
+
+    if (keyPressDelay > 0) {
+        uint32_t gapUs = (uint32_t)keyPressDelay * 1000;
+        uint32_t elapsed = micros() - lastReportUs;
+        if (elapsed < gapUs) {
+            uint32_t remaining = gapUs - elapsed;
+            if (remaining >= 1000 && !waitMs(remaining / 1000)) return false;
+            delayMicroseconds(remaining % 1000);
+        }
+    }
+
+    KeyReport copy = report;
+    keyboard.sendReport(&copy);
+    lastReportUs = micros();
+    queueStats.reportsSent++;
+    return true;
+}
+
+bool DeviceHandler::sendStroke(const HidKeyStroke &stroke) {
+    KeyReport report = {stroke.modifiers, 0, {stroke.keyCode, 0, 0, 0, 0, 0}};
+    return sendKeyReport(report);
+}
+
+size_t DeviceHandler::typeChunk(HidReportStream &stream, const char *text, size_t len) {
+    HidKeyStroke strokes[TYPE_BATCH];
+    size_t reports = 0;
+
+    while (len > 0) {
+        size_t produced = 0;
+        size_t consumed = stream.compile(text, len, strokes, TYPE_BATCH, produced);
+        for (size_t i = 0; i < produced; i++) {
+            if (!sendStroke(strokes[i])) return reports;
+            reports++;
+        }
+        text += consumed;
+        len -= consumed;
+    }
+
+    return reports;
+}
+
+size_t DeviceHandler::finishTyping(HidReportStream &stream) {
+    HidKeyStroke release;
+    size_t produced = stream.finish(&release, 1);
+    if (produced && sendStroke(release)) {
+        return 1;
+    }
+    return 0;
+}
+
+void DeviceHandler::recordTyping(size_t chars, size_t reports, uint32_t startUs) {
+    lastTyping.chars = chars;
+    lastTyping.reports = reports;
+    lastTyping.durationUs = micros() - startUs;
+    debugI("Typed %u chars in %u reports (%lu us)", (unsigned)chars, (unsigned)reports, (unsigned long)lastTyping.durationUs);
+}
+
+void DeviceHandler::typeQueuedText(const char *text, size_t len) {
+    uint32_t startUs = micros();
+    HidReportStream stream;
+    size_t reports = typeChunk(stream, text, len);
+    reports += finishTyping(stream);
+    if (!cancelRequested) recordTyping(len, reports, startUs);
 }
 
 void DeviceHandler::printFile(const char *filePath) {
@@ -80,85 +506,154 @@ void DeviceHandler::printFile(const char *filePath) {
     // Reset file pointer to start
     file.seek(0);
 
-    while (file.available()) {
-        char c = file.read();
-        if (c != '\r') {
-            keyboard.print(c);   
+    uint32_t startUs = micros();
+    HidReportStream stream;
+    char buffer[FILE_CHUNK];
+    size_t chars = 0;
+    size_t reports = 0;
+
+    if (SecureFile::isEncrypted(file)) {
+        // Decrypted a chunk at a time; a chunk that fails to authenticate
+        // stops typing before any of it reaches the host
+        SecureFileReader reader;
+        int bytesRead = -1;
+        if (reader.open(file)) {
+            while (!cancelRequested && (bytesRead = reader.read((uint8_t *)buffer, sizeof(buffer))) > 0) {
+                reports += typeChunk(stream, buffer, bytesRead);
+                chars += bytesRead;
+            }
+        }
+        memset(buffer, 0, sizeof(buffer));
+        if (bytesRead < 0) {
+            debugE("File %s could not be decrypted", filePath);
+        }
+    } else {
+        while (file.available() && !cancelRequested) {
+            size_t bytesRead = file.read((uint8_t *)buffer, sizeof(buffer));
+            if (bytesRead == 0) break;
+            reports += typeChunk(stream, buffer, bytesRead);
+            chars += bytesRead;
         }
     }
 
     file.close();
-    keyboard.println();
+
+    // Finish with a newline like keyboard.println() did
+    reports += typeChunk(stream, "\n", 1);
+    reports += finishTyping(stream);
+    if (cancelRequested) return;
+    recordTyping(chars + 1, reports, startUs);
+    debugI("File %s typed out", filePath);
+}
+
+// Queued HID work finishes later, so the command reports the job it started
+static void queuedResult(CommandResult &result, uint32_t jobId, const char *what) {
+    if (jobId) {
+        result.setStatus(CMD_STATUS_ACCEPTED);
+        result.printf("%s queued as HID job %lu", what, (unsigned long)jobId);
+    } else {
+        result.fail(CMD_STATUS_BUSY, "%s rejected, HID queue full", what);
+    }
 }
 
 void DeviceHandler::registerCommands() {
-    CommandHandler::registerCommand("hid", [](const String &command) {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
-
-        if (cmd == "mouse") {
-            int x = 0, y = 0;
-            int commaIndex = args.indexOf(',');
-            if (commaIndex > 0) {
-                x = args.substring(0, commaIndex).toInt();
-                y = args.substring(commaIndex + 1).toInt();
-                DeviceHandler::sendMouseMovement(x, y);
+    CommandHandler::registerCommand("hid", [](const CommandArgs &args, CommandResult &result) {
+        const CommandToken &cmd = args[0];
+        CommandToken rest = args.rest(1);
+
+        if (cmd.equals("mouse")) {
+            // x,y without copying: strtol stops at the comma and at the token end
+            const char *comma = (const char *)memchr(rest.data, ',', rest.length);
+            if (comma && comma > rest.data) {
+                int x = strtol(rest.data, nullptr, 10);
+                int y = strtol(comma + 1, nullptr, 10);
+                queuedResult(result, DeviceHandler::sendMouseMovement(x, y), "Mouse move");
             } else {
-                debugW("Invalid args for HID mouse. Expected: x,y");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid args for HID mouse. Expected: x,y");
             }
         }
-        else if (cmd == "keys") {
-            sendKeys(args);
+        else if (cmd.equals("keys")) {
+            queuedResult(result, typeText(rest.data, rest.length), "Typing");
         }
-        else if (cmd == "winlock") {
-            keyboard.pressRaw(HID_KEY_GUI_LEFT);
-            keyboard.pressRaw(HID_KEY_L);
-            delay(500);
-            keyboard.releaseAll();
-            debugI("Windows locked");
+        else if (cmd.equals("winlock")) {
+            HidEntry entries[3];
+            entries[0].type = HID_ENTRY_REPORT;
+            entries[0].report = {KEYBOARD_MODIFIER_LEFTGUI, 0, {HID_KEY_L, 0, 0, 0, 0, 0}};
+            entries[1].type = HID_ENTRY_DELAY;
+            entries[1].delayMs = 500;
+            entries[2].type = HID_ENTRY_REPORT;
+            entries[2].report = {0, 0, {0, 0, 0, 0, 0, 0}};
+            queuedResult(result, enqueue(entries, 3, nullptr, nullptr), "Windows lock");
         }
-        else if (cmd == "tapkey") {
-            if (!args.isEmpty()) {
-                DeviceHandler::tapKey(args);
+        else if (cmd.equals("tapkey")) {
+            if (!rest.isEmpty()) {
+                queuedResult(result, DeviceHandler::tapKey(rest.toString()), "Key tap");
             } else {
-                debugW("No key provided for tapKey");
+                result.fail(CMD_STATUS_BAD_REQUEST, "No key provided for tapKey");
             }
         }
-        else if (cmd == "processkey") {
-            int spaceIndex = args.indexOf(' ');
-            if (spaceIndex > 0) {
-                String key = args.substring(0, spaceIndex);
-                String action = args.substring(spaceIndex + 1);
-                if (action.equalsIgnoreCase("press")) {
-                    DeviceHandler::processKey(key, true);
-                } else if (action.equalsIgnoreCase("release")) {
-                    DeviceHandler::processKey(key, false);
+        else if (cmd.equals("processkey")) {
+            if (args.count() >= 3) {
+                if (KeyMappings::keyMap.find(std::string(args[1].data, args[1].length)) == KeyMappings::keyMap.end()) {
+                    result.fail(CMD_STATUS_BAD_REQUEST, "Invalid key: %.*s", (int)args[1].length, args[1].data);
+                } else if (args[2].equals("press")) {
+                    queuedResult(result, DeviceHandler::processKey(args[1].toString(), true), "Key press");
+                } else if (args[2].equals("release")) {
+                    queuedResult(result, DeviceHandler::processKey(args[1].toString(), false), "Key release");
                 } else {
-                    debugW("Invalid action for processKey. Use 'press' or 'release'");
+                    result.fail(CMD_STATUS_BAD_REQUEST, "Invalid action for processKey. Use 'press' or 'release'");
                 }
             } else {
-                debugW("Invalid args for processKey. Expected: <key> <press/release>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid args for processKey. Expected: <key> <press/release>");
             }
         }
-        else if (cmd == "delay") {
-            int delay = args.toInt();
-            if (delay > 0) {
+        else if (cmd.equals("delay")) {
+            long delay = args[1].toInt();
+            if (delay > 0 || args[1].equals("0")) {
                 DeviceHandler::setKeyPressDelay(delay);
+                result.printf("Key press delay set to %d ms", keyPressDelay);
             } else {
-                debugW("Invalid delay value. Expected positive integer");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid delay value. Expected non-negative integer");
             }
         }
-        else if (cmd == "file") { // New subcommand to handle file typing
-            if (args.isEmpty()) {
-                debugW("No file path provided for HID file command");
+        else if (cmd.equals("stats")) {
+            const TypingStats &stats = DeviceHandler::getTypingStats();
+            uint32_t charsPerSecond = stats.durationUs ? (uint32_t)((uint64_t)stats.chars * 1000000 / stats.durationUs) : 0;
+            JsonDocument doc;
+            doc["chars"] = stats.chars;
+            doc["reports"] = stats.reports;
+            doc["durationUs"] = stats.durationUs;
+            doc["charsPerSecond"] = charsPerSecond;
+            result.json(doc);
+        }
+        else if (cmd.equals("file")) { // New subcommand to handle file typing
+            if (rest.isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "No file path provided for HID file command");
                 return;
             }
-            
-            printFile(args.c_str());
-            debugI("File %s typed out successfully", args.c_str());
+
+            String path = rest.toString();
+            queuedResult(result, typeFile(path.c_str()), "File typing");
+        }
+        else if (cmd.equals("stop")) {
+            DeviceHandler::cancel();
+            result.printf("HID output cancelled");
+        }
+        else if (cmd.equals("status")) {
+            HidQueueStats stats = DeviceHandler::getQueueStats();
+            JsonDocument doc;
+            doc["depth"] = stats.depth;
+            doc["capacity"] = stats.capacity;
+            doc["highWater"] = stats.highWater;
+            doc["busy"] = stats.busy;
+            doc["jobsQueued"] = stats.jobsQueued;
+            doc["jobsRejected"] = stats.jobsRejected;
+            doc["jobsCancelled"] = stats.jobsCancelled;
+            doc["reportsSent"] = stats.reportsSent;
+            result.json(doc);
         }
         else {
-            debugW("Unknown HID subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown HID subcommand: %.*s", (int)cmd.length, cmd.data);
         }
     },
     "Handles HID commands. Usage: hid <subcommand> [args]\n"
@@ -168,8 +663,11 @@ void DeviceHandler::registerCommands() {
     "  winlock - Locks Windows\n"
     "  tapKey <key> - Tap a single key\n"
     "  processKey <key> <press/release> - Press or release a key\n"
-    "  delay <ms> - Set key press delay (default 20 ms)\n"
-    "  file <path> - Type out the contents of the file line by line"); // Updated help string
+    "  delay <ms> - Set minimum gap between key reports (default 1 ms, 0 = USB poll rate)\n"
+    "  file <path> - Type out the contents of the file line by line\n"
+    "  stats - Show throughput of the last typing job\n"
+    "  status - Show HID queue depth and counters\n"
+    "  stop - Abort typing and clear the HID queue"); // Updated help string
 }
 
 #endif // ENABLE_DEVICE_HANDLER
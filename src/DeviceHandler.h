@@ -4,40 +4,151 @@
 
 #include <USBHIDMouse.h>
 #include <USBHIDKeyboard.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+#include "HidReportStream.h"
+#include "HidReportRing.h"
 
+// Throughput of the most recent typing job
+struct TypingStats {
+    size_t chars;
+    size_t reports;
+    uint32_t durationUs;
+};
+
+// HID output queue counters
+struct HidQueueStats {
+    size_t depth;        // Entries waiting right now
+    size_t highWater;    // Deepest the queue has been since boot
+    size_t capacity;
+    uint32_t jobsQueued;
+    uint32_t jobsRejected; // Queue full or out of memory
+    uint32_t jobsCancelled;
+    uint32_t reportsSent;
+    bool busy;           // HID task is working on an entry
+};
+
+// Called on the HID task when a job finishes (completed) or is flushed by
+// cancel() (!completed). Keep it short; the next report waits for it.
+typedef void (*HidJobCallback)(uint32_t jobId, bool completed, void *ctx);
+
+enum HidEntryType : uint8_t {
+    HID_ENTRY_REPORT, // Raw keyboard report
+    HID_ENTRY_MOUSE,  // Relative mouse move
+    HID_ENTRY_DELAY,  // Pause the queue
+    HID_ENTRY_TEXT,   // Heap copy of text, compiled into reports on the HID task
+    HID_ENTRY_TEXT_REF, // Caller-owned text that stays valid until the job is done
+    HID_ENTRY_FILE,   // Heap copy of a LittleFS path to type out
+    HID_ENTRY_DONE    // Completion callback for the job queued before it
+};
+
+struct HidEntry {
+    HidEntryType type;
+    union {
+        KeyReport report;
+        struct { int8_t x; int8_t y; } mouse;
+        uint32_t delayMs;
+        struct { char *data; uint32_t len; } text;
+        char *path;
+        struct { HidJobCallback callback; void *ctx; uint32_t jobId; } done;
+    };
+};
+
+// All HID output goes through a queue drained by a dedicated FreeRTOS task
+// that owns the keyboard and mouse. Public calls copy what they need, queue
+// it and return at once with a job id (0 if the queue was full).
 class DeviceHandler
 {
 private:
+    static const size_t QUEUE_SIZE = 128;
+
     static USBHIDMouse mouse;
     static USBHIDKeyboard keyboard;
+    static TaskHandle_t hidTaskHandle;
+    static HidReportRing<HidEntry, QUEUE_SIZE> queue;
+    static portMUX_TYPE queueMux;           // Serializes producers
+    static KeyReport heldReport;            // Keys held via processKey(), producer side
+    static std::atomic<bool> cancelRequested;
+    static std::atomic<bool> busy;
+    static uint32_t nextJobId;
+    static HidQueueStats queueStats;
+    static uint32_t lastReportUs;
+    static TypingStats lastTyping;
+
     static void registerCommands();
+    static void hidTask(void *pvParameters);
+    static uint32_t enqueue(HidEntry *entries, size_t count, HidJobCallback callback, void *ctx);
+    static void runEntry(const HidEntry &entry);
+    static void releaseEntry(const HidEntry &entry, bool completed);
+    static void flushQueue();
+    static bool waitMs(uint32_t ms);
+    static bool sendStroke(const HidKeyStroke &stroke);
+    static bool sendKeyReport(const KeyReport &report);
+    static size_t typeChunk(HidReportStream &stream, const char *text, size_t len);
+    static size_t finishTyping(HidReportStream &stream);
+    static void typeQueuedText(const char *text, size_t len);
     static void printFile(const char *filePath);
-    
+    static void recordTyping(size_t chars, size_t reports, uint32_t startUs);
+
 public:
-    static void sendMouseMovement(int x, int y);
-    static USBHIDKeyboard& getKeyboard();
-    static int keyPressDelay; // Configurable delay for key presses
+    static int keyPressDelay; // Minimum gap between keyboard reports in ms (0 = USB poll rate)
     static void setKeyPressDelay(int delay);
+    static const TypingStats& getTypingStats();
+    static HidQueueStats getQueueStats();
     static void loop();
     static void init();
-    static void sendKeys(const String& text);
-    static void tapKey(const String& key);
-    static void processKey(const String& keyName, bool press);
+
+    // Queue HID output; each returns the job id, or 0 if it was rejected
+    static uint32_t sendMouseMovement(int x, int y);
+    static uint32_t typeText(const char *text, size_t len, HidJobCallback callback = nullptr, void *ctx = nullptr);
+    static uint32_t sendKeys(const String& text, HidJobCallback callback = nullptr, void *ctx = nullptr);
+    // Like typeText() without the copy; text must outlive the job
+    static uint32_t typeTextRef(const char *text, size_t len, HidJobCallback callback = nullptr, void *ctx = nullptr);
+    // Compiles the text on the calling task and queues the reports themselves,
+    // waiting up to timeoutMs for room before each batch. Nothing is copied to
+    // the heap and text may be wiped as soon as it returns. Returns the id of
+    // the last batch, or 0 if one was rejected; the queue is then flushed,
+    // so the text is never left half typed.
+    static uint32_t typeTextReports(const char *text, size_t len, uint32_t timeoutMs);
+    static uint32_t typeFile(const char *filePath, HidJobCallback callback = nullptr, void *ctx = nullptr);
+    static uint32_t tapKey(const String& key);
+    static uint32_t tapKeyCode(uint8_t keyCode);
+    static uint32_t processKey(const String& keyName, bool press);
+    static uint32_t sendReports(const KeyReport *reports, size_t count, HidJobCallback callback = nullptr, void *ctx = nullptr);
+    static uint32_t queueDelay(uint32_t ms);
+
+    // Abort the running job and drop everything queued. The HID task stops
+    // before its next report and releases all keys.
+    static void cancel();
+    static bool isIdle();
+    // Block the caller until the queue has room for count entries
+    static bool waitForSpace(size_t count, uint32_t timeoutMs);
 };
 
 #else
-class USBHIDKeyboard;
+#include <USBHIDKeyboard.h> // KeyReport
+typedef void (*HidJobCallback)(uint32_t jobId, bool completed, void *ctx);
 class DeviceHandler
 {
 public: // No-op implementation of DeviceHandler
-    static void sendMouseMovement(int x, int y) {} // No-op
+    static uint32_t sendMouseMovement(int x, int y) { return 0; } // No-op
     static USBHIDKeyboard fakeKeyboard;
     static int keyPressDelay;
     static void loop() {} // No-op
     static void init() {} // No-op
-    static void sendKeys(const String& text) {} // No-op
-    static void tapKey(const String& key) {} // No-op
-    static void processKey(const String& keyName, bool press) {} // No-op
+    static uint32_t sendKeys(const String& text, HidJobCallback callback = nullptr, void *ctx = nullptr) { return 0; } // No-op
+    static uint32_t typeText(const char *text, size_t len, HidJobCallback callback = nullptr, void *ctx = nullptr) { return 0; } // No-op
+    static uint32_t typeTextRef(const char *text, size_t len, HidJobCallback callback = nullptr, void *ctx = nullptr) { return 0; } // No-op
+    static uint32_t typeTextReports(const char *text, size_t len, uint32_t timeoutMs) { return 0; } // No-op
+    static uint32_t tapKey(const String& key) { return 0; } // No-op
+    static uint32_t tapKeyCode(uint8_t keyCode) { return 0; } // No-op
+    static uint32_t processKey(const String& keyName, bool press) { return 0; } // No-op
+    static uint32_t sendReports(const KeyReport *reports, size_t count, HidJobCallback callback = nullptr, void *ctx = nullptr) { return 0; } // No-op
+    static uint32_t queueDelay(uint32_t ms) { return 0; } // No-op
+    static void cancel() {} // No-op
+    static bool isIdle() { return true; } // No-op
+    static bool waitForSpace(size_t count, uint32_t timeoutMs) { return true; } // No-op
 };
 
-#endif // ENABLE_DEVICE_HANDLER
\ No newline at end of file
+#endif // ENABLE_DEVICE_HANDLER
@@ -90,51 +90,37 @@ String getFileNameFromUrl(const String &url)
 
 void DownloadHandler::registerCommands()
 {
-    CommandHandler::registerCommand("download", [](const String &args)
+    CommandHandler::registerCommand("download", [](const CommandArgs &args, CommandResult &result)
                                     {
-        if (args.isEmpty())
+        String url = args[0].toString();
+        String destination = args.rest(1).toString();
+
+        if (url.isEmpty())
         {
-            debugW("Usage: download <url> [destination]");
+            result.fail(CMD_STATUS_BAD_REQUEST, "Usage: download <url> [destination]");
             return;
         }
 
-        int spaceIndex = args.indexOf(' ');
-        String url, destination;
-
-        if (spaceIndex < 0)
+        if (destination.isEmpty())
         {
             // Only URL provided; derive destination from URL
-            url = args;
             destination = getFileNameFromUrl(url);
             if (destination.isEmpty())
             {
-                debugE("Failed to derive destination filename from URL");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Failed to derive destination filename from URL");
                 return;
             }
         }
-        else
-        {
-            url = args.substring(0, spaceIndex);
-            destination = args.substring(spaceIndex + 1);
-            destination.trim(); // Trim whitespace from the destination string
-        }
-
-        if (url.isEmpty())
-        {
-            debugW("Invalid arguments. URL is empty.");
-            debugI("Usage: download <url> [destination]");
-            return;
-        }
 
         debugI("Attempting to download from URL: %s to destination: %s", url.c_str(), destination.c_str());
 
         if (downloadFile(url, destination))
         {
-            debugI("File downloaded successfully to: %s", destination.c_str());
+            result.printf("File downloaded successfully to: %s", destination.c_str());
         }
         else
         {
-            debugE("Failed to download file from: %s", url.c_str());
+            result.fail(CMD_STATUS_FAILED, "Failed to download file from: %s", url.c_str());
         } },
         "Downloads a file from a URL and saves it to LittleFS. Usage: download <url> [destination]");
 
@@ -0,0 +1,266 @@
+#ifdef ENABLE_DUCKYSCRIPT_HANDLER
+
+#include "DuckyScriptCompiler.h"
+#include "Globals.h"
+#include "KeyMappings.h"
+#include <USBHIDKeyboard.h>
+#include <string>
+
+// Longest text operand; longer STRING lines are split across instructions
+static const size_t MAX_TEXT_OPERAND = 0x7FFF;
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Case-insensitive compare of a token against a keyword
+static bool tokenEquals(const char *token, size_t len, const char *keyword) {
+    size_t keywordLen = strlen(keyword);
+    return len == keywordLen && strncasecmp(token, keyword, len) == 0;
+}
+
+static long parseLong(const char *text, size_t len) {
+    char buffer[16];
+    size_t n = len < sizeof(buffer) - 1 ? len : sizeof(buffer) - 1;
+    memcpy(buffer, text, n);
+    buffer[n] = '\0';
+    return strtol(buffer, nullptr, 10);
+}
+
+static uint16_t readU16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readU32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t DuckyScriptCompiler::hashUpdate(uint32_t hash, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+String DuckyScriptCompiler::cachePath(const String &scriptPath) {
+    return scriptPath + ".dbc";
+}
+
+void DuckyScriptCompiler::emitU16(std::vector<uint8_t> &code, uint16_t value) {
+    code.push_back(value & 0xFF);
+    code.push_back(value >> 8);
+}
+
+void DuckyScriptCompiler::emitU32(std::vector<uint8_t> &code, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        code.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void DuckyScriptCompiler::emitText(std::vector<uint8_t> &code, DuckyOp op, const char *text, size_t len, bool newline) {
+    do {
+        size_t chunk = len < MAX_TEXT_OPERAND ? len : MAX_TEXT_OPERAND;
+        bool last = chunk == len;
+        size_t operand = chunk + (last && newline ? 1 : 0);
+
+        code.push_back(op);
+        emitU16(code, operand);
+        code.insert(code.end(), text, text + chunk);
+        if (last && newline) code.push_back('\n');
+
+        text += chunk;
+        len -= chunk;
+    } while (len > 0);
+}
+
+bool DuckyScriptCompiler::compile(const char *source, size_t len, std::vector<uint8_t> &code) {
+    DuckyCompileState state;
+    beginCompile(code, len, state);
+
+    size_t lineStart = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i == len || source[i] == '\n') {
+            compileNext(source + lineStart, i - lineStart, code, state);
+            lineStart = i + 1;
+        }
+    }
+    return finishCompile(code);
+}
+
+void DuckyScriptCompiler::beginCompile(std::vector<uint8_t> &code, size_t sizeHint, DuckyCompileState &state) {
+    code.clear();
+    code.reserve(sizeHint + 8);
+    state.lastStart = SIZE_MAX;
+    state.lineNumber = 1;
+}
+
+void DuckyScriptCompiler::compileNext(const char *line, size_t len, std::vector<uint8_t> &code, DuckyCompileState &state) {
+    compileLine(line, len, state.lineNumber++, code, state.lastStart);
+}
+
+bool DuckyScriptCompiler::finishCompile(std::vector<uint8_t> &code) {
+    code.push_back(DUCKY_OP_END);
+    if (code.size() > MAX_CODE_SIZE) {
+        debugE("DuckyScript too large to compile (%u bytes of bytecode)", (unsigned)code.size());
+        return false;
+    }
+    return true;
+}
+
+void DuckyScriptCompiler::compileLine(const char *line, size_t len, size_t lineNumber, std::vector<uint8_t> &code, size_t &lastStart) {
+    while (len > 0 && isBlank(line[0])) {
+        line++;
+        len--;
+    }
+    while (len > 0 && isBlank(line[len - 1])) {
+        len--;
+    }
+    if (len == 0 || (len >= 2 && strncmp(line, "//", 2) == 0) || (len >= 3 && strncmp(line, "REM", 3) == 0)) {
+        return;
+    }
+
+    size_t commandLen = 0;
+    while (commandLen < len && line[commandLen] != ' ') commandLen++;
+    const char *args = commandLen < len ? line + commandLen + 1 : line + len;
+    size_t argsLen = (line + len) - args;
+
+    size_t start = code.size();
+
+    if (tokenEquals(line, commandLen, "DELAY")) {
+        long value = parseLong(args, argsLen);
+        if (value > 0) {
+            code.push_back(DUCKY_OP_DELAY);
+            emitU32(code, value);
+        } else {
+            debugE("Line %u: invalid DELAY", (unsigned)lineNumber);
+        }
+    }
+    else if (tokenEquals(line, commandLen, "DEFAULT_DELAY")) {
+        long value = parseLong(args, argsLen);
+        if (value <= 0) debugE("Line %u: invalid DEFAULT_DELAY", (unsigned)lineNumber);
+        code.push_back(DUCKY_OP_DEFAULT_DELAY);
+        emitU32(code, value > 0 ? value : 0);
+    }
+    else if (tokenEquals(line, commandLen, "STRING") || tokenEquals(line, commandLen, "STRINGLN")) {
+        if (argsLen > 0) {
+            emitText(code, DUCKY_OP_STRING, args, argsLen, commandLen == 8);
+        } else {
+            debugE("Line %u: STRING missing args", (unsigned)lineNumber);
+        }
+    }
+    else if (tokenEquals(line, commandLen, "REPEAT")) {
+        long count = parseLong(args, argsLen);
+        if (count > 0 && lastStart != SIZE_MAX) {
+            code.push_back(DUCKY_OP_REPEAT);
+            emitU16(code, lastStart);
+            emitU16(code, start);
+            emitU16(code, count > 0xFFFF ? 0xFFFF : count);
+        } else {
+            debugE("Line %u: invalid REPEAT or no previous line", (unsigned)lineNumber);
+        }
+    }
+    else if (tokenEquals(line, commandLen, "COMMAND")) {
+        if (argsLen > 0) {
+            emitText(code, DUCKY_OP_COMMAND, args, argsLen, false);
+        } else {
+            debugE("Line %u: COMMAND missing args", (unsigned)lineNumber);
+        }
+    }
+    else {
+        // Modifiers or single keys, resolved to HID codes now
+        uint8_t modifiers = 0;
+        uint8_t keys[6];
+        uint8_t keyCount = 0;
+
+        size_t pos = 0;
+        while (pos < len) {
+            while (pos < len && line[pos] == ' ') pos++;
+            size_t tokenStart = pos;
+            while (pos < len && line[pos] != ' ') pos++;
+            if (pos == tokenStart) break;
+
+            std::string token(line + tokenStart, pos - tokenStart);
+            uint8_t keyCode = KeyMappings::getKeyCode(token);
+            if (keyCode == 0) {
+                debugW("Line %u: unknown key %s", (unsigned)lineNumber, token.c_str());
+            } else if (keyCode >= HID_KEY_CONTROL_LEFT && keyCode <= HID_KEY_GUI_RIGHT) {
+                modifiers |= (1 << (keyCode - HID_KEY_CONTROL_LEFT));
+            } else if (keyCount < sizeof(keys)) {
+                keys[keyCount++] = keyCode;
+            } else {
+                debugW("Line %u: too many keys in combo, ignoring %s", (unsigned)lineNumber, token.c_str());
+            }
+        }
+
+        if (modifiers || keyCount) {
+            code.push_back(DUCKY_OP_COMBO);
+            code.push_back(modifiers);
+            code.push_back(keyCount);
+            code.insert(code.end(), keys, keys + keyCount);
+        }
+    }
+
+    if (code.size() > start) {
+        lastStart = start;
+    }
+}
+
+bool DuckyScriptCompiler::decode(const uint8_t *code, size_t size, size_t &pc, DuckyInstruction &instruction) {
+    if (pc >= size) return false;
+
+    instruction.op = (DuckyOp)code[pc];
+    size_t remaining = size - pc - 1;
+    const uint8_t *operands = code + pc + 1;
+
+    switch (instruction.op) {
+    case DUCKY_OP_END:
+        pc += 1;
+        return true;
+    case DUCKY_OP_STRING:
+    case DUCKY_OP_COMMAND:
+        if (remaining < 2) return false;
+        instruction.length = readU16(operands);
+        if (remaining - 2 < instruction.length) return false;
+        instruction.data = operands + 2;
+        pc += 3 + instruction.length;
+        return true;
+    case DUCKY_OP_COMBO:
+        if (remaining < 2) return false;
+        instruction.modifiers = operands[0];
+        instruction.keyCount = operands[1];
+        if (instruction.keyCount > 6 || remaining - 2 < instruction.keyCount) return false;
+        instruction.data = operands + 2;
+        pc += 3 + instruction.keyCount;
+        return true;
+    case DUCKY_OP_DELAY:
+    case DUCKY_OP_DEFAULT_DELAY:
+        if (remaining < 4) return false;
+        instruction.value = readU32(operands);
+        pc += 5;
+        return true;
+    case DUCKY_OP_REPEAT:
+        if (remaining < 6) return false;
+        instruction.start = readU16(operands);
+        instruction.end = readU16(operands + 2);
+        instruction.value = readU16(operands + 4);
+        // Ranges always point backwards, so nested REPEATs terminate
+        if (instruction.start >= instruction.end || instruction.end > pc) return false;
+        pc += 7;
+        return true;
+    }
+    return false;
+}
+
+bool DuckyScriptCompiler::validate(const uint8_t *code, size_t size) {
+    size_t pc = 0;
+    DuckyInstruction instruction;
+    while (decode(code, size, pc, instruction)) {
+        if (instruction.op == DUCKY_OP_END) {
+            return pc == size;
+        }
+    }
+    return false;
+}
+
+#endif // ENABLE_DUCKYSCRIPT_HANDLER
@@ -0,0 +1,86 @@
+#pragma once
+
+#ifdef ENABLE_DUCKYSCRIPT_HANDLER
+
+#include <Arduino.h>
+#include <vector>
+
+// Bytecode opcodes. Multi-byte operands are little endian.
+enum DuckyOp : uint8_t {
+    DUCKY_OP_END = 0,           // End of script
+    DUCKY_OP_STRING = 1,        // u16 len, text (STRINGLN appends '\n')
+    DUCKY_OP_COMBO = 2,         // u8 modifiers, u8 count, count HID key codes
+    DUCKY_OP_DELAY = 3,         // u32 ms
+    DUCKY_OP_DEFAULT_DELAY = 4, // u32 ms, applied after every following instruction
+    DUCKY_OP_REPEAT = 5,        // u16 start, u16 end, u16 count: run [start, end) count times
+    DUCKY_OP_COMMAND = 6        // u16 len, command line
+};
+
+// Header of a cached .dbc file; the source hash and size decide whether the
+// cache is still valid for the script next to it
+struct DuckyBytecodeHeader {
+    uint32_t magic;
+    uint32_t sourceHash; // FNV-1a of the script bytes
+    uint32_t sourceSize;
+    uint32_t codeSize;
+};
+
+// Decoded instruction, pointing into the bytecode buffer
+struct DuckyInstruction {
+    DuckyOp op;
+    uint32_t value;       // DELAY/DEFAULT_DELAY ms, REPEAT count
+    uint16_t start, end;  // REPEAT range
+    uint8_t modifiers;    // COMBO
+    uint8_t keyCount;     // COMBO
+    const uint8_t *data;  // STRING/COMMAND text, COMBO key codes
+    uint16_t length;      // STRING/COMMAND length
+};
+
+// Where a line-at-a-time compile has got to
+struct DuckyCompileState {
+    size_t lastStart;  // Start of the previous instruction, for REPEAT
+    size_t lineNumber;
+};
+
+// Compiles DuckyScript text into bytecode once so running a script does no
+// tokenizing, String work or key map lookups
+class DuckyScriptCompiler
+{
+public:
+    static const uint32_t MAGIC = 0x31424344; // "DCB1"
+    static const uint32_t HASH_SEED = 2166136261u;
+    static const size_t MAX_CODE_SIZE = 0xFFFF; // REPEAT offsets are 16 bit
+    static const uint8_t MAX_REPEAT_DEPTH = 4;
+
+    // Incremental FNV-1a, start with HASH_SEED
+    static uint32_t hashUpdate(uint32_t hash, const uint8_t *data, size_t len);
+
+    // Compile a whole script. Bad lines are logged and skipped like the old
+    // interpreter did. Returns false only if the result would not fit.
+    static bool compile(const char *source, size_t len, std::vector<uint8_t> &code);
+
+    // compile() a line at a time, for sources that are never whole in RAM:
+    // beginCompile(), then compileNext() with each line (without its '\n'),
+    // then finishCompile()
+    static void beginCompile(std::vector<uint8_t> &code, size_t sizeHint, DuckyCompileState &state);
+    static void compileNext(const char *line, size_t len, std::vector<uint8_t> &code, DuckyCompileState &state);
+    static bool finishCompile(std::vector<uint8_t> &code);
+
+    // Decode the instruction at pc and advance pc. Returns false on
+    // malformed bytecode (never reads past size).
+    static bool decode(const uint8_t *code, size_t size, size_t &pc, DuckyInstruction &instruction);
+
+    // Walk the whole program once; cached bytecode is checked before it runs
+    static bool validate(const uint8_t *code, size_t size);
+
+    // Cache file used for a script ("/scripts/demo.txt" -> "/scripts/demo.txt.dbc")
+    static String cachePath(const String &scriptPath);
+
+private:
+    static void compileLine(const char *line, size_t len, size_t lineNumber, std::vector<uint8_t> &code, size_t &lastStart);
+    static void emitText(std::vector<uint8_t> &code, DuckyOp op, const char *text, size_t len, bool newline);
+    static void emitU16(std::vector<uint8_t> &code, uint16_t value);
+    static void emitU32(std::vector<uint8_t> &code, uint32_t value);
+};
+
+#endif // ENABLE_DUCKYSCRIPT_HANDLER
@@ -2,179 +2,676 @@
 #include "DuckyScriptHandler.h"
 #include "DeviceHandler.h"
 #include "LittleFS.h"
-#include "KeyMappings.h"
+#include "SecureFile.h"
+#include "mbedtls/platform_util.h"
 #include <vector>
 
+// Queue entries one instruction can need (combo press + release + delays)
+static const size_t LINE_QUEUE_ENTRIES = 4;
+
+// How long a script waits for the HID queue to drain before giving up
+static const uint32_t QUEUE_WAIT_MS = 30000;
+
+// Instructions stepped per loop() call
+static const uint16_t STEP_BUDGET = 16;
+
+// Bytes hashed per read when checking a script against its cache
+static const size_t HASH_CHUNK = 64;
+
+// Plaintext taken from the reader per read when compiling an encrypted script
+static const size_t DECRYPT_CHUNK = 64;
+
+// First size of the buffer a line of an encrypted script is put together in
+static const size_t LINE_BUFFER_START = 128;
+
+uint8_t DuckyScriptHandler::codeBuffer[DuckyScriptHandler::CODE_BUFFER_SIZE];
+std::vector<uint8_t> DuckyScriptHandler::heapCode;
+
+DuckyScriptHandler::RunRequest DuckyScriptHandler::runQueue[DuckyScriptHandler::RUN_QUEUE_SIZE];
+size_t DuckyScriptHandler::runHead = 0;
+size_t DuckyScriptHandler::runCount = 0;
+portMUX_TYPE DuckyScriptHandler::runMux = portMUX_INITIALIZER_UNLOCKED;
+std::atomic<bool> DuckyScriptHandler::stopRequested(false);
+std::atomic<uint32_t> DuckyScriptHandler::pendingCommand(0);
+uint32_t DuckyScriptHandler::commandTicket = 0;
+
+DuckyRunState DuckyScriptHandler::state = DUCKY_IDLE;
+char DuckyScriptHandler::currentPath[DuckyScriptHandler::RUN_TEXT_SIZE] = "";
+const char *DuckyScriptHandler::currentSource = "";
+const uint8_t *DuckyScriptHandler::code = nullptr;
+size_t DuckyScriptHandler::codeSize = 0;
+size_t DuckyScriptHandler::pc = 0;
+uint32_t DuckyScriptHandler::defaultDelay = 0;
+uint32_t DuckyScriptHandler::pendingDelay = 0;
+uint32_t DuckyScriptHandler::wakeAt = 0;
+uint32_t DuckyScriptHandler::waitingSince = 0;
+DuckyScriptHandler::RepeatFrame DuckyScriptHandler::repeats[DuckyScriptCompiler::MAX_REPEAT_DEPTH];
+uint8_t DuckyScriptHandler::repeatDepth = 0;
+uint32_t DuckyScriptHandler::startedAt = 0;
+uint32_t DuckyScriptHandler::instructionCount = 0;
+uint32_t DuckyScriptHandler::completedCount = 0;
+uint32_t DuckyScriptHandler::failedCount = 0;
+uint32_t DuckyScriptHandler::stoppedCount = 0;
+uint32_t DuckyScriptHandler::rejectedCount = 0;
+
 void DuckyScriptHandler::init() {
     registerCommands();
     debugI("DuckyScriptHandler initialized");
 }
 
-void DuckyScriptHandler::executeScript(const String &filePath) {
-    debugI("Executing DuckyScript from: %s", filePath.c_str());
-    File file = LittleFS.open(filePath, "r");
-    if (!file) {
-        debugE("Failed to open file: %s", filePath.c_str());
-        return;
-    }
+void DuckyScriptHandler::hashScript(File &file, uint32_t &hash, uint32_t &size) {
+    uint8_t buffer[HASH_CHUNK];
+    hash = DuckyScriptCompiler::HASH_SEED;
+    size = 0;
 
-    String lastLine;
+    file.seek(0);
     while (file.available()) {
-        String line = file.readStringUntil('\n');
-        line.trim();
-        if (line.isEmpty() || line.startsWith("//") || line.startsWith("REM")) {
-            debugI("Skipping: %s", line.isEmpty() ? "empty" : line.c_str());
-            continue;
+        size_t bytesRead = file.read(buffer, sizeof(buffer));
+        if (bytesRead == 0) break;
+        hash = DuckyScriptCompiler::hashUpdate(hash, buffer, bytesRead);
+        size += bytesRead;
+    }
+}
+
+// Load cached bytecode into dest (if it fits) or heapDest. Returns false if
+// there is no cache, it belongs to a different version of the script, or it
+// does not validate.
+bool DuckyScriptHandler::readCache(const String &filePath, uint32_t hash, uint32_t size, uint8_t *dest, size_t capacity, std::vector<uint8_t> *heapDest, size_t &codeSize) {
+    File cache = LittleFS.open(DuckyScriptCompiler::cachePath(filePath), "r");
+    if (!cache) return false;
+
+    DuckyBytecodeHeader header;
+    bool valid = cache.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == DuckyScriptCompiler::MAGIC &&
+                 header.sourceHash == hash &&
+                 header.sourceSize == size &&
+                 header.codeSize > 0 && header.codeSize <= DuckyScriptCompiler::MAX_CODE_SIZE;
+
+    if (valid) {
+        if (!dest || header.codeSize > capacity) {
+            if (!heapDest) {
+                cache.close();
+                return false;
+            }
+            heapDest->resize(header.codeSize);
+            dest = heapDest->data();
         }
-        debugI("Line: %s", line.c_str());
-        processLine(line);
-        lastLine = line;
+        valid = cache.read(dest, header.codeSize) == header.codeSize &&
+                DuckyScriptCompiler::validate(dest, header.codeSize);
     }
-    file.close();
-    debugI("DuckyScript execution completed");
+    cache.close();
+
+    if (!valid) {
+        debugW("Stale or invalid DuckyScript cache for %s", filePath.c_str());
+        return false;
+    }
+    codeSize = header.codeSize;
+    return true;
 }
 
-void DuckyScriptHandler::processLine(const String &line) {
-    static int defaultDelay = 0;
-    static String lastLine;
+void DuckyScriptHandler::writeCache(const String &filePath, uint32_t hash, uint32_t size, const std::vector<uint8_t> &code) {
+    String cachePath = DuckyScriptCompiler::cachePath(filePath);
+    File cache = LittleFS.open(cachePath, "w");
+    if (!cache) {
+        debugW("Failed to write DuckyScript cache %s", cachePath.c_str());
+        return;
+    }
+
+    DuckyBytecodeHeader header = {DuckyScriptCompiler::MAGIC, hash, size, (uint32_t)code.size()};
+    bool written = cache.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                   cache.write(code.data(), code.size()) == code.size();
+    cache.close();
 
-    std::vector<String> tokens;
-    int start = 0, end = 0;
-    while ((end = line.indexOf(' ', start)) != -1) {
-        String token = line.substring(start, end);
-        token.trim();
-        if (!token.isEmpty()) tokens.push_back(token);
-        start = end + 1;
+    if (!written) {
+        debugW("Failed to write DuckyScript cache %s", cachePath.c_str());
+        LittleFS.remove(cachePath);
     }
-    if (start < line.length()) {
-        String token = line.substring(start);
-        token.trim();
-        if (!token.isEmpty()) tokens.push_back(token);
+}
+
+bool DuckyScriptHandler::compileSource(File &file, uint32_t size, std::vector<uint8_t> &code) {
+    std::vector<char> source(size);
+    file.seek(0);
+    if (size > 0 && file.read((uint8_t *)source.data(), size) != size) {
+        debugE("Failed to read DuckyScript source");
+        return false;
     }
+    return DuckyScriptCompiler::compile(source.data(), size, code);
+}
 
-    if (tokens.empty()) return;
+// Grows a buffer holding plaintext, wiping the copy it leaves behind
+static bool growSecret(char *&buffer, size_t &capacity, size_t needed) {
+    size_t grownCapacity = capacity;
+    while (grownCapacity < needed) grownCapacity *= 2;
+    char *grown = (char *)malloc(grownCapacity);
+    if (!grown) {
+        return false;
+    }
+    memcpy(grown, buffer, capacity);
+    mbedtls_platform_zeroize(buffer, capacity);
+    free(buffer);
+    buffer = grown;
+    capacity = grownCapacity;
+    return true;
+}
 
-    String command = tokens[0];
-    String args = tokens.size() > 1 ? line.substring(line.indexOf(' ') + 1) : "";
+// Encrypted scripts are decrypted and compiled a line at a time on every
+// run, so besides the bytecode only one chunk and the current line of
+// plaintext are ever in RAM. Their bytecode holds the typed text, so it is
+// never cached on flash; a cache left from before the script was encrypted
+// is removed.
+bool DuckyScriptHandler::compileEncrypted(File &file, const String &filePath, std::vector<uint8_t> &code) {
+    String cachePath = DuckyScriptCompiler::cachePath(filePath);
+    if (LittleFS.exists(cachePath)) {
+        LittleFS.remove(cachePath);
+    }
 
-    if (CommandHandler::equalsIgnoreCase(command, "DELAY")) {
-        int delayValue = args.toInt();
-        if (delayValue > 0) {
-            debugI("DELAY %d ms", delayValue);
-            delay(delayValue);
-        } else {
-            debugE("Invalid DELAY: %s", args.c_str());
+    size_t sizeHint = file.size(); // The ciphertext size bounds the plaintext
+    size_t capacity = LINE_BUFFER_START;
+    char *line = (char *)malloc(capacity);
+    SecureFileReader reader;
+    if (!line || !reader.open(file)) {
+        free(line);
+        debugE("Failed to decrypt DuckyScript %s", filePath.c_str());
+        return false;
+    }
+
+    DuckyCompileState state;
+    DuckyScriptCompiler::beginCompile(code, sizeHint, state);
+    char chunk[DECRYPT_CHUNK];
+    size_t lineLength = 0;
+    int length = 0;
+    bool ok = true;
+    while (ok && (length = reader.read((uint8_t *)chunk, sizeof(chunk))) > 0) {
+        const char *p = chunk;
+        const char *end = chunk + length;
+        while (ok && p < end) {
+            const char *newline = (const char *)memchr(p, '\n', end - p);
+            size_t take = (newline ? newline : end) - p;
+            ok = lineLength + take <= capacity || growSecret(line, capacity, lineLength + take);
+            if (!ok) {
+                debugE("No memory for a line of DuckyScript %s", filePath.c_str());
+                break;
+            }
+            memcpy(line + lineLength, p, take);
+            lineLength += take;
+            p += take;
+            if (newline) {
+                DuckyScriptCompiler::compileNext(line, lineLength, code, state);
+                lineLength = 0;
+                p++;
+            }
         }
     }
-    else if (CommandHandler::equalsIgnoreCase(command, "DEFAULT_DELAY")) {
-        defaultDelay = args.toInt();
-        if (defaultDelay > 0) debugI("DEFAULT_DELAY %d ms", defaultDelay);
-        else debugE("Invalid DEFAULT_DELAY: %s", args.c_str());
+    if (length < 0) {
+        debugE("Failed to decrypt DuckyScript %s", filePath.c_str());
+        ok = false;
     }
-    else if (CommandHandler::equalsIgnoreCase(command, "STRING")) {
-        if (!args.isEmpty()) {
-            debugI("STRING: %s", args.c_str());
-            DeviceHandler::sendKeys(args);
-        } else {
-            debugE("STRING missing args");
-        }
+    if (ok) {
+        DuckyScriptCompiler::compileNext(line, lineLength, code, state);
+        ok = DuckyScriptCompiler::finishCompile(code);
+    }
+
+    mbedtls_platform_zeroize(chunk, sizeof(chunk));
+    mbedtls_platform_zeroize(line, capacity);
+    free(line);
+    if (!ok) {
+        // Lines before a chunk that failed to authenticate must not run either
+        mbedtls_platform_zeroize(code.data(), code.size());
+        code.clear();
+    }
+    return ok;
+}
+
+bool DuckyScriptHandler::executeScript(const String &filePath, const char *source) {
+    return submit(filePath.c_str(), filePath.length(), false, source);
+}
+
+bool DuckyScriptHandler::executeScript(const char *filePath, size_t len, const char *source) {
+    return submit(filePath, len, false, source);
+}
+
+bool DuckyScriptHandler::executeLine(const String &line, const char *source) {
+    return submit(line.c_str(), line.length(), true, source);
+}
+
+// Called from the web server, MQTT and button handlers as well as loop(), so
+// the run queue is only ever touched under runMux
+bool DuckyScriptHandler::submit(const char *text, size_t len, bool isLine, const char *source) {
+    if (len == 0 || len >= RUN_TEXT_SIZE) {
+        debugE("DuckyScript %s is empty or too long", isLine ? "line" : "path");
+        return false;
+    }
+
+    bool queued = false;
+    size_t pending = 0;
+    portENTER_CRITICAL(&runMux);
+    if (runCount < RUN_QUEUE_SIZE) {
+        RunRequest &request = runQueue[(runHead + runCount) % RUN_QUEUE_SIZE];
+        memcpy(request.text, text, len);
+        request.text[len] = '\0';
+        request.isLine = isLine;
+        request.source = source;
+        runCount++;
+        queued = true;
+    } else {
+        rejectedCount++;
+    }
+    pending = runCount;
+    portEXIT_CRITICAL(&runMux);
+
+    if (!queued) {
+        debugE("DuckyScript run queue full, dropping %.*s", (int)len, text);
+        return false;
     }
-    else if (CommandHandler::equalsIgnoreCase(command, "STRINGLN")) {
-        if (!args.isEmpty()) {
-            debugI("STRINGLN: %s", args.c_str());
-            DeviceHandler::sendKeys(args);
-            DeviceHandler::processKey("ENTER", true);
-            delay(10);
-            DeviceHandler::processKey("ENTER", false);
+    debugI("Queued DuckyScript %.*s from %s (%u pending)", isLine ? 4 : (int)len, isLine ? "line" : text, source, (unsigned)pending);
+    return true;
+}
+
+bool DuckyScriptHandler::takeNext(RunRequest &request) {
+    bool taken = false;
+    portENTER_CRITICAL(&runMux);
+    if (runCount > 0) {
+        request = runQueue[runHead];
+        runHead = (runHead + 1) % RUN_QUEUE_SIZE;
+        runCount--;
+        taken = true;
+    }
+    portEXIT_CRITICAL(&runMux);
+    return taken;
+}
+
+// Get the bytecode for a request into codeBuffer (or heapCode) and reset the
+// runtime to its first instruction. Only called once the HID queue is idle,
+// since queued STRING text may still point into the previous script.
+bool DuckyScriptHandler::load(const RunRequest &request) {
+    heapCode.clear();
+    code = nullptr;
+    codeSize = 0;
+
+    if (request.isLine) {
+        if (!DuckyScriptCompiler::compile(request.text, strlen(request.text), heapCode)) return false;
+        codeSize = heapCode.size();
+    } else {
+        String filePath(request.text);
+        debugI("Executing DuckyScript from: %s", filePath.c_str());
+        File file = LittleFS.open(filePath, "r");
+        if (!file) {
+            debugE("Failed to open file: %s", filePath.c_str());
+            return false;
+        }
+
+        if (SecureFile::isEncrypted(file)) {
+            bool compiled = compileEncrypted(file, filePath, heapCode);
+            file.close();
+            if (!compiled) return false;
+            codeSize = heapCode.size();
+            debugI("Compiled encrypted script to %u bytes of bytecode", (unsigned)codeSize);
         } else {
-            debugE("STRINGLN missing args");
+            uint32_t hash, size;
+            hashScript(file, hash, size);
+
+            if (readCache(filePath, hash, size, codeBuffer, CODE_BUFFER_SIZE, &heapCode, codeSize)) {
+                debugI("Running cached bytecode (%u bytes)", (unsigned)codeSize);
+            } else {
+                if (!compileSource(file, size, heapCode)) {
+                    file.close();
+                    return false;
+                }
+                writeCache(filePath, hash, size, heapCode);
+                codeSize = heapCode.size();
+                debugI("Compiled %u bytes of script to %u bytes of bytecode", (unsigned)size, (unsigned)codeSize);
+            }
+            file.close();
         }
     }
-    else if (CommandHandler::equalsIgnoreCase(command, "REPEAT")) {
-        int count = args.toInt();
-        if (count > 0 && !lastLine.isEmpty()) {
-            debugI("REPEAT %d times", count);
-            for (int i = 0; i < count; i++) {
-                processLine(lastLine);
+
+    if (!heapCode.empty() && codeSize <= CODE_BUFFER_SIZE) {
+        memcpy(codeBuffer, heapCode.data(), codeSize);
+        heapCode.clear();
+    }
+    code = heapCode.empty() ? codeBuffer : heapCode.data();
+
+    portENTER_CRITICAL(&runMux);
+    strcpy(currentPath, request.isLine ? "(line)" : request.text);
+    currentSource = request.source;
+    portEXIT_CRITICAL(&runMux);
+
+    pc = 0;
+    defaultDelay = 0;
+    pendingDelay = 0;
+    repeatDepth = 0;
+    instructionCount = 0;
+    startedAt = millis();
+    state = DUCKY_RUNNING;
+    return true;
+}
+
+void DuckyScriptHandler::loop() {
+    if (stopRequested.exchange(false) && state != DUCKY_IDLE) {
+        finish(stoppedCount, "stopped");
+    }
+
+    if (state == DUCKY_IDLE) {
+        if (!DeviceHandler::isIdle()) return;
+
+        RunRequest request;
+        if (takeNext(request)) {
+            if (!load(request)) {
+                failedCount++;
+                return;
             }
         } else {
-            debugE("Invalid REPEAT or no previous line");
+            // Nothing left typing out of it, give a large script's memory back
+            if (heapCode.capacity() > 0) std::vector<uint8_t>().swap(heapCode);
+            return;
         }
     }
-    else if (CommandHandler::equalsIgnoreCase(command, "COMMAND")) {
-        if (!args.isEmpty()) {
-            debugI("COMMAND: %s", args.c_str());
-            CommandHandler::handleCommand(args);
-        } else {
-            debugE("COMMAND missing args");
-        }
+
+    step(STEP_BUDGET);
+}
+
+// Park the script until the HID queue is ready again. Returns true if it can
+// go ahead now.
+bool DuckyScriptHandler::waitForHid(bool ready) {
+    if (ready) {
+        state = DUCKY_RUNNING;
+        return true;
     }
-    else {
-        // Handle modifiers or single keys
-        debugI("Key combo or single key: %s", line.c_str());
-        pressKeyCombo(line);
+    if (state != DUCKY_WAIT_HID) {
+        state = DUCKY_WAIT_HID;
+        waitingSince = millis();
+    } else if (millis() - waitingSince >= QUEUE_WAIT_MS) {
+        debugE("HID queue stalled, aborting script");
+        DeviceHandler::cancel();
+        finish(failedCount, "failed");
+    }
+    return false;
+}
+
+// Run up to budget instructions. Returns early whenever the script has to
+// wait, leaving pc on the instruction to retry.
+void DuckyScriptHandler::step(uint16_t budget) {
+    DuckyInstruction instruction;
+
+    while (budget-- > 0 && state != DUCKY_IDLE) {
+        if (state == DUCKY_SLEEPING) {
+            if ((int32_t)(millis() - wakeAt) < 0) return;
+            state = DUCKY_RUNNING;
+        }
+        if (state == DUCKY_WAIT_COMMAND) {
+            if (pendingCommand != 0) return;
+            state = DUCKY_RUNNING;
+        }
+
+        // Delays are measured from when the keystrokes before them have
+        // actually been sent, like the blocking interpreter did
+        if (pendingDelay > 0) {
+            if (!waitForHid(DeviceHandler::isIdle())) return;
+            wakeAt = millis() + pendingDelay;
+            pendingDelay = 0;
+            state = DUCKY_SLEEPING;
+            return;
+        }
+
+        if (repeatDepth > 0 && pc == repeats[repeatDepth - 1].end) {
+            RepeatFrame &frame = repeats[repeatDepth - 1];
+            if (--frame.remaining > 0) {
+                pc = frame.start;
+            } else {
+                pc = frame.returnPc;
+                repeatDepth--;
+                pendingDelay += defaultDelay;
+            }
+            continue;
+        }
+
+        size_t next = pc;
+        if (!DuckyScriptCompiler::decode(code, codeSize, next, instruction)) {
+            debugE("Invalid bytecode at offset %u", (unsigned)pc);
+            finish(failedCount, "failed");
+            return;
+        }
+
+        switch (instruction.op) {
+        case DUCKY_OP_END:
+            finish(completedCount, "completed");
+            return;
+
+        case DUCKY_OP_STRING:
+            if (!waitForHid(DeviceHandler::waitForSpace(LINE_QUEUE_ENTRIES, 0))) return;
+            // The bytecode stays put until the HID queue drains, so no copy.
+            // Another producer may have taken the room since; if so, retry
+            // this line until QUEUE_WAIT_MS rather than skip its text.
+            if (!waitForHid(DeviceHandler::typeTextRef((const char *)instruction.data, instruction.length) != 0)) return;
+            break;
+
+        case DUCKY_OP_COMBO: {
+            if (!waitForHid(DeviceHandler::waitForSpace(LINE_QUEUE_ENTRIES, 0))) return;
+            // Modifiers and up to six keys go out as a single report, then a release
+            KeyReport reports[2] = {{instruction.modifiers, 0, {0, 0, 0, 0, 0, 0}}, {0, 0, {0, 0, 0, 0, 0, 0}}};
+            memcpy(reports[0].keys, instruction.data, instruction.keyCount);
+            if (!waitForHid(DeviceHandler::sendReports(reports, 2) != 0)) return;
+            break;
+        }
+
+        case DUCKY_OP_DELAY:
+            pendingDelay += instruction.value;
+            break;
+
+        case DUCKY_OP_DEFAULT_DELAY:
+            defaultDelay = instruction.value;
+            pc = next;
+            continue;
+
+        case DUCKY_OP_REPEAT:
+            if (repeatDepth >= DuckyScriptCompiler::MAX_REPEAT_DEPTH) {
+                debugE("REPEAT nested too deep at offset %u", (unsigned)pc);
+                finish(failedCount, "failed");
+                return;
+            }
+            if (instruction.value > 0) {
+                repeats[repeatDepth++] = {(uint16_t)next, instruction.start, instruction.end, (uint16_t)instruction.value};
+                pc = instruction.start;
+                instructionCount++;
+                continue;
+            }
+            break;
+
+        case DUCKY_OP_COMMAND: {
+            // Keep the command in order with the keystrokes queued before it
+            if (!waitForHid(DeviceHandler::isIdle())) return;
+
+            // Run it on the command executor and pick up again once it is done.
+            // The ticket tells a late callback from an earlier script apart.
+            uint32_t ticket = ++commandTicket;
+            if (ticket == 0) ticket = ++commandTicket;
+            pendingCommand = ticket;
+            debugI("COMMAND: %.*s", (int)instruction.length, (const char *)instruction.data);
+            if (!CommandBus::submit((const char *)instruction.data, instruction.length, CMD_SOURCE_SCRIPT,
+                                    0, commandDone, (void *)(uintptr_t)ticket)) {
+                pendingCommand = 0;
+                return; // Bus full, try again on the next loop()
+            }
+            pc = next;
+            instructionCount++;
+            pendingDelay += defaultDelay;
+            state = DUCKY_WAIT_COMMAND;
+            return;
+        }
+        }
+
+        pc = next;
+        instructionCount++;
+        pendingDelay += defaultDelay;
     }
+}
 
-    if (defaultDelay > 0) delay(defaultDelay);
+void DuckyScriptHandler::commandDone(uint32_t correlationId, const CommandResult &result, void *ctx) {
+    uint32_t ticket = (uint32_t)(uintptr_t)ctx;
+    pendingCommand.compare_exchange_strong(ticket, 0);
+}
+
+void DuckyScriptHandler::finish(uint32_t &counter, const char *outcome) {
+    counter++;
+    state = DUCKY_IDLE;
+    pendingCommand = 0;
+    repeatDepth = 0;
+    pendingDelay = 0;
+    debugI("DuckyScript %s %s after %u instructions in %lu ms", currentPath, outcome,
+           (unsigned)instructionCount, (unsigned long)(millis() - startedAt));
+}
+
+void DuckyScriptHandler::stop() {
+    portENTER_CRITICAL(&runMux);
+    runCount = 0;
+    portEXIT_CRITICAL(&runMux);
 
-    lastLine = line;
+    // The runtime itself belongs to loop(); it stops at its next step
+    stopRequested = true;
+    DeviceHandler::cancel();
 }
 
-void DuckyScriptHandler::pressKeyCombo(const String &line) {
-    std::vector<String> tokens;
-    int start = 0, end = 0;
-    while ((end = line.indexOf(' ', start)) != -1) {
-        String token = line.substring(start, end);
-        token.trim();
-        if (!token.isEmpty()) tokens.push_back(token);
-        start = end + 1;
+const char *DuckyScriptHandler::stateName(DuckyRunState state) {
+    switch (state) {
+    case DUCKY_RUNNING: return "running";
+    case DUCKY_WAIT_HID: return "waiting";
+    case DUCKY_SLEEPING: return "sleeping";
+    case DUCKY_WAIT_COMMAND: return "command";
+    default: return "idle";
     }
-    if (start < line.length()) {
-        String token = line.substring(start);
-        token.trim();
-        if (!token.isEmpty()) tokens.push_back(token);
+}
+
+DuckyStatus DuckyScriptHandler::getStatus() {
+    DuckyStatus status;
+    char path[RUN_TEXT_SIZE];
+
+    portENTER_CRITICAL(&runMux);
+    status.state = state;
+    memcpy(path, currentPath, sizeof(path));
+    status.source = currentSource;
+    status.pending = runCount;
+    status.rejected = rejectedCount;
+    portEXIT_CRITICAL(&runMux);
+
+    bool active = status.state != DUCKY_IDLE;
+    uint32_t now = millis();
+    status.path = active ? path : "";
+    if (!active) status.source = "";
+    status.pc = active ? pc : 0;
+    status.codeSize = active ? codeSize : 0;
+    status.instructions = active ? instructionCount : 0;
+    status.elapsedMs = active ? now - startedAt : 0;
+    status.sleepRemainingMs = status.state == DUCKY_SLEEPING && (int32_t)(wakeAt - now) > 0 ? wakeAt - now : 0;
+    status.completed = completedCount;
+    status.failed = failedCount;
+    status.stopped = stoppedCount;
+    return status;
+}
+
+void DuckyScriptHandler::statusToJson(const DuckyStatus &status, JsonDocument &doc) {
+    doc["state"]        = stateName(status.state);
+    doc["path"]         = status.path;
+    doc["source"]       = status.source;
+    doc["offset"]       = status.pc;
+    doc["codeSize"]     = status.codeSize;
+    doc["progress"]     = status.codeSize ? status.pc * 100 / status.codeSize : 0;
+    doc["instructions"] = status.instructions;
+    doc["elapsedMs"]    = status.elapsedMs;
+    doc["sleepMs"]      = status.sleepRemainingMs;
+    doc["pending"]      = status.pending;
+    doc["completed"]    = status.completed;
+    doc["failed"]       = status.failed;
+    doc["stopped"]      = status.stopped;
+    doc["rejected"]     = status.rejected;
+}
+
+// Compare the cost of compiling from source (what every run used to pay)
+// against loading cached bytecode and walking it
+void DuckyScriptHandler::benchmark(const String &filePath, int iterations, CommandResult &result) {
+    File file = LittleFS.open(filePath, "r");
+    if (!file) {
+        result.fail(CMD_STATUS_NOT_FOUND, "Failed to open file: %s", filePath.c_str());
+        return;
     }
 
-    std::vector<String> pressedKeys;
-    for (const String &token : tokens) {
-        std::string key = token.c_str();
-        uint8_t keyCode = KeyMappings::getKeyCode(key);
-        if (keyCode != 0) {
-            debugI("Pressing: %s", key.c_str());
-            DeviceHandler::processKey(token, true);
-            pressedKeys.push_back(token);
-        } else {
-            debugW("Unknown key: %s", key.c_str());
-        }
+    uint32_t hash, size;
+    hashScript(file, hash, size);
+
+    std::vector<uint8_t> code;
+    uint32_t start = micros();
+    for (int i = 0; i < iterations; i++) {
+        compileSource(file, size, code);
     }
+    uint32_t compileUs = (micros() - start) / iterations;
+    writeCache(filePath, hash, size, code);
 
-    delay(10); // Debounce
+    std::vector<uint8_t> cached;
+    size_t codeSize = 0;
+    start = micros();
+    for (int i = 0; i < iterations; i++) {
+        hashScript(file, hash, size);
+        readCache(filePath, hash, size, nullptr, 0, &cached, codeSize);
+    }
+    uint32_t loadUs = (micros() - start) / iterations;
+    file.close();
 
-    for (const String &key : pressedKeys) {
-        debugI("Releasing: %s", key.c_str());
-        DeviceHandler::processKey(key, false);
+    DuckyInstruction instruction;
+    size_t instructions = 0;
+    start = micros();
+    for (int i = 0; i < iterations; i++) {
+        size_t pc = 0;
+        instructions = 0;
+        while (DuckyScriptCompiler::decode(code.data(), code.size(), pc, instruction) && instruction.op != DUCKY_OP_END) {
+            instructions++;
+        }
     }
+    uint32_t decodeUs = (micros() - start) / iterations;
+
+    result.printf("DUCKY BENCH %s: %u source bytes -> %u bytecode bytes, %u instructions\n",
+           filePath.c_str(), (unsigned)size, (unsigned)code.size(), (unsigned)instructions);
+    result.printf("  read+compile: %lu us, hash+load cache: %lu us, decode: %lu us (avg of %d)",
+           (unsigned long)compileUs, (unsigned long)loadUs, (unsigned long)decodeUs, iterations);
 }
 
 void DuckyScriptHandler::registerCommands() {
-    CommandHandler::registerCommand("DUCKY", [](const String &command) {
-        debugI("DUCKY command: %s", command.c_str());
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
-        if (CommandHandler::equalsIgnoreCase(cmd, "FILE")) {
-            if (args.isEmpty()) {
-                debugE("Missing file path for DUCKY FILE");
+    CommandHandler::registerCommand("DUCKY", [](const CommandArgs &args, CommandResult &result) {
+        const CommandToken &cmd = args[0];
+        CommandToken rest = args.rest(1);
+        if (cmd.equals("FILE") || cmd.equals("LINE")) {
+            bool isLine = cmd.equals("LINE");
+            if (rest.isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Missing %s for DUCKY %s", isLine ? "line" : "file path", isLine ? "LINE" : "FILE");
+                return;
+            }
+            if (submit(rest.data, rest.length, isLine, "command")) {
+                result.setStatus(CMD_STATUS_ACCEPTED);
+                result.printf("DuckyScript queued");
+            } else {
+                result.fail(CMD_STATUS_BUSY, "DuckyScript run queue full or entry too long");
+            }
+        } else if (cmd.equals("STOP")) {
+            stop();
+            result.printf("DuckyScript stopped");
+        } else if (cmd.equals("STATUS")) {
+            JsonDocument doc;
+            statusToJson(getStatus(), doc);
+            result.json(doc);
+        } else if (cmd.equals("BENCH")) {
+            if (args[1].isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Missing file path for DUCKY BENCH");
                 return;
             }
-            executeScript(args);
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "LINE")) {
-            processLine(args);
+            long iterations = args[2].toInt();
+            benchmark(args[1].toString(), iterations > 0 ? iterations : 20, result);
         } else {
-            debugW("Unknown DUCKY subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown DUCKY subcommand: %.*s", (int)cmd.length, cmd.data);
         }
     }, "Usage: DUCKY FILE <file_path>\n"
-       "  FILE <file_path> - Executes DuckyScript from file\n"
-       "  LINE <line> - Processes a single DuckyScript line");
+       "  FILE <file_path> - Queues DuckyScript from file (bytecode is cached as <file_path>.dbc)\n"
+       "  LINE <line> - Queues a single DuckyScript line\n"
+       "  STATUS - Shows the running script, its progress and the run queue\n"
+       "  STOP - Stops the running script and clears the run queue\n"
+       "  BENCH <file_path> [iterations] - Times compiling vs loading the cached bytecode");
 }
 
-#endif
\ No newline at end of file
+#endif
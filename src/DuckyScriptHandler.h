@@ -3,17 +3,123 @@
 #ifdef ENABLE_DUCKYSCRIPT_HANDLER
 
 #include "Globals.h"
+#include "DuckyScriptCompiler.h"
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <atomic>
 
+enum DuckyRunState : uint8_t {
+    DUCKY_IDLE,     // Nothing running
+    DUCKY_RUNNING,  // Stepping instructions
+    DUCKY_WAIT_HID, // Waiting for room in (or an empty) HID queue
+    DUCKY_SLEEPING, // In a DELAY, wakes at wakeAt
+    DUCKY_WAIT_COMMAND // A COMMAND line is running on the command bus
+};
+
+// Snapshot of the runtime for DUCKY STATUS and /ducky/status
+struct DuckyStatus {
+    DuckyRunState state;
+    String path;
+    const char *source;   // Who submitted the running script
+    size_t pc;
+    size_t codeSize;
+    uint32_t instructions;
+    uint32_t elapsedMs;
+    uint32_t sleepRemainingMs;
+    size_t pending;       // Scripts waiting in the run queue
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t stopped;
+    uint32_t rejected;    // Run queue was full
+};
+
+// Scripts are queued and stepped from loop() a few instructions at a time.
+// DELAY only sets a wake-up deadline, so a long script never holds up the
+// web server, MQTT or buttons.
 class DuckyScriptHandler
 {
 private:
-    static void processLine(const String &line);
+    static const size_t CODE_BUFFER_SIZE = 4096;
+    static const size_t RUN_QUEUE_SIZE = 8;
+    static const size_t RUN_TEXT_SIZE = 128;
+
+    // Pending script path, or a single line for DUCKY LINE
+    struct RunRequest {
+        char text[RUN_TEXT_SIZE];
+        bool isLine;
+        const char *source;
+    };
+
+    // Active REPEAT: run [start, end) remaining more times, then go to returnPc
+    struct RepeatFrame {
+        uint16_t returnPc;
+        uint16_t start;
+        uint16_t end;
+        uint16_t remaining;
+    };
+
+    // Bytecode of the running script; STRING text is typed straight out of
+    // it, so neither is touched again until the HID queue has drained
+    static uint8_t codeBuffer[CODE_BUFFER_SIZE];
+    static std::vector<uint8_t> heapCode; // Used instead when the script does not fit
+
+    static RunRequest runQueue[RUN_QUEUE_SIZE];
+    static size_t runHead;
+    static size_t runCount;
+    static portMUX_TYPE runMux; // Guards the run queue and currentPath/currentSource
+    static std::atomic<bool> stopRequested;
+    static std::atomic<uint32_t> pendingCommand; // Ticket of the COMMAND on the bus, 0 once done
+    static uint32_t commandTicket;
+
+    static DuckyRunState state;
+    static char currentPath[RUN_TEXT_SIZE];
+    static const char *currentSource;
+    static const uint8_t *code;
+    static size_t codeSize;
+    static size_t pc;
+    static uint32_t defaultDelay;
+    static uint32_t pendingDelay;
+    static uint32_t wakeAt;
+    static uint32_t waitingSince; // When the script started waiting on the HID queue
+    static RepeatFrame repeats[DuckyScriptCompiler::MAX_REPEAT_DEPTH];
+    static uint8_t repeatDepth;
+    static uint32_t startedAt;
+    static uint32_t instructionCount;
+    static uint32_t completedCount;
+    static uint32_t failedCount;
+    static uint32_t stoppedCount;
+    static uint32_t rejectedCount;
+
     static void registerCommands();
-    static void pressKeyCombo(const String &line);
+    static void hashScript(File &file, uint32_t &hash, uint32_t &size);
+    static bool readCache(const String &filePath, uint32_t hash, uint32_t size, uint8_t *dest, size_t capacity, std::vector<uint8_t> *heapDest, size_t &codeSize);
+    static void writeCache(const String &filePath, uint32_t hash, uint32_t size, const std::vector<uint8_t> &code);
+    static bool compileSource(File &file, uint32_t size, std::vector<uint8_t> &code);
+    static bool compileEncrypted(File &file, const String &filePath, std::vector<uint8_t> &code);
+    static bool submit(const char *text, size_t len, bool isLine, const char *source);
+    static bool takeNext(RunRequest &request);
+    static bool load(const RunRequest &request);
+    static void step(uint16_t budget);
+    static bool waitForHid(bool ready);
+    static void finish(uint32_t &counter, const char *outcome);
+    static void commandDone(uint32_t correlationId, const CommandResult &result, void *ctx);
+    static void benchmark(const String &filePath, int iterations, CommandResult &result);
 
 public:
     static void init();
-    static void executeScript(const String &filePath);
+    static void loop();
+
+    // Queue a script to run; returns false if the run queue is full
+    static bool executeScript(const String &filePath, const char *source = "command");
+    static bool executeScript(const char *filePath, size_t len, const char *source);
+    static bool executeLine(const String &line, const char *source = "command");
+
+    // Stop the running script, drop queued ones and cancel pending HID output
+    static void stop();
+    static DuckyStatus getStatus();
+    static const char *stateName(DuckyRunState state);
+    static void statusToJson(const DuckyStatus &status, JsonDocument &doc);
 };
 
 #else
@@ -22,7 +128,11 @@ class DuckyScriptHandler
 {
 public:
     static void init() {} // No-op
-    static void executeScript(const String &filePath) {} // No-op
+    static void loop() {} // No-op
+    static bool executeScript(const String &filePath, const char *source = "command") { return false; } // No-op
+    static bool executeScript(const char *filePath, size_t len, const char *source) { return false; } // No-op
+    static bool executeLine(const String &line, const char *source = "command") { return false; } // No-op
+    static void stop() {} // No-op
 };
 
 #endif // ENABLE_DUCKYSCRIPT_HANDLER
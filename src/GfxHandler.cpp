@@ -109,20 +109,22 @@ void GfxHandler::drawImage(int x, int y, int width, int height, const char *data
 
 void GfxHandler::registerCommands()
 {
-    CommandHandler::registerCommand("tft", [](const String &command){
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
+    CommandHandler::registerCommand("tft", [](const CommandArgs &commandArgs, CommandResult &result){
+        String cmd = commandArgs[0].toString();
+        String args = commandArgs.rest(1).toString();
 
         if (cmd == "print") {
             printMessage(args.c_str());
+            result.printf("Printed to TFT");
         }
 
-        if (cmd == "identify") {
+        else if (cmd == "identify") {
             // Print device name
             printMessage(settings.device.name.c_str());
             
             // Reboot due to heap stack overflow !!!!!!!!!!!!!
             LedHandler::setColorByName("blue");
+            result.printf("Device: %s", settings.device.name.c_str());
             //delay(30000);
             //LedHandler::setColorByName("black");
         }
@@ -130,6 +132,7 @@ void GfxHandler::registerCommands()
         else if (cmd == "clock") {
             bool state = args.equalsIgnoreCase("true");
             toggleClock(state);
+            result.printf("Clock %s", state ? "shown" : "hidden");
         }
 
         else if (cmd == "draw"){
@@ -143,8 +146,7 @@ void GfxHandler::registerCommands()
 
             // Ensure at least three commas exist (imageName, x, y, width, height)
             if (firstComma == -1 || secondComma == -1 || thirdComma == -1) {
-                debugI("Error: Invalid arguments for draw command.");
-                debugI("Received args: %s", args.c_str());
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid arguments for draw command: %s", args.c_str());
                 return;
             }
 
@@ -157,7 +159,7 @@ void GfxHandler::registerCommands()
 
             // Validate width and height
             if (width <= 0 || height <= 0) {
-                debugI("Error: Invalid width or height.");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid width or height.");
                 return;
             }
 
@@ -181,13 +183,14 @@ void GfxHandler::registerCommands()
                 drawImage(x, y, width, height, image_wifi_off);
             }
             else {
-                debugI("Error: Unknown image name: %s", imageName.c_str());
+                result.fail(CMD_STATUS_NOT_FOUND, "Unknown image name: %s", imageName.c_str());
                 return;
             }
+            result.printf("Drew %s", imageName.c_str());
         }
 
         else {
-            debugW("Unknown tft subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown tft subcommand: %s", cmd.c_str());
         } }, "Handles tft commands. Usage: led <subcommand> [args]\n"
                                          "  Subcommands:\n"
                                          "  print <print> - Print a message to TFT screen\n"
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+// Heap counters for the benchmarks; only a difference between two readings
+// means anything
+class HeapStats
+{
+public:
+    // Blocks allocated right now, so a difference is what a piece of code
+    // kept, not what it allocated and freed again
+    static size_t allocatedBlocks()
+    {
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+        return info.allocated_blocks;
+    }
+
+    // malloc, calloc and realloc calls so far. Only the native env counts
+    // them (NATIVE_COUNT_ALLOCATIONS); elsewhere this returns false.
+    static bool allocations(size_t &count)
+    {
+#ifdef NATIVE_COUNT_ALLOCATIONS
+        count = heap_caps_native_allocations();
+        return true;
+#else
+        count = 0;
+        return false;
+#endif
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Bounded single-producer/single-consumer ring buffer.
+ *
+ * push() and pop() never block or allocate. Each index is only written by
+ * one side, so one producer and one consumer can run on different cores
+ * without a lock. Callers with several producers must serialize push()
+ * among themselves (DeviceHandler uses a spinlock for that).
+ *
+ * @tparam T Trivially copyable entry type.
+ * @tparam N Capacity, must be a power of two.
+ */
+template <typename T, size_t N>
+class HidReportRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "HidReportRing capacity must be a power of two");
+
+private:
+    T buffer[N];
+    std::atomic<size_t> head{0}; // Next slot to write, owned by the producer
+    std::atomic<size_t> tail{0}; // Next slot to read, owned by the consumer
+
+public:
+    /**
+     * Appends an entry.
+     * @return false if the ring is full.
+     */
+    bool push(const T &entry)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+        buffer[h & (N - 1)] = entry;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Removes the oldest entry.
+     * @return false if the ring is empty.
+     */
+    bool pop(T &entry)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        entry = buffer[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Number of queued entries. Exact for the producer and consumer, a
+     * snapshot for anyone else.
+     */
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t available() const { return N - size(); }
+
+    static constexpr size_t capacity() { return N; }
+};
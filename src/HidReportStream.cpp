@@ -0,0 +1,44 @@
+#include "HidReportStream.h"
+#include "KeyMappings.h"
+
+void HidReportStream::reset() {
+    heldModifiers = 0;
+    heldKey = 0;
+}
+
+size_t HidReportStream::compile(const char *text, size_t len, HidKeyStroke *out, size_t capacity, size_t &produced) {
+    produced = 0;
+    size_t consumed = 0;
+
+    while (consumed < len && capacity - produced >= MAX_STROKES_PER_CHAR) {
+        const KeyMappings::AsciiKey &key = KeyMappings::getAsciiKey(text[consumed++]);
+        if (key.keyCode == 0) {
+            continue;
+        }
+
+        if (key.modifiers != heldModifiers) {
+            // Modifier-only report; also releases the held key
+            out[produced++] = {key.modifiers, 0};
+            heldModifiers = key.modifiers;
+            heldKey = 0;
+        } else if (key.keyCode == heldKey) {
+            // The host only sees a second press of the same key after a release
+            out[produced++] = {heldModifiers, 0};
+            heldKey = 0;
+        }
+
+        out[produced++] = {heldModifiers, key.keyCode};
+        heldKey = key.keyCode;
+    }
+
+    return consumed;
+}
+
+size_t HidReportStream::finish(HidKeyStroke *out, size_t capacity) {
+    if ((heldKey == 0 && heldModifiers == 0) || capacity == 0) {
+        return 0;
+    }
+    out[0] = {0, 0};
+    reset();
+    return 1;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One keyboard report holding at most one non-modifier key
+struct HidKeyStroke {
+    uint8_t modifiers;
+    uint8_t keyCode;
+};
+
+// Compiles ASCII text into the minimal sequence of keyboard reports needed to
+// type it. A key is only released before the next character when that
+// character reuses the same key; otherwise the next report replaces it
+// directly. Modifier changes get their own report so the host never sees a
+// key and a modifier transition in the same frame.
+//
+// The stream keeps the currently held key between calls, so text can be
+// compiled in chunks (e.g. while reading a file) without breaking the rules
+// above at chunk boundaries.
+class HidReportStream
+{
+public:
+    // Worst case number of reports one character compiles to
+    static const size_t MAX_STROKES_PER_CHAR = 2;
+
+    HidReportStream() { reset(); }
+
+    // Forget the held key; call when the keyboard state was changed elsewhere
+    void reset();
+
+    // Compile as much of text as fits into out. Returns the number of input
+    // characters consumed and sets produced to the number of reports written.
+    // Characters without a key (CR, non-ASCII) are consumed and skipped.
+    size_t compile(const char *text, size_t len, HidKeyStroke *out, size_t capacity, size_t &produced);
+
+    // Write the final all-keys-up report if anything is held. Returns the
+    // number of reports written (0 or 1).
+    size_t finish(HidKeyStroke *out, size_t capacity);
+
+private:
+    uint8_t heldModifiers;
+    uint8_t heldKey;
+};
@@ -44,87 +44,84 @@ void JiggleHandler::loop()
 void JiggleHandler::performJiggle()
 {
     // Move the mouse slightly in a square pattern based on jiggleAmount
+    // Queued on the HID task, so loop() is not held up by the pauses
     DeviceHandler::sendMouseMovement(jiggleAmount, -jiggleAmount);
-    delay(50);
+    DeviceHandler::queueDelay(50);
     DeviceHandler::sendMouseMovement(-jiggleAmount, jiggleAmount);
-    delay(50);
     debugI("Mouse jiggled with amount: %d.", jiggleAmount);
 }
 
 void JiggleHandler::registerCommands()
 {
-    CommandHandler::registerCommand("jiggle", [](const String &command)
+    CommandHandler::registerCommand("jiggle", [](const CommandArgs &args, CommandResult &result)
                                     {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
+        const CommandToken &cmd = args[0];
+        const CommandToken &value = args[1];
 
-        if (CommandHandler::equalsIgnoreCase(cmd, "true"))
+        if (cmd.equals("true"))
         {
             jiggleEnabled = true;
-            debugI("Mouse jiggle enabled.");
+            result.printf("Mouse jiggle enabled.");
         }
-        else if (CommandHandler::equalsIgnoreCase(cmd, "false"))
+        else if (cmd.equals("false"))
         {
             jiggleEnabled = false;
-            debugI("Mouse jiggle disabled.");
+            result.printf("Mouse jiggle disabled.");
         }
-        else if (CommandHandler::equalsIgnoreCase(cmd, "time"))
+        else if (cmd.equals("time"))
         {
-            int interval = args.toInt();
+            int interval = value.toInt();
             if (interval > 0)
             {
                 jiggleInterval = interval;
                 jiggleTimer.setInterval(jiggleInterval);
-                debugI("Mouse jiggle interval set to %d ms.", jiggleInterval);
+                result.printf("Mouse jiggle interval set to %d ms.", jiggleInterval);
             }
             else
             {
-                debugW("Invalid interval: %s", args.c_str());
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid interval: %.*s", (int)value.length, value.data);
             }
         }
-        else if (CommandHandler::equalsIgnoreCase(cmd, "amount"))
+        else if (cmd.equals("amount"))
         {
-            int amount = args.toInt();
+            int amount = value.toInt();
             if (amount > 0)
             {
                 jiggleAmount = amount;
-                debugI("Mouse jiggle amount set to %d.", jiggleAmount);
+                result.printf("Mouse jiggle amount set to %d.", jiggleAmount);
             }
             else
             {
-                debugW("Invalid amount: %s", args.c_str());
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid amount: %.*s", (int)value.length, value.data);
             }
         }
-        else if (CommandHandler::equalsIgnoreCase(cmd, "countdown"))
+        else if (cmd.equals("countdown"))
         {
-            if (CommandHandler::equalsIgnoreCase(args, "true"))
+            if (value.equals("true"))
             {
                 showCountdown = true;
-                debugI("Countdown display enabled.");
+                result.printf("Countdown display enabled.");
             }
-            else if (CommandHandler::equalsIgnoreCase(args, "false"))
+            else if (value.equals("false"))
             {
                 showCountdown = false;
-                debugI("Countdown display disabled.");
+                result.printf("Countdown display disabled.");
             }
             else
             {
-                debugW("Invalid argument for countdown: %s", args.c_str());
+                result.fail(CMD_STATUS_BAD_REQUEST, "Invalid argument for countdown: %.*s", (int)value.length, value.data);
             }
         }
-        else if (CommandHandler::equalsIgnoreCase(cmd, "state"))
+        else if (cmd.equals("state"))
         {
-            String stateMessage = String("Jiggle State:\n") +
-                                  "  Enabled: " + (jiggleEnabled ? "true" : "false") + "\n" +
-                                  "  Interval: " + jiggleInterval + " ms\n" +
-                                  "  Amount: " + jiggleAmount + " pixels\n" +
-                                  "  Countdown: " + (showCountdown ? "true" : "false");
-            debugI("%s", stateMessage.c_str());
+            result.printf("Jiggle State:\n  Enabled: %s\n  Interval: %d ms\n  Amount: %d pixels\n  Countdown: %s",
+                          jiggleEnabled ? "true" : "false", jiggleInterval, jiggleAmount,
+                          showCountdown ? "true" : "false");
             //GfxHandler::printMessage(stateMessage);
         }
         else
         {
-            debugW("Unknown jiggle subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown jiggle subcommand: %.*s", (int)cmd.length, cmd.data);
         } }, "Handles JIGGLE commands. Usage: JIGGLE <subcommand> [args]\n"
              "  Subcommands:\n"
              "  true - Enables mouse jiggle\n"
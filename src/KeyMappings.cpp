@@ -89,6 +89,46 @@ const std::map<std::string, uint8_t> keyMap = {
     {"KP_ENTER", HID_KEY_KEYPAD_ENTER}
 };
 
+// ASCII to key table used by the report-level typing engine.
+// Control characters other than BS, TAB, LF, ESC and DEL have no key (CR is
+// dropped so CRLF text types a single ENTER).
+#define SHIFT KEYBOARD_MODIFIER_LEFTSHIFT
+const AsciiKey asciiMap[128] = {
+    {0, 0},                      {0, 0},                      {0, 0},                      {0, 0}, // 0x00 0x01 0x02 0x03
+    {0, 0},                      {0, 0},                      {0, 0},                      {0, 0}, // 0x04 0x05 0x06 0x07
+    {HID_KEY_BACKSPACE, 0},      {HID_KEY_TAB, 0},            {HID_KEY_ENTER, 0},          {0, 0}, // BS TAB LF 0x0B
+    {0, 0},                      {0, 0},                      {0, 0},                      {0, 0}, // 0x0C 0x0D 0x0E 0x0F
+    {0, 0},                      {0, 0},                      {0, 0},                      {0, 0}, // 0x10 0x11 0x12 0x13
+    {0, 0},                      {0, 0},                      {0, 0},                      {0, 0}, // 0x14 0x15 0x16 0x17
+    {0, 0},                      {0, 0},                      {0, 0},                      {HID_KEY_ESCAPE, 0}, // 0x18 0x19 0x1A ESC
+    {0, 0},                      {0, 0},                      {0, 0},                      {0, 0}, // 0x1C 0x1D 0x1E 0x1F
+    {HID_KEY_SPACE, 0},          {HID_KEY_1, SHIFT},          {HID_KEY_APOSTROPHE, SHIFT}, {HID_KEY_3, SHIFT}, // space '!' '"' '#'
+    {HID_KEY_4, SHIFT},          {HID_KEY_5, SHIFT},          {HID_KEY_7, SHIFT},          {HID_KEY_APOSTROPHE, 0}, // '$' '%' '&' '\''
+    {HID_KEY_9, SHIFT},          {HID_KEY_0, SHIFT},          {HID_KEY_8, SHIFT},          {HID_KEY_EQUAL, SHIFT}, // '(' ')' '*' '+'
+    {HID_KEY_COMMA, 0},          {HID_KEY_MINUS, 0},          {HID_KEY_PERIOD, 0},         {HID_KEY_SLASH, 0}, // ',' '-' '.' '/'
+    {HID_KEY_0, 0},              {HID_KEY_1, 0},              {HID_KEY_2, 0},              {HID_KEY_3, 0}, // '0' '1' '2' '3'
+    {HID_KEY_4, 0},              {HID_KEY_5, 0},              {HID_KEY_6, 0},              {HID_KEY_7, 0}, // '4' '5' '6' '7'
+    {HID_KEY_8, 0},              {HID_KEY_9, 0},              {HID_KEY_SEMICOLON, SHIFT},  {HID_KEY_SEMICOLON, 0}, // '8' '9' ':' ';'
+    {HID_KEY_COMMA, SHIFT},      {HID_KEY_EQUAL, 0},          {HID_KEY_PERIOD, SHIFT},     {HID_KEY_SLASH, SHIFT}, // '<' '=' '>' '?'
+    {HID_KEY_2, SHIFT},          {HID_KEY_A, SHIFT},          {HID_KEY_B, SHIFT},          {HID_KEY_C, SHIFT}, // '@' 'A' 'B' 'C'
+    {HID_KEY_D, SHIFT},          {HID_KEY_E, SHIFT},          {HID_KEY_F, SHIFT},          {HID_KEY_G, SHIFT}, // 'D' 'E' 'F' 'G'
+    {HID_KEY_H, SHIFT},          {HID_KEY_I, SHIFT},          {HID_KEY_J, SHIFT},          {HID_KEY_K, SHIFT}, // 'H' 'I' 'J' 'K'
+    {HID_KEY_L, SHIFT},          {HID_KEY_M, SHIFT},          {HID_KEY_N, SHIFT},          {HID_KEY_O, SHIFT}, // 'L' 'M' 'N' 'O'
+    {HID_KEY_P, SHIFT},          {HID_KEY_Q, SHIFT},          {HID_KEY_R, SHIFT},          {HID_KEY_S, SHIFT}, // 'P' 'Q' 'R' 'S'
+    {HID_KEY_T, SHIFT},          {HID_KEY_U, SHIFT},          {HID_KEY_V, SHIFT},          {HID_KEY_W, SHIFT}, // 'T' 'U' 'V' 'W'
+    {HID_KEY_X, SHIFT},          {HID_KEY_Y, SHIFT},          {HID_KEY_Z, SHIFT},          {HID_KEY_BRACKET_LEFT, 0}, // 'X' 'Y' 'Z' '['
+    {HID_KEY_BACKSLASH, 0},      {HID_KEY_BRACKET_RIGHT, 0},  {HID_KEY_6, SHIFT},          {HID_KEY_MINUS, SHIFT}, // '\\' ']' '^' '_'
+    {HID_KEY_GRAVE, 0},          {HID_KEY_A, 0},              {HID_KEY_B, 0},              {HID_KEY_C, 0}, // '`' 'a' 'b' 'c'
+    {HID_KEY_D, 0},              {HID_KEY_E, 0},              {HID_KEY_F, 0},              {HID_KEY_G, 0}, // 'd' 'e' 'f' 'g'
+    {HID_KEY_H, 0},              {HID_KEY_I, 0},              {HID_KEY_J, 0},              {HID_KEY_K, 0}, // 'h' 'i' 'j' 'k'
+    {HID_KEY_L, 0},              {HID_KEY_M, 0},              {HID_KEY_N, 0},              {HID_KEY_O, 0}, // 'l' 'm' 'n' 'o'
+    {HID_KEY_P, 0},              {HID_KEY_Q, 0},              {HID_KEY_R, 0},              {HID_KEY_S, 0}, // 'p' 'q' 'r' 's'
+    {HID_KEY_T, 0},              {HID_KEY_U, 0},              {HID_KEY_V, 0},              {HID_KEY_W, 0}, // 't' 'u' 'v' 'w'
+    {HID_KEY_X, 0},              {HID_KEY_Y, 0},              {HID_KEY_Z, 0},              {HID_KEY_BRACKET_LEFT, SHIFT}, // 'x' 'y' 'z' '{'
+    {HID_KEY_BACKSLASH, SHIFT},  {HID_KEY_BRACKET_RIGHT, SHIFT}, {HID_KEY_GRAVE, SHIFT},      {HID_KEY_DELETE, 0}, // '|' '}' '~' DEL
+};
+#undef SHIFT
+
 // Optional mouse button mappings
 const std::map<std::string, uint8_t> mouseButtonMap = {
     {"LEFT", 1}, {"RIGHT", 2}, {"MIDDLE", 4} // HID mouse button bits
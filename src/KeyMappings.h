@@ -3,17 +3,32 @@
 
 #include <map>
 #include <string>
+#include <stdint.h>
 
 namespace KeyMappings {
 // Map for friendly command names to HID key codes
 extern const std::map<std::string, uint8_t> keyMap;
 
+// HID usage and modifier bits needed to type one ASCII character
+struct AsciiKey {
+    uint8_t keyCode;   // HID usage, 0 when the character cannot be typed
+    uint8_t modifiers; // KEYBOARD_MODIFIER_* bits held with the key
+};
+
+// US layout lookup table indexed by 7-bit ASCII code
+extern const AsciiKey asciiMap[128];
+
 // Map for mouse buttons (optional)
 extern const std::map<std::string, uint8_t> mouseButtonMap;
 
 // Utility function to get HID key code by name
 uint8_t getKeyCode(const std::string& keyName);
 
+// Get the key for an ASCII character, {0, 0} for anything outside the table
+inline const AsciiKey& getAsciiKey(char c) {
+    return asciiMap[(uint8_t)c < 128 ? (uint8_t)c : 0];
+}
+
 // Utility function to get mouse button code by name
 uint8_t getMouseButtonCode(const std::string& buttonName);
 } // namespace KeyMappings
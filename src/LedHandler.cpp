@@ -54,18 +54,22 @@ void LedHandler::setColorByName(const String &colorName, uint8_t brightness) {
 
 // Register LED-related commands
 void LedHandler::registerCommands() {
-  CommandHandler::registerCommand("led",[](const String &command) {String cmd, args;
-      CommandHandler::parseCommand(command, cmd, args);
+  CommandHandler::registerCommand("led",[](const CommandArgs &args, CommandResult &result) {
+      const CommandToken &cmd = args[0];
 
-      if (cmd == "color") {
-        setColorByName(args.c_str(), defaultBrightness);
-      } else if (cmd == "clear") {
+      if (cmd.equals("color")) {
+        String color = args.rest(1).toString();
+        setColorByName(color, defaultBrightness);
+        result.printf("LED color set to %s", color.c_str());
+      } else if (cmd.equals("clear")) {
         clear();
-      } else if (cmd == "brightness") {
-        uint8_t brightness = static_cast<uint8_t>(args.toInt());
+        result.printf("LEDs cleared");
+      } else if (cmd.equals("brightness")) {
+        uint8_t brightness = static_cast<uint8_t>(args[1].toInt());
         setDefaultBrightness(brightness);
+        result.printf("LED brightness set to %u", brightness);
       } else {
-        debugW("Unknown led subcommand: %s", cmd.c_str());
+        result.fail(CMD_STATUS_BAD_REQUEST, "Unknown led subcommand: %.*s", (int)cmd.length, cmd.data);
       }
     },
     "Handles LED commands. Usage: led <subcommand> [args]\n"
@@ -3,6 +3,8 @@
 #include "LittleFsHandler.h"
 #include "Globals.h"
 #include "CommandHandler.h"
+#include "SecureFile.h"
+#include "mbedtls/platform_util.h"
 #include <LittleFS.h>
 
 void LittleFsHandler::init()
@@ -32,6 +34,7 @@ bool LittleFsHandler::writeFile(const String &path, const String &content, bool
     }
     file.print(content);
     file.close();
+    ConfigManager::fileChanged(path.c_str());
     return true;
 }
 
@@ -55,6 +58,7 @@ String LittleFsHandler::readFile(const String &path)
 
 bool LittleFsHandler::deleteFile(const String &path)
 {
+    ConfigManager::fileChanged(path.c_str());
     return LittleFS.remove(path);
 }
 
@@ -67,6 +71,7 @@ bool LittleFsHandler::deleteAllFiles()
         return false;
     }
 
+    ConfigManager::fileChanged(nullptr);
     File file = root.openNextFile();
     while (file)
     {
@@ -84,6 +89,7 @@ bool LittleFsHandler::createFolder(const String &path)
 
 bool LittleFsHandler::deleteRecursive(const String &path)
 {
+    ConfigManager::fileChanged(nullptr);
     File dir = LittleFS.open(path);
     if (!dir.isDirectory())
     {
@@ -103,108 +109,139 @@ bool LittleFsHandler::deleteRecursive(const String &path)
     return LittleFS.rmdir(path);
 }
 
-void LittleFsHandler::listFiles()
+void LittleFsHandler::listFiles(CommandResult &result)
 {
-    debugI("Listing all files in LittleFS:");
     File root = LittleFS.open("/");
     if (!root || !root.isDirectory())
     {
-        debugE("Failed to open root directory");
+        result.fail(CMD_STATUS_FAILED, "Failed to open root directory");
         return;
     }
 
+    result.printf("Files in LittleFS:");
     File file = root.openNextFile();
     while (file)
     {
-        debugI("File: %s, Size: %d", file.name(), file.size());
+        result.printf("\n  %s (%d bytes)", file.name(), (int)file.size());
         file = root.openNextFile();
     }
 }
 
+void LittleFsHandler::readEncryptedFile(const String &path, CommandResult &result)
+{
+    SecureFileReader reader;
+    if (!reader.open(path.c_str())) {
+        result.fail(CMD_STATUS_FAILED, "Failed to decrypt file: %s", path.c_str());
+        return;
+    }
+
+    char buffer[128];
+    int bytesRead;
+    while ((bytesRead = reader.read((uint8_t *)buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, bytesRead);
+    }
+    mbedtls_platform_zeroize(buffer, sizeof(buffer));
+    if (bytesRead < 0) {
+        result.fail(CMD_STATUS_FAILED, "Encrypted file failed to authenticate: %s", path.c_str());
+    }
+}
+
 void LittleFsHandler::registerCommands()
 {
-    CommandHandler::registerCommand("LITTLEFS", [](const String &command)
+    CommandHandler::registerCommand("LITTLEFS", [](const CommandArgs &args, CommandResult &result)
                                     {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
+        const CommandToken &cmd = args[0];
+        String path = args[1].toString();
 
-        if (CommandHandler::equalsIgnoreCase(cmd, "LIST")) {
-            listFiles();
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "FORMAT")) {
+        if (cmd.equals("LIST")) {
+            listFiles(result);
+        } else if (cmd.equals("FORMAT")) {
+            ConfigManager::fileChanged(nullptr);
             if (LittleFS.format()) {
-                debugI("LittleFS formatted successfully");
+                result.printf("LittleFS formatted successfully");
             } else {
-                debugE("Failed to format LittleFS");
+                result.fail(CMD_STATUS_FAILED, "Failed to format LittleFS");
             }
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "WRITE")) {
-            String path, content;
-            int splitIndex = args.indexOf(' ');
-            if (splitIndex > 0) {
-                path = args.substring(0, splitIndex);
-                content = args.substring(splitIndex + 1);
-                if (writeFile(path, content)) {
-                    debugI("File written successfully: %s", path.c_str());
+        } else if (cmd.equals("WRITE")) {
+            if (!args[2].isEmpty()) {
+                if (writeFile(path, args.rest(2).toString())) {
+                    result.printf("File written successfully: %s", path.c_str());
                 } else {
-                    debugE("Failed to write file: %s", path.c_str());
+                    result.fail(CMD_STATUS_FAILED, "Failed to write file: %s", path.c_str());
                 }
             } else {
-                debugW("Usage: LITTLEFS WRITE <path> <content>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: LITTLEFS WRITE <path> <content>");
             }
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "READ")) {
-            if (!args.isEmpty()) {
-                String content = readFile(args);
+        } else if (cmd.equals("READ")) {
+            if (!path.isEmpty() && SecureFile::isEncrypted(path.c_str())) {
+                readEncryptedFile(path, result);
+            } else if (!path.isEmpty()) {
+                String content = readFile(path);
                 if (!content.isEmpty()) {
-                    debugI("Content of %s: %s", args.c_str(), content.c_str());
+                    result.append(content.c_str(), content.length());
                 } else {
-                    debugE("Failed to read file or file is empty: %s", args.c_str());
+                    result.fail(CMD_STATUS_NOT_FOUND, "Failed to read file or file is empty: %s", path.c_str());
                 }
             } else {
-                debugW("Usage: LITTLEFS READ <path>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: LITTLEFS READ <path>");
+            }
+        } else if (cmd.equals("ENCRYPT") || cmd.equals("DECRYPT")) {
+            bool encrypt = cmd.equals("ENCRYPT");
+            String target = args[2].isEmpty() ? path : args[2].toString();
+            if (path.isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: LITTLEFS %s <path> [target]", encrypt ? "ENCRYPT" : "DECRYPT");
+            } else if (encrypt ? SecureFile::encryptFile(path.c_str(), target.c_str()) : SecureFile::decryptFile(path.c_str(), target.c_str())) {
+                ConfigManager::fileChanged(target.c_str());
+                result.printf("File %s: %s", encrypt ? "encrypted" : "decrypted", target.c_str());
+            } else {
+                result.fail(CMD_STATUS_FAILED, "Failed to %s file: %s", encrypt ? "encrypt" : "decrypt", path.c_str());
             }
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "DELETE")) {
-            if (!args.isEmpty()) {
-                if (deleteFile(args)) {
-                    debugI("File deleted successfully: %s", args.c_str());
+        } else if (cmd.equals("DELETE")) {
+            if (!path.isEmpty()) {
+                if (deleteFile(path)) {
+                    result.printf("File deleted successfully: %s", path.c_str());
                 } else {
-                    debugE("Failed to delete file: %s", args.c_str());
+                    result.fail(CMD_STATUS_FAILED, "Failed to delete file: %s", path.c_str());
                 }
             } else {
-                debugW("Usage: LITTLEFS DELETE <path>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: LITTLEFS DELETE <path>");
             }
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "DELETE_ALL")) {
+        } else if (cmd.equals("DELETE_ALL")) {
             if (deleteAllFiles()) {
-                debugI("All files deleted successfully");
+                result.printf("All files deleted successfully");
             } else {
-                debugE("Failed to delete all files");
+                result.fail(CMD_STATUS_FAILED, "Failed to delete all files");
             }
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "MKDIR")) {
-            if (!args.isEmpty()) {
-                if (createFolder(args)) {
-                    debugI("Folder created successfully: %s", args.c_str());
+        } else if (cmd.equals("MKDIR")) {
+            if (!path.isEmpty()) {
+                if (createFolder(path)) {
+                    result.printf("Folder created successfully: %s", path.c_str());
                 } else {
-                    debugE("Failed to create folder: %s", args.c_str());
+                    result.fail(CMD_STATUS_FAILED, "Failed to create folder: %s", path.c_str());
                 }
             } else {
-                debugW("Usage: LITTLEFS MKDIR <path>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: LITTLEFS MKDIR <path>");
             }
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "RMDIR")) {
-            if (!args.isEmpty()) {
-                if (deleteRecursive(args)) {
-                    debugI("Folder deleted recursively: %s", args.c_str());
+        } else if (cmd.equals("RMDIR")) {
+            if (!path.isEmpty()) {
+                if (deleteRecursive(path)) {
+                    result.printf("Folder deleted recursively: %s", path.c_str());
                 } else {
-                    debugE("Failed to delete folder: %s", args.c_str());
+                    result.fail(CMD_STATUS_FAILED, "Failed to delete folder: %s", path.c_str());
                 }
             } else {
-                debugW("Usage: LITTLEFS RMDIR <path>");
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: LITTLEFS RMDIR <path>");
             }
         } else {
-            debugW("Unknown LITTLEFS subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown LITTLEFS subcommand: %.*s", (int)cmd.length, cmd.data);
         } }, "Handles LittleFS commands. Usage: LITTLEFS <subcommand> [args]\n"
                                          "  Subcommands:\n"
                                          "  LIST - Lists all files in LittleFS\n"
                                          "  FORMAT - Formats LittleFS\n"
                                          "  WRITE <path> <content> - Writes to a file\n"
-                                         "  READ <path> - Reads a file\n"
+                                         "  READ <path> - Reads a file, decrypting it if it is encrypted\n"
+                                         "  ENCRYPT <path> [target] - Encrypts a file at rest (in place unless a target is given)\n"
+                                         "  DECRYPT <path> [target] - Decrypts an encrypted file\n"
                                          "  DELETE <path> - Deletes a file\n"
                                          "  DELETE_ALL - Deletes all files\n"
                                          "  MKDIR <path> - Creates a folder\n"
@@ -3,13 +3,15 @@
 #ifdef ENABLE_LITTLEFS_HANDLER
 
 #include <Arduino.h>
+#include "CommandHandler.h"
 
 class LittleFsHandler
 {
 private:
     static void registerCommands();
     static bool deleteRecursive(const String &path);
-    static void listFiles();
+    static void listFiles(CommandResult &result);
+    static void readEncryptedFile(const String &path, CommandResult &result);
 
 public:
     static void init();
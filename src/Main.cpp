@@ -17,10 +17,12 @@
 #include "DownloadHandler.h"
 #include "AesHandler.h"
 #include "CryptoHandler.h"
+#include "RekeyHandler.h"
 #include "JiggleHandler.h"
 #include "ImprovWiFiHandler.h"
 #include "LittleFsHandler.h"
 #include "DuckyScriptHandler.h"
+#include "DatabaseHandler.h"
 
 void setup()
 {
@@ -29,6 +31,7 @@ void setup()
   ScriptHandler::init();
   DuckyScriptHandler::init();
   ConfigManager::init();
+  DatabaseHandler::init();
   GfxHandler::init();
   ImprovWiFiHandler::init();
   WebHandler::init();
@@ -36,17 +39,19 @@ void setup()
   ButtonHandler::init();
   OTAHandler::init();
   CommandHandler::init();
+  CommandBus::init();
   DeviceHandler::init();
   CronHandler::init();
   SystemMonitor::init();
   DownloadHandler::init();
   AesHandler::init();
   CryptoHandler::init();
+  RekeyHandler::init();
   TimeHandler::init(settings.device.timezone);
   JiggleHandler::init();
   BluetoothHandler::init();
   MqttHandler::init();
-  CommandHandler::handleCommand(settings.device.bootCommand);
+  CommandBus::submit(settings.device.bootCommand, CMD_SOURCE_BOOT);
   
   //GfxHandler::printMessage(SOFTWARE_VERSION);
   //LedHandler::setDefaultBrightness(50);
@@ -65,8 +70,10 @@ void loop()
   ButtonHandler::loop();
   OTAHandler::loop();
   DeviceHandler::loop();
+  DuckyScriptHandler::loop();
   CronHandler::loop();
   JiggleHandler::loop();
   BluetoothHandler::loop();
   MqttHandler::loop();
+  CryptoHandler::loop();
 }
\ No newline at end of file
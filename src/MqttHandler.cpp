@@ -5,11 +5,14 @@
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
 #include <LittleFS.h>
+#include <ArduinoJson.h>
+#include "RekeyHandler.h"
 
 // Constants
 static constexpr uint32_t DEFAULT_TIMEOUT_MS = 500;  // Initial reconnect delay
 static constexpr uint32_t MAX_BACKOFF_MS = 900000;    // Max delay (15 minutes)
 static constexpr uint8_t BACKOFF_FACTOR = 5;         // Exponential multiplier
+static constexpr uint16_t MQTT_BUFFER_SIZE = CommandRecord::TEXT_SIZE + 256;  // Result JSON plus topic and header
 
 // Static variables
 static WiFiClient wifiClient;
@@ -18,11 +21,26 @@ static PubSubClient mqttClient(wifiClient);          // Default to non-secure cl
 static NonBlockingTimer mqttReconnectTimer(DEFAULT_TIMEOUT_MS);
 static uint32_t currentBackoffMs = DEFAULT_TIMEOUT_MS;  // Tracks current delay
 
+// Messages built on other tasks (command results and the mqtt command, both
+// on the executor) wait here and are published from loop(), since
+// PubSubClient is not safe to use from two tasks. Each entry is a heap copy
+// handed over by pointer; an empty topic means settings.mqtt.pubTopic.
+static constexpr UBaseType_t OUTBOX_DEPTH = 8;
+
+struct OutboxEntry {
+  String topic;
+  String payload;
+};
+
+static QueueHandle_t outbox = nullptr;
+static uint32_t outboxDropped = 0;
+
 void MqttHandler::init() {
   if (!settings.mqtt.enabled) {
     return;
   }
 
+  outbox = xQueueCreate(OUTBOX_DEPTH, sizeof(OutboxEntry*));
   registerCommands();
   connectToMqtt();
 }
@@ -41,7 +59,80 @@ void MqttHandler::loop() {
   } else {
     mqttClient.loop();  // Process incoming MQTT messages
     currentBackoffMs = DEFAULT_TIMEOUT_MS;  // Reset backoff on successful connection
+    publishOutbox();
+    publishRekeyProgress();
+  }
+}
+
+void MqttHandler::commandDone(uint32_t correlationId, const CommandResult& result, void* ctx) {
+  JsonDocument doc;
+  doc["id"] = correlationId;
+  doc["status"] = (int)result.status();
+  doc["durationUs"] = result.durationUs();
+  if (result.isJson() && !result.truncated()) {
+    doc["result"] = serialized(result.text(), result.size());
+  } else {
+    doc["result"] = result.text();
+  }
+
+  String reply;
+  serializeJson(doc, reply);
+  queueMessage(nullptr, reply);
+}
+
+// Hand a finished message to loop(). Safe from any task; returns false if
+// the outbox is full, in which case the message is dropped.
+bool MqttHandler::queueMessage(const char* topic, const String& payload) {
+  if (!outbox) {
+    return false;
+  }
+
+  OutboxEntry* entry = new OutboxEntry();
+  if (topic) {
+    entry->topic = topic;
+  }
+  entry->payload = payload;
+  if (xQueueSend(outbox, &entry, 0) != pdTRUE) {
+    delete entry;
+    outboxDropped++;
+    debugW("MQTT: Outbox full, message dropped (%u so far)", (unsigned int)outboxDropped);
+    return false;
   }
+  return true;
+}
+
+void MqttHandler::publishOutbox() {
+  OutboxEntry* entry;
+  while (outbox && xQueueReceive(outbox, &entry, 0) == pdTRUE) {
+    const char* topic = entry->topic.isEmpty() ? settings.mqtt.pubTopic.c_str() : entry->topic.c_str();
+    publish(topic, entry->payload.c_str());
+    delete entry;
+  }
+}
+
+// Password change progress, published once per checkpoint and on each
+// change of state
+void MqttHandler::publishRekeyProgress() {
+  static RekeyState lastState = REKEY_IDLE;
+  static uint32_t lastCheckpoint = 0;
+  RekeyStatus rekey = RekeyHandler::getStatus();
+  if (rekey.state == lastState && rekey.nextId == lastCheckpoint) {
+    return;
+  }
+  lastState = rekey.state;
+  lastCheckpoint = rekey.nextId;
+
+  JsonDocument doc;
+  JsonObject progress = doc["rekey"].to<JsonObject>();
+  progress["state"] = RekeyHandler::stateName(rekey.state);
+  progress["nextId"] = rekey.nextId;
+  progress["lastId"] = rekey.lastId;
+  progress["converted"] = rekey.converted;
+  progress["unreadable"] = rekey.unreadable;
+  progress["elapsedMs"] = rekey.elapsedMs;
+  char message[160];
+  serializeJson(doc, message, sizeof(message));
+  publish(settings.mqtt.pubTopic.c_str(), message);
 }
 
 void MqttHandler::publish(const char* topic, const char* message) {
@@ -98,6 +189,7 @@ void MqttHandler::connectToMqtt() {
   // Set server and callback
   mqttClient.setServer(settings.mqtt.server.c_str(), settings.mqtt.port);
   mqttClient.setCallback(handleMqttCallback);
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);  // Default 256 bytes is too small for results and batches
 
   debugI("MQTT: Connecting to %s:%d", settings.mqtt.server.c_str(), settings.mqtt.port);
 
@@ -148,32 +240,46 @@ void MqttHandler::handleMqttCallback(char* topic, uint8_t* payload, uint32_t len
   debugI("MQTT: Received on [%s]: %s", topic, message.c_str());
 
   if (String(topic) == settings.mqtt.subTopic) {
-    debugD("MQTT: Echoing message to publish topic");
-    publish(settings.mqtt.pubTopic.c_str(), message.c_str());
-    CommandHandler::handleCommand(message);
+    uint32_t id;
+    if (CommandBus::isBatch(message.c_str(), message.length())) {
+      CommandBatchOptions options = {false, 0};
+      id = CommandBus::submitBatch(message.c_str(), message.length(), CMD_SOURCE_MQTT, options, 0, commandDone);
+    } else {
+      id = CommandBus::submit(message, CMD_SOURCE_MQTT, 0, commandDone);
+    }
+    if (!id) {
+      publish(settings.mqtt.pubTopic.c_str(), "{\"status\":503,\"result\":\"Command queue full\"}");
+    }
   }
 }
 
 void MqttHandler::registerCommands() {
   CommandHandler::registerCommand(
       "mqtt", 
-      [](const String& command) {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
-
-        if (CommandHandler::equalsIgnoreCase(cmd, "msg")) {
-          MqttHandler::publish(settings.mqtt.pubTopic.c_str(), args.c_str());
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "topic")) {
-          int32_t delimiterPos = args.indexOf(' ');
-          if (delimiterPos == -1) {
-            debugW("MQTT: Invalid topic command format");
+      [](const CommandArgs& args, CommandResult& result) {
+        const CommandToken& cmd = args[0];
+
+        // Runs on the command executor, so the message goes through the
+        // outbox and loop() publishes it
+        if (cmd.equals("msg")) {
+          if (!MqttHandler::queueMessage(nullptr, args.rest(1).toString())) {
+            result.fail(CMD_STATUS_BUSY, "MQTT: Outbox full");
+            return;
+          }
+          result.printf("Queued for %s", settings.mqtt.pubTopic.c_str());
+        } else if (cmd.equals("topic")) {
+          if (args.count() < 3) {
+            result.fail(CMD_STATUS_BAD_REQUEST, "MQTT: Invalid topic command format");
+            return;
+          }
+          String topic = args[1].toString();
+          if (!MqttHandler::queueMessage(topic.c_str(), args.rest(2).toString())) {
+            result.fail(CMD_STATUS_BUSY, "MQTT: Outbox full");
             return;
           }
-          String topic = args.substring(0, delimiterPos);
-          String message = args.substring(delimiterPos + 1);
-          MqttHandler::publish(topic.c_str(), message.c_str());
+          result.printf("Queued for %s", topic.c_str());
         } else {
-          debugW("MQTT: Unknown subcommand: %s", cmd.c_str());
+          result.fail(CMD_STATUS_BAD_REQUEST, "MQTT: Unknown subcommand: %.*s", (int)cmd.length, cmd.data);
         }
       }, 
       "Handles MQTT commands.\n"
@@ -10,11 +10,19 @@ class MqttHandler {
   static void loop();
   static void publish(const char* topic, const char* message);
 
+  // Publishes from loop(); safe to call from any task. A null topic means
+  // settings.mqtt.pubTopic. Returns false if the outbox is full.
+  static bool queueMessage(const char* topic, const String& payload);
+
  private:
   static void connectToMqtt();
   static void handleMqttCallback(char* topic, uint8_t* payload, uint32_t length);
   static void registerCommands();
   static bool loadCertificate(String& certContent);
+  // Publishes the result of a command received on subTopic to pubTopic
+  static void commandDone(uint32_t correlationId, const CommandResult& result, void* ctx);
+  static void publishOutbox();
+  static void publishRekeyProgress();
 };
 
 #else
@@ -0,0 +1,87 @@
+// Entry point for the native (host) env only. Brings up the handlers that
+// build off-device and runs commands given as arguments, or one per line from
+// stdin, through the command bus. Scripts and typing run to completion before
+// the next command, so a run is repeatable under perf or valgrind.
+//
+//   .pio/build/native/program "cmdbench 10000" "ducky bench /test.txt 100"
+
+// Unit tests (pio test) bring their own main()
+#if defined(NATIVE_BUILD) && !defined(PIO_UNIT_TESTING)
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+#include "DuckyScriptHandler.h"
+#include "CronHandler.h"
+#include "CryptoHandler.h"
+#include "RekeyHandler.h"
+#include "AesHandler.h"
+#include "ButtonHandler.h"
+#include "DatabaseHandler.h"
+#include "LittleFsHandler.h"
+#include "TimeHandler.h"
+#include <LittleFS.h>
+#include <iostream>
+#include <string>
+
+static bool isBusy()
+{
+    if (!DeviceHandler::isIdle()) return true;
+    if (RekeyHandler::getStatus().state == REKEY_RUNNING) return true;
+    DuckyStatus status = DuckyScriptHandler::getStatus();
+    return status.state != DUCKY_IDLE || status.pending > 0;
+}
+
+static void runCommand(const String &command)
+{
+    if (!CommandBus::submitAndWait(command, CMD_SOURCE_CONSOLE))
+    {
+        debugE("Command rejected: %s", command.c_str());
+        return;
+    }
+
+    // What setup()/loop() would keep pumping on the device
+    while (isBusy())
+    {
+        DuckyScriptHandler::loop();
+        DeviceHandler::loop();
+        CronHandler::loop();
+        CryptoHandler::loop();
+        delay(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    LittleFS.begin();
+    LittleFsHandler::init();
+    ConfigManager::init();
+    DatabaseHandler::init();
+    CommandHandler::init();
+    CommandBus::init();
+    DeviceHandler::init();
+    DuckyScriptHandler::init();
+    CronHandler::init();
+    AesHandler::init();
+    ButtonHandler::init();
+    CryptoHandler::init();
+    RekeyHandler::init();
+    TimeHandler::init(settings.device.timezone);
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            runCommand(String(argv[i]));
+        }
+        return 0;
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        runCommand(String(line.c_str()));
+    }
+    return 0;
+}
+
+#endif // NATIVE_BUILD && !PIO_UNIT_TESTING
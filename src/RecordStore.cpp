@@ -0,0 +1,617 @@
+#include "RecordStore.h"
+#include "Globals.h"
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+#include <algorithm>
+
+RecordStore::RecordStore(const char *logPath, const char *jsonPath, const char *arrayKey)
+    : logPath(logPath), jsonPath(jsonPath), arrayKey(arrayKey), tempPath(String(logPath) + ".tmp"),
+      importPath(String(logPath) + ".import"), mutex(nullptr),
+      fileSize(0), garbage(0), compactions(0), lastCompactMs(0), generation(0)
+{
+}
+
+void RecordStore::lock()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void RecordStore::unlock()
+{
+    xSemaphoreGive(mutex);
+}
+
+uint32_t RecordStore::checksum(RecordHeader header, const uint8_t *payload, size_t length)
+{
+    header.crc = 0;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&header, sizeof(header));
+    return esp_rom_crc32_le(crc, payload, length);
+}
+
+bool RecordStore::writeRecord(File &file, uint8_t type, uint32_t id, const char *payload, size_t length)
+{
+    RecordHeader header = {MAGIC, type, 0, id, (uint32_t)length, 0};
+    header.crc = checksum(header, (const uint8_t *)payload, length);
+    return file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+           (length == 0 || file.write((const uint8_t *)payload, length) == length);
+}
+
+std::vector<RecordStore::IndexEntry>::iterator RecordStore::find(uint32_t id)
+{
+    auto it = std::lower_bound(index.begin(), index.end(), id, [](const IndexEntry &entry, uint32_t value) { return entry.id < value; });
+    return it != index.end() && it->id == id ? it : index.end();
+}
+
+// Apply one record to the index, counting what it makes obsolete
+void RecordStore::applyRecord(std::vector<IndexEntry> &index, size_t &garbage, uint8_t type, uint32_t id, uint32_t offset, uint32_t length)
+{
+    auto it = std::lower_bound(index.begin(), index.end(), id, [](const IndexEntry &entry, uint32_t value) { return entry.id < value; });
+    bool exists = it != index.end() && it->id == id;
+    if (exists)
+    {
+        garbage += sizeof(RecordHeader) + it->length;
+    }
+
+    if (type == RECORD_PUT)
+    {
+        IndexEntry entry = {id, offset, length};
+        if (exists)
+        {
+            *it = entry;
+        }
+        else
+        {
+            index.insert(it, entry);
+        }
+    }
+    else
+    {
+        garbage += sizeof(RecordHeader); // The tombstone itself
+        if (exists)
+        {
+            index.erase(it);
+        }
+    }
+}
+
+// Read the log from the start, stopping at the first record that is torn or
+// fails its checksum. validSize is where the good part ends.
+bool RecordStore::scan(size_t &validSize)
+{
+    index.clear();
+    garbage = 0;
+    validSize = 0;
+
+    File file = LittleFS.open(logPath, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    size_t size = file.size();
+    std::vector<uint8_t> payload(MAX_RECORD_SIZE);
+    size_t offset = 0;
+    while (offset + sizeof(RecordHeader) <= size)
+    {
+        RecordHeader header;
+        if (file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+            header.magic != MAGIC ||
+            (header.type != RECORD_PUT && header.type != RECORD_DELETE) ||
+            header.length > MAX_RECORD_SIZE ||
+            offset + sizeof(header) + header.length > size ||
+            file.read(payload.data(), header.length) != header.length ||
+            checksum(header, payload.data(), header.length) != header.crc)
+        {
+            break;
+        }
+
+        applyRecord(index, garbage, header.type, header.id, offset + sizeof(header), header.length);
+        offset += sizeof(header) + header.length;
+    }
+    file.close();
+
+    validSize = offset;
+    fileSize = size;
+    if (validSize < size)
+    {
+        debugW("%s: %u damaged bytes after offset %u", logPath, (unsigned)(size - validSize), (unsigned)validSize);
+    }
+    return true;
+}
+
+bool RecordStore::open()
+{
+    if (!mutex)
+    {
+        mutex = xSemaphoreCreateMutex();
+    }
+    lock();
+
+    // A compaction that stopped after removing the old log but before the
+    // rename left a complete copy behind; one that stopped earlier did not
+    if (LittleFS.exists(tempPath))
+    {
+        if (!LittleFS.exists(logPath))
+        {
+            LittleFS.rename(tempPath, logPath);
+        }
+        else
+        {
+            LittleFS.remove(tempPath);
+        }
+    }
+
+    // An import is only whole once renamed, so redo it from the JSON
+    if (LittleFS.exists(importPath))
+    {
+        LittleFS.remove(importPath);
+    }
+
+    bool ok;
+    if (!LittleFS.exists(logPath))
+    {
+        ok = LittleFS.exists(jsonPath) ? importLocked(jsonPath) : true;
+        if (ok && LittleFS.exists(jsonPath))
+        {
+            debugI("%s: imported %u records from %s", logPath, (unsigned)index.size(), jsonPath);
+        }
+    }
+    else
+    {
+        size_t validSize;
+        ok = scan(validSize);
+        // Appends must not land after a damaged tail, so rewrite the log now
+        if (ok && validSize < fileSize)
+        {
+            ok = compactLocked();
+        }
+    }
+
+    debugI("%s: %u records, %u bytes, %u garbage", logPath, (unsigned)index.size(), (unsigned)fileSize, (unsigned)garbage);
+    unlock();
+    return ok;
+}
+
+bool RecordStore::append(uint8_t type, uint32_t id, const char *payload, size_t length)
+{
+    File file = LittleFS.open(logPath, "a");
+    if (!file)
+    {
+        debugE("Failed to open %s for append", logPath);
+        return false;
+    }
+
+    bool written = writeRecord(file, type, id, payload, length);
+    file.close();
+    if (!written)
+    {
+        // Drop whatever part of the record made it to flash
+        debugE("Failed to append record %u to %s", (unsigned)id, logPath);
+        compactLocked();
+        return false;
+    }
+
+    applyRecord(index, garbage, type, id, fileSize + sizeof(RecordHeader), length);
+    fileSize += sizeof(RecordHeader) + length;
+    generation++;
+    return true;
+}
+
+bool RecordStore::put(uint32_t id, const char *payload, size_t length)
+{
+    if (id == 0 || length > MAX_RECORD_SIZE)
+    {
+        debugW("%s: record %u is invalid or too large (%u bytes)", logPath, (unsigned)id, (unsigned)length);
+        return false;
+    }
+
+    lock();
+    bool ok = append(RECORD_PUT, id, payload, length);
+    unlock();
+    return ok;
+}
+
+bool RecordStore::put(uint32_t id, JsonObjectConst record)
+{
+    size_t length = measureJson(record);
+    if (length > MAX_RECORD_SIZE)
+    {
+        debugW("%s: record %u is too large (%u bytes)", logPath, (unsigned)id, (unsigned)length);
+        return false;
+    }
+
+    std::vector<char> payload(length + 1);
+    serializeJson(record, payload.data(), payload.size());
+    return put(id, payload.data(), length);
+}
+
+bool RecordStore::putIf(uint32_t id, JsonObjectConst record, uint32_t expected, bool &conflict)
+{
+    conflict = false;
+    size_t length = measureJson(record);
+    if (id == 0 || length > MAX_RECORD_SIZE)
+    {
+        debugW("%s: record %u is invalid or too large (%u bytes)", logPath, (unsigned)id, (unsigned)length);
+        return false;
+    }
+
+    // Serialized before taking the store, which is held only to compare and append
+    std::vector<char> payload(length + 1);
+    serializeJson(record, payload.data(), payload.size());
+
+    lock();
+    conflict = generation != expected;
+    bool ok = !conflict && append(RECORD_PUT, id, payload.data(), length);
+    unlock();
+    return ok;
+}
+
+bool RecordStore::remove(uint32_t id)
+{
+    lock();
+    bool ok = find(id) != index.end() && append(RECORD_DELETE, id, nullptr, 0);
+    unlock();
+    return ok;
+}
+
+bool RecordStore::contains(uint32_t id)
+{
+    lock();
+    bool found = find(id) != index.end();
+    unlock();
+    return found;
+}
+
+uint32_t RecordStore::nextId()
+{
+    lock();
+    uint32_t id = index.empty() ? 1 : index.back().id + 1;
+    unlock();
+    return id;
+}
+
+bool RecordStore::readPayload(File &file, const IndexEntry &entry, char *buffer)
+{
+    return file.seek(entry.offset) && file.read((uint8_t *)buffer, entry.length) == entry.length;
+}
+
+bool RecordStore::get(uint32_t id, JsonDocument &doc)
+{
+    uint32_t readAt;
+    return get(id, doc, readAt);
+}
+
+bool RecordStore::get(uint32_t id, JsonDocument &doc, uint32_t &readAt)
+{
+    lock();
+    readAt = generation;
+    auto it = find(id);
+    bool ok = false;
+    if (it != index.end())
+    {
+        IndexEntry entry = *it;
+        std::vector<char> payload(entry.length);
+        File file = LittleFS.open(logPath, "r");
+        ok = file && readPayload(file, entry, payload.data()) && !deserializeJson(doc, payload.data(), entry.length);
+        file.close();
+    }
+    unlock();
+    return ok;
+}
+
+bool RecordStore::forEach(RecordCallback callback, void *ctx)
+{
+    lock();
+    File file = LittleFS.open(logPath, "r");
+    bool ok = index.empty() || file;
+    std::vector<char> payload(MAX_RECORD_SIZE + 1);
+    for (size_t i = 0; ok && i < index.size(); i++)
+    {
+        ok = readPayload(file, index[i], payload.data());
+        if (ok)
+        {
+            payload[index[i].length] = '\0';
+            callback(index[i].id, payload.data(), index[i].length, ctx);
+        }
+    }
+    if (file)
+    {
+        file.close();
+    }
+    unlock();
+    return ok;
+}
+
+struct ExportState {
+    Print *out;
+    bool first;
+};
+
+static void exportRecord(uint32_t id, const char *payload, size_t length, void *ctx)
+{
+    ExportState *state = static_cast<ExportState *>(ctx);
+    if (!state->first)
+    {
+        state->out->print(",\n");
+    }
+    state->out->write((const uint8_t *)payload, length);
+    state->first = false;
+}
+
+bool RecordStore::exportJson(Print &out)
+{
+    ExportState state = {&out, true};
+    out.printf("{\"%s\":[\n", arrayKey);
+    bool ok = forEach(exportRecord, &state);
+    out.print("\n]}");
+    return ok;
+}
+
+bool RecordStore::exportJson(const char *path)
+{
+    String tempJson = String(path) + ".tmp";
+    File file = LittleFS.open(tempJson, "w");
+    if (!file)
+    {
+        return false;
+    }
+    bool ok = exportJson(file);
+    file.close();
+
+    if (ok)
+    {
+        LittleFS.remove(path);
+        ok = LittleFS.rename(tempJson, path);
+    }
+    if (!ok)
+    {
+        LittleFS.remove(tempJson);
+    }
+    return ok;
+}
+
+// Skip whitespace and return the next character without consuming it, -1 at the end
+static int peekToken(Stream &in)
+{
+    int c;
+    while ((c = in.peek()) == ' ' || c == '\n' || c == '\r' || c == '\t')
+    {
+        in.read();
+    }
+    return c;
+}
+
+// Move past the opening bracket of "key": [
+static bool seekArray(Stream &in, const char *key)
+{
+    String pattern = String("\"") + key + "\"";
+    size_t matched = 0;
+    int c;
+    while ((c = in.read()) >= 0)
+    {
+        matched = c == pattern[matched] ? matched + 1 : (c == pattern[0] ? 1 : 0);
+        if (matched == pattern.length())
+        {
+            break;
+        }
+    }
+    if (c < 0)
+    {
+        return false;
+    }
+    while ((c = in.read()) >= 0 && c != '[')
+    {
+        if (c != ':' && c != ' ' && c != '\n' && c != '\r' && c != '\t')
+        {
+            return false;
+        }
+    }
+    return c == '[';
+}
+
+bool RecordStore::importJson(const char *path)
+{
+    lock();
+    bool ok = importLocked(path);
+    unlock();
+    return ok;
+}
+
+// Stream the array one object at a time into a new log, then swap it in
+bool RecordStore::importLocked(const char *path)
+{
+    File in = LittleFS.open(path, "r");
+    if (!in || !seekArray(in, arrayKey))
+    {
+        debugE("%s: no \"%s\" array in %s", logPath, arrayKey, path);
+        if (in)
+        {
+            in.close();
+        }
+        return false;
+    }
+
+    File out = LittleFS.open(importPath, "w");
+    if (!out)
+    {
+        in.close();
+        return false;
+    }
+
+    std::vector<IndexEntry> newIndex;
+    size_t newGarbage = 0;
+    size_t newSize = 0;
+    std::vector<char> payload(MAX_RECORD_SIZE + 1);
+    bool ok = true;
+    while (ok)
+    {
+        int c = peekToken(in);
+        if (c == ']')
+        {
+            break;
+        }
+        if (c == ',')
+        {
+            in.read();
+            continue;
+        }
+
+        JsonDocument doc;
+        ok = c == '{' && !deserializeJson(doc, in);
+        if (!ok)
+        {
+            debugE("%s: bad record in %s", logPath, path);
+            break;
+        }
+
+        uint32_t id = doc["id"].is<const char *>() ? atol(doc["id"].as<const char *>()) : doc["id"].as<uint32_t>();
+        if (id == 0)
+        {
+            id = newIndex.empty() ? 1 : newIndex.back().id + 1;
+            doc["id"] = id;
+        }
+
+        size_t length = measureJson(doc);
+        if (length > MAX_RECORD_SIZE)
+        {
+            debugW("%s: skipping record %u (%u bytes)", logPath, (unsigned)id, (unsigned)length);
+            continue;
+        }
+        serializeJson(doc, payload.data(), payload.size());
+        ok = writeRecord(out, RECORD_PUT, id, payload.data(), length);
+        applyRecord(newIndex, newGarbage, RECORD_PUT, id, newSize + sizeof(RecordHeader), length);
+        newSize += sizeof(RecordHeader) + length;
+    }
+    in.close();
+    out.close();
+
+    if (!ok)
+    {
+        LittleFS.remove(importPath);
+        return false;
+    }
+    if (!replaceLog(importPath, newIndex, newSize))
+    {
+        return false;
+    }
+    garbage = newGarbage;
+    generation++;
+    return true;
+}
+
+bool RecordStore::copyLive(File &out, std::vector<IndexEntry> &newIndex)
+{
+    File in = LittleFS.open(logPath, "r");
+    if (!in && !index.empty())
+    {
+        return false;
+    }
+
+    std::vector<char> payload(MAX_RECORD_SIZE);
+    uint32_t offset = 0;
+    bool ok = true;
+    newIndex.reserve(index.size());
+    for (const IndexEntry &entry : index)
+    {
+        ok = readPayload(in, entry, payload.data()) && writeRecord(out, RECORD_PUT, entry.id, payload.data(), entry.length);
+        if (!ok)
+        {
+            break;
+        }
+        newIndex.push_back({entry.id, offset + (uint32_t)sizeof(RecordHeader), entry.length});
+        offset += sizeof(RecordHeader) + entry.length;
+    }
+    if (in)
+    {
+        in.close();
+    }
+    return ok;
+}
+
+// Put the finished temp file in place of the log. If the rename cannot
+// replace the log, the log is removed first; open() finishes that case for
+// a compaction and imports the JSON again for an import.
+bool RecordStore::replaceLog(const String &source, std::vector<IndexEntry> &newIndex, size_t newSize)
+{
+    if (!LittleFS.rename(source, logPath))
+    {
+        LittleFS.remove(logPath);
+        if (!LittleFS.rename(source, logPath))
+        {
+            debugE("Failed to replace %s", logPath);
+            return false;
+        }
+    }
+
+    index.swap(newIndex);
+    fileSize = newSize;
+    garbage = 0;
+    return true;
+}
+
+bool RecordStore::compactLocked()
+{
+    uint32_t start = millis();
+    File out = LittleFS.open(tempPath, "w");
+    if (!out)
+    {
+        debugE("Failed to create %s", tempPath.c_str());
+        return false;
+    }
+
+    std::vector<IndexEntry> newIndex;
+    bool ok = copyLive(out, newIndex);
+    out.close();
+
+    size_t newSize = 0;
+    for (const IndexEntry &entry : newIndex)
+    {
+        newSize += sizeof(RecordHeader) + entry.length;
+    }
+
+    size_t oldSize = fileSize;
+    ok = ok && replaceLog(tempPath, newIndex, newSize);
+    if (!ok)
+    {
+        LittleFS.remove(tempPath);
+        debugE("Compacting %s failed", logPath);
+        return false;
+    }
+
+    compactions++;
+    lastCompactMs = millis() - start;
+    debugI("Compacted %s from %u to %u bytes in %u ms", logPath, (unsigned)oldSize, (unsigned)fileSize, (unsigned)lastCompactMs);
+    return true;
+}
+
+bool RecordStore::compact()
+{
+    lock();
+    bool ok = compactLocked();
+    unlock();
+    return ok;
+}
+
+bool RecordStore::needsCompaction()
+{
+    lock();
+    bool needed = garbage >= COMPACT_MIN_GARBAGE && garbage * 2 >= fileSize;
+    unlock();
+    return needed;
+}
+
+uint32_t RecordStore::getGeneration()
+{
+    lock();
+    uint32_t current = generation;
+    unlock();
+    return current;
+}
+
+RecordStoreStats RecordStore::getStats()
+{
+    lock();
+    RecordStoreStats stats = {index.size(), fileSize, garbage, compactions, lastCompactMs};
+    unlock();
+    return stats;
+}
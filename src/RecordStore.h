@@ -0,0 +1,123 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <vector>
+
+// On-flash header in front of every record. The CRC covers the header (with
+// crc zeroed) and the payload, so a torn or damaged append is detected.
+struct RecordHeader {
+    uint16_t magic;
+    uint8_t type;      // RecordType
+    uint8_t reserved;
+    uint32_t id;
+    uint32_t length;   // Payload bytes that follow
+    uint32_t crc;
+};
+
+enum RecordType : uint8_t {
+    RECORD_PUT = 1,    // Payload is the record's JSON object
+    RECORD_DELETE = 2  // Tombstone, no payload
+};
+
+struct RecordStoreStats {
+    size_t records;      // Live records
+    size_t fileSize;
+    size_t garbage;      // Bytes held by overwritten records and tombstones
+    uint32_t compactions;
+    uint32_t lastCompactMs;
+};
+
+typedef void (*RecordCallback)(uint32_t id, const char *payload, size_t length, void *ctx);
+
+// Append-only log of JSON records keyed by id. An edit appends one record
+// (or a tombstone) instead of rewriting the file; an index in RAM maps each
+// id to its latest copy. Once garbage passes a threshold the live records
+// are copied to a new file, which then replaces the log in one rename.
+//
+// JSON files ({"<arrayKey>": [...]}) are the import/export format: on first
+// open an existing JSON file is imported, and export writes the same shape.
+class RecordStore
+{
+public:
+    static const size_t MAX_RECORD_SIZE = 2048;
+
+    RecordStore(const char *logPath, const char *jsonPath, const char *arrayKey);
+
+    // Build the index from the log, finishing an interrupted compaction and
+    // dropping a damaged tail. Imports the JSON file if there is no log yet.
+    bool open();
+
+    bool put(uint32_t id, const char *payload, size_t length);
+    bool put(uint32_t id, JsonObjectConst record);
+    // put() only if no record has changed since the store was at generation,
+    // so a read-modify-write cannot undo an edit made in between. On a
+    // conflict nothing is written and conflict is set; retry from get().
+    bool putIf(uint32_t id, JsonObjectConst record, uint32_t generation, bool &conflict);
+    bool remove(uint32_t id);
+    bool contains(uint32_t id);
+    // Read one record; false if there is no such id or it cannot be read
+    bool get(uint32_t id, JsonDocument &doc);
+    // The same, also giving the generation it was read at, for putIf()
+    bool get(uint32_t id, JsonDocument &doc, uint32_t &generation);
+    uint32_t nextId(); // One past the highest id in use
+
+    // Call back with every live record, in id order. The payload is only
+    // valid during the call, and the store must not be changed from it.
+    bool forEach(RecordCallback callback, void *ctx);
+
+    bool exportJson(Print &out);
+    bool exportJson(const char *path);
+    // Replace every record with the ones in a JSON file; records are read
+    // one at a time, so the file can be larger than the heap
+    bool importJson(const char *path);
+
+    bool needsCompaction();
+    bool compact();
+
+    RecordStoreStats getStats();
+    const char *name() const { return arrayKey; }
+    // Counts changes to the records since boot (compaction is not one), for
+    // telling whether an earlier export is still current
+    uint32_t getGeneration();
+
+private:
+    static const uint16_t MAGIC = 0x5452; // "RT"
+    static const size_t COMPACT_MIN_GARBAGE = 4096;
+
+    struct IndexEntry {
+        uint32_t id;
+        uint32_t offset; // Of the payload
+        uint32_t length;
+    };
+
+    const char *logPath;
+    const char *jsonPath;
+    const char *arrayKey;
+    String tempPath;   // Compaction output, complete once the old log is gone
+    String importPath; // Import output, never trusted after a reset
+    SemaphoreHandle_t mutex;
+    std::vector<IndexEntry> index; // Sorted by id
+    size_t fileSize;
+    size_t garbage;
+    uint32_t compactions;
+    uint32_t lastCompactMs;
+    uint32_t generation;
+
+    void lock();
+    void unlock();
+    static uint32_t checksum(RecordHeader header, const uint8_t *payload, size_t length);
+    static bool writeRecord(File &file, uint8_t type, uint32_t id, const char *payload, size_t length);
+    std::vector<IndexEntry>::iterator find(uint32_t id);
+    static void applyRecord(std::vector<IndexEntry> &index, size_t &garbage, uint8_t type, uint32_t id, uint32_t offset, uint32_t length);
+    bool scan(size_t &validSize);
+    bool append(uint8_t type, uint32_t id, const char *payload, size_t length);
+    bool readPayload(File &file, const IndexEntry &entry, char *buffer);
+    bool copyLive(File &out, std::vector<IndexEntry> &newIndex);
+    bool replaceLog(const String &source, std::vector<IndexEntry> &newIndex, size_t newSize);
+    bool importLocked(const char *path);
+    bool compactLocked();
+};
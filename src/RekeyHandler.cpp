@@ -0,0 +1,356 @@
+#ifdef ENABLE_CRYPTO_HANDLER
+
+#include "RekeyHandler.h"
+#include "Globals.h"
+#include "ConfigManager.h"
+#include "CryptoHandler.h"
+#include "DatabaseHandler.h"
+#include "ButtonHandler.h"
+#include <ArduinoJson.h>
+#include <Preferences.h>
+
+#define REKEY_NAMESPACE "rekey" // Preferences holding the checkpoint
+#define REKEY_WAIT_MS 1000      // Poll interval while waiting for an unlock
+
+TaskHandle_t RekeyHandler::taskHandle = nullptr;
+portMUX_TYPE RekeyHandler::statusMux = portMUX_INITIALIZER_UNLOCKED;
+RekeyStatus RekeyHandler::status = {REKEY_IDLE, 0, 0, 0, 0, 0, 0};
+uint32_t RekeyHandler::startedAt = 0;
+bool RekeyHandler::startPending = false;
+String RekeyHandler::pendingOld;
+String RekeyHandler::pendingNew;
+bool RekeyHandler::pendingQueued = false;
+
+const char *RekeyHandler::stateName(RekeyState state) {
+    switch (state) {
+    case REKEY_STARTING:
+        return "starting";
+    case REKEY_RUNNING:
+        return "running";
+    case REKEY_WAITING:
+        return "waiting for unlock";
+    case REKEY_DONE:
+        return "done";
+    case REKEY_REFUSED:
+        return "refused";
+    default:
+        return "idle";
+    }
+}
+
+void RekeyHandler::init() {
+    xTaskCreatePinnedToCore(
+        rekeyTask,     // Task function
+        "RekeyTask",   // Task name
+        4096,          // Stack size (records are parsed on the heap)
+        nullptr,       // Parameters
+        0,             // Priority (below loop())
+        &taskHandle,   // Task handle
+        tskNO_AFFINITY // Run on any core
+    );
+
+    registerCommands();
+
+    // A rotation that was cut short by a restart carries on from its checkpoint
+    if (CryptoHandler::isRekeying()) {
+        debugI("Resuming password change");
+        setState(REKEY_RUNNING);
+        xTaskNotifyGive(taskHandle);
+    }
+    debugI("RekeyHandler initialized");
+}
+
+// Only one change may be started at a time
+bool RekeyHandler::claimStart() {
+    portENTER_CRITICAL(&statusMux);
+    bool claimed = !startPending;
+    startPending = true;
+    portEXIT_CRITICAL(&statusMux);
+    if (!claimed || CryptoHandler::isRekeying()) {
+        if (claimed) {
+            releaseStart();
+        }
+        debugW("A password change is already in progress");
+        return false;
+    }
+    return true;
+}
+
+void RekeyHandler::releaseStart() {
+    portENTER_CRITICAL(&statusMux);
+    startPending = false;
+    portEXIT_CRITICAL(&statusMux);
+}
+
+bool RekeyHandler::isBusy() {
+    portENTER_CRITICAL(&statusMux);
+    bool pending = startPending;
+    portEXIT_CRITICAL(&statusMux);
+    return pending || CryptoHandler::isRekeying();
+}
+
+// Runs two key derivations, so never on the AsyncTCP task
+bool RekeyHandler::beginChange(const String &oldPassword, const String &newPassword) {
+    if (!CryptoHandler::beginRekey(oldPassword, newPassword)) {
+        return false;
+    }
+    saveCheckpoint(1);
+    return true;
+}
+
+bool RekeyHandler::start(const String &oldPassword, const String &newPassword) {
+    if (!claimStart()) {
+        return false;
+    }
+    bool ok = beginChange(oldPassword, newPassword);
+    releaseStart();
+    if (ok) {
+        setState(REKEY_RUNNING);
+        xTaskNotifyGive(taskHandle);
+    }
+    return ok;
+}
+
+bool RekeyHandler::startInBackground(const String &oldPassword, const String &newPassword) {
+    if (!claimStart()) {
+        return false;
+    }
+    // The claim keeps anyone else off these until the task has used them
+    pendingOld = oldPassword;
+    pendingNew = newPassword;
+    portENTER_CRITICAL(&statusMux);
+    pendingQueued = true;
+    status.state = REKEY_STARTING;
+    portEXIT_CRITICAL(&statusMux);
+    xTaskNotifyGive(taskHandle);
+    return true;
+}
+
+// Start the change asked for with startInBackground(), on the rekey task
+void RekeyHandler::beginPending() {
+    portENTER_CRITICAL(&statusMux);
+    bool queued = pendingQueued;
+    pendingQueued = false;
+    portEXIT_CRITICAL(&statusMux);
+    if (!queued) {
+        return;
+    }
+
+    String oldPassword = pendingOld;
+    String newPassword = pendingNew;
+    pendingOld = String();
+    pendingNew = String();
+
+    debugI("Deriving keys for the new password");
+    if (beginChange(oldPassword, newPassword)) {
+        ConfigManager::save();
+        setState(REKEY_RUNNING);
+    } else {
+        setState(REKEY_REFUSED);
+    }
+    releaseStart();
+}
+
+RekeyStatus RekeyHandler::getStatus() {
+    portENTER_CRITICAL(&statusMux);
+    RekeyStatus copy = status;
+    portEXIT_CRITICAL(&statusMux);
+    if (copy.state == REKEY_RUNNING || copy.state == REKEY_WAITING) {
+        copy.elapsedMs = millis() - startedAt;
+    }
+    return copy;
+}
+
+void RekeyHandler::setState(RekeyState state) {
+    portENTER_CRITICAL(&statusMux);
+    status.state = state;
+    portEXIT_CRITICAL(&statusMux);
+}
+
+void RekeyHandler::saveCheckpoint(uint32_t nextId) {
+    Preferences prefs;
+    if (prefs.begin(REKEY_NAMESPACE, false)) {
+        prefs.putUInt("next", nextId);
+        prefs.end();
+    }
+    portENTER_CRITICAL(&statusMux);
+    status.nextId = nextId;
+    portEXIT_CRITICAL(&statusMux);
+}
+
+void RekeyHandler::rekeyTask(void *pvParameters) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        beginPending();
+        run();
+    }
+}
+
+// Block until someone unlocks the session, e.g. with CRYPTO UNLOCK after a
+// restart where the saved settings still hold the old password
+void RekeyHandler::waitForUnlock() {
+    debugW("Password change paused until the vault is unlocked with the new password");
+    setState(REKEY_WAITING);
+    while (!CryptoHandler::isUnlocked()) {
+        vTaskDelay(pdMS_TO_TICKS(REKEY_WAIT_MS));
+    }
+    setState(REKEY_RUNNING);
+}
+
+// Re-encrypt one button's password if it is not under the current key.
+// Returns true if the record was rewritten, or still needs to be. The record is written back only
+// if nothing was saved since it was read, so a web edit made while the
+// password was being re-encrypted is never overwritten; the edit is read
+// and gone over again instead.
+bool RekeyHandler::rekeyButton(uint32_t id) {
+    for (int attempt = 0; attempt < REKEY_PUT_ATTEMPTS; attempt++) {
+        JsonDocument doc;
+        uint32_t generation;
+        if (!DatabaseHandler::buttons.get(id, doc, generation)) {
+            return false;
+        }
+        const char *password = doc["userPassword"] | "";
+        size_t length = strlen(password);
+        if (length == 0 || !CryptoHandler::needsRekey(password, length)) {
+            return false;
+        }
+
+        String text(password);
+        while (!CryptoHandler::reencrypt(text)) {
+            if (CryptoHandler::isUnlocked()) {
+                // Decryptable by neither key; it was already unusable
+                debugW("Button %u password could not be decrypted, left as it was", (unsigned int)id);
+                portENTER_CRITICAL(&statusMux);
+                status.unreadable++;
+                portEXIT_CRITICAL(&statusMux);
+                return false;
+            }
+            waitForUnlock();
+        }
+
+        doc["userPassword"] = text;
+        bool conflict;
+        if (DatabaseHandler::buttons.putIf(id, doc.as<JsonObjectConst>(), generation, conflict)) {
+            ButtonHandler::buttonSaved(doc.as<JsonObjectConst>());
+            portENTER_CRITICAL(&statusMux);
+            status.converted++;
+            portEXIT_CRITICAL(&statusMux);
+            return true;
+        }
+        if (!conflict) {
+            debugE("Failed to save button %u", (unsigned int)id);
+            return false;
+        }
+        debugV("Button %u changed while re-encrypting, reading it again", (unsigned int)id);
+    }
+    // Still being edited; counts as work left, so another walk comes back to it
+    debugW("Button %u kept changing, left for the next pass", (unsigned int)id);
+    return true;
+}
+
+// Walk the buttons from the checkpoint, then again from the start until a
+// whole walk finds nothing left under the old key. Web edits made meanwhile
+// are encrypted under the new key, but one that raced a batch could still
+// have written old text back, which the last walk catches.
+void RekeyHandler::run() {
+    if (!CryptoHandler::isRekeying()) {
+        return;
+    }
+
+    Preferences prefs;
+    uint32_t next = 1;
+    if (prefs.begin(REKEY_NAMESPACE, true)) {
+        next = prefs.getUInt("next", 1);
+        prefs.end();
+    }
+
+    startedAt = millis();
+    portENTER_CRITICAL(&statusMux);
+    status = {REKEY_RUNNING, next, 0, 0, 0, 0, 0};
+    portEXIT_CRITICAL(&statusMux);
+    debugI("Re-encrypting button passwords from id %u", (unsigned int)next);
+
+    bool fullWalk = next <= 1;
+    while (true) {
+        uint32_t rewritten = 0;
+        size_t inBatch = 0;
+        for (uint32_t id = next; id < DatabaseHandler::buttons.nextId(); id++) {
+            if (!DatabaseHandler::buttons.contains(id)) {
+                continue;
+            }
+            if (rekeyButton(id)) {
+                rewritten++;
+            }
+            if (++inBatch == REKEY_BATCH_SIZE) {
+                saveCheckpoint(id + 1);
+                DatabaseHandler::recordChanged(DatabaseHandler::buttons);
+                vTaskDelay(pdMS_TO_TICKS(REKEY_BATCH_DELAY_MS));
+                inBatch = 0;
+            }
+        }
+
+        portENTER_CRITICAL(&statusMux);
+        status.passes++;
+        status.lastId = DatabaseHandler::buttons.nextId();
+        portEXIT_CRITICAL(&statusMux);
+        if (fullWalk && rewritten == 0) {
+            break;
+        }
+        next = 1;
+        fullWalk = true;
+        saveCheckpoint(next);
+    }
+
+    DatabaseHandler::recordChanged(DatabaseHandler::buttons);
+    if (!CryptoHandler::finishRekey()) {
+        setState(REKEY_IDLE);
+        return;
+    }
+    if (prefs.begin(REKEY_NAMESPACE, false)) {
+        prefs.clear();
+        prefs.end();
+    }
+
+    portENTER_CRITICAL(&statusMux);
+    status.state = REKEY_DONE;
+    status.nextId = status.lastId;
+    status.elapsedMs = millis() - startedAt;
+    portEXIT_CRITICAL(&statusMux);
+    debugI("Password change done: %u passwords re-encrypted in %u ms", (unsigned int)status.converted,
+           (unsigned int)status.elapsedMs);
+}
+
+void RekeyHandler::registerCommands() {
+    CommandHandler::registerCommand("REKEY", [](const CommandArgs &args, CommandResult &result) {
+        const CommandToken &cmd = args[0];
+
+        if (cmd.isEmpty() || cmd.equals("STATUS")) {
+            RekeyStatus rekey = getStatus();
+            JsonDocument doc;
+            doc["state"] = stateName(rekey.state);
+            doc["nextId"] = rekey.nextId;
+            doc["lastId"] = rekey.lastId;
+            doc["converted"] = rekey.converted;
+            doc["unreadable"] = rekey.unreadable;
+            doc["passes"] = rekey.passes;
+            doc["elapsedMs"] = rekey.elapsedMs;
+            result.json(doc);
+        } else if (cmd.equals("START")) {
+            if (args[2].isEmpty()) {
+                result.fail(CMD_STATUS_BAD_REQUEST, "Usage: REKEY START <current password> <new password>");
+            } else if (start(args[1].toString(), args.rest(2).toString())) {
+                ConfigManager::save();
+                result.printf("Password changed; re-encrypting buttons in the background");
+            } else {
+                result.fail(CMD_STATUS_FAILED, "Password change refused");
+            }
+        } else {
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown REKEY subcommand: %.*s", (int)cmd.length, cmd.data);
+        }
+    }, "Changes the device password and re-encrypts stored passwords. Usage: REKEY <subcommand> <args>\n"
+       "  Subcommands:\n"
+       "  status - Shows the progress of a password change\n"
+       "  start <current password> <new password> - Changes the password and starts re-encrypting");
+}
+
+#endif // ENABLE_CRYPTO_HANDLER
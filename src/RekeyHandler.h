@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifdef ENABLE_CRYPTO_HANDLER
+
+#include "CommandHandler.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Buttons re-encrypted between checkpoints and pauses
+#ifndef REKEY_BATCH_SIZE
+#define REKEY_BATCH_SIZE 8
+#endif
+
+// Pause after each batch, so presses and web requests are not held up
+#ifndef REKEY_BATCH_DELAY_MS
+#define REKEY_BATCH_DELAY_MS 50
+#endif
+
+// Times a button is read again after a web edit beat its re-encrypted copy
+#ifndef REKEY_PUT_ATTEMPTS
+#define REKEY_PUT_ATTEMPTS 3
+#endif
+
+enum RekeyState : uint8_t {
+    REKEY_IDLE,
+    REKEY_STARTING, // Deriving the old and new keys
+    REKEY_RUNNING,
+    REKEY_WAITING, // Session locked by the user; resumes after CRYPTO UNLOCK
+    REKEY_DONE,
+    REKEY_REFUSED // The current password did not unlock the vault; nothing changed
+};
+
+struct RekeyStatus {
+    RekeyState state;
+    uint32_t nextId;     // Checkpoint: first button id of the next batch
+    uint32_t lastId;     // One past the highest button id
+    uint32_t converted;  // Passwords re-encrypted so far
+    uint32_t unreadable; // Passwords that could not be decrypted and were left as they were
+    uint32_t passes;     // Walks over the buttons; the last one finds nothing to do
+    uint32_t elapsedMs;
+};
+
+// Re-encrypts every stored button password after the master password
+// changes. A low-priority task walks the button records in id order, a
+// batch at a time, and checkpoints the next id in preferences after each
+// batch. The vault keeps the old key until a full walk finds nothing left
+// under it, so a restart part way simply resumes from the checkpoint.
+class RekeyHandler
+{
+public:
+    static void init();
+
+    // Switch the vault to newPassword and start re-encrypting. Fails, and
+    // changes nothing, if oldPassword does not unlock the vault.
+    static bool start(const String &oldPassword, const String &newPassword);
+    // The same, but the keys are derived on the rekey task, so this returns
+    // at once; the outcome shows in getStatus(). For callers on the AsyncTCP
+    // task. Saves the settings once the vault has the new password.
+    static bool startInBackground(const String &oldPassword, const String &newPassword);
+    // True while a password change is being started or carried out
+    static bool isBusy();
+    static RekeyStatus getStatus();
+    static const char *stateName(RekeyState state);
+
+private:
+    static TaskHandle_t taskHandle;
+    static portMUX_TYPE statusMux;
+    static RekeyStatus status;
+    static uint32_t startedAt;
+    static bool startPending; // A start() or startInBackground() owns the fields below
+    static String pendingOld;
+    static String pendingNew;
+    static bool pendingQueued; // Set once they are filled in, for the task
+
+    static bool claimStart();
+    static void releaseStart();
+    static bool beginChange(const String &oldPassword, const String &newPassword);
+    static void beginPending();
+    static void rekeyTask(void *pvParameters);
+    static void run();
+    static bool rekeyButton(uint32_t id);
+    static void waitForUnlock();
+    static void saveCheckpoint(uint32_t nextId);
+    static void setState(RekeyState state);
+    static void registerCommands();
+};
+
+#else
+
+enum RekeyState : uint8_t {
+    REKEY_IDLE,
+    REKEY_STARTING,
+    REKEY_RUNNING,
+    REKEY_WAITING,
+    REKEY_DONE,
+    REKEY_REFUSED
+};
+
+struct RekeyStatus {
+    RekeyState state;
+    uint32_t nextId;
+    uint32_t lastId;
+    uint32_t converted;
+    uint32_t unreadable;
+    uint32_t passes;
+    uint32_t elapsedMs;
+};
+
+class RekeyHandler
+{
+public:
+    static void init() {}
+    static bool start(const String &oldPassword, const String &newPassword) { return true; }
+    static bool startInBackground(const String &oldPassword, const String &newPassword) { return true; }
+    static bool isBusy() { return false; }
+    static RekeyStatus getStatus() { return RekeyStatus(); }
+    static const char *stateName(RekeyState state) { return "idle"; }
+};
+
+#endif // ENABLE_CRYPTO_HANDLER
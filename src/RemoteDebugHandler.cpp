@@ -36,7 +36,15 @@ void RemoteDebugHandler::init()
 // Store the custom command handling logic in a global or class-level function
 void RemoteDebugHandler::handleCustomCommands() {
     String command = Debug.getLastCommand(); // Retrieve the last received command
-    CommandHandler::handleCommand(command); // Pass the command to the CommandHandler
+    if (!CommandBus::submit(command, CMD_SOURCE_CONSOLE, 0, commandDone)) { // Run it on the command executor
+        debugA("Command queue full, try again");
+    }
+}
+
+// The result text itself is logged by CommandHandler; close it off with the
+// status so it shows whatever debug level the console is set to
+void RemoteDebugHandler::commandDone(uint32_t correlationId, const CommandResult &result, void *ctx) {
+    debugA("[%lu] %u in %lu us", (unsigned long)correlationId, (unsigned)result.status(), (unsigned long)result.durationUs());
 }
 
 #endif // ENABLE_REMOTE_DEBUG_HANDLER
\ No newline at end of file
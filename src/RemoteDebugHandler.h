@@ -7,6 +7,8 @@
 // Declare the RemoteDebug instance
 extern RemoteDebug Debug;
 
+class CommandResult;
+
 class RemoteDebugHandler {
 public:
     static void loop();
@@ -15,6 +17,7 @@ public:
 
 private:
     static void handleCustomCommands();
+    static void commandDone(uint32_t correlationId, const CommandResult &result, void *ctx);
 };
 
 #else
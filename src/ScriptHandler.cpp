@@ -57,21 +57,21 @@ void ScriptHandler::scriptTask(void *pvParameters)
     }
 }
 
-void ScriptHandler::handleScriptFile(const String &args)
+void ScriptHandler::handleScriptFile(const String &args, CommandResult &result)
 {
     if (args.isEmpty()) {
-        debugW("SCRIPT FILE requires a file path. Usage: SCRIPT FILE <path>");
+        result.fail(CMD_STATUS_BAD_REQUEST, "SCRIPT FILE requires a file path. Usage: SCRIPT FILE <path>");
         return;
     }
 
     if (!LittleFS.exists(args)) {
-        debugW("Script file not found: %s", args.c_str());
+        result.fail(CMD_STATUS_NOT_FOUND, "Script file not found: %s", args.c_str());
         return;
     }
 
     File scriptFile = LittleFS.open(args, "r");
     if (!scriptFile) {
-        debugE("Failed to open script file: %s", args.c_str());
+        result.fail(CMD_STATUS_FAILED, "Failed to open script file: %s", args.c_str());
         return;
     }
 
@@ -96,7 +96,7 @@ void ScriptHandler::handleScriptFile(const String &args)
     }
 
     scriptFile.close();
-    debugI("Finished executing script file: %s", args.c_str());
+    result.printf("Finished executing script file: %s", args.c_str());
 }
 
 bool ScriptHandler::handleSpecialScriptCommand(const String &line)
@@ -128,7 +128,7 @@ bool ScriptHandler::handleSpecialScriptCommand(const String &line)
 
 void ScriptHandler::executeCommand(const String &command)
 {
-    CommandHandler::handleCommand(command);
+    CommandBus::submitAndWait(command, CMD_SOURCE_SCRIPT);
 
     // Apply the default delay after executing the command
     if (defaultDelay > 0) {
@@ -138,14 +138,13 @@ void ScriptHandler::executeCommand(const String &command)
 
 void ScriptHandler::registerCommands()
 {
-    CommandHandler::registerCommand("SCRIPT", [](const String &command) {
-        String subCommand, args;
-        CommandHandler::parseCommand(command, subCommand, args);
+    CommandHandler::registerCommand("SCRIPT", [](const CommandArgs &args, CommandResult &result) {
+        const CommandToken &subCommand = args[0];
 
-        if (CommandHandler::equalsIgnoreCase(subCommand, "FILE")) {
-            handleScriptFile(args);
+        if (subCommand.equals("FILE")) {
+            handleScriptFile(args.rest(1).toString(), result);
         } else {
-            debugW("Unknown SCRIPT subcommand: %s", subCommand.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown SCRIPT subcommand: %.*s", (int)subCommand.length, subCommand.data);
         }
     },
     "Handles SCRIPT commands. Usage: SCRIPT <subcommand> [args]\n"
@@ -17,7 +17,7 @@ private:
     static void scriptTask(void *pvParameters);
 
     // Handles the SCRIPT FILE subcommand to execute script files
-    static void handleScriptFile(const String &args);
+    static void handleScriptFile(const String &args, CommandResult &result);
 
     // Registers the SCRIPT command and its subcommands
     static void registerCommands();
@@ -0,0 +1,360 @@
+#include "SecureFile.h"
+#include "Globals.h"
+#include "CryptoHandler.h"
+#include <LittleFS.h>
+#include <aes/esp_aes.h>
+#include "mbedtls/platform_util.h"
+
+static const size_t TAG_SIZE = CryptoHandler::CHUNK_TAG_SIZE;
+
+void SecureFile::buildAad(const SecureFileHeader &header, bool last, uint8_t *aad) {
+    memcpy(aad, &header, sizeof(header));
+    aad[sizeof(header)] = last ? 1 : 0;
+}
+
+void SecureFile::buildNonce(const SecureFileHeader &header, uint32_t index, uint8_t *nonce) {
+    memcpy(nonce, header.noncePrefix, sizeof(header.noncePrefix));
+    nonce[8] = index >> 24;
+    nonce[9] = index >> 16;
+    nonce[10] = index >> 8;
+    nonce[11] = index;
+}
+
+bool SecureFile::isEncrypted(File &file) {
+    SecureFileHeader header;
+    file.seek(0);
+    bool encrypted = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == MAGIC;
+    file.seek(0);
+    return encrypted;
+}
+
+bool SecureFile::isEncrypted(const char *path) {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
+    }
+    bool encrypted = isEncrypted(file);
+    file.close();
+    return encrypted;
+}
+
+// Writes go to dst + ".tmp" first, so a failure part way leaves dst as it was
+bool SecureFile::encryptFile(const char *src, const char *dst) {
+    File in = LittleFS.open(src, "r");
+    if (!in) {
+        debugE("Failed to open %s", src);
+        return false;
+    }
+    if (isEncrypted(in)) {
+        debugW("%s is already encrypted", src);
+        in.close();
+        return false;
+    }
+
+    String tempPath = String(dst) + ".tmp";
+    SecureFileWriter writer;
+    bool ok = writer.open(tempPath.c_str());
+    uint8_t chunk[CHUNK_SIZE];
+    while (ok && in.available()) {
+        size_t bytesRead = in.read(chunk, sizeof(chunk));
+        if (bytesRead == 0) break;
+        ok = writer.write(chunk, bytesRead) == bytesRead;
+    }
+    mbedtls_platform_zeroize(chunk, sizeof(chunk));
+    in.close();
+    ok = writer.close() && ok;
+
+    if (!ok || (LittleFS.exists(dst) && !LittleFS.remove(dst)) || !LittleFS.rename(tempPath, dst)) {
+        debugE("Failed to encrypt %s", src);
+        LittleFS.remove(tempPath);
+        return false;
+    }
+    debugI("Encrypted %s to %s", src, dst);
+    return true;
+}
+
+bool SecureFile::decryptFile(const char *src, const char *dst) {
+    SecureFileReader reader;
+    if (!reader.open(src)) {
+        return false;
+    }
+
+    String tempPath = String(dst) + ".tmp";
+    File out = LittleFS.open(tempPath, "w");
+    if (!out) {
+        debugE("Failed to create %s", tempPath.c_str());
+        return false;
+    }
+
+    uint8_t chunk[CHUNK_SIZE];
+    int bytesRead;
+    bool ok = true;
+    while (ok && (bytesRead = reader.read(chunk, sizeof(chunk))) > 0) {
+        ok = out.write(chunk, bytesRead) == (size_t)bytesRead;
+    }
+    mbedtls_platform_zeroize(chunk, sizeof(chunk));
+    ok = ok && !reader.failed();
+    reader.close();
+    out.close();
+
+    if (!ok || (LittleFS.exists(dst) && !LittleFS.remove(dst)) || !LittleFS.rename(tempPath, dst)) {
+        debugE("Failed to decrypt %s", src);
+        LittleFS.remove(tempPath);
+        return false;
+    }
+    debugI("Decrypted %s to %s", src, dst);
+    return true;
+}
+
+static uint32_t kilobytesPerSecond(size_t bytes, uint32_t us) {
+    return (uint64_t)bytes * 1000000 / 1024 / (us ? us : 1);
+}
+
+// The AES engine alone (CTR, no authentication) is the ceiling; GCM adds
+// GHASH in software, and the file rows add LittleFS on top
+void SecureFile::benchmark(size_t kilobytes, CommandResult &result) {
+    static const char *benchPath = "/secure-bench.enc";
+    size_t total = kilobytes * 1024;
+    uint8_t *chunk = (uint8_t *)malloc(CHUNK_SIZE + TAG_SIZE);
+    if (!chunk) {
+        result.fail(CMD_STATUS_FAILED, "No memory for the benchmark buffer");
+        return;
+    }
+    memset(chunk, 'x', CHUNK_SIZE);
+    result.printf("securefilebench: %u KB in %u byte chunks\n", (unsigned int)kilobytes, (unsigned int)CHUNK_SIZE);
+
+    uint8_t key[32], counter[16] = {0}, stream[16];
+    size_t offset = 0;
+    esp_fill_random(key, sizeof(key));
+    esp_aes_context aes;
+    esp_aes_init(&aes);
+    esp_aes_setkey(&aes, key, 256);
+    uint32_t start = micros();
+    for (size_t done = 0; done < total; done += CHUNK_SIZE) {
+        esp_aes_crypt_ctr(&aes, CHUNK_SIZE, &offset, counter, stream, chunk, chunk);
+    }
+    uint32_t ctrUs = micros() - start;
+    esp_aes_free(&aes);
+    mbedtls_platform_zeroize(key, sizeof(key));
+    result.printf("  esp_aes CTR (engine only): %u KB/s\n", (unsigned int)kilobytesPerSecond(total, ctrUs));
+
+    SecureFileHeader header = {MAGIC, VERSION, 0, CHUNK_SIZE, {0}};
+    uint8_t aad[AAD_SIZE], nonce[CryptoHandler::CHUNK_NONCE_SIZE];
+    buildAad(header, false, aad);
+    bool ok = true;
+    start = micros();
+    for (uint32_t index = 0; ok && index * CHUNK_SIZE < total; index++) {
+        buildNonce(header, index, nonce);
+        ok = CryptoHandler::sealChunk(nonce, aad, sizeof(aad), chunk, CHUNK_SIZE, chunk + CHUNK_SIZE);
+    }
+    uint32_t gcmUs = micros() - start;
+    if (!ok) {
+        free(chunk);
+        result.fail(CMD_STATUS_FAILED, "Chunk encryption failed; is the crypto session locked?");
+        return;
+    }
+    result.printf("  mbedTLS GCM chunks: %u KB/s\n", (unsigned int)kilobytesPerSecond(total, gcmUs));
+
+    SecureFileWriter writer;
+    start = micros();
+    ok = writer.open(benchPath);
+    for (size_t done = 0; ok && done < total; done += CHUNK_SIZE) {
+        ok = writer.write(chunk, CHUNK_SIZE) == CHUNK_SIZE;
+    }
+    ok = writer.close() && ok;
+    uint32_t writeUs = micros() - start;
+
+    SecureFileReader reader;
+    size_t readBytes = 0;
+    int bytesRead = 0;
+    start = micros();
+    if (ok && reader.open(benchPath)) {
+        while ((bytesRead = reader.read(chunk, CHUNK_SIZE)) > 0) {
+            readBytes += bytesRead;
+        }
+        reader.close();
+    }
+    uint32_t readUs = micros() - start;
+    LittleFS.remove(benchPath);
+    free(chunk);
+
+    if (!ok || readBytes != total) {
+        result.fail(CMD_STATUS_FAILED, "File round trip failed (%u of %u bytes)", (unsigned int)readBytes, (unsigned int)total);
+        return;
+    }
+    result.printf("  encrypted file write: %u KB/s\n", (unsigned int)kilobytesPerSecond(total, writeUs));
+    result.printf("  encrypted file read: %u KB/s", (unsigned int)kilobytesPerSecond(total, readUs));
+}
+
+SecureFileWriter::SecureFileWriter() : buffer(nullptr), filled(0), index(0), failed(false) {}
+
+SecureFileWriter::~SecureFileWriter() {
+    if (buffer) {
+        mbedtls_platform_zeroize(buffer, SecureFile::CHUNK_SIZE + TAG_SIZE);
+        free(buffer);
+    }
+    if (file) {
+        file.close();
+    }
+}
+
+bool SecureFileWriter::open(const char *path) {
+    buffer = (uint8_t *)malloc(SecureFile::CHUNK_SIZE + TAG_SIZE);
+    file = LittleFS.open(path, "w");
+    if (!buffer || !file) {
+        debugE("Failed to open %s for encryption", path);
+        failed = true;
+        return false;
+    }
+
+    header.magic = SecureFile::MAGIC;
+    header.version = SecureFile::VERSION;
+    header.reserved = 0;
+    header.chunkSize = SecureFile::CHUNK_SIZE;
+    esp_fill_random(header.noncePrefix, sizeof(header.noncePrefix));
+    if (file.write((const uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+        debugE("Failed to write header to %s", path);
+        failed = true;
+    }
+    return !failed;
+}
+
+bool SecureFileWriter::sealChunk(bool last) {
+    uint8_t aad[SecureFile::AAD_SIZE];
+    uint8_t nonce[CryptoHandler::CHUNK_NONCE_SIZE];
+    SecureFile::buildAad(header, last, aad);
+    SecureFile::buildNonce(header, index, nonce);
+
+    if (!CryptoHandler::sealChunk(nonce, aad, sizeof(aad), buffer, filled, buffer + filled) ||
+        file.write(buffer, filled + TAG_SIZE) != filled + TAG_SIZE) {
+        failed = true;
+        return false;
+    }
+    index++;
+    filled = 0;
+    return true;
+}
+
+size_t SecureFileWriter::write(const uint8_t *data, size_t length) {
+    size_t written = 0;
+    while (!failed && written < length) {
+        // A full chunk is only sealed once more data shows it is not the last
+        if (filled == SecureFile::CHUNK_SIZE && !sealChunk(false)) {
+            break;
+        }
+        size_t n = min(length - written, SecureFile::CHUNK_SIZE - filled);
+        memcpy(buffer + filled, data + written, n);
+        filled += n;
+        written += n;
+    }
+    return written;
+}
+
+bool SecureFileWriter::close() {
+    if (!file) {
+        return false;
+    }
+    bool ok = !failed && sealChunk(true);
+    file.close();
+    return ok;
+}
+
+SecureFileReader::SecureFileReader() : buffer(nullptr), filled(0), consumed(0), index(0), last(false), error(false) {}
+
+SecureFileReader::~SecureFileReader() {
+    close();
+}
+
+bool SecureFileReader::open(const char *path) {
+    File source = LittleFS.open(path, "r");
+    if (!source) {
+        debugE("Failed to open %s", path);
+        return false;
+    }
+    return open(source);
+}
+
+bool SecureFileReader::open(File &source) {
+    file = source;
+    buffer = (uint8_t *)malloc(SecureFile::CHUNK_SIZE + TAG_SIZE);
+    // The first chunk is opened up front so a locked vault or a wrong key
+    // fails here, before a caller has sent or typed anything
+    if (!buffer || !readHeader() || !openChunk()) {
+        close();
+        error = true;
+        return false;
+    }
+    return true;
+}
+
+bool SecureFileReader::readHeader() {
+    file.seek(0);
+    if (file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) || header.magic != SecureFile::MAGIC) {
+        debugE("%s is not an encrypted file", file.path());
+        return false;
+    }
+    if (header.version != SecureFile::VERSION || header.chunkSize == 0 || header.chunkSize > SecureFile::CHUNK_SIZE) {
+        debugE("Unsupported encrypted file version %u, chunk size %u", header.version, header.chunkSize);
+        return false;
+    }
+    return true;
+}
+
+// Read, authenticate and decrypt the next chunk into buffer
+bool SecureFileReader::openChunk() {
+    size_t wanted = header.chunkSize + TAG_SIZE;
+    size_t got = file.read(buffer, wanted);
+    if (got < TAG_SIZE) {
+        debugE("Encrypted file ends early at chunk %u", (unsigned int)index);
+        return false;
+    }
+    last = got < wanted || !file.available();
+
+    uint8_t aad[SecureFile::AAD_SIZE];
+    uint8_t nonce[CryptoHandler::CHUNK_NONCE_SIZE];
+    SecureFile::buildAad(header, last, aad);
+    SecureFile::buildNonce(header, index, nonce);
+    filled = got - TAG_SIZE;
+    consumed = 0;
+    if (!CryptoHandler::openChunk(nonce, aad, sizeof(aad), buffer, filled, buffer + filled)) {
+        filled = 0;
+        return false;
+    }
+    index++;
+    return true;
+}
+
+int SecureFileReader::read(uint8_t *data, size_t length) {
+    if (error || !buffer) {
+        return -1;
+    }
+    size_t copied = 0;
+    while (copied < length) {
+        if (consumed == filled) {
+            if (last) {
+                break;
+            }
+            if (!openChunk()) {
+                error = true;
+                return -1;
+            }
+            continue;
+        }
+        size_t n = min(length - copied, filled - consumed);
+        memcpy(data + copied, buffer + consumed, n);
+        consumed += n;
+        copied += n;
+    }
+    return copied;
+}
+
+void SecureFileReader::close() {
+    if (buffer) {
+        mbedtls_platform_zeroize(buffer, SecureFile::CHUNK_SIZE + TAG_SIZE);
+        free(buffer);
+        buffer = nullptr;
+    }
+    if (file) {
+        file.close();
+    }
+}
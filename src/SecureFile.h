@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "CommandHandler.h"
+
+// Header at the start of an encrypted file
+struct SecureFileHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t chunkSize;     // Plaintext bytes per chunk; the last one may be shorter
+    uint8_t noncePrefix[8]; // Random per file; the chunk index makes up the rest of the nonce
+};
+
+// Files encrypted at rest as a stream of AES-256-GCM chunks under the vault
+// file key (see CryptoHandler::sealChunk):
+//
+//   header | chunk 0 | chunk 1 | ... | last chunk
+//   chunk  = ciphertext (chunkSize bytes, fewer for the last) | 16 byte tag
+//
+// A chunk's tag also covers the header and whether it is the last chunk, so
+// chunks cannot be reordered, moved between files or cut off at the end
+// without the reader noticing. Only one chunk of plaintext is ever in RAM.
+class SecureFile
+{
+public:
+    static const uint32_t MAGIC = 0x45585450; // "PTXE"
+    static const uint8_t VERSION = 1;
+    static const size_t CHUNK_SIZE = 512;
+
+    static bool isEncrypted(File &file); // Leaves the position at the start
+    static bool isEncrypted(const char *path);
+
+    // Encrypt or decrypt a whole file through a temporary file that then
+    // replaces dst (which may be the same path as src)
+    static bool encryptFile(const char *src, const char *dst);
+    static bool decryptFile(const char *src, const char *dst);
+
+    // Time chunk sealing straight on the AES engine and through the file
+    // stream, for kilobytes of data
+    static void benchmark(size_t kilobytes, CommandResult &result);
+
+    static void buildAad(const SecureFileHeader &header, bool last, uint8_t *aad);
+    static void buildNonce(const SecureFileHeader &header, uint32_t index, uint8_t *nonce);
+    static const size_t AAD_SIZE = sizeof(SecureFileHeader) + 1;
+};
+
+// Writes plaintext as an encrypted file. close() seals the last chunk; a
+// writer destroyed without close() leaves an unreadable file behind.
+class SecureFileWriter
+{
+public:
+    SecureFileWriter();
+    ~SecureFileWriter();
+
+    bool open(const char *path);
+    size_t write(const uint8_t *data, size_t length);
+    bool close();
+
+private:
+    File file;
+    SecureFileHeader header;
+    uint8_t *buffer; // One chunk plus its tag
+    size_t filled;
+    uint32_t index;
+    bool failed;
+
+    bool sealChunk(bool last);
+};
+
+// Reads the plaintext of an encrypted file one chunk at a time. read()
+// returns -1 once a chunk fails to authenticate; nothing from that chunk
+// is returned.
+class SecureFileReader
+{
+public:
+    SecureFileReader();
+    ~SecureFileReader();
+
+    bool open(const char *path);
+    bool open(File &source); // Takes over an already open file
+    // open() also authenticates the first chunk, so it fails if the vault is locked
+    int read(uint8_t *data, size_t length);
+    bool failed() const { return error; }
+    void close();
+
+private:
+    File file;
+    SecureFileHeader header;
+    uint8_t *buffer;
+    size_t filled;   // Plaintext bytes in buffer
+    size_t consumed; // Of those, already returned
+    uint32_t index;
+    bool last;
+    bool error;
+
+    bool readHeader();
+    bool openChunk();
+};
@@ -33,17 +33,17 @@ void TemplateHandler::debugLevels()
 
 void TemplateHandler::registerCommands()
 {
-    CommandHandler::registerCommand("TEMPLATE", [](const String &command)
+    CommandHandler::registerCommand("TEMPLATE", [](const CommandArgs &args, CommandResult &result)
                                     {
-        String cmd, args;
-        CommandHandler::parseCommand(command, cmd, args);
+        const CommandToken &cmd = args[0];
 
-        if (CommandHandler::equalsIgnoreCase(cmd, "DEBUG")) {
+        if (cmd.equals("DEBUG")) {
             debugLevels();
-        } else if (CommandHandler::equalsIgnoreCase(cmd, "HELLO")) {
-            debugI("Hello World!");
+            result.printf("Debug levels printed");
+        } else if (cmd.equals("HELLO")) {
+            result.printf("Hello World!");
         } else {
-            debugW("Unknown TEMPLATE subcommand: %s", cmd.c_str());
+            result.fail(CMD_STATUS_BAD_REQUEST, "Unknown TEMPLATE subcommand: %.*s", (int)cmd.length, cmd.data);
         } }, "Handles TEMPLATE commands. Usage: TEMPLATE <subcommand> [args]\n"
                                          "  Subcommands:\n"
                                          "  debug - Prints debug levels\n"
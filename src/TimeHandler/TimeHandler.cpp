@@ -86,7 +86,7 @@ void TimeHandler::syncTime()
         return;
     }
 
-    debugI("TimeHandler: Time successfully synchronized. Current local time: %s", formatDateTime("%Y-%m-%d %I:%M:%S %p"));
+    debugI("TimeHandler: Time successfully synchronized. Current local time: %s", formatDateTime("%Y-%m-%d %I:%M:%S %p").c_str());
     // debugD("TimeHandler: DST flag (tm_isdst): %d", timeinfo.tm_isdst);
 
     isTimeSynced = true;
@@ -162,40 +162,40 @@ String TimeHandler::formatDateTime(const char *format, time_t timestamp)
 void TimeHandler::logAllDateTimeFormats()
 {
     // Full Date-Time (12-hour format with AM/PM)
-    debugI("Full Date-Time (12-hour): %s", formatDateTime("%Y-%m-%d %I:%M:%S %p"));
+    debugI("Full Date-Time (12-hour): %s", formatDateTime("%Y-%m-%d %I:%M:%S %p").c_str());
 
     // Full Date-Time (24-hour format)
-    debugI("Full Date-Time (24-hour): %s", formatDateTime("%Y-%m-%d %H:%M:%S"));
+    debugI("Full Date-Time (24-hour): %s", formatDateTime("%Y-%m-%d %H:%M:%S").c_str());
 
     // Date Only
-    debugI("Date Only: %s", formatDateTime("%Y-%m-%d"));
+    debugI("Date Only: %s", formatDateTime("%Y-%m-%d").c_str());
 
     // Time Only (12-hour format with AM/PM)
-    debugI("Time Only (12-hour): %s", formatDateTime("%I:%M:%S %p"));
+    debugI("Time Only (12-hour): %s", formatDateTime("%I:%M:%S %p").c_str());
 
     // Time Only (24-hour format)
-    debugI("Time Only (24-hour): %s", formatDateTime("%H:%M:%S"));
+    debugI("Time Only (24-hour): %s", formatDateTime("%H:%M:%S").c_str());
 
     // Day of the Week
-    debugI("Day of the Week: %s", formatDateTime("%A"));
+    debugI("Day of the Week: %s", formatDateTime("%A").c_str());
 
     // Month and Year
-    debugI("Month and Year: %s", formatDateTime("%B %Y"));
+    debugI("Month and Year: %s", formatDateTime("%B %Y").c_str());
 
     // Weekday, Month, and Date
-    debugI("Weekday, Month, Date: %s", formatDateTime("%A, %B %d"));
+    debugI("Weekday, Month, Date: %s", formatDateTime("%A, %B %d").c_str());
 
     // Short Date-Time (MM/DD/YY HH:MM)
-    debugI("Short Date-Time: %s", formatDateTime("%m/%d/%y %H:%M"));
+    debugI("Short Date-Time: %s", formatDateTime("%m/%d/%y %H:%M").c_str());
 
     // ISO 8601 Format
-    debugI("ISO 8601 Format: %s", formatDateTime("%Y-%m-%dT%H:%M:%S"));
+    debugI("ISO 8601 Format: %s", formatDateTime("%Y-%m-%dT%H:%M:%S").c_str());
 
     // Linux Epoch Time
     debugI("Linux Epoch Time: %ld", time(nullptr));
 
     // Custom Timezone String
-    debugI("Custom Timezone: %s", formatDateTime("%Z"));
+    debugI("Custom Timezone: %s", formatDateTime("%Z").c_str());
 }
 
 #endif // ENABLE_TIME_HANDLER
\ No newline at end of file
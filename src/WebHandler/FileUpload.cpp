@@ -0,0 +1,245 @@
+#ifdef ENABLE_WEB_HANDLER
+
+#include "FileUpload.h"
+#include "Globals.h"
+#include "WebHandler.h"
+#include "SecureFile.h"
+#include "CryptoHandler.h"
+#include <new>
+
+std::vector<FileUpload::State *> FileUpload::active;
+
+static bool parseSha256(const String &hex, uint8_t *digest)
+{
+    if (hex.length() != 64) {
+        return false;
+    }
+    for (size_t i = 0; i < 32; i++) {
+        char pair[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
+        char *end;
+        digest[i] = (uint8_t)strtoul(pair, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+FileUpload::State *FileUpload::state(AsyncWebServerRequest *request)
+{
+    return (State *)request->_tempObject;
+}
+
+bool FileUpload::begin(AsyncWebServerRequest *request, const String &path, const String &sha256, bool encrypt)
+{
+    for (State *upload : active) {
+        if (upload->path == path) {
+            WebHandler::sendErrorResponse(request, 409, "Another upload to this file is in progress");
+            return false;
+        }
+    }
+
+    if (encrypt && !CryptoHandler::unlockInBackground()) {
+        WebHandler::sendVaultLocked(request);
+        return false;
+    }
+
+    uint8_t expected[32];
+    bool hashing = !sha256.isEmpty();
+    if (hashing && !parseSha256(sha256, expected)) {
+        WebHandler::sendErrorResponse(request, 400, "sha256 must be 64 hex digits");
+        return false;
+    }
+
+    // _tempObject is released with free(), so the state is built in a
+    // malloc() block and its destructor run by hand in release()
+    void *memory = malloc(sizeof(State));
+    uint8_t *buffer = encrypt ? nullptr : (uint8_t *)malloc(UPLOAD_BUFFER_SIZE);
+    if (!memory || (!encrypt && !buffer)) {
+        free(memory);
+        free(buffer);
+        WebHandler::sendErrorResponse(request, 503, "Out of memory");
+        return false;
+    }
+
+    State *upload = new (memory) State();
+    upload->path = path;
+    upload->tempPath = path + ".part";
+    upload->writer = nullptr;
+    upload->buffer = buffer;
+    upload->filled = 0;
+    upload->hashing = hashing;
+    memcpy(upload->expected, expected, sizeof(expected));
+    upload->finished = false;
+    upload->startedAt = millis();
+    if (hashing) {
+        mbedtls_md_init(&upload->sha);
+        mbedtls_md_setup(&upload->sha, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0);
+        mbedtls_md_starts(&upload->sha);
+    }
+
+    request->_tempObject = upload;
+    request->onDisconnect([request]() { release(request); });
+    active.push_back(upload);
+
+    bool opened;
+    if (encrypt) {
+        upload->writer = new SecureFileWriter();
+        opened = upload->writer->open(upload->tempPath.c_str());
+    } else {
+        upload->file = LittleFS.open(upload->tempPath, "w");
+        opened = (bool)upload->file;
+    }
+    if (!opened) {
+        debugE("Failed to open %s for writing", upload->tempPath.c_str());
+        fail(request, upload, 500, "Failed to open file for writing");
+        return false;
+    }
+    return true;
+}
+
+void FileUpload::write(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    State *upload = state(request);
+    if (!upload || upload->finished) {
+        return; // Already answered
+    }
+    bool last = index + len == total;
+
+    if (upload->hashing) {
+        mbedtls_md_update(&upload->sha, data, len);
+    }
+
+    if (upload->writer) {
+        if (upload->writer->write(data, len) != len) {
+            fail(request, upload, 500, "Failed to encrypt file");
+            return;
+        }
+    } else {
+        while (len > 0) {
+            size_t count = UPLOAD_BUFFER_SIZE - upload->filled;
+            if (count > len) {
+                count = len;
+            }
+            memcpy(upload->buffer + upload->filled, data, count);
+            upload->filled += count;
+            data += count;
+            len -= count;
+            if (upload->filled == UPLOAD_BUFFER_SIZE && !flush(upload)) {
+                fail(request, upload, 507, "Failed to write file; the filesystem may be full");
+                return;
+            }
+        }
+    }
+
+    if (!last) {
+        return;
+    }
+
+    if (upload->hashing) {
+        uint8_t digest[32];
+        mbedtls_md_finish(&upload->sha, digest);
+        if (memcmp(digest, upload->expected, sizeof(digest)) != 0) {
+            fail(request, upload, 400, "Checksum mismatch");
+            return;
+        }
+    }
+    if (!commit(upload)) {
+        fail(request, upload, 500, "Failed to save file");
+        return;
+    }
+
+    uint32_t elapsedMs = millis() - upload->startedAt;
+    debugI("Uploaded %s: %u bytes in %u ms", upload->path.c_str(), (unsigned int)total, (unsigned int)elapsedMs);
+    JsonDocument doc;
+    doc["path"] = upload->path;
+    doc["bytes"] = total;
+    doc["ms"] = elapsedMs;
+    doc["kbps"] = elapsedMs ? (uint32_t)((uint64_t)total * 1000 / 1024 / elapsedMs) : 0;
+    WebHandler::sendSuccessResponse(request, "File saved successfully", &doc);
+}
+
+bool FileUpload::flush(State *upload)
+{
+    if (upload->filled == 0) {
+        return true;
+    }
+    size_t written = upload->file.write(upload->buffer, upload->filled);
+    bool ok = written == upload->filled;
+    upload->filled = 0;
+    return ok;
+}
+
+// Close the .part file and move it over the target. If the rename cannot
+// replace an existing file, that file is removed first.
+bool FileUpload::commit(State *upload)
+{
+    bool ok;
+    if (upload->writer) {
+        ok = upload->writer->close();
+    } else {
+        ok = flush(upload);
+        upload->file.close();
+    }
+    if (ok && !LittleFS.rename(upload->tempPath, upload->path)) {
+        LittleFS.remove(upload->path);
+        ok = LittleFS.rename(upload->tempPath, upload->path);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    upload->finished = true;
+    ConfigManager::fileChanged(upload->path.c_str());
+    return true;
+}
+
+void FileUpload::fail(AsyncWebServerRequest *request, State *upload, int code, const char *message)
+{
+    debugE("Upload of %s failed: %s", upload->path.c_str(), message);
+    discard(upload);
+    WebHandler::sendErrorResponse(request, code, message);
+}
+
+// Drop the partial file; the old one, if any, is untouched
+void FileUpload::discard(State *upload)
+{
+    if (upload->finished) {
+        return;
+    }
+    upload->finished = true;
+    if (upload->writer) {
+        delete upload->writer; // Closes without sealing
+        upload->writer = nullptr;
+    } else if (upload->file) {
+        upload->file.close();
+    }
+    LittleFS.remove(upload->tempPath);
+}
+
+void FileUpload::release(AsyncWebServerRequest *request)
+{
+    State *upload = state(request);
+    if (!upload) {
+        return;
+    }
+    if (!upload->finished) {
+        debugW("Upload of %s cut short; partial file removed", upload->path.c_str());
+    }
+    discard(upload);
+
+    for (size_t i = 0; i < active.size(); i++) {
+        if (active[i] == upload) {
+            active.erase(active.begin() + i);
+            break;
+        }
+    }
+    if (upload->hashing) {
+        mbedtls_md_free(&upload->sha);
+    }
+    delete upload->writer;
+    free(upload->buffer);
+    upload->~State(); // The request frees the memory itself
+}
+
+#endif // ENABLE_WEB_HANDLER
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifdef ENABLE_WEB_HANDLER
+
+#include <ESPAsyncWebServer.h>
+#include <LittleFS.h>
+#include "mbedtls/md.h"
+#include <vector>
+
+// Bytes gathered before each write; one LittleFS block
+#ifndef UPLOAD_BUFFER_SIZE
+#define UPLOAD_BUFFER_SIZE 4096
+#endif
+
+class SecureFileWriter;
+
+// Streams one POST /file body to flash. The body goes to path + ".part",
+// opened once for the whole request, in UPLOAD_BUFFER_SIZE writes (or
+// through a SecureFileWriter when encrypting). When the last chunk is in,
+// an optional SHA-256 is checked and the file renamed over path, so the
+// old file stays whole until the new one is complete. An upload that fails
+// or whose client goes away removes its .part file.
+//
+// The state lives in request->_tempObject and is torn down from the
+// request's disconnect callback, which the server runs before freeing it.
+class FileUpload
+{
+public:
+    // Call on the first chunk. sha256 is 64 hex digits or empty; encrypt
+    // stores the file encrypted at rest. Answers the request and returns
+    // false if the upload cannot start.
+    static bool begin(AsyncWebServerRequest *request, const String &path, const String &sha256, bool encrypt);
+    // Call with every chunk, the first one included. Answers the request
+    // once the file is in place, or as soon as something fails.
+    static void write(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+
+private:
+    struct State {
+        String path;
+        String tempPath;
+        File file;
+        SecureFileWriter *writer; // Instead of file when encrypting
+        uint8_t *buffer;
+        size_t filled;
+        bool hashing;
+        uint8_t expected[32];
+        mbedtls_md_context_t sha;
+        bool finished; // Committed, or failed and answered
+        uint32_t startedAt;
+    };
+
+    static std::vector<State *> active; // Only touched from the AsyncTCP task
+
+    static State *state(AsyncWebServerRequest *request);
+    static bool flush(State *upload);
+    static bool commit(State *upload);
+    static void fail(AsyncWebServerRequest *request, State *upload, int code, const char *message);
+    static void discard(State *upload);
+    static void release(AsyncWebServerRequest *request);
+};
+
+#endif // ENABLE_WEB_HANDLER
@@ -0,0 +1,68 @@
+#ifdef ENABLE_WEB_HANDLER
+
+#include "RequestBody.h"
+#include "Globals.h"
+#include "WebHandler.h"
+
+RequestBody::Buffer *RequestBody::buffer(AsyncWebServerRequest *request)
+{
+    return (Buffer *)request->_tempObject;
+}
+
+bool RequestBody::collect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total, size_t maxLength)
+{
+    if (index == 0) {
+        if (total > maxLength) {
+            debugW("Request body of %u bytes refused (limit %u)", (unsigned int)total, (unsigned int)maxLength);
+            WebHandler::sendErrorResponse(request, 413, "Request body too large");
+            return false;
+        }
+        if (request->_tempObject) {
+            return false; // Not ours; another handler owns it
+        }
+        Buffer *body = (Buffer *)malloc(sizeof(Buffer) + total);
+        if (!body) {
+            WebHandler::sendErrorResponse(request, 503, "Out of memory");
+            return false;
+        }
+        body->length = total;
+        body->received = 0;
+        request->_tempObject = body;
+    }
+
+    Buffer *body = buffer(request);
+    if (!body || index != body->received || index + len > body->length) {
+        return false; // Already answered, or chunks out of step
+    }
+    memcpy(body->data + index, data, len);
+    body->received += len;
+    if (body->received < body->length) {
+        return false;
+    }
+
+    body->data[body->length] = '\0';
+    return true;
+}
+
+const char *RequestBody::data(AsyncWebServerRequest *request)
+{
+    Buffer *body = buffer(request);
+    return body && body->received == body->length ? body->data : nullptr;
+}
+
+size_t RequestBody::length(AsyncWebServerRequest *request)
+{
+    Buffer *body = buffer(request);
+    return body && body->received == body->length ? body->length : 0;
+}
+
+DeserializationError RequestBody::parseJson(AsyncWebServerRequest *request, JsonDocument &doc)
+{
+    const char *json = data(request);
+    if (!json) {
+        return DeserializationError::IncompleteInput;
+    }
+    return deserializeJson(doc, json, length(request));
+}
+
+#endif // ENABLE_WEB_HANDLER
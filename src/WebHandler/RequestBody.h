@@ -0,0 +1,49 @@
+#pragma once
+
+#ifdef ENABLE_WEB_HANDLER
+
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+
+// Largest body a handler accepts unless it passes its own limit
+#ifndef WEB_BODY_MAX_LENGTH
+#define WEB_BODY_MAX_LENGTH 16384
+#endif
+
+// Collects a POST body that arrives in several chunks into one buffer owned
+// by the request. The buffer is allocated once, from Content-Length, when
+// the first chunk comes in and lives in request->_tempObject, which the
+// server frees with the request. Every request has its own, so two uploads
+// at the same time cannot mix, and each chunk is copied once, into place.
+//
+//   if (!RequestBody::collect(request, data, len, index, total)) return;
+//   JsonDocument doc;
+//   DeserializationError error = RequestBody::parseJson(request, doc);
+class RequestBody
+{
+public:
+    // Add one chunk. Returns true once the whole body is in. A body over
+    // maxLength, or one there is no memory for, is answered with 413 or 503
+    // on its first chunk and the rest of it is ignored.
+    static bool collect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total,
+                        size_t maxLength = WEB_BODY_MAX_LENGTH);
+
+    // The complete body, NUL terminated; nullptr before collect() returns true
+    static const char *data(AsyncWebServerRequest *request);
+    static size_t length(AsyncWebServerRequest *request);
+
+    static DeserializationError parseJson(AsyncWebServerRequest *request, JsonDocument &doc);
+
+private:
+    // Laid out in front of the body in a single malloc() block, since the
+    // server releases _tempObject with free() rather than delete
+    struct Buffer {
+        size_t length;
+        size_t received;
+        char data[1];
+    };
+
+    static Buffer *buffer(AsyncWebServerRequest *request);
+};
+
+#endif // ENABLE_WEB_HANDLER
@@ -3,24 +3,11 @@
 #include "ServeAuth.h"
 #include "Globals.h"
 #include "WebHandler.h"
-#include <vector>
+#include "WebAuth.h"
+#include "RequestBody.h"
+#include "SessionTable.h"
 #include <LittleFS.h>
 
-// Store active session tokens in memory
-std::vector<String> activeSessions;
-
-// Generate a secure random session token
-String generateRandomToken()
-{
-    String token = "";
-    for (int i = 0; i < 32; i++)
-    { // 32-character token
-        char c = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"[random(62)];
-        token += c;
-    }
-    return token;
-}
-
 String getContentType(String filename) {
     if (filename.endsWith(".html")) return "text/html";
     else if (filename.endsWith(".css")) return "text/css";
@@ -33,6 +20,12 @@ String getContentType(String filename) {
     return "text/plain";
 }
 
+bool ServeAuth::findSessionCookie(AsyncWebServerRequest *request, const char *&token, size_t &length)
+{
+    AsyncWebHeader *cookieHeader = request->getHeader("Cookie");
+    return cookieHeader && SessionTable::findCookie(cookieHeader->value().c_str(), token, length);
+}
+
 void ServeAuth::registerEndpoints(AsyncWebServer &server)
 {
     handleLoginRequest(server);
@@ -42,14 +35,15 @@ void ServeAuth::registerEndpoints(AsyncWebServer &server)
 
 void ServeAuth::handleLoginRequest(AsyncWebServer &server)
 {
-    server.on("/auth/login", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+    WebAuth::on(server, "/auth/login", HTTP_POST, AUTH_NONE, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
               {
+        if (!RequestBody::collect(request, data, len, index, total, 512)) {
+            return;
+        }
         debugV("Received POST request on /auth/login");
 
-        WebHandler::printRequestBody(request, data, len);
-
         JsonDocument doc;
-        DeserializationError error = deserializeJson(doc, data, len);
+        DeserializationError error = RequestBody::parseJson(request, doc);
 
         if (error) {
             debugE("JSON deserialization failed: %s", error.c_str());
@@ -64,8 +58,8 @@ void ServeAuth::handleLoginRequest(AsyncWebServer &server)
         
         //if (strcmp(username, "admin") == 0 && strcmp(password, "pass") == 0) {
         if (strcmp(username, settings.device.userName.c_str()) == 0 && strcmp(password, settings.device.userPassword.c_str()) == 0) {
-            String sessionToken = generateRandomToken();
-            activeSessions.push_back(sessionToken);  // Store valid session
+            char sessionToken[SessionTable::TOKEN_TEXT_SIZE];
+            SessionTable::create(sessionToken, sizeof(sessionToken));
 
             JsonDocument response;
             response["status"] = "success";
@@ -76,12 +70,12 @@ void ServeAuth::handleLoginRequest(AsyncWebServer &server)
             serializeJson(response, jsonResponse);
 
             AsyncWebServerResponse *res = request->beginResponse(200, "application/json", jsonResponse);
-            res->addHeader("Set-Cookie", "session=" + sessionToken + "; Path=/; HttpOnly;");
+            res->addHeader("Set-Cookie", String("session=") + sessionToken + "; Path=/; HttpOnly;");
             //res->addHeader("Set-Cookie", "userName=" + settings.device.userName + "; Path=/; HttpOnly;");
             WebHandler::addCorsHeaders(res);
             request->send(res);
 
-            debugV("Generated session token: %s", sessionToken.c_str());
+            debugV("Session started, %u active", (unsigned int)SessionTable::count());
         } else {
             request->send(401, "application/json", R"({"status": "error", "message": "Invalid credentials"})");
         } });
@@ -89,25 +83,16 @@ void ServeAuth::handleLoginRequest(AsyncWebServer &server)
 
 void ServeAuth::handleLogoutRequest(AsyncWebServer &server)
 {
-    server.on("/auth/logout", HTTP_POST, [](AsyncWebServerRequest *request)
+    WebAuth::on(server, "/auth/logout", HTTP_POST, AUTH_NONE, [](AsyncWebServerRequest *request)
               {
-        if (!request->hasHeader("Cookie")) {
+        const char *sessionToken;
+        size_t length;
+        if (!findSessionCookie(request, sessionToken, length)) {
             request->send(400, "application/json", R"({"status": "error", "message": "No session found"})");
             return;
         }
 
-        AsyncWebHeader* cookieHeader = request->getHeader("Cookie");
-        String cookie = cookieHeader->value();
-
-        if (!cookie.startsWith("session=")) {
-            request->send(400, "application/json", R"({"status": "error", "message": "Invalid session"})");
-            return;
-        }
-
-        String sessionToken = cookie.substring(8);
-
-        // Remove session from activeSessions
-        activeSessions.erase(remove(activeSessions.begin(), activeSessions.end(), sessionToken), activeSessions.end());
+        SessionTable::remove(sessionToken, length);
 
         // Create response and set an expired cookie
         AsyncWebServerResponse *res = request->beginResponse(200, "application/json", R"({"status": "success", "message": "Logged out"})");
@@ -119,44 +104,12 @@ void ServeAuth::handleLogoutRequest(AsyncWebServer &server)
 
 void ServeAuth::handleSecureRequest(AsyncWebServer &server)
 {
-    // Use a wildcard to catch all requests under /secure
-    server.on("/secure/*", HTTP_ANY, [](AsyncWebServerRequest *request) {
+    // Use a wildcard to catch all requests under /secure; WebAuth sends
+    // anyone without a live session to /login.html before this runs
+    WebAuth::on(server, "/secure/*", HTTP_ANY, AUTH_SESSION, [](AsyncWebServerRequest *request) {
         String url = request->url();
 
         debugI("Received request: %s", url.c_str());
-        
-        // Check for authentication
-        if (!request->hasHeader("Cookie")) {
-            debugI("No cookie header found, redirecting to /login.html");
-            request->redirect("/login.html");
-            return;
-        }
-
-        AsyncWebHeader* cookieHeader = request->getHeader("Cookie");
-        String cookie = cookieHeader->value();
-
-        if (!cookie.startsWith("session=")) {
-            debugI("No session found in cookie, redirecting to /login.html");
-            request->redirect("/login.html");
-            return;
-        }
-        
-        String sessionToken = cookie.substring(8);  // Extract session token
-
-        // Check if sessionToken exists in activeSessions
-        bool validSession = false;
-        for (const String &token : activeSessions) {
-            if (sessionToken == token) {
-                validSession = true;
-                break;
-            }
-        }
-
-        if (!validSession) {
-            debugI("Invalid session token, redirecting to /login.html");
-            request->redirect("/login.html");
-            return;
-        }
 
         // Serve the requested file if it exists under /secure
         if (LittleFS.exists(url)) {
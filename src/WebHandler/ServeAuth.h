@@ -14,6 +14,9 @@ private:
     static void handleLoginRequest(AsyncWebServer &server);
     static void handleLogoutRequest(AsyncWebServer &server);
     static void handleSecureRequest(AsyncWebServer &server);
+
+    // Points token at the session cookie's value in the request's Cookie header
+    static bool findSessionCookie(AsyncWebServerRequest *request, const char *&token, size_t &length);
 };
 
 #endif // ENABLE_WEB_HANDLER
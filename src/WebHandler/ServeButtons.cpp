@@ -3,31 +3,38 @@
 #include "ServeButtons.h"
 #include "Globals.h"
 #include "WebHandler.h"
-#include "ButtonHandler.h"  // Add this include for runButton access
+#include "WebAuth.h"
+#include "ButtonHandler.h"
 #include <ArduinoJson.h>
-#include <LittleFS.h>
 #include "CryptoHandler.h"
+#include "DatabaseHandler.h"
+#include "RequestBody.h"
+#include "ServeCommand.h"
 
 void ServeButtons::registerEndpoints(AsyncWebServer &server)
 {
-    server.on("/buttons", HTTP_GET, handleGetButtons);
-    server.on("/buttons", HTTP_DELETE, handleDeleteButton);
-    server.on("/buttons", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, handlePostButtons);
-    server.on("/run-button", HTTP_POST, handleRunButton);  // New endpoint for running buttons
+    WebAuth::on(server, "/buttons", HTTP_GET, AUTH_BEARER, handleGetButtons);
+    WebAuth::on(server, "/buttons", HTTP_DELETE, AUTH_BEARER, handleDeleteButton);
+    WebAuth::on(server, "/buttons", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {}, NULL, handlePostButtons);
+    WebAuth::on(server, "/run-button", HTTP_POST, AUTH_BEARER, handleRunButton);  // New endpoint for running buttons
 }
 
 void ServeButtons::handleGetButtons(AsyncWebServerRequest *request)
 {
-    File file = LittleFS.open(BUTTONS_FILE, "r");
-    if (!file || file.size() == 0) {
-        WebHandler::sendErrorResponse(request, 400, "Failed to read %s", BUTTONS_FILE);
+    // Read the counter first: an edit racing the export only makes the tag stale
+    String etag = WebHandler::makeEtag("buttons", DatabaseHandler::buttons.getGeneration());
+    if (WebHandler::sendIfNotModified(request, etag)) {
         return;
     }
 
-    String json = file.readString();
-    file.close();
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    if (!DatabaseHandler::buttons.exportJson(*response)) {
+        delete response;
+        WebHandler::sendErrorResponse(request, 500, "Failed to read buttons");
+        return;
+    }
 
-    AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", json);
+    WebHandler::addEtagHeaders(response, etag);
     WebHandler::addCorsHeaders(response);
     request->send(response);
 }
@@ -39,69 +46,92 @@ void ServeButtons::handleDeleteButton(AsyncWebServerRequest *request)
         return;
     }
 
-    String buttonId = request->getParam("id")->value();
-    File file = LittleFS.open(BUTTONS_FILE, "r");
-    if (!file) {
-        WebHandler::sendErrorResponse(request, 500, "Failed to read %s", BUTTONS_FILE);
+    int buttonId = request->getParam("id")->value().toInt();
+    if (!DatabaseHandler::buttons.contains(buttonId)) {
+        WebHandler::sendErrorResponse(request, 404, "Button ID not found");
         return;
     }
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
-
-    if (error) {
-        WebHandler::sendErrorResponse(request, 500, "Invalid JSON format in %s", BUTTONS_FILE);
+    if (!DatabaseHandler::buttons.remove(buttonId)) {
+        debugE("Failed to delete button %d", buttonId);
+        WebHandler::sendErrorResponse(request, 500, "Failed to delete button");
         return;
     }
 
-    JsonArray buttons = doc["buttons"];
-    bool buttonFound = false;
+    ButtonHandler::buttonDeleted(buttonId);
+    DatabaseHandler::recordChanged(DatabaseHandler::buttons);
+    WebHandler::sendSuccessResponse(request, "Button deleted successfully");
+}
 
-    for (size_t i = 0; i < buttons.size(); i++) {
-        if (String(buttons[i]["id"].as<String>()) == buttonId) {
-            buttons.remove(i);
-            buttonFound = true;
-            break;
+// Copy the fields of an edit onto the stored button, encrypting a new
+// password if the button had none. False if it could not be encrypted.
+static bool mergeButton(JsonObject existingButton, JsonObjectConst newButton)
+{
+    for (JsonPairConst kv : newButton) {
+        if (kv.key() == "userPassword") {
+            if (kv.value().is<String>()) {
+                String newPassword = kv.value().as<String>();
+                if (!newPassword.isEmpty()) {
+                    // Check if password exists in existing button
+                    if (!existingButton["userPassword"].is<String>() || existingButton["userPassword"].as<String>().isEmpty()) {
+                        // No prior password; treat as plaintext and encrypt
+                        debugV("No prior password for ID: %d; encrypting new password", existingButton["id"].as<int>());
+                        String encryptedPassword = CryptoHandler::encrypt(newPassword);
+                        if (encryptedPassword.isEmpty()) {
+                            return false;
+                        }
+                        existingButton["userPassword"] = encryptedPassword;
+                    } else if (CryptoHandler::needsRekey(newPassword.c_str(), newPassword.length()) && !CryptoHandler::reencrypt(newPassword)) {
+                        // A page loaded before a password change sends back text under
+                        // the old key; it is re-encrypted above while that key still
+                        // works, and otherwise must not replace the stored password
+                        debugW("Stale password for ID: %d not saved", existingButton["id"].as<int>());
+                    } else {
+                        // Password exists; assume incoming is encrypted and store as-is
+                        debugV("Existing password for ID: %d; storing new password as-is", existingButton["id"].as<int>());
+                        existingButton["userPassword"] = newPassword;
+                    }
+                } else {
+                    debugV("Empty password skipped for ID: %d; removing if no prior password", existingButton["id"].as<int>());
+                    if (!existingButton["userPassword"].is<String>() || existingButton["userPassword"].as<String>().isEmpty()) {
+                        existingButton.remove("userPassword");
+                    }
+                    // Otherwise, preserve existing password
+                }
+            }
+        } else if (kv.key() != "id") {
+            debugV("Updating field '%s' to '%s' for ID: %d", kv.key().c_str(), kv.value().as<String>().c_str(), existingButton["id"].as<int>());
+            existingButton[kv.key()] = kv.value();
         }
     }
+    return true;
+}
 
-    if (!buttonFound) {
-        WebHandler::sendErrorResponse(request, 404, "Button ID not found");
-        return;
-    }
-
-    file = LittleFS.open(BUTTONS_FILE, "w");
-    if (!file) {
-        WebHandler::sendErrorResponse(request, 500, "Failed to write %s", BUTTONS_FILE);
-        return;
+// True if any button in the edit carries a password, which takes the vault key
+static bool hasPassword(JsonArrayConst buttons)
+{
+    for (JsonObjectConst button : buttons) {
+        const char *password = button["userPassword"];
+        if (password && *password) {
+            return true;
+        }
     }
-
-    serializeJsonPretty(doc, file);
-    file.close();
-    WebHandler::sendSuccessResponse(request, "Button deleted successfully");
+    return false;
 }
 
 void ServeButtons::handlePostButtons(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
 {
     debugV("Received POST request on /buttons");
 
-    // Accumulate incoming data
-    static String requestBody;
-    if (index == 0) {
-        requestBody = ""; // Start a new request body
-    }
-    requestBody += String((char *)data).substring(0, len); // Append the current chunk
-
-    if (index + len != total) {
+    if (!RequestBody::collect(request, data, len, index, total)) {
         return; // Wait until all chunks are received
     }
 
-    debugV("Complete request body received: %s", requestBody.c_str());
+    debugV("Complete request body received: %s", RequestBody::data(request));
 
     // Parse the incoming JSON payload
     JsonDocument incomingDoc;
-    DeserializationError error = deserializeJson(incomingDoc, requestBody);
+    DeserializationError error = RequestBody::parseJson(request, incomingDoc);
 
     if (error) {
         debugE("JSON deserialization failed: %s", error.c_str());
@@ -109,116 +139,58 @@ void ServeButtons::handlePostButtons(AsyncWebServerRequest *request, uint8_t *da
         return;
     }
 
-    // Read the existing JSON file
-    File file = LittleFS.open(BUTTONS_FILE, "r");
-    JsonDocument existingDoc;
-    
-    if (file) {
-        debugV("Opened existing file for reading: %s", BUTTONS_FILE);
-        DeserializationError readError = deserializeJson(existingDoc, file);
-        if (readError) {
-            debugE("Failed to deserialize existing JSON: %s", readError.c_str());
-            file.close();
-            WebHandler::sendErrorResponse(request, 500, "Failed to read existing buttons2.json");
-            return;
-        }
-        file.close();
-    } else {
-        debugW("No existing file found; initializing new document");
-        existingDoc["buttons"] = JsonArray(); // Initialize an empty "buttons" array
-    }
-
-    JsonArray existingButtons = existingDoc["buttons"];
+    // Each button is one record: read the stored copy, merge and append it
     JsonArray incomingButtons = incomingDoc["buttons"];
-    
-    // Update existing buttons or add new ones
+    if (hasPassword(incomingButtons) && !CryptoHandler::unlockInBackground()) {
+        WebHandler::sendVaultLocked(request);
+        return;
+    }
     for (JsonObject newButton : incomingButtons) {
-        bool found = false;
-
-        for (JsonObject existingButton : existingButtons) {
-            if (existingButton["id"] == newButton["id"]) {
-                debugV("Found button with ID: %d", existingButton["id"].as<int>());
-                // Update only the provided fields, encrypting new passwords if none existed
-                for (JsonPair kv : newButton) {
-                    if (kv.key() == "userPassword") {
-                        if (kv.value().is<String>()) {
-                            String newPassword = kv.value().as<String>();
-                            if (!newPassword.isEmpty()) {
-                                // Check if password exists in existing button
-                                if (!existingButton["userPassword"].is<String>() || existingButton["userPassword"].as<String>().isEmpty()) {
-                                    // No prior password; treat as plaintext and encrypt
-                                    debugV("No prior password for ID: %d; encrypting new password", existingButton["id"].as<int>());
-                                    String encryptedPassword = CryptoHandler::encryptAES(newPassword, settings.device.userPassword);
-                                    existingButton["userPassword"] = encryptedPassword;
-                                } else {
-                                    // Password exists; assume incoming is encrypted and store as-is
-                                    debugV("Existing password for ID: %d; storing new password as-is", existingButton["id"].as<int>());
-                                    existingButton["userPassword"] = newPassword;
-                                }
-                            } else {
-                                debugV("Empty password skipped for ID: %d; removing if no prior password", existingButton["id"].as<int>());
-                                if (!existingButton["userPassword"].is<String>() || existingButton["userPassword"].as<String>().isEmpty()) {
-                                    existingButton.remove("userPassword");
-                                }
-                                // Otherwise, preserve existing password
-                            }
-                        }
-                    } else {
-                        debugV("Updating field '%s' to '%s' for ID: %d", kv.key().c_str(), kv.value().as<String>().c_str(), existingButton["id"].as<int>());
-                        existingButton[kv.key()] = kv.value();
-                    }
-                }
-                found = true;
-                break;
+        int id = newButton["id"] | 0;
+        JsonDocument existingDoc;
+
+        JsonObject button;
+        if (id > 0 && DatabaseHandler::buttons.get(id, existingDoc)) {
+            debugV("Found button with ID: %d", id);
+            button = existingDoc.as<JsonObject>();
+            if (!mergeButton(button, newButton)) {
+                WebHandler::sendVaultLocked(request);
+                return;
             }
-        }
-
-        if (!found) {
+        } else {
             debugV("Creating new button");
-            int maxId = 0;
-            for (JsonObject existingButton : existingButtons) {
-                int existingId = existingButton["id"] | 0;
-                if (existingId > maxId) {
-                    maxId = existingId;
-                }
-            }
-            
-            int newId = maxId + 1;
-            
-            JsonObject buttonToAdd = newButton;
-            if (buttonToAdd["id"].isNull() || buttonToAdd["id"] == 0) {
-                buttonToAdd["id"] = newId;
-                if (buttonToAdd["userPassword"].is<String>()) {
-                    String plainPassword = buttonToAdd["userPassword"].as<String>();
+            button = newButton;
+            if (id <= 0) {
+                id = DatabaseHandler::buttons.nextId();
+                button["id"] = id;
+                if (button["userPassword"].is<String>()) {
+                    String plainPassword = button["userPassword"].as<String>();
                     if (!plainPassword.isEmpty()) {
-                        debugV("Encrypting password for new button ID: %d", newId);
-                        String encryptedPassword = CryptoHandler::encryptAES(plainPassword, settings.device.userPassword);
-                        buttonToAdd["userPassword"] = encryptedPassword;
+                        debugV("Encrypting password for new button ID: %d", id);
+                        String encryptedPassword = CryptoHandler::encrypt(plainPassword);
+                        if (encryptedPassword.isEmpty()) {
+                            WebHandler::sendVaultLocked(request);
+                            return;
+                        }
+                        button["userPassword"] = encryptedPassword;
                     } else {
-                        debugV("Empty password removed for new button ID: %d", newId);
-                        buttonToAdd.remove("userPassword");
+                        debugV("Empty password removed for new button ID: %d", id);
+                        button.remove("userPassword");
                     }
                 }
             }
-            existingButtons.add(buttonToAdd);
-            debugV("Added new button with ID: %d", newId);
         }
-    }
 
-    // Write the updated JSON back to the file
-    debugV("Attempting to write updated JSON to %s", BUTTONS_FILE);
-    file = LittleFS.open(BUTTONS_FILE, "w");
-    if (!file) {
-        debugE("Failed to open file for writing: %s", BUTTONS_FILE);
-        WebHandler::sendErrorResponse(request, 500, "Failed to write buttons2.json");
-        return;
+        if (!DatabaseHandler::buttons.put(id, button)) {
+            debugE("Failed to save button %d", id);
+            WebHandler::sendErrorResponse(request, 500, "Failed to save button");
+            return;
+        }
+        ButtonHandler::buttonSaved(button);
+        debugV("Saved button with ID: %d", id);
     }
 
-    debugV("Serializing updated JSON");
-    serializeJsonPretty(existingDoc, file);
-    debugV("Closing file after write");
-    file.close();
-    debugV("File write successful");
+    DatabaseHandler::recordChanged(DatabaseHandler::buttons);
     WebHandler::sendSuccessResponse(request, "Buttons updated successfully");
 }
 
@@ -243,10 +215,25 @@ void ServeButtons::handleRunButton(AsyncWebServerRequest *request)
     buttonId = buttonIdStr.toInt();
     debugV("Attempting to run button with ID: %d", buttonId);
 
-    // Execute the button action
-    ButtonHandler::runButton(buttonId);
+    if (ButtonHandler::needsVault(buttonId) && !CryptoHandler::unlockInBackground()) {
+        WebHandler::sendVaultLocked(request);
+        return;
+    }
 
-    WebHandler::sendSuccessResponse(request, "Button executed successfully");
+    if (!DatabaseHandler::buttons.contains(buttonId)) {
+        WebHandler::sendErrorResponse(request, 404, "Button ID not found");
+        return;
+    }
+
+    // Typing waits for the HID queue, so the press runs on the executor
+    String command = "BUTTON RUN ";
+    command += buttonId;
+    uint32_t id = CommandBus::submit(command, CMD_SOURCE_WEB);
+    if (id == 0) {
+        WebHandler::sendErrorResponse(request, 503, "Command queue full");
+        return;
+    }
+    ServeCommand::sendQueued(request, id);
 }
 
 #endif // ENABLE_WEB_HANDLER
\ No newline at end of file
@@ -3,29 +3,34 @@
 #include "ServeCategories.h"
 #include "Globals.h"
 #include "WebHandler.h"
+#include "WebAuth.h"
 #include <ArduinoJson.h>
-#include <LittleFS.h>
+#include "DatabaseHandler.h"
+#include "RequestBody.h"
 
 void ServeCategories::registerEndpoints(AsyncWebServer &server)
 {
-    server.on("/categories", HTTP_GET, handleGetCategories);
-    server.on("/categories", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, handlePostCategories);
-    server.on("/categories", HTTP_DELETE, handleDeleteCategory);
+    WebAuth::on(server, "/categories", HTTP_GET, AUTH_BEARER, handleGetCategories);
+    WebAuth::on(server, "/categories", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {}, NULL, handlePostCategories);
+    WebAuth::on(server, "/categories", HTTP_DELETE, AUTH_BEARER, handleDeleteCategory);
 }
 
 void ServeCategories::handleGetCategories(AsyncWebServerRequest *request)
 {
-    // Open the file for reading
-    File file = LittleFS.open(CATEGORIES_FILE, "r");
-    if (!file || file.size() == 0) {
-        WebHandler::sendErrorResponse(request, 400, "Failed to read categories.json or file is empty");
+    // Read the counter first: an edit racing the export only makes the tag stale
+    String etag = WebHandler::makeEtag("categories", DatabaseHandler::categories.getGeneration());
+    if (WebHandler::sendIfNotModified(request, etag)) {
         return;
     }
 
-    String json = file.readString(); // Read the file content into a string
-    file.close(); // Close the file
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    if (!DatabaseHandler::categories.exportJson(*response)) {
+        delete response;
+        WebHandler::sendErrorResponse(request, 500, "Failed to read categories");
+        return;
+    }
 
-    AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", json);
+    WebHandler::addEtagHeaders(response, etag);
     WebHandler::addCorsHeaders(response);
     request->send(response);
 }
@@ -34,22 +39,15 @@ void ServeCategories::handlePostCategories(AsyncWebServerRequest *request, uint8
 {
     debugV("Received POST request on /categories");
 
-    // Accumulate incoming data
-    static String requestBody;
-    if (index == 0) {
-        requestBody = ""; // Start a new request body
-    }
-    requestBody += String((char *)data).substring(0, len); // Append the current chunk
-
-    if (index + len != total) {
+    if (!RequestBody::collect(request, data, len, index, total)) {
         return; // Wait until all chunks are received
     }
 
-    debugV("Complete request body received: %s", requestBody.c_str());
+    debugV("Complete request body received: %s", RequestBody::data(request));
 
     // Parse the incoming JSON payload
     JsonDocument incomingDoc;
-    DeserializationError error = deserializeJson(incomingDoc, requestBody);
+    DeserializationError error = RequestBody::parseJson(request, incomingDoc);
 
     if (error) {
         debugE("JSON deserialization failed: %s", error.c_str());
@@ -57,100 +55,43 @@ void ServeCategories::handlePostCategories(AsyncWebServerRequest *request, uint8
         return;
     }
 
-    // Read the existing JSON file
-    File file = LittleFS.open(CATEGORIES_FILE, "r");
-    JsonDocument existingDoc;
-    
-    if (file) {
-        deserializeJson(existingDoc, file); // Deserialize existing data
-        file.close();
-    } else {
-        debugW("No existing file found; initializing new document");
-        existingDoc["categories"] = JsonArray(); // Initialize an empty "categories" array
-    }
-
-    JsonArray existingCategories = existingDoc["categories"];
+    // The saved categories go back to the caller, so a new one's id is known
+    JsonDocument responseDoc;
+    JsonArray savedCategories = responseDoc["categories"].to<JsonArray>();
     JsonArray incomingCategories = incomingDoc["categories"];
 
-    // Update existing categories or add new ones
     for (JsonObject newCategory : incomingCategories) {
-        bool found = false;
-
-        for (JsonObject existingCategory : existingCategories) {
-            if (existingCategory["id"] == newCategory["id"]) {
-                // Update only the provided fields for the matching category
-                for (JsonPair kv : newCategory) {
-                    existingCategory[kv.key()] = kv.value();
-                }
-                found = true;
-                break;
-            }
-        }
-
-        /*
-        if (!found) {
-            // Generate a new ID
-            int maxId = 0;
-            for (JsonObject existingCategory : existingCategories) {
-                int existingId = existingCategory["id"] | 0;
-                if (existingId > maxId) {
-                    maxId = existingId;
-                }
-            }
-        
-            int newId = maxId + 1;
-        
-            // Assign a new ID if it's missing or 0
-            JsonObject categoryToAdd = newCategory;
-            if (!categoryToAdd.containsKey("id") || categoryToAdd["id"] == 0) {
-                categoryToAdd["id"] = newId;
-            }
-        
-            existingCategories.add(categoryToAdd);
-        }
-        */
-
-        if (!found) {
-            // Generate a new ID
-            int maxId = 0;
-            for (JsonObject existingCategory : existingCategories) {
-                int existingId = existingCategory["id"] | 0;
-                if (existingId > maxId) {
-                    maxId = existingId;
-                }
+        int id = newCategory["id"] | 0;
+        JsonDocument existingDoc;
+
+        JsonObject category;
+        if (id > 0 && DatabaseHandler::categories.get(id, existingDoc)) {
+            // Update only the provided fields for the matching category
+            category = existingDoc.as<JsonObject>();
+            for (JsonPair kv : newCategory) {
+                category[kv.key()] = kv.value();
             }
-            
-            int newId = maxId + 1;
-            
+        } else {
             // Assign a new ID if it's missing or 0
-            JsonObject categoryToAdd = newCategory;
-            if (categoryToAdd["id"].isNull() || categoryToAdd["id"] == 0) {
-                categoryToAdd["id"] = newId;
+            category = newCategory;
+            if (id <= 0) {
+                id = DatabaseHandler::categories.nextId();
+                category["id"] = id;
             }
-            
-            existingCategories.add(categoryToAdd);
         }
 
+        if (!DatabaseHandler::categories.put(id, category)) {
+            debugE("Failed to save category %d", id);
+            WebHandler::sendErrorResponse(request, 500, "Failed to save category");
+            return;
+        }
+        savedCategories.add(category);
     }
 
-    // Write the updated JSON back to the file
-    file = LittleFS.open(CATEGORIES_FILE, "w");
-    if (!file) {
-        debugE("Failed to open file for writing: %s", CATEGORIES_FILE);
-        WebHandler::sendErrorResponse(request, 500, "Failed to write categories.json");
-        return;
-    }
-
-    //serializeJson(existingDoc, file); // Save updated JSON
-    serializeJsonPretty(existingDoc, file); // ✅ Nicely formatted JSON
-
-    file.close();
+    DatabaseHandler::recordChanged(DatabaseHandler::categories);
 
-    //WebHandler::sendSuccessResponse(request, "Categories updated successfully");
     String responseBody;
-    
-    //serializeJson(existingDoc, responseBody);
-    serializeJsonPretty(existingDoc, responseBody);
+    serializeJsonPretty(responseDoc, responseBody);
 
     AsyncWebServerResponse *response = request->beginResponse(200, "application/json", responseBody);
     WebHandler::addCorsHeaders(response);
@@ -165,61 +106,24 @@ void ServeCategories::handleDeleteCategory(AsyncWebServerRequest *request)
         return;
     }
 
-    String categoryId = request->getParam("id")->value(); // Use String instead of int
-    debugV("Attempting to delete category with ID: %s", categoryId.c_str());
-
-    // Open the JSON file for reading
-    File file = LittleFS.open(CATEGORIES_FILE, "r");
-    if (!file) {
-        debugE("Failed to open file for reading: %s", CATEGORIES_FILE);
-        WebHandler::sendErrorResponse(request, 500, "Failed to read categories.json");
-        return;
-    }
-
-    // Parse the JSON content
-    JsonDocument doc; // Adjust size as needed
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
-
-    if (error) {
-        debugE("Failed to parse JSON file: %s", error.c_str());
-        WebHandler::sendErrorResponse(request, 500, "Invalid JSON format categories.json");
-        return;
-    }
-
-    JsonArray categories = doc["categories"];
-    bool categoryFound = false;
-
-    // Iterate over the categories array and remove the one with the matching ID
-    for (size_t i = 0; i < categories.size(); i++) {
-        if (String(categories[i]["id"].as<String>()) == categoryId) { // Compare as strings
-            categories.remove(i);
-            categoryFound = true;
-            break;
-        }
-    }
+    int categoryId = request->getParam("id")->value().toInt();
+    debugV("Attempting to delete category with ID: %d", categoryId);
 
-    if (!categoryFound) {
-        debugW("Category with ID %s not found", categoryId.c_str());
+    if (!DatabaseHandler::categories.contains(categoryId)) {
+        debugW("Category with ID %d not found", categoryId);
         WebHandler::sendErrorResponse(request, 404, "Category ID not found");
         return;
     }
 
-    // Write the updated JSON back to the file
-    file = LittleFS.open(CATEGORIES_FILE, "w");
-    if (!file) {
-        debugE("Failed to open file for writing: %s", CATEGORIES_FILE);
-        WebHandler::sendErrorResponse(request, 500, "Failed to write categories.json");
+    if (!DatabaseHandler::categories.remove(categoryId)) {
+        debugE("Failed to delete category %d", categoryId);
+        WebHandler::sendErrorResponse(request, 500, "Failed to delete category");
         return;
     }
 
-    //serializeJson(doc, file);
-    serializeJsonPretty(doc, file);
-
-    file.close();
-
-    debugV("Category with ID %s deleted successfully", categoryId.c_str());
+    DatabaseHandler::recordChanged(DatabaseHandler::categories);
+    debugV("Category with ID %d deleted successfully", categoryId);
     WebHandler::sendSuccessResponse(request, "Category deleted successfully");
 }
 
-#endif // ENABLE_WEB_HANDLER
\ No newline at end of file
+#endif // ENABLE_WEB_HANDLER
@@ -3,35 +3,136 @@
 #include "ServeCommand.h"
 #include "Globals.h"
 #include "WebHandler.h"
+#include "WebAuth.h"
+#include "RequestBody.h"
 
 void ServeCommand::registerEndpoints(AsyncWebServer &server)
 {
     handleCommandRequest(server);
+    handleBatchRequest(server);
+    handleResultRequest(server);
+}
+
+void ServeCommand::sendResult(AsyncWebServerRequest *request, const CommandRecord &record)
+{
+    JsonDocument doc;
+    doc["status"] = record.status < 300 ? "success" : "error";
+    doc["id"] = record.correlationId;
+    doc["code"] = (int)record.status;
+    doc["durationUs"] = record.durationUs;
+    if (record.isJson && !record.truncated) {
+        doc["result"] = serialized((const char *)record.text);
+    } else {
+        doc["result"] = (const char *)record.text;
+    }
+    if (record.truncated) {
+        doc["truncated"] = true;
+    }
+
+    String jsonResponse;
+    serializeJson(doc, jsonResponse);
+
+    AsyncWebServerResponse *response = request->beginResponse(record.status, "application/json", jsonResponse);
+    WebHandler::addCorsHeaders(response);
+    request->send(response);
+}
+
+void ServeCommand::handleCommandRequest(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    if (!RequestBody::collect(request, data, len, index, total, CommandBus::MAX_COMMAND_LENGTH)) {
+        return;
+    }
+    debugV("Received POST request on /command/set");
+
+    String command = RequestBody::data(request);
+    command.trim(); // Remove any leading/trailing whitespace or newlines
+
+    if (command.isEmpty()) {
+        debugW("Received an empty command");
+        WebHandler::sendErrorResponse(request, 400, "Empty command received");
+        return;
+    }
+
+    debugV("Executing command: %s", command.c_str());
+
+    // Hand the command to the executor; this callback runs on the AsyncTCP task
+    uint32_t id = CommandBus::submit(command, CMD_SOURCE_WEB);
+    if (id == 0) {
+        WebHandler::sendErrorResponse(request, 503, "Command queue full");
+        return;
+    }
+
+    sendQueued(request, id);
+}
+
+// Callbacks run on the AsyncTCP task, which every connection shares, so
+// this never waits for the executor: the caller gets the id straight away
+// and fetches the outcome from /command/result
+void ServeCommand::sendQueued(AsyncWebServerRequest *request, uint32_t id)
+{
+    String jsonResponse = "{\"status\":\"success\",\"message\":\"Command queued\",\"data\":{\"id\":";
+    jsonResponse += id;
+    jsonResponse += "}}";
+
+    AsyncWebServerResponse *response = request->beginResponse(202, "application/json", jsonResponse);
+    WebHandler::addCorsHeaders(response);
+    request->send(response);
+}
+
+void ServeCommand::handleBatchRequest(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    // The body can arrive in several chunks
+    if (!RequestBody::collect(request, data, len, index, total, CommandBus::MAX_BATCH_LENGTH)) {
+        return;
+    }
+
+    CommandBatchOptions options = {false, 0};
+    if (request->hasParam("stopOnError")) {
+        String value = request->getParam("stopOnError")->value();
+        options.stopOnError = value == "1" || value.equalsIgnoreCase("true");
+    }
+    if (request->hasParam("delayMs")) {
+        options.delayMs = request->getParam("delayMs")->value().toInt();
+    }
+
+    uint32_t id = CommandBus::submitBatch(RequestBody::data(request), RequestBody::length(request), CMD_SOURCE_WEB, options);
+    if (id == 0) {
+        WebHandler::sendErrorResponse(request, 503, "Command queue full");
+        return;
+    }
+    sendQueued(request, id);
 }
 
 void ServeCommand::handleCommandRequest(AsyncWebServer &server)
 {
-    server.on("/command/set", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
-              {
-        debugV("Received POST request on /command/set");
+    WebAuth::on(server, "/command/set", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+              { handleCommandRequest(request, data, len, index, total); });
+}
 
-        // Convert the raw data to a string
-        String command = String((const char*)data).substring(0, len);
-        command.trim(); // Remove any leading/trailing whitespace or newlines
+void ServeCommand::handleBatchRequest(AsyncWebServer &server)
+{
+    WebAuth::on(server, "/command/batch", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+              { handleBatchRequest(request, data, len, index, total); });
+}
 
-        if (command.isEmpty()) {
-            debugW("Received an empty command");
-            WebHandler::sendErrorResponse(request, 400, "Empty command received");
+void ServeCommand::handleResultRequest(AsyncWebServer &server)
+{
+    WebAuth::on(server, "/command/result", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request)
+              {
+        if (!request->hasParam("id")) {
+            WebHandler::sendErrorResponse(request, 400, "Missing id parameter");
             return;
         }
 
-        debugV("Executing command: %s", command.c_str());
-
-        // Send the command to the CommandHandler
-        CommandHandler::handleCommand(command);
-
-        // Respond with success
-        WebHandler::sendSuccessResponse(request, "Command executed successfully"); });
+        uint32_t id = strtoul(request->getParam("id")->value().c_str(), nullptr, 10);
+        // Too big for the AsyncTCP stack. Only this callback fills it, and
+        // web callbacks never run concurrently, so one copy is enough.
+        static CommandRecord record;
+        if (!CommandBus::getResult(id, record)) {
+            WebHandler::sendErrorResponse(request, 404, "No result for this command (still running or expired)");
+            return;
+        }
+        sendResult(request, record); });
 }
 
 #endif // ENABLE_WEB_HANDLER
@@ -3,6 +3,7 @@
 #ifdef ENABLE_WEB_HANDLER
 
 #include <ESPAsyncWebServer.h>
+#include "CommandBus.h"
 
 class ServeCommand
 {
@@ -10,9 +11,24 @@ public:
     // Registers the endpoint for handling commands
     static void registerEndpoints(AsyncWebServer &server);
 
+    // Answers 202 with the id to fetch the result by from /command/result
+    static void sendQueued(AsyncWebServerRequest *request, uint32_t id);
+
 private:
     // Handles the POST request for executing commands
     static void handleCommandRequest(AsyncWebServer &server);
+    static void handleCommandRequest(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+
+    // POST /command/batch: JSON array/object or one command per line, run
+    // back to back. Query parameters stopOnError and delayMs set defaults.
+    static void handleBatchRequest(AsyncWebServer &server);
+    static void handleBatchRequest(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+
+    // GET /command/result?id=: outcome of a command or batch queued by /command/set or /command/batch
+    static void handleResultRequest(AsyncWebServer &server);
+
+    // Sends a finished command's status, duration and result, with its status as the HTTP code
+    static void sendResult(AsyncWebServerRequest *request, const CommandRecord &record);
 };
 
 #endif // ENABLE_WEB_HANDLER
@@ -3,6 +3,8 @@
 #include "ServeDevice.h"
 #include "Globals.h"
 #include "WebHandler.h"
+#include "WebAuth.h"
+#include "WebAdmission.h"
 #include "TimeHandler.h"
 #include "Timezones.h"
 #include <WiFi.h>
@@ -12,11 +14,24 @@
 
 static NonBlockingTimer delayTimer(1000);
 
+AsyncEventSource ServeDevice::events("/device/events");
+JsonDocument ServeDevice::staticInfo;
+JsonDocument ServeDevice::lastSent;
+ServeDevice::FsUsage ServeDevice::fsUsage = {0, 0, 0, 0, false};
+portMUX_TYPE ServeDevice::fsUsageMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool ServeDevice::snapshotDue = false;
+uint32_t ServeDevice::lastEventAt = 0;
+uint32_t ServeDevice::eventId = 0;
+
 void ServeDevice::registerEndpoints(AsyncWebServer &server)
 {
+    buildStaticInfo();
+    refreshFsUsage();
     handleDeviceInfo(server);
+    handleDeviceEvents(server);
     handleDeviceReboot(server);
     handleDeviceWifiNetworks(server);
+    handleDeviceAdmission(server);
     //handleDeviceTimezones(server);
     //handleDeviceBackup(server);
     //handleDeviceFormat(server);
@@ -25,81 +40,189 @@ void ServeDevice::registerEndpoints(AsyncWebServer &server)
 
 void ServeDevice::handleDeviceInfo(AsyncWebServer &server)
 {
-    server.on("/device/info", HTTP_GET, [](AsyncWebServerRequest *request)
+    WebAuth::on(server, "/device/info", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request)
               {
         
         debugV("Serving /device/get");
 
         JsonDocument doc;
-        
-        doc["firmwareVersion"]   = SOFTWARE_VERSION;
-        doc["freeHeap"]    = ESP.getFreeHeap();
-        doc["heapSize"]    = ESP.getHeapSize();
-        doc["maxAllocHeap"]    = ESP.getMaxAllocHeap();
-        doc["deviceName"]   = settings.device.name;
-        doc["timezone"]    = settings.device.timezone;
-        doc["bootCount"]    = settings.device.bootCount;
-        doc["upTime"]    = settings.device.upTime;
-        doc["bootTime"] = TimeHandler::formatDateTime("%I:%M:%S %p %m-%d-%Y", settings.device.bootTime); // Use the saved boot time
-        doc["currentTime"]  = TimeHandler::formatDateTime("%I:%M:%S %p %m-%d-%Y");
-        doc["ssid"]        = WiFi.SSID();
-        doc["ip"]          = WiFi.localIP().toString();
-        doc["mac"]         = WiFi.macAddress();
-        doc["rssi"]        = WiFi.RSSI();
-        doc["wifiMode"]    = WiFi.getMode();
-        doc["wifiChannel"] = WiFi.channel();
-        doc["settingsFile"]     = SETTINGS_FILE;
-        doc["buttonsFile"]      = BUTTONS_FILE;
-        doc["categoriesFile"]   = CATEGORIES_FILE;
-        doc["certFile"]         = EMQX_CERT_FILE;
-        doc["wifiNetworksFile"] = WIFI_NETWORKS_FILE;
-        doc["timezonesFile"]   = TIMEZONES_FILE;
-        doc["mqttConnected"] = settings.mqtt.isConnected;
-        doc["mqttEnabled"] = settings.mqtt.enabled;
-        doc["mqttServer"] = settings.mqtt.server;
-        doc["mqttPort"] = settings.mqtt.port;
-        doc["mqttSsl"] = settings.mqtt.ssl;
-        doc["mqttSubTopic"] = settings.mqtt.subTopic;
-        doc["mqttPubTopic"] = settings.mqtt.pubTopic;
-        doc["tickRateHz"] = configTICK_RATE_HZ;
-        doc["chipModel"]   = ESP.getChipModel();
-        doc["chipRevision"] = (int)ESP.getChipRevision();
-        doc["chipId"]      = ESP.getEfuseMac();
-        doc["chipCores"] = ESP.getChipCores();
-        doc["flashSize"]   = ESP.getFlashChipSize();
-        doc["flashSpeed"]  = ESP.getFlashChipSpeed();
-        doc["flashMode"]   = ESP.getFlashChipMode();
-        doc["cpuFreqMHz"]  = ESP.getCpuFreqMHz();
-        doc["sdkVersion"]  = ESP.getSdkVersion();
-        doc["psramSize"]   = ESP.getPsramSize();
-        doc["freePsram"]   = ESP.getFreePsram();
-        doc["lastResetTime"] = esp_timer_get_time(); // Example: microseconds since startup
-        doc["littleFsTotalSpace"] = LittleFS.totalBytes();
-        doc["littleFsUsedSpace"] = LittleFS.usedBytes();
-        doc["littleFsFreeSpace"] = LittleFS.totalBytes() - LittleFS.usedBytes();
-        
-         // Add reset reason
-        esp_reset_reason_t resetReason = esp_reset_reason();
-        switch (resetReason) {
-            case ESP_RST_POWERON: doc["resetReason"] = "Power-on Reset"; break;
-            case ESP_RST_EXT:     doc["resetReason"] = "External Reset"; break;
-            case ESP_RST_SW:      doc["resetReason"] = "Software Reset"; break;
-            case ESP_RST_PANIC:   doc["resetReason"] = "Panic Reset"; break;
-            case ESP_RST_INT_WDT: doc["resetReason"] = "Interrupt Watchdog Reset"; break;
-            case ESP_RST_TASK_WDT:doc["resetReason"] = "Task Watchdog Reset"; break;
-            case ESP_RST_WDT:     doc["resetReason"] = "Other Watchdog Reset"; break;
-            case ESP_RST_DEEPSLEEP: doc["resetReason"] = "Deep Sleep Reset"; break;
-            case ESP_RST_BROWNOUT: doc["resetReason"] = "Brownout Reset"; break;
-            case ESP_RST_SDIO:    doc["resetReason"] = "SDIO Reset"; break;
-            default:              doc["resetReason"] = "Unknown Reset"; break;
-        }
+        addStaticInfo(doc);
+        addLiveInfo(doc);
 
         WebHandler::sendSuccessResponse(request, "GET /device/get", &doc); });
 }
 
+static const char *resetReasonName(esp_reset_reason_t reason)
+{
+    switch (reason) {
+        case ESP_RST_POWERON: return "Power-on Reset";
+        case ESP_RST_EXT:     return "External Reset";
+        case ESP_RST_SW:      return "Software Reset";
+        case ESP_RST_PANIC:   return "Panic Reset";
+        case ESP_RST_INT_WDT: return "Interrupt Watchdog Reset";
+        case ESP_RST_TASK_WDT:return "Task Watchdog Reset";
+        case ESP_RST_WDT:     return "Other Watchdog Reset";
+        case ESP_RST_DEEPSLEEP: return "Deep Sleep Reset";
+        case ESP_RST_BROWNOUT: return "Brownout Reset";
+        case ESP_RST_SDIO:    return "SDIO Reset";
+        default:              return "Unknown Reset";
+    }
+}
+
+// Fields that cannot change while running, gathered once at startup
+void ServeDevice::buildStaticInfo()
+{
+    staticInfo["firmwareVersion"]   = SOFTWARE_VERSION;
+    staticInfo["heapSize"]    = ESP.getHeapSize();
+    staticInfo["mac"]         = WiFi.macAddress();
+    staticInfo["settingsFile"]     = SETTINGS_FILE;
+    staticInfo["buttonsFile"]      = BUTTONS_FILE;
+    staticInfo["categoriesFile"]   = CATEGORIES_FILE;
+    staticInfo["certFile"]         = EMQX_CERT_FILE;
+    staticInfo["wifiNetworksFile"] = WIFI_NETWORKS_FILE;
+    staticInfo["timezonesFile"]   = TIMEZONES_FILE;
+    staticInfo["tickRateHz"] = configTICK_RATE_HZ;
+    staticInfo["chipModel"]   = ESP.getChipModel();
+    staticInfo["chipRevision"] = (int)ESP.getChipRevision();
+    staticInfo["chipId"]      = ESP.getEfuseMac();
+    staticInfo["chipCores"] = ESP.getChipCores();
+    staticInfo["flashSize"]   = ESP.getFlashChipSize();
+    staticInfo["flashSpeed"]  = ESP.getFlashChipSpeed();
+    staticInfo["flashMode"]   = ESP.getFlashChipMode();
+    staticInfo["cpuFreqMHz"]  = ESP.getCpuFreqMHz();
+    staticInfo["sdkVersion"]  = ESP.getSdkVersion();
+    staticInfo["psramSize"]   = ESP.getPsramSize();
+    staticInfo["resetReason"] = resetReasonName(esp_reset_reason());
+}
+
+void ServeDevice::addStaticInfo(JsonDocument &doc)
+{
+    for (JsonPairConst field : staticInfo.as<JsonObjectConst>()) {
+        doc[field.key()] = field.value();
+    }
+}
+
+// Filesystem usage walks the LittleFS metadata, so it is only measured
+// again after a file has been written (or at most FS_USAGE_MAX_AGE_MS later,
+// for writers that do not say so). Only the loop task measures it.
+void ServeDevice::refreshFsUsage()
+{
+    uint32_t filesGeneration = ConfigManager::getFilesGeneration();
+    if (fsUsage.valid && fsUsage.generation == filesGeneration && millis() - fsUsage.measuredAt <= FS_USAGE_MAX_AGE_MS) {
+        return;
+    }
+
+    FsUsage measured;
+    measured.total = LittleFS.totalBytes();
+    measured.used = LittleFS.usedBytes();
+    measured.generation = filesGeneration;
+    measured.measuredAt = millis();
+    measured.valid = true;
+    portENTER_CRITICAL(&fsUsageMux);
+    fsUsage = measured;
+    portEXIT_CRITICAL(&fsUsageMux);
+}
+
+// Fields that change while running. Called from the AsyncTCP task
+// (/device/info) and the loop task (/device/events).
+void ServeDevice::addLiveInfo(JsonDocument &doc)
+{
+    portENTER_CRITICAL(&fsUsageMux);
+    FsUsage usage = fsUsage;
+    portEXIT_CRITICAL(&fsUsageMux);
+
+    doc["freeHeap"]    = ESP.getFreeHeap();
+    doc["maxAllocHeap"]    = ESP.getMaxAllocHeap();
+    doc["deviceName"]   = settings.device.name;
+    doc["timezone"]    = settings.device.timezone;
+    doc["bootCount"]    = settings.device.bootCount;
+    doc["upTime"]    = settings.device.upTime;
+    doc["bootTime"] = TimeHandler::formatDateTime("%I:%M:%S %p %m-%d-%Y", settings.device.bootTime); // Use the saved boot time
+    doc["currentTime"]  = TimeHandler::formatDateTime("%I:%M:%S %p %m-%d-%Y");
+    doc["ssid"]        = WiFi.SSID();
+    doc["ip"]          = WiFi.localIP().toString();
+    doc["rssi"]        = WiFi.RSSI();
+    doc["wifiMode"]    = WiFi.getMode();
+    doc["wifiChannel"] = WiFi.channel();
+    doc["mqttConnected"] = settings.mqtt.isConnected;
+    doc["mqttEnabled"] = settings.mqtt.enabled;
+    doc["mqttServer"] = settings.mqtt.server;
+    doc["mqttPort"] = settings.mqtt.port;
+    doc["mqttSsl"] = settings.mqtt.ssl;
+    doc["mqttSubTopic"] = settings.mqtt.subTopic;
+    doc["mqttPubTopic"] = settings.mqtt.pubTopic;
+    doc["freePsram"]   = ESP.getFreePsram();
+    doc["lastResetTime"] = esp_timer_get_time(); // Example: microseconds since startup
+    doc["littleFsTotalSpace"] = usage.total;
+    doc["littleFsUsedSpace"] = usage.used;
+    doc["littleFsFreeSpace"] = usage.total - usage.used;
+}
+
+// GET /device/events: a Server-Sent Events stream. A browser gets the whole
+// device info as an "info" event when it connects, then an "update" event
+// every telemetry interval holding only the fields that changed.
+void ServeDevice::handleDeviceEvents(AsyncWebServer &server)
+{
+    events.onConnect([](AsyncEventSourceClient *client) {
+        debugV("Device events client connected");
+        snapshotDue = true; // Sent from loop(), which owns the last sent values
+    });
+    // EventSource cannot send headers, so the token may also come as ?token=
+    WebAuth::add(server, &events, AUTH_BEARER_PARAM);
+}
+
+// count() and send() hold the event source's clients lock, which the
+// AsyncTCP task also takes before it adds or frees a client, so they are
+// safe from the loop task
+void ServeDevice::loop()
+{
+    refreshFsUsage();
+    if (events.count() == 0) {
+        lastEventAt = 0;
+        return;
+    }
+
+    uint32_t interval = settings.device.telemetryInterval > 0 ? settings.device.telemetryInterval : DEVICE_EVENTS_INTERVAL_MS;
+    if (!snapshotDue && millis() - lastEventAt < interval) {
+        return;
+    }
+    lastEventAt = millis();
+
+    JsonDocument current;
+    addLiveInfo(current);
+    JsonObjectConst previous = lastSent.as<JsonObjectConst>();
+
+    String message;
+    if (snapshotDue) {
+        // Everyone gets the full set again, so a new browser and the ones
+        // already connected agree on what the next update is relative to
+        snapshotDue = false;
+        JsonDocument info;
+        addStaticInfo(info);
+        for (JsonPairConst field : current.as<JsonObjectConst>()) {
+            info[field.key()] = field.value();
+        }
+        serializeJson(info, message);
+        events.send(message.c_str(), "info", ++eventId, DEVICE_EVENTS_RECONNECT_MS);
+    } else {
+        JsonDocument changed;
+        for (JsonPairConst field : current.as<JsonObjectConst>()) {
+            if (field.value() != previous[field.key()]) {
+                changed[field.key()] = field.value();
+            }
+        }
+        if (changed.isNull()) {
+            return;
+        }
+        serializeJson(changed, message);
+        events.send(message.c_str(), "update", ++eventId);
+    }
+    lastSent = current;
+}
+
 void ServeDevice::handleDeviceReboot(AsyncWebServer &server)
 {
-    server.on("/device/reboot", HTTP_GET, [](AsyncWebServerRequest *request)
+    WebAuth::on(server, "/device/reboot", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request)
               {
         
         debugV("Received GET request on /device/reboot");
@@ -116,9 +239,20 @@ void ServeDevice::handleDeviceReboot(AsyncWebServer &server)
         } });
 }
 
+// GET /device/admission: requests taken on and turned away by the web
+// server's admission control, per class, with its limits
+void ServeDevice::handleDeviceAdmission(AsyncWebServer &server)
+{
+    WebAuth::on(server, "/device/admission", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request)
+              {
+        JsonDocument doc;
+        WebAdmission::report(doc);
+        WebHandler::sendSuccessResponse(request, "GET /device/admission", &doc); });
+}
+
 void ServeDevice::handleDeviceWifiNetworks(AsyncWebServer &server)
 {
-    server.on("/device/wifi/networks", HTTP_GET, [](AsyncWebServerRequest *request){
+    WebAuth::on(server, "/device/wifi/networks", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request){
 
         if (!LittleFS.begin(true)) {
             debugE("Failed to mount LittleFS");
@@ -148,7 +282,7 @@ void ServeDevice::handleDeviceWifiNetworks(AsyncWebServer &server)
 
 void ServeDevice::handleDeviceTimezones(AsyncWebServer &server)
 {
-    server.on("/data/timezones", HTTP_GET, [](AsyncWebServerRequest *request){
+    WebAuth::on(server, "/data/timezones", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request){
         if (!LittleFS.begin(true)) {
             debugE("Failed to mount LittleFS");
             WebHandler::sendErrorResponse(request, 500, "Failed to mount filesystem");
@@ -177,7 +311,7 @@ void ServeDevice::handleDeviceTimezones(AsyncWebServer &server)
 
 void ServeDevice::handleDeviceFormat(AsyncWebServer &server)
 {
-    server.on("/device/format", HTTP_GET, [](AsyncWebServerRequest *request)
+    WebAuth::on(server, "/device/format", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request)
               {
         debugV("Received GET request on /device/format");
 
@@ -202,7 +336,7 @@ void ServeDevice::handleDeviceFormat(AsyncWebServer &server)
 
 void ServeDevice::handleDeviceOTA(AsyncWebServer &server)
 {
-    server.on("/device/ota", HTTP_POST, [](AsyncWebServerRequest *request) {
+    WebAuth::on(server, "/device/ota", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {
         if (Update.hasError()) {
             JsonDocument data;
             data["message"] = "Update failed!";
@@ -3,15 +3,56 @@
 #ifdef ENABLE_WEB_HANDLER
 
 #include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+
+// Default time between /device/events updates (settings device.telemetryInterval overrides it)
+#ifndef DEVICE_EVENTS_INTERVAL_MS
+#define DEVICE_EVENTS_INTERVAL_MS 2000
+#endif
+
+// Retry delay the browser is told to use if the event stream drops
+#ifndef DEVICE_EVENTS_RECONNECT_MS
+#define DEVICE_EVENTS_RECONNECT_MS 5000
+#endif
+
+// Filesystem usage is measured again after any file change, or after this long
+#ifndef FS_USAGE_MAX_AGE_MS
+#define FS_USAGE_MAX_AGE_MS 60000
+#endif
 
 class ServeDevice {
 public:
     static void registerEndpoints(AsyncWebServer& server);
+    // Pushes telemetry to /device/events subscribers; does nothing without any
+    static void loop();
 
 private:
+    struct FsUsage {
+        size_t total;
+        size_t used;
+        uint32_t generation; // ConfigManager::getFilesGeneration() when measured
+        uint32_t measuredAt;
+        bool valid;
+    };
+
+    static AsyncEventSource events;
+    static JsonDocument staticInfo; // Built once by registerEndpoints()
+    static JsonDocument lastSent;   // Live fields as of the last event
+    static FsUsage fsUsage;      // Written by the loop task only
+    static portMUX_TYPE fsUsageMux; // So /device/info copies it whole
+    static volatile bool snapshotDue; // Set from the AsyncTCP task when a browser connects
+    static uint32_t lastEventAt;
+    static uint32_t eventId;
+
+    static void buildStaticInfo();
+    static void addStaticInfo(JsonDocument& doc);
+    static void refreshFsUsage();
+    static void addLiveInfo(JsonDocument& doc);
     static void handleDeviceInfo(AsyncWebServer& server);
+    static void handleDeviceEvents(AsyncWebServer& server);
     static void handleDeviceReboot(AsyncWebServer& server);
     static void handleDeviceWifiNetworks(AsyncWebServer& server);
+    static void handleDeviceAdmission(AsyncWebServer& server);
     static void handleDeviceTimezones(AsyncWebServer& server);
     //static void handleDeviceBackup(AsyncWebServer& server);
     static void handleDeviceFormat(AsyncWebServer& server);
@@ -0,0 +1,67 @@
+#ifdef ENABLE_WEB_HANDLER
+
+#include "ServeDucky.h"
+#include "Globals.h"
+#include "WebHandler.h"
+#include "WebAuth.h"
+#include "DuckyScriptHandler.h"
+#include <ArduinoJson.h>
+
+void ServeDucky::registerEndpoints(AsyncWebServer &server)
+{
+    handleStatus(server);
+    handleRun(server);
+    handleStop(server);
+}
+
+void ServeDucky::handleStatus(AsyncWebServer &server)
+{
+    WebAuth::on(server, "/ducky/status", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request)
+              {
+        debugV("Serving /ducky/status");
+
+#ifdef ENABLE_DUCKYSCRIPT_HANDLER
+        JsonDocument doc;
+        DuckyScriptHandler::statusToJson(DuckyScriptHandler::getStatus(), doc);
+
+        WebHandler::sendSuccessResponse(request, "DuckyScript status", &doc);
+#else
+        WebHandler::sendErrorResponse(request, 404, "DuckyScript not enabled");
+#endif
+    });
+}
+
+void ServeDucky::handleRun(AsyncWebServer &server)
+{
+    WebAuth::on(server, "/ducky/run", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request)
+              {
+        debugV("Received POST request on /ducky/run");
+
+        if (!request->hasParam("path"))
+        {
+            WebHandler::sendErrorResponse(request, 400, "Missing path parameter");
+            return;
+        }
+
+        String path = request->getParam("path")->value();
+        if (!DuckyScriptHandler::executeScript(path, "web"))
+        {
+            WebHandler::sendErrorResponse(request, 503, "DuckyScript run queue full");
+            return;
+        }
+
+        WebHandler::sendSuccessResponse(request, "DuckyScript queued");
+    });
+}
+
+void ServeDucky::handleStop(AsyncWebServer &server)
+{
+    WebAuth::on(server, "/ducky/stop", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request)
+              {
+        debugV("Received POST request on /ducky/stop");
+        DuckyScriptHandler::stop();
+        WebHandler::sendSuccessResponse(request, "DuckyScript stopped");
+    });
+}
+
+#endif // ENABLE_WEB_HANDLER
@@ -0,0 +1,24 @@
+#pragma once
+
+#ifdef ENABLE_WEB_HANDLER
+
+#include <ESPAsyncWebServer.h>
+
+class ServeDucky
+{
+public:
+    // Registers the DuckyScript run queue endpoints
+    static void registerEndpoints(AsyncWebServer &server);
+
+private:
+    // Reports the running script, its progress and the run queue
+    static void handleStatus(AsyncWebServer &server);
+
+    // Queues a script from LittleFS (?path=/scripts/demo.txt)
+    static void handleRun(AsyncWebServer &server);
+
+    // Stops the running script and clears the run queue
+    static void handleStop(AsyncWebServer &server);
+};
+
+#endif // ENABLE_WEB_HANDLER
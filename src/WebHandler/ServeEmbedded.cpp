@@ -3,54 +3,102 @@
 #include "ServeEmbedded.h"
 #include "Globals.h"
 #include "WebHandler.h"
-#include "ServeEmbeddedFiles.h"
-#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+// Picks up GET requests for embedded files. Unlike serveStatic() this never
+// touches LittleFS, so there is no file open or .gz probe per request.
+class EmbeddedWebHandler : public AsyncWebHandler
+{
+public:
+    bool canHandle(AsyncWebServerRequest *request) override
+    {
+        if (request->method() != HTTP_GET || !ServeEmbedded::find(request->url())) {
+            return false;
+        }
+        AsyncWebHeader *encoding = request->getHeader("Accept-Encoding");
+        if (!encoding || encoding->value().indexOf("gzip") < 0) {
+            return false;
+        }
+        request->addInterestingHeader("If-None-Match");
+        return true;
+    }
+
+    void handleRequest(AsyncWebServerRequest *request) override
+    {
+        const EmbeddedFile *file = ServeEmbedded::find(request->url());
+        if (file) {
+            ServeEmbedded::sendFile(request, *file);
+        }
+    }
+};
 
 void ServeEmbedded::registerEndpoints(AsyncWebServer &server)
 {
-    handleGetRequest(server);
+#ifdef ENABLE_EMBEDDED_WWW
+    server.addHandler(new EmbeddedWebHandler());
+    debugI("ServeEmbedded registered %u files", (unsigned int)EMBEDDED_FILE_COUNT);
+
+    // Checked once here rather than per request
+    unsigned int shadowed = 0;
+    for (size_t i = 0; i < EMBEDDED_FILE_COUNT; i++) {
+        if (LittleFS.exists(String("/www") + embeddedFiles[i].path)) {
+            shadowed++;
+        }
+    }
+    if (shadowed > 0) {
+        debugI("%u files in LittleFS /www are served from the embedded copy instead", shadowed);
+    }
+#else
+    debugI("ServeEmbedded has no embedded files; serving the UI from LittleFS");
+#endif
 }
 
-void ServeEmbedded::serveEmbeddedFile(AsyncWebServer &server, const char *path, const uint8_t *start, const uint8_t *end, const char *contentType)
+// Binary search of the route table, which the build script sorts by path.
+// A path ending in '/' means the index.html inside it.
+const EmbeddedFile *ServeEmbedded::find(const String &url)
 {
-    server.on(path, HTTP_GET, [path, start, end, contentType](AsyncWebServerRequest *request){
-        size_t fileSize = end - start;
-        AsyncWebServerResponse* response = request->beginResponse_P(200, contentType, start, fileSize);
-        response->addHeader("Content-Encoding", "identity");
-        WebHandler::addCorsHeaders(response);
-        request->send(response);
-        debugV("Served: %s", path); });
+#ifdef ENABLE_EMBEDDED_WWW
+    String path = url;
+    if (path.endsWith("/")) {
+        path += "index.html";
+    }
+
+    size_t low = 0;
+    size_t high = EMBEDDED_FILE_COUNT;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        int order = strcmp(path.c_str(), embeddedFiles[middle].path);
+        if (order == 0) {
+            return &embeddedFiles[middle];
+        }
+        if (order < 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+#endif
+    return nullptr;
 }
 
-void ServeEmbedded::handleGetRequest(AsyncWebServer &server)
+void ServeEmbedded::sendFile(AsyncWebServerRequest *request, const EmbeddedFile &file)
 {
-    /*
-    serveEmbeddedFile(server, "/backup.html", backup_html_start, backup_html_end, "text/html");
-    serveEmbeddedFile(server, "/buttoneditor.html", buttoneditor_html_start, buttoneditor_html_end, "text/html");
-    serveEmbeddedFile(server, "/buttoneditor.css", buttoneditor_css_start, buttoneditor_css_end, "text/css");
-    serveEmbeddedFile(server, "/buttoneditor.js", buttoneditor_js_start, buttoneditor_js_end, "application/javascript");
-    serveEmbeddedFile(server, "/buttons.html", buttons_html_start, buttons_html_end, "text/html");
-    serveEmbeddedFile(server, "/buttons.js", buttons_js_start, buttons_js_end, "application/javascript");
-    serveEmbeddedFile(server, "/error.html", error_html_start, error_html_end, "text/html");
-    serveEmbeddedFile(server, "/favicon.ico", favicon_ico_start, favicon_ico_end, "image/x-icon");
-    serveEmbeddedFile(server, "/files.css", files_css_start, files_css_end, "text/css");
-    serveEmbeddedFile(server, "/files.html", files_html_start, files_html_end, "text/html");
-    serveEmbeddedFile(server, "/files.js", files_js_start, files_js_end, "application/javascript");
-    serveEmbeddedFile(server, "/footer.html", footer_html_start, footer_html_end, "text/html");
-    serveEmbeddedFile(server, "/global.js", global_js_start, global_js_end, "application/javascript");
-    serveEmbeddedFile(server, "/", index_html_start, index_html_end, "text/html");
-    serveEmbeddedFile(server, "/index.js", index_js_start, index_js_end, "application/javascript");
-    serveEmbeddedFile(server, "/navbar.html", navbar_html_start, navbar_html_end, "text/html");
-    serveEmbeddedFile(server, "/settings.html", settings_html_start, settings_html_end, "text/html");
-    serveEmbeddedFile(server, "/settings.js", settings_js_start, settings_js_end, "application/javascript");
-    serveEmbeddedFile(server, "/styles.css", styles_css_start, styles_css_end, "text/css");
-    serveEmbeddedFile(server, "/terminal.css", terminal_css_start, terminal_css_end, "text/css");
-    serveEmbeddedFile(server, "/terminal.html", terminal_html_start, terminal_html_end, "text/html");
-    serveEmbeddedFile(server, "/terminal.js", terminal_js_start, terminal_js_end, "application/javascript");
-    serveEmbeddedFile(server, "/timezones.json", timezones_json_start, timezones_json_end, "application/json");
-    */
-         
-    debugI("ServeEmbedded handleGetRequest registered");
+    AsyncWebServerResponse *response;
+    AsyncWebHeader *match = request->getHeader("If-None-Match");
+    if (match && (match->value().indexOf(file.etag) >= 0 || match->value() == "*")) {
+        response = request->beginResponse(304);
+        debugV("Not modified: %s", file.path);
+    } else {
+        // Sent from flash as it is acknowledged; nothing is copied to the heap
+        response = request->beginResponse_P(200, file.contentType, file.data, file.length);
+        response->addHeader("Content-Encoding", "gzip");
+        debugV("Served: %s", file.path);
+    }
+    response->addHeader("ETag", file.etag);
+    response->addHeader("Cache-Control", file.cacheControl);
+    response->addHeader("Vary", "Accept-Encoding");
+    WebHandler::addCorsHeaders(response);
+    request->send(response);
 }
 
-#endif // ENABLE_WEB_HANDLER
\ No newline at end of file
+#endif // ENABLE_WEB_HANDLER
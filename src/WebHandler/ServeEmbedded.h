@@ -3,14 +3,22 @@
 #ifdef ENABLE_WEB_HANDLER
 
 #include <ESPAsyncWebServer.h>
+#include "ServeEmbeddedFiles.h"
 
+// Serves the web UI from the gzipped copy linked into flash. Files are sent
+// straight from flash with a strong ETag, and a request whose If-None-Match
+// still matches gets a 304 without a body. Anything not embedded, and any
+// client that does not accept gzip, falls through to the LittleFS handler.
+// An embedded file shadows the LittleFS /www file of the same path, so a
+// change to one of those needs a firmware build; boot logs how many are.
 class ServeEmbedded {
 public:
     static void registerEndpoints(AsyncWebServer& server);
+    static const EmbeddedFile *find(const String &url);
 
 private:
-    static void serveEmbeddedFile(AsyncWebServer &server, const char *path, const uint8_t *start, const uint8_t *end, const char *contentType);
-    static void handleGetRequest(AsyncWebServer& server);
+    friend class EmbeddedWebHandler;
+    static void sendFile(AsyncWebServerRequest *request, const EmbeddedFile &file);
 };
 
-#endif // ENABLE_WEB_HANDLER
\ No newline at end of file
+#endif // ENABLE_WEB_HANDLER
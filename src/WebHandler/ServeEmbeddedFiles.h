@@ -4,66 +4,21 @@
 
 #include <Arduino.h>
 
-// Declarations for embedded files
-/*
-extern const uint8_t backup_html_start[] asm("_binary_web_backup_html_start");
-extern const uint8_t backup_html_end[] asm("_binary_web_backup_html_end");
+// One gzipped file of the web UI, linked into flash
+struct EmbeddedFile {
+    const char *path;         // URL path, e.g. "/css/styles.css"
+    const char *contentType;
+    const char *etag;         // Strong, quoted
+    const char *cacheControl;
+    const uint8_t *data;      // Gzip stream
+    size_t length;
+};
+
+// The route table is generated from data/www by tools/embed_www.py, which
+// also defines ENABLE_EMBEDDED_WWW. Builds without the script (native)
+// serve the UI from LittleFS only.
+#ifdef ENABLE_EMBEDDED_WWW
+#include "EmbeddedWww.h"
+#endif
 
-extern const uint8_t buttoneditor_html_start[] asm("_binary_web_buttoneditor_html_start");
-extern const uint8_t buttoneditor_html_end[] asm("_binary_web_buttoneditor_html_end");
-extern const uint8_t buttoneditor_css_start[] asm("_binary_web_buttoneditor_css_start");
-extern const uint8_t buttoneditor_css_end[] asm("_binary_web_buttoneditor_css_end");
-extern const uint8_t buttoneditor_js_start[] asm("_binary_web_buttoneditor_js_start");
-extern const uint8_t buttoneditor_js_end[] asm("_binary_web_buttoneditor_js_end");
-
-extern const uint8_t buttons_html_start[] asm("_binary_web_buttons_html_start");
-extern const uint8_t buttons_html_end[] asm("_binary_web_buttons_html_end");
-extern const uint8_t buttons_js_start[] asm("_binary_web_buttons_js_start");
-extern const uint8_t buttons_js_end[] asm("_binary_web_buttons_js_end");
-
-extern const uint8_t error_html_start[] asm("_binary_web_error_html_start");
-extern const uint8_t error_html_end[] asm("_binary_web_error_html_end");
-
-extern const uint8_t favicon_ico_start[] asm("_binary_web_favicon_ico_start");
-extern const uint8_t favicon_ico_end[]   asm("_binary_web_favicon_ico_end");
-
-extern const uint8_t files_css_start[] asm("_binary_web_files_css_start");
-extern const uint8_t files_css_end[] asm("_binary_web_files_css_end");
-extern const uint8_t files_html_start[] asm("_binary_web_files_html_start");
-extern const uint8_t files_html_end[] asm("_binary_web_files_html_end");
-extern const uint8_t files_js_start[] asm("_binary_web_files_js_start");
-extern const uint8_t files_js_end[] asm("_binary_web_files_js_end");
-
-extern const uint8_t footer_html_start[] asm("_binary_web_footer_html_start");
-extern const uint8_t footer_html_end[] asm("_binary_web_footer_html_end");
-
-extern const uint8_t global_js_start[] asm("_binary_web_global_js_start");
-extern const uint8_t global_js_end[] asm("_binary_web_global_js_end");
-
-extern const uint8_t index_html_start[] asm("_binary_web_index_html_start");
-extern const uint8_t index_html_end[] asm("_binary_web_index_html_end");
-extern const uint8_t index_js_start[] asm("_binary_web_index_js_start");
-extern const uint8_t index_js_end[] asm("_binary_web_index_js_end");
-
-extern const uint8_t navbar_html_start[] asm("_binary_web_navbar_html_start");
-extern const uint8_t navbar_html_end[] asm("_binary_web_navbar_html_end");
-
-extern const uint8_t settings_html_start[] asm("_binary_web_settings_html_start");
-extern const uint8_t settings_html_end[] asm("_binary_web_settings_html_end");
-extern const uint8_t settings_js_start[] asm("_binary_web_settings_js_start");
-extern const uint8_t settings_js_end[] asm("_binary_web_settings_js_end");
-
-extern const uint8_t styles_css_start[] asm("_binary_web_styles_css_start");
-extern const uint8_t styles_css_end[] asm("_binary_web_styles_css_end");
-
-extern const uint8_t terminal_css_start[] asm("_binary_web_terminal_css_start");
-extern const uint8_t terminal_css_end[] asm("_binary_web_terminal_css_end");
-extern const uint8_t terminal_html_start[] asm("_binary_web_terminal_html_start");
-extern const uint8_t terminal_html_end[] asm("_binary_web_terminal_html_end");
-extern const uint8_t terminal_js_start[] asm("_binary_web_terminal_js_start");
-extern const uint8_t terminal_js_end[] asm("_binary_web_terminal_js_end");
-
-extern const uint8_t timezones_json_start[] asm("_binary_web_timezones_json_start");
-extern const uint8_t timezones_json_end[] asm("_binary_web_timezones_json_end");
-*/
 #endif // ENABLE_WEB_HANDLER
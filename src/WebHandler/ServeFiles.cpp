@@ -3,21 +3,133 @@
 #include "ServeFiles.h"
 #include "Globals.h"
 #include "WebHandler.h"
+#include "WebAuth.h"
+#include "SecureFile.h"
+#include "CryptoHandler.h"
+#include "FileUpload.h"
 #include <LittleFS.h>
+#include <memory>
 
 // Register endpoints for file management
 void ServeFiles::registerEndpoints(AsyncWebServer &server)
 {
-    server.on("/files", HTTP_GET, handleListFiles);                                              // List files
-    server.on("/file", HTTP_GET, handleReadFile);                                                // Read a file
-    server.on("/file", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, handleWriteFile); // Write a file
-    server.on("/file", HTTP_DELETE, handleDeleteFile);                                           // Delete a file
-    server.on("/folder", HTTP_POST, handleCreateFolder);                                         // Create folder
-    server.on("/folder", HTTP_DELETE, handleDeleteFolder);                                       // Delete folder
-    server.on("/folders", HTTP_GET, handleListFolders);                                          // List folders
-    server.on("/rename", HTTP_POST, handleRename);                                               // Rename file or folder
-    server.on("/filemanager", HTTP_GET, handleFileManager);                                      // List files and folders together
-    server.on("/folder/files", HTTP_GET, handleListFilesInFolder);                               // New endpoint: List files in a folder
+    WebAuth::on(server, "/files", HTTP_GET, AUTH_BEARER, handleListFiles);                                              // List files
+    WebAuth::on(server, "/file", HTTP_GET, AUTH_BEARER, handleReadFile);                                                // Read a file
+    WebAuth::on(server, "/file", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {}, NULL, handleWriteFile); // Write a file
+    WebAuth::on(server, "/file", HTTP_DELETE, AUTH_BEARER, handleDeleteFile);                                           // Delete a file
+    WebAuth::on(server, "/folder", HTTP_POST, AUTH_BEARER, handleCreateFolder);                                         // Create folder
+    WebAuth::on(server, "/folder", HTTP_DELETE, AUTH_BEARER, handleDeleteFolder);                                       // Delete folder
+    WebAuth::on(server, "/folders", HTTP_GET, AUTH_BEARER, handleListFolders);                                          // List folders
+    WebAuth::on(server, "/rename", HTTP_POST, AUTH_BEARER, handleRename);                                               // Rename file or folder
+    WebAuth::on(server, "/filemanager", HTTP_GET, AUTH_BEARER, handleFileManager);                                      // List files and folders together
+    WebAuth::on(server, "/folder/files", HTTP_GET, AUTH_BEARER, handleListFilesInFolder);                               // New endpoint: List files in a folder
+}
+
+DirectoryWalker::DirectoryWalker(const String &root, bool recursive) : recursive(recursive)
+{
+    String dirPath = root.endsWith("/") ? root : root + "/";
+    File dir = LittleFS.open(dirPath);
+    if (dir && dir.isDirectory())
+    {
+        dirs.push_back(dir);
+        dirPaths.push_back(dirPath);
+    }
+}
+
+bool DirectoryWalker::next(String &path, bool &isDirectory)
+{
+    while (!dirs.empty())
+    {
+        File file = dirs.back().openNextFile();
+        if (!file)
+        {
+            dirs.back().close();
+            dirs.pop_back();
+            dirPaths.pop_back();
+            continue;
+        }
+
+        path = dirPaths.back() + file.name();
+        isDirectory = file.isDirectory();
+        if (isDirectory && recursive && dirs.size() < MAX_DEPTH)
+        {
+            // Descend now, so entries come out in the same order as a recursive listing
+            dirs.push_back(file);
+            dirPaths.push_back(path + "/");
+        }
+        return true;
+    }
+    return false;
+}
+
+void FileListing::addSection(const char *key, const String &root, bool recursive, bool files, bool folders, bool relative)
+{
+    Section section = {key, root, recursive, files, folders, relative};
+    sections.push_back(section);
+}
+
+void FileListing::setPath(const String &listedPath)
+{
+    path = listedPath;
+}
+
+bool FileListing::next(String &out)
+{
+    out = "";
+    while (current < sections.size())
+    {
+        const Section &section = sections[current];
+        if (!walker)
+        {
+            walker.reset(new DirectoryWalker(section.root, section.recursive));
+            out += current == 0 ? "{\"" : ",\"";
+            out += section.key;
+            out += "\":[";
+            first = true;
+            return true;
+        }
+
+        String entry;
+        bool isDirectory;
+        while (walker->next(entry, isDirectory))
+        {
+            if (isDirectory ? !section.folders : !section.files)
+            {
+                continue;
+            }
+            if (!first)
+            {
+                out += ',';
+            }
+            first = false;
+            WebHandler::appendJsonString(out, section.relative ? entry.c_str() + section.root.length() : entry.c_str());
+            return true;
+        }
+
+        walker.reset();
+        current++;
+        out = "]";
+        return true;
+    }
+
+    if (finished)
+    {
+        return false;
+    }
+    if (!path.isEmpty())
+    {
+        out = ",\"path\":";
+        WebHandler::appendJsonString(out, path.c_str());
+    }
+    out += "}";
+    finished = true;
+    return true;
+}
+
+void ServeFiles::sendListing(AsyncWebServerRequest *request, const char *message, std::shared_ptr<FileListing> listing)
+{
+    WebHandler::sendChunkedSuccess(request, message, [listing](String &out) -> bool
+                                   { return listing->next(out); });
 }
 
 // Handler for `/filemanager`
@@ -42,48 +154,13 @@ void ServeFiles::handleFileManager(AsyncWebServerRequest *request)
         WebHandler::sendErrorResponse(request, 404, "Invalid directory path");
         return;
     }
+    dir.close();
 
-    JsonDocument doc;
-    JsonArray files = doc["files"].to<JsonArray>();
-    JsonArray folders = doc["folders"].to<JsonArray>();
-
-    // List files and folders
-    listFilesAndFolders(files, folders, path);
-
-    doc["path"] = path;
-    WebHandler::sendSuccessResponse(request, "Directory contents fetched successfully", &doc);
-}
-
-// Helper to list files and folders
-void ServeFiles::listFilesAndFolders(JsonArray &files, JsonArray &folders, const String &path)
-{
-    File dir = LittleFS.open(path);
-    if (!dir || !dir.isDirectory())
-    {
-        debugE("Failed to open directory: %s", path.c_str());
-        return;
-    }
-
-    File file = dir.openNextFile();
-    while (file)
-    {
-        String name = file.name();
-        if (name.startsWith(path))
-        {
-            name = name.substring(path.length());
-        }
-        if (file.isDirectory())
-        {
-            debugV("Found folder: %s", name.c_str());
-            folders.add(name);
-        }
-        else
-        {
-            debugV("Found file: %s", name.c_str());
-            files.add(name);
-        }
-        file = dir.openNextFile();
-    }
+    std::shared_ptr<FileListing> listing(new FileListing());
+    listing->addSection("files", path, false, true, false, true);
+    listing->addSection("folders", path, false, false, true, true);
+    listing->setPath(path);
+    sendListing(request, "Directory contents fetched successfully", listing);
 }
 
 void ServeFiles::handleSearch(AsyncWebServerRequest *request)
@@ -146,6 +223,8 @@ void ServeFiles::handleRename(AsyncWebServerRequest *request)
 
     if (LittleFS.rename(oldName, newName))
     {
+        ConfigManager::fileChanged(oldName.c_str());
+        ConfigManager::fileChanged(newName.c_str());
         WebHandler::sendSuccessResponse(request, "Renamed successfully");
     }
     else
@@ -154,45 +233,13 @@ void ServeFiles::handleRename(AsyncWebServerRequest *request)
     }
 }
 
-void ServeFiles::listFoldersRecursive(JsonArray &folders, const String &path)
-{
-    String dirPath = path.isEmpty() ? "/" : (path.endsWith("/") ? path : path + "/");
-
-    debugV("Opening directory: %s", dirPath.c_str());
-    File dir = LittleFS.open(dirPath);
-
-    if (!dir || !dir.isDirectory())
-    {
-        debugE("Failed to open directory: %s", dirPath.c_str());
-        return;
-    }
-
-    File file = dir.openNextFile();
-    while (file)
-    {
-        if (file.isDirectory())
-        {
-            String fullPath = dirPath + file.name();
-            debugV("Found folder: %s", fullPath.c_str());
-            folders.add(fullPath);
-            // Recursively list subdirectories
-            listFoldersRecursive(folders, fullPath);
-        }
-        file = dir.openNextFile();
-    }
-}
-
 void ServeFiles::handleListFolders(AsyncWebServerRequest *request)
 {
     debugV("Received GET request on /folders");
 
-    JsonDocument doc;
-    JsonArray folders = doc["folders"].to<JsonArray>();
-
-    // Start recursive folder listing from the root directory
-    listFoldersRecursive(folders, "/");
-
-    WebHandler::sendSuccessResponse(request, "Folders listed successfully", &doc);
+    std::shared_ptr<FileListing> listing(new FileListing());
+    listing->addSection("folders", "/", true, false, true, false);
+    sendListing(request, "Folders listed successfully", listing);
 }
 
 void ServeFiles::handleCreateFolder(AsyncWebServerRequest *request)
@@ -303,6 +350,7 @@ bool ServeFiles::deleteFolderRecursive(const String &folderPath)
                 dir.close();
                 return false;
             }
+            ConfigManager::fileChanged(filePath.c_str());
             debugI("Successfully deleted file: %s", filePath.c_str());
         }
         file.close(); // Explicitly close the file
@@ -322,55 +370,22 @@ bool ServeFiles::deleteFolderRecursive(const String &folderPath)
     return true;
 }
 
-// Helper to ensure parent directories exist
+// Helper to ensure parent directories exist, creating each missing level
 bool ServeFiles::ensureParentDirsExist(const String &filePath)
 {
-    int lastSlashIndex = filePath.lastIndexOf('/');
-    if (lastSlashIndex <= 0)
-        return true; // No parent directories
-
-    String parentPath = filePath.substring(0, lastSlashIndex);
-    debugV("Ensuring directory exists: %s", parentPath.c_str());
-
-    if (LittleFS.exists(parentPath))
-        return true;                   // Directory already exists
-    return LittleFS.mkdir(parentPath); // Create the directory
-}
-
-// Recursive helper for listing files
-void ServeFiles::listFilesRecursive(JsonArray &files, const String &path)
-{
-    // Ensure the directory path starts with "/" and does not end with "/"
-    String dirPath = path.isEmpty() ? "/" : (path.endsWith("/") ? path : path + "/");
-
-    debugV("Opening directory: %s", dirPath.c_str());
-    File dir = LittleFS.open(dirPath);
-
-    if (!dir || !dir.isDirectory())
-    {
-        debugE("Failed to open directory: %s", dirPath.c_str());
-        return;
-    }
-
-    File file = dir.openNextFile();
-    while (file)
+    int slash = filePath.indexOf('/', 1);
+    while (slash > 0)
     {
-        String fullPath = dirPath + file.name();
-
-        if (file.isDirectory())
-        {
-            debugV("Entering directory: %s", fullPath.c_str());
-            // Recursively list files in subdirectory
-            listFilesRecursive(files, fullPath);
-        }
-        else
+        String parentPath = filePath.substring(0, slash);
+        if (!LittleFS.exists(parentPath))
         {
-            debugV("Found file: %s", fullPath.c_str());
-            files.add(fullPath);
+            debugV("Creating directory: %s", parentPath.c_str());
+            if (!LittleFS.mkdir(parentPath))
+                return false;
         }
-
-        file = dir.openNextFile();
+        slash = filePath.indexOf('/', slash + 1);
     }
+    return true;
 }
 
 // Handle listing files
@@ -378,13 +393,9 @@ void ServeFiles::handleListFiles(AsyncWebServerRequest *request)
 {
     debugV("Received GET request on /files");
 
-    JsonDocument doc;
-    JsonArray files = doc["files"].to<JsonArray>();
-
-    // Start recursive listing from the root directory
-    listFilesRecursive(files, "/");
-
-    WebHandler::sendSuccessResponse(request, "Files listed successfully", &doc);
+    std::shared_ptr<FileListing> listing(new FileListing());
+    listing->addSection("files", "/", true, true, false, false);
+    sendListing(request, "Files listed successfully", listing);
 }
 
 // Handle reading a file
@@ -416,6 +427,12 @@ void ServeFiles::handleReadFile(AsyncWebServerRequest *request)
         return;
     }
 
+    if (SecureFile::isEncrypted(file))
+    {
+        sendEncryptedFile(request, file);
+        return;
+    }
+
     String content = file.readString();
     file.close();
     debugV("File content: %s", content.c_str());
@@ -427,45 +444,78 @@ void ServeFiles::handleReadFile(AsyncWebServerRequest *request)
     request->send(response);
 }
 
-// Handle writing to a file
-void ServeFiles::handleWriteFile(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+// Stream the plaintext of an encrypted file, one chunk decrypted at a time
+void ServeFiles::sendEncryptedFile(AsyncWebServerRequest *request, File &file)
 {
-    debugV("Received POST request on /file");
-
-    if (!request->hasParam("filename"))
+    if (!CryptoHandler::unlockInBackground())
     {
-        WebHandler::sendErrorResponse(request, 400, "Filename is required");
+        file.close();
+        WebHandler::sendVaultLocked(request);
         return;
     }
-    String filename = request->getParam("filename")->value();
-    debugV("Filename: %s", filename.c_str());
 
-    // Ensure parent directories exist
-    if (!ensureParentDirsExist(filename))
+    std::shared_ptr<SecureFileReader> reader(new SecureFileReader());
+    if (!reader->open(file))
     {
-        debugE("Failed to create parent directories for: %s", filename.c_str());
-        WebHandler::sendErrorResponse(request, 500, "Failed to create directories");
+        if (!CryptoHandler::isUnlocked())
+        {
+            WebHandler::sendVaultLocked(request);
+            return;
+        }
+        WebHandler::sendErrorResponse(request, 500, "Failed to decrypt file");
         return;
     }
 
-    debugV("Data length: %d, Index: %d, Total: %d", len, index, total);
+    AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain", [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                      {
+        // The status line is already sent, so a chunk that fails to
+        // authenticate can only cut the response short
+        int bytesRead = reader->read(buffer, maxLen);
+        if (bytesRead < 0)
+        {
+            debugE("Encrypted file failed to authenticate at offset %u", (unsigned)index);
+            return 0;
+        }
+        return bytesRead; });
+    WebHandler::addCorsHeaders(response);
+    request->send(response);
+}
 
-    File file = LittleFS.open(filename, index == 0 ? "w" : "a");
-    if (!file)
+// Handle writing to a file. The body streams into a temporary file that
+// replaces the target only once it is complete (see FileUpload).
+// ?encrypt=1 stores it encrypted at rest, e.g. for backups; ?sha256=<hex>
+// rejects a body that does not match.
+void ServeFiles::handleWriteFile(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    if (index == 0)
     {
-        debugE("Failed to open file for writing: %s", filename.c_str());
-        WebHandler::sendErrorResponse(request, 500, "Failed to open file for writing");
-        return;
-    }
+        debugV("Received POST request on /file");
 
-    file.write(data, len);
-    file.close();
-    debugV("Data written to file: %s", filename.c_str());
+        if (!request->hasParam("filename"))
+        {
+            WebHandler::sendErrorResponse(request, 400, "Filename is required");
+            return;
+        }
+        String filename = request->getParam("filename")->value();
+        debugV("Filename: %s, %u bytes", filename.c_str(), (unsigned int)total);
 
-    if (index + len == total)
-    {
-        WebHandler::sendSuccessResponse(request, "File saved successfully");
+        // Ensure parent directories exist
+        if (!ensureParentDirsExist(filename))
+        {
+            debugE("Failed to create parent directories for: %s", filename.c_str());
+            WebHandler::sendErrorResponse(request, 500, "Failed to create directories");
+            return;
+        }
+
+        String sha256 = request->hasParam("sha256") ? request->getParam("sha256")->value() : String();
+        bool encrypt = request->hasParam("encrypt") && request->getParam("encrypt")->value() == "1";
+        if (!FileUpload::begin(request, filename, sha256, encrypt))
+        {
+            return;
+        }
     }
+
+    FileUpload::write(request, data, len, index, total);
 }
 
 /*
@@ -538,6 +588,7 @@ void ServeFiles::handleDeleteFile(AsyncWebServerRequest *request)
 
     if (LittleFS.remove(filename))
     {
+        ConfigManager::fileChanged(filename.c_str());
         debugV("File deleted: %s", filename.c_str());
         WebHandler::sendSuccessResponse(request, "File deleted successfully");
     }
@@ -550,44 +601,6 @@ void ServeFiles::handleDeleteFile(AsyncWebServerRequest *request)
 
 // This may be repeated code TODO: Refactor and cleanup later
 
-// Recursive helper to list files in a folder and its subfolders
-void ServeFiles::listFilesRecursiveInFolder(JsonArray &files, const String &basePath, const String &currentPath)
-{
-    String dirPath = currentPath.isEmpty() ? basePath : currentPath;
-    if (!dirPath.endsWith("/"))
-    {
-        dirPath += "/";
-    }
-
-    debugV("Opening directory: %s", dirPath.c_str());
-    File dir = LittleFS.open(dirPath);
-
-    if (!dir || !dir.isDirectory())
-    {
-        debugE("Failed to open directory: %s", dirPath.c_str());
-        return;
-    }
-
-    File file = dir.openNextFile();
-    while (file)
-    {
-        String fullPath = dirPath + file.name();
-        String relativePath = fullPath.substring(basePath.length()); // Relative to the base path
-
-        if (file.isDirectory())
-        {
-            debugV("Entering subdirectory: %s", fullPath.c_str());
-            listFilesRecursiveInFolder(files, basePath, fullPath); // Recurse into subfolder
-        }
-        else
-        {
-            debugV("Found file: %s", fullPath.c_str());
-            files.add(relativePath); // Add file with path relative to the base folder
-        }
-        file = dir.openNextFile();
-    }
-}
-
 // Handler for `/folder/files` with subfolder support
 void ServeFiles::handleListFilesInFolder(AsyncWebServerRequest *request)
 {
@@ -610,15 +623,13 @@ void ServeFiles::handleListFilesInFolder(AsyncWebServerRequest *request)
         WebHandler::sendErrorResponse(request, 404, "Invalid directory path");
         return;
     }
+    dir.close();
 
-    JsonDocument doc;
-    JsonArray files = doc["files"].to<JsonArray>();
-
-    // List files recursively starting from the specified path
-    listFilesRecursiveInFolder(files, path, path);
-
-    doc["path"] = path;
-    WebHandler::sendSuccessResponse(request, "Files in folder and subfolders listed successfully", &doc);
+    // Paths relative to the requested folder
+    std::shared_ptr<FileListing> listing(new FileListing());
+    listing->addSection("files", path, true, true, false, true);
+    listing->setPath(path);
+    sendListing(request, "Files in folder and subfolders listed successfully", listing);
 }
 
 #endif // ENABLE_WEB_HANDLER
\ No newline at end of file
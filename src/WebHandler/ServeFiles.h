@@ -4,6 +4,56 @@
 
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <memory>
+#include <vector>
+
+// Walks a directory tree depth first, one entry per call. Only the open
+// directory handles down to the current entry are held, never a list of names.
+class DirectoryWalker {
+public:
+    static const size_t MAX_DEPTH = 8;
+
+    DirectoryWalker(const String &root, bool recursive);
+    // Full path of the next entry; false once the walk is done
+    bool next(String &path, bool &isDirectory);
+
+private:
+    bool recursive;
+    std::vector<File> dirs;
+    std::vector<String> dirPaths; // With a trailing '/'
+};
+
+// The "data" object of a file listing, produced lazily for
+// WebHandler::sendChunkedSuccess: one JSON array per section, walked as the
+// response goes out, then an optional "path"
+class FileListing {
+public:
+    FileListing() : current(0), first(true), finished(false) {}
+
+    // "key": [...] of the files and/or folders below root, by full path or
+    // relative to root
+    void addSection(const char *key, const String &root, bool recursive, bool files, bool folders, bool relative);
+    void setPath(const String &listedPath);
+    bool next(String &out);
+
+private:
+    struct Section {
+        const char *key;
+        String root;
+        bool recursive;
+        bool files;
+        bool folders;
+        bool relative;
+    };
+
+    std::vector<Section> sections;
+    size_t current;
+    std::unique_ptr<DirectoryWalker> walker;
+    bool first;
+    bool finished;
+    String path;
+};
 
 class ServeFiles {
 public:
@@ -11,24 +61,21 @@ public:
 
 private:
     static void handleFileManager(AsyncWebServerRequest *request);
-    static void listFilesAndFolders(JsonArray &files, JsonArray &folders, const String &path);
+    static void sendListing(AsyncWebServerRequest *request, const char *message, std::shared_ptr<FileListing> listing);
     static void handleSearch(AsyncWebServerRequest *request);
     static void searchRecursive(JsonArray &results, const String &path, const String &query);
     static void handleRename(AsyncWebServerRequest *request);
-    static void listFoldersRecursive(JsonArray &folders, const String &path);
     static void handleListFolders(AsyncWebServerRequest *request);
     static void handleCreateFolder(AsyncWebServerRequest *request);
     static void handleDeleteFolder(AsyncWebServerRequest *request);
     static bool deleteFolderRecursive(const String &folderPath);
     static bool ensureParentDirsExist(const String &filePath);
-    static void listFilesRecursive(JsonArray &files, const String &path);
     static void handleListFiles(AsyncWebServerRequest *request);
     static void handleReadFile(AsyncWebServerRequest *request);
+    static void sendEncryptedFile(AsyncWebServerRequest *request, File &file);
     static void handleWriteFile(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
     static bool isProtectedFile(const String &filename);
     static void handleDeleteFile(AsyncWebServerRequest *request);
-    //TODO cleanup
-    static void listFilesRecursiveInFolder(JsonArray &files, const String &basePath, const String &currentPath);
     static void handleListFilesInFolder(AsyncWebServerRequest *request);
 };
 
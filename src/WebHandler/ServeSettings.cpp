@@ -5,15 +5,23 @@
 #include "ServeSettings.h"
 #include "Globals.h"
 #include "WebHandler.h"
+#include "WebAuth.h"
+#include "RekeyHandler.h"
+#include "RequestBody.h"
 
 void ServeSettings::registerEndpoints(AsyncWebServer &server)
 {
-    server.on("/settings/get", HTTP_GET, handleGetSettings);
-    server.on("/settings/set", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, handleSetSettings);
+    WebAuth::on(server, "/settings/get", HTTP_GET, AUTH_BEARER, handleGetSettings);
+    WebAuth::on(server, "/settings/set", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {}, NULL, handleSetSettings);
 }
 
 void ServeSettings::handleGetSettings(AsyncWebServerRequest *request)
 {
+    String etag = WebHandler::makeEtag("settings", ConfigManager::getGeneration());
+    if (WebHandler::sendIfNotModified(request, etag)) {
+        return;
+    }
+
     // Open the file for reading
     File file = LittleFS.open(SETTINGS_FILE, "r");
     if (!file || file.size() == 0) {
@@ -25,6 +33,7 @@ void ServeSettings::handleGetSettings(AsyncWebServerRequest *request)
     file.close(); // Close the file
 
     AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", json);
+    WebHandler::addEtagHeaders(response, etag);
     WebHandler::addCorsHeaders(response);
     request->send(response);
 }
@@ -33,21 +42,14 @@ void ServeSettings::handleSetSettings(AsyncWebServerRequest *request, uint8_t *d
 {
     debugV("Received POST request on /settings/set");
 
-    // Accumulate incoming data
-    static String requestBody;
-    if (index == 0) {
-        requestBody = ""; // Start fresh
-    }
-    requestBody += String((char*)data).substring(0, len);
-
     // Wait until the full body is received
-    if (index + len != total) {
+    if (!RequestBody::collect(request, data, len, index, total)) {
         return;
     }
 
     // Parse incoming JSON
     JsonDocument newDoc;
-    DeserializationError error = deserializeJson(newDoc, requestBody);
+    DeserializationError error = RequestBody::parseJson(request, newDoc);
     if (error) {
         WebHandler::sendErrorResponse(request, 400, "Invalid JSON format in request");
         return;
@@ -68,6 +70,22 @@ void ServeSettings::handleSetSettings(AsyncWebServerRequest *request, uint8_t *d
         debugV("No existing settings file found, creating new one");
     }
 
+    // A new device password re-keys the vault, which takes two key
+    // derivations, so it is left to the rekey task; that task saves the
+    // password once the vault has taken it, and refuses it (see REKEY STATUS)
+    // if the current one does not unlock the vault
+    const char *requested = newDoc["device"]["userPassword"] | (const char *)nullptr;
+    bool passwordChange = requested && settings.device.userPassword != requested;
+    String newPassword;
+    if (passwordChange) {
+        if (RekeyHandler::isBusy()) {
+            WebHandler::sendErrorResponse(request, 409, "A password change is already in progress; see REKEY STATUS");
+            return;
+        }
+        newPassword = requested;
+        newDoc["device"].remove("userPassword");
+    }
+
     // Merge new settings into existing settings
     // Update top-level objects (device, wifi, mqtt, security)
     for (JsonPair kv : newDoc.as<JsonObject>()) {
@@ -90,8 +108,22 @@ void ServeSettings::handleSetSettings(AsyncWebServerRequest *request, uint8_t *d
 
     serializeJsonPretty(existingDoc, file);
     file.close();
+    ConfigManager::fileChanged(SETTINGS_FILE);
 
-    WebHandler::sendSuccessResponse(request, "Settings updated successfully");
+    if (!passwordChange) {
+        WebHandler::sendSuccessResponse(request, "Settings updated successfully");
+        return;
+    }
+    // Handed over only now, so the file written above cannot overwrite the
+    // one the rekey task saves
+    if (!RekeyHandler::startInBackground(settings.device.userPassword, newPassword)) {
+        WebHandler::sendErrorResponse(request, 409, "Settings saved, but a password change is already in progress; see REKEY STATUS");
+        return;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(202, "application/json",
+        R"({"status":"success","message":"Settings saved; password change started, see REKEY STATUS"})");
+    WebHandler::addCorsHeaders(response);
+    request->send(response);
 }
 
 /*
@@ -0,0 +1,386 @@
+#ifdef ENABLE_WEB_HANDLER
+
+#include "ServeSocket.h"
+#include "Globals.h"
+#include "WebHandler.h"
+#include "WebAuth.h"
+
+// A message bigger than the free TCP window is still handed over once this
+// much is free; AsyncWebSocketClient splits it across acks
+static const size_t SEND_MIN_ROOM = 2048;
+
+// Log levels as RemoteDebug numbers them
+static const char *const LOG_LEVEL_NAMES[] = {"profiler", "verbose", "debug", "info", "warning", "error", "any"};
+static const uint8_t LOG_LEVEL_COUNT = sizeof(LOG_LEVEL_NAMES) / sizeof(LOG_LEVEL_NAMES[0]);
+
+AsyncWebSocket ServeSocket::socket("/ws");
+SemaphoreHandle_t ServeSocket::lock = nullptr;
+std::vector<ServeSocket::Client *> ServeSocket::clients;
+
+void ServeSocket::registerEndpoints(AsyncWebServer &server)
+{
+    lock = xSemaphoreCreateMutex();
+    socket.onEvent(onEvent);
+    WebAuth::add(server, &socket, AUTH_BEARER_PARAM);
+}
+
+// Feed each browser from its queue while its connection can take more
+void ServeSocket::loop()
+{
+    if (!lock) {
+        return;
+    }
+    socket.cleanupClients(WS_MAX_CLIENTS);
+
+    for (size_t i = 0;; i++) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        uint32_t id = i < clients.size() ? clients[i]->id : 0;
+        xSemaphoreGive(lock);
+        if (id == 0) {
+            break;
+        }
+
+        // The AsyncTCP task frees a client, and runs its queue, only under
+        // this lock, so the client stays valid while it is fed
+        AsyncWebLockGuard guard(socket.clientsLock());
+        AsyncWebSocketClient *client = socket.client(id);
+        if (!client || client->status() != WS_CONNECTED) {
+            continue;
+        }
+        String message;
+        while (client->canSend() && pop(id, client->client()->space(), message)) {
+            client->text(message);
+        }
+    }
+}
+
+void ServeSocket::onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+{
+    switch (type) {
+    case WS_EVT_CONNECT:
+        addClient(client->id());
+        debugI("WebSocket client %u connected from %s", (unsigned int)client->id(), client->remoteIP().toString().c_str());
+        break;
+    case WS_EVT_DISCONNECT:
+        removeClient(client->id());
+        debugI("WebSocket client %u disconnected", (unsigned int)client->id());
+        break;
+    case WS_EVT_DATA:
+        onData(client, (AwsFrameInfo *)arg, data, len);
+        break;
+    default:
+        break;
+    }
+}
+
+void ServeSocket::onData(AsyncWebSocketClient *client, AwsFrameInfo *info, uint8_t *data, size_t len)
+{
+    uint32_t id = client->id();
+    if (info->message_opcode != WS_TEXT) {
+        if (info->index == 0) {
+            sendError(id, 400, "Only text frames are accepted");
+        }
+        return;
+    }
+
+    // Whole message in one frame, the usual case
+    if (info->final && info->index == 0 && info->len == len && info->num == 0) {
+        onText(id, (const char *)data, len);
+        return;
+    }
+
+    // Otherwise put the fragments together first
+    String text;
+    bool complete = false;
+    bool tooLong = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Client *entry = find(id);
+    if (entry) {
+        if (info->num == 0 && info->index == 0) {
+            entry->frame = "";
+            entry->frameDropped = false;
+        }
+        if (entry->frameDropped) {
+            // Rest of a message already refused
+        } else if (entry->frame.length() + len > CommandBus::MAX_COMMAND_LENGTH) {
+            entry->frame = "";
+            entry->frameDropped = true;
+            tooLong = true;
+        } else {
+            for (size_t i = 0; i < len; i++) {
+                entry->frame += (char)data[i];
+            }
+            if (info->final && info->index + len == info->len) {
+                text = entry->frame;
+                entry->frame = "";
+                complete = true;
+            }
+        }
+    }
+    xSemaphoreGive(lock);
+
+    if (tooLong) {
+        sendError(id, 413, "Command too long");
+    } else if (complete) {
+        onText(id, text.c_str(), text.length());
+    }
+}
+
+void ServeSocket::onText(uint32_t id, const char *text, size_t length)
+{
+    while (length > 0 && isspace((unsigned char)*text)) {
+        text++;
+        length--;
+    }
+    while (length > 0 && isspace((unsigned char)text[length - 1])) {
+        length--;
+    }
+    if (length == 0) {
+        return;
+    }
+
+    String command;
+    if (text[0] == '{') {
+        JsonDocument doc;
+        if (deserializeJson(doc, text, length)) {
+            sendError(id, 400, "Invalid JSON");
+            return;
+        }
+
+        if (doc["log"].is<const char *>()) {
+            const char *name = doc["log"];
+            uint8_t level = LOG_OFF;
+            for (uint8_t i = 1; i < LOG_LEVEL_COUNT - 1; i++) {
+                if (strcasecmp(name, LOG_LEVEL_NAMES[i]) == 0) {
+                    level = i;
+                }
+            }
+            if (level == LOG_OFF && strcasecmp(name, "off") != 0) {
+                sendError(id, 400, "log must be verbose, debug, info, warning, error or off");
+                return;
+            }
+            setLogLevel(id, level);
+            push(id, String("{\"type\":\"status\",\"log\":\"") + (level == LOG_OFF ? "off" : LOG_LEVEL_NAMES[level]) + "\"}");
+            return;
+        }
+
+        if (!doc["command"].is<const char *>()) {
+            sendError(id, 400, "Expected command or log");
+            return;
+        }
+        command = doc["command"].as<const char *>();
+        text = command.c_str();
+        length = command.length();
+    }
+
+    if (length > CommandBus::MAX_COMMAND_LENGTH) {
+        sendError(id, 413, "Command too long");
+        return;
+    }
+    // The result comes back on the executor, see commandDone
+    if (CommandBus::submit(text, length, CMD_SOURCE_WEB, 0, commandDone, (void *)(uintptr_t)id) == 0) {
+        sendError(id, 503, "Command queue full");
+    }
+}
+
+// Runs on the executor task; same fields as POST /command/set answers with
+void ServeSocket::commandDone(uint32_t correlationId, const CommandResult &result, void *ctx)
+{
+    JsonDocument doc;
+    doc["type"] = "result";
+    doc["status"] = result.ok() ? "success" : "error";
+    doc["id"] = correlationId;
+    doc["code"] = (int)result.status();
+    doc["durationUs"] = result.durationUs();
+    if (result.isJson() && !result.truncated()) {
+        doc["result"] = serialized(result.text(), result.size());
+    } else {
+        doc["result"] = result.text();
+    }
+    if (result.truncated()) {
+        doc["truncated"] = true;
+    }
+
+    String message;
+    serializeJson(doc, message);
+    push((uint32_t)(uintptr_t)ctx, message);
+}
+
+// RemoteDebug tap; runs on whichever task logged the line
+void ServeSocket::logLine(uint8_t level, const char *line, size_t length)
+{
+    // A line logged while this task holds the lock would deadlock
+    if (xSemaphoreGetMutexHolder(lock) == xTaskGetCurrentTaskHandle()) {
+        return;
+    }
+
+    char text[256];
+    if (length >= sizeof(text)) {
+        length = sizeof(text) - 1;
+    }
+    memcpy(text, line, length);
+    text[length] = '\0';
+
+    String message;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (Client *client : clients) {
+        if (client->logLevel == LOG_OFF || level < client->logLevel) {
+            continue;
+        }
+        if (message.isEmpty()) {
+            message = "{\"type\":\"log\",\"level\":\"";
+            message += level < LOG_LEVEL_COUNT ? LOG_LEVEL_NAMES[level] : "any";
+            message += "\",\"line\":";
+            WebHandler::appendJsonString(message, text);
+            message += "}";
+        }
+        pushLocked(client, message);
+    }
+    xSemaphoreGive(lock);
+}
+
+void ServeSocket::addClient(uint32_t id)
+{
+    Client *client = new Client();
+    client->id = id;
+    client->logLevel = LOG_OFF;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    clients.push_back(client);
+    xSemaphoreGive(lock);
+}
+
+void ServeSocket::removeClient(uint32_t id)
+{
+    bool tailing = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (size_t i = 0; i < clients.size(); i++) {
+        if (clients[i]->id == id) {
+            tailing = clients[i]->logLevel != LOG_OFF;
+            delete clients[i];
+            clients.erase(clients.begin() + i);
+            break;
+        }
+    }
+    xSemaphoreGive(lock);
+
+    if (tailing) {
+        updateLogTap();
+    }
+}
+
+void ServeSocket::setLogLevel(uint32_t id, uint8_t level)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Client *client = find(id);
+    if (client) {
+        client->logLevel = level;
+    }
+    xSemaphoreGive(lock);
+    updateLogTap();
+}
+
+// Ask RemoteDebug for lines down to the lowest level any browser wants
+void ServeSocket::updateLogTap()
+{
+#ifdef ENABLE_REMOTE_DEBUG_HANDLER
+    uint8_t lowest = LOG_OFF;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (Client *client : clients) {
+        if (client->logLevel < lowest) {
+            lowest = client->logLevel;
+        }
+    }
+    xSemaphoreGive(lock);
+
+    if (lowest == LOG_OFF) {
+        Debug.setCallBackLogLine(nullptr, Debug.ANY);
+    } else {
+        Debug.setCallBackLogLine(logLine, lowest);
+    }
+#endif
+}
+
+void ServeSocket::sendError(uint32_t id, int code, const char *message)
+{
+    JsonDocument doc;
+    doc["type"] = "result";
+    doc["status"] = "error";
+    doc["id"] = 0;
+    doc["code"] = code;
+    doc["result"] = message;
+
+    String json;
+    serializeJson(doc, json);
+    push(id, json);
+}
+
+void ServeSocket::push(uint32_t id, const String &message)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Client *client = find(id);
+    if (client) {
+        pushLocked(client, message);
+    }
+    xSemaphoreGive(lock);
+}
+
+// Queue a message, dropping the oldest ones until it fits
+void ServeSocket::pushLocked(Client *client, const String &message)
+{
+    size_t length = message.length();
+    if (length > WS_QUEUE_BYTES) {
+        client->dropped++;
+        return;
+    }
+    while (client->count > 0 && (client->count == WS_QUEUE_MESSAGES || client->bytes + length > WS_QUEUE_BYTES)) {
+        String &oldest = client->messages[client->head];
+        client->bytes -= oldest.length();
+        oldest = String(); // Give the memory back now
+        client->head = (client->head + 1) % WS_QUEUE_MESSAGES;
+        client->count--;
+        client->dropped++;
+    }
+    client->messages[(client->head + client->count) % WS_QUEUE_MESSAGES] = message;
+    client->count++;
+    client->bytes += length;
+}
+
+// Next message for a browser whose connection has room bytes free. A drop
+// notice goes out before the (newer) messages still queued.
+bool ServeSocket::pop(uint32_t id, size_t room, String &out)
+{
+    bool found = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Client *client = find(id);
+    if (client && client->dropped > 0) {
+        out = String("{\"type\":\"dropped\",\"count\":") + client->dropped + "}";
+        if (out.length() <= room) {
+            client->dropped = 0;
+            found = true;
+        }
+    } else if (client && client->count > 0) {
+        String &next = client->messages[client->head];
+        if (next.length() <= room || room >= SEND_MIN_ROOM) {
+            client->bytes -= next.length();
+            out = std::move(next);
+            next = String();
+            client->head = (client->head + 1) % WS_QUEUE_MESSAGES;
+            client->count--;
+            found = true;
+        }
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+ServeSocket::Client *ServeSocket::find(uint32_t id)
+{
+    for (Client *client : clients) {
+        if (client->id == id) {
+            return client;
+        }
+    }
+    return nullptr;
+}
+
+#endif // ENABLE_WEB_HANDLER
@@ -0,0 +1,84 @@
+#pragma once
+
+#ifdef ENABLE_WEB_HANDLER
+
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <vector>
+
+// Browsers on /ws at once; past this the oldest connection is closed
+#ifndef WS_MAX_CLIENTS
+#define WS_MAX_CLIENTS 4
+#endif
+
+// Messages and bytes held per browser; past either the oldest are dropped
+#ifndef WS_QUEUE_MESSAGES
+#define WS_QUEUE_MESSAGES 16
+#endif
+
+#ifndef WS_QUEUE_BYTES
+#define WS_QUEUE_BYTES 8192
+#endif
+
+class CommandResult;
+
+// Command and log channel for the web terminal on /ws. A text frame is a
+// command line, or JSON: {"command": "..."} runs one, {"log": "info"} tails
+// the debug log from that level up and {"log": "off"} stops it. Replies are
+// JSON frames:
+//   {"type":"result","status":"success","id":7,"code":200,"durationUs":120,"result":...}
+//   {"type":"log","level":"info","line":"..."}
+//   {"type":"status","log":"info"}
+//   {"type":"dropped","count":3} - messages lost while the browser fell behind
+//
+// Results (executor task) and log lines (any task) go into a bounded queue
+// per browser. loop() hands them to the socket only while its TCP window
+// has room, so a slow browser loses its oldest messages instead of piling
+// them up in AsyncWebSocketClient's own unbounded queue. It holds the
+// socket's clients lock while it does, which the AsyncTCP task also takes
+// before it frees a client or touches its queue; that lock is always taken
+// before ours.
+class ServeSocket
+{
+public:
+    static void registerEndpoints(AsyncWebServer &server);
+    static void loop();
+
+private:
+    struct Client {
+        uint32_t id;
+        uint8_t logLevel;                   // LOG_OFF when not tailing
+        String messages[WS_QUEUE_MESSAGES]; // Ring, oldest at head
+        size_t head;
+        size_t count;
+        size_t bytes;
+        uint32_t dropped;
+        String frame;      // Fragmented message being put together (AsyncTCP task only)
+        bool frameDropped; // The rest of it is ignored, it was too long
+    };
+
+    static const uint8_t LOG_OFF = 0xFF;
+
+    static AsyncWebSocket socket;
+    static SemaphoreHandle_t lock; // Guards clients and their queues
+    static std::vector<Client *> clients;
+
+    static void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
+    static void onData(AsyncWebSocketClient *client, AwsFrameInfo *info, uint8_t *data, size_t len);
+    static void onText(uint32_t id, const char *text, size_t length);
+    static void commandDone(uint32_t correlationId, const CommandResult &result, void *ctx);
+    static void logLine(uint8_t level, const char *line, size_t length);
+
+    static void addClient(uint32_t id);
+    static void removeClient(uint32_t id);
+    static void setLogLevel(uint32_t id, uint8_t level);
+    static void updateLogTap();
+    static void sendError(uint32_t id, int code, const char *message);
+    static void push(uint32_t id, const String &message);
+    static void pushLocked(Client *client, const String &message);
+    static bool pop(uint32_t id, size_t room, String &out);
+    static Client *find(uint32_t id);
+};
+
+#endif // ENABLE_WEB_HANDLER
@@ -3,6 +3,7 @@
 #include "ServeTemplate.h"
 #include "Globals.h"
 #include "WebHandler.h"
+#include "WebAuth.h"
 #include <ArduinoJson.h>
 
 void ServeTemplate::registerEndpoints(AsyncWebServer &server)
@@ -13,7 +14,7 @@ void ServeTemplate::registerEndpoints(AsyncWebServer &server)
 
 void ServeTemplate::handleGetRequest(AsyncWebServer &server)
 {
-    server.on("/template/get", HTTP_GET, [](AsyncWebServerRequest *request)
+    WebAuth::on(server, "/template/get", HTTP_GET, AUTH_BEARER, [](AsyncWebServerRequest *request)
               {
         debugV("Received GET request on /template/get");
 
@@ -26,7 +27,7 @@ void ServeTemplate::handleGetRequest(AsyncWebServer &server)
 
 void ServeTemplate::handleSetRequest(AsyncWebServer &server)
 {
-    server.on("/template/set", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+    WebAuth::on(server, "/template/set", HTTP_POST, AUTH_BEARER, [](AsyncWebServerRequest *request) {}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
               {
             debugV("Received POST request on /template/set");
 
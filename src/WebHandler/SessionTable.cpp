@@ -0,0 +1,203 @@
+#ifdef ENABLE_WEB_HANDLER
+
+#include "SessionTable.h"
+
+SessionTable::Slot SessionTable::slots[SessionTable::SLOTS];
+size_t SessionTable::used = 0;
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool SessionTable::create(char *text, size_t size)
+{
+    if (size < TOKEN_TEXT_SIZE) {
+        return false;
+    }
+
+    uint32_t now = millis();
+    if (used >= SESSION_MAX) {
+        evict(now);
+    }
+
+    uint8_t token[TOKEN_SIZE];
+    do {
+        esp_fill_random(token, sizeof(token));
+    } while (find(token) >= 0);
+
+    size_t index = home(token);
+    while (slots[index].used) {
+        index = (index + 1) % SLOTS;
+    }
+    Slot &slot = slots[index];
+    memcpy(slot.token, token, sizeof(token));
+    slot.createdAt = now;
+    slot.lastUsed = now;
+    slot.used = true;
+    used++;
+
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < TOKEN_SIZE; i++) {
+        text[i * 2] = digits[token[i] >> 4];
+        text[i * 2 + 1] = digits[token[i] & 0x0F];
+    }
+    text[TOKEN_SIZE * 2] = '\0';
+    return true;
+}
+
+bool SessionTable::touch(const char *text, size_t length)
+{
+    uint8_t token[TOKEN_SIZE];
+    if (!parse(text, length, token)) {
+        return false;
+    }
+    int index = find(token);
+    if (index < 0) {
+        return false;
+    }
+
+    uint32_t now = millis();
+    if (expired(slots[index], now)) {
+        erase(index);
+        return false;
+    }
+    slots[index].lastUsed = now;
+    return true;
+}
+
+void SessionTable::remove(const char *text, size_t length)
+{
+    uint8_t token[TOKEN_SIZE];
+    if (!parse(text, length, token)) {
+        return;
+    }
+    int index = find(token);
+    if (index >= 0) {
+        erase(index);
+    }
+}
+
+bool SessionTable::findCookie(const char *header, const char *&value, size_t &length)
+{
+    static const char name[] = "session=";
+    static const size_t nameLength = sizeof(name) - 1;
+
+    const char *p = header;
+    while ((p = strstr(p, name)) != nullptr) {
+        // Must be a whole cookie name, not the end of another one
+        if (p == header || p[-1] == ';' || p[-1] == ' ') {
+            value = p + nameLength;
+            const char *end = strchr(value, ';');
+            length = end ? (size_t)(end - value) : strlen(value);
+            return true;
+        }
+        p += nameLength;
+    }
+    return false;
+}
+
+bool SessionTable::parse(const char *text, size_t length, uint8_t *token)
+{
+    if (length != TOKEN_SIZE * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < TOKEN_SIZE; i++) {
+        int high = hexValue(text[i * 2]);
+        int low = hexValue(text[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        token[i] = (uint8_t)(high << 4 | low);
+    }
+    return true;
+}
+
+size_t SessionTable::home(const uint8_t *token)
+{
+    uint32_t hash;
+    memcpy(&hash, token, sizeof(hash));
+    return hash % SLOTS;
+}
+
+int SessionTable::find(const uint8_t *token)
+{
+    size_t index = home(token);
+    for (size_t probes = 0; probes < SLOTS && slots[index].used; probes++) {
+        if (sameToken(slots[index].token, token)) {
+            return (int)index;
+        }
+        index = (index + 1) % SLOTS;
+    }
+    return -1;
+}
+
+bool SessionTable::expired(const Slot &slot, uint32_t now)
+{
+    return now - slot.createdAt >= SESSION_LIFETIME_MS || now - slot.lastUsed >= SESSION_IDLE_MS;
+}
+
+// Looks at every byte whatever the first difference, so the time taken
+// says nothing about how much of a guessed token was right
+bool SessionTable::sameToken(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < TOKEN_SIZE; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+// Empty a slot, then move later entries of the same probe run back into
+// the gap so every entry stays reachable from its home slot
+void SessionTable::erase(size_t index)
+{
+    memset(&slots[index], 0, sizeof(Slot));
+    used--;
+
+    size_t gap = index;
+    size_t next = (index + 1) % SLOTS;
+    while (slots[next].used) {
+        size_t want = home(slots[next].token);
+        // Move the entry if its home is not between the gap and where it sits
+        bool movable = gap <= next ? (want <= gap || want > next) : (want <= gap && want > next);
+        if (movable) {
+            slots[gap] = slots[next];
+            memset(&slots[next], 0, sizeof(Slot));
+            gap = next;
+        }
+        next = (next + 1) % SLOTS;
+    }
+}
+
+// Make room for a login: drop every expired session, and if none had
+// expired, the least recently used one
+void SessionTable::evict(uint32_t now)
+{
+    size_t before = used;
+    // erase() can move entries between slots, so scan again after each one
+    for (size_t i = 0; i < SLOTS; i++) {
+        if (slots[i].used && expired(slots[i], now)) {
+            erase(i);
+            i = (size_t)-1;
+        }
+    }
+    if (used < before) {
+        return;
+    }
+
+    int oldest = -1;
+    for (size_t i = 0; i < SLOTS; i++) {
+        if (slots[i].used && (oldest < 0 || now - slots[i].lastUsed > now - slots[oldest].lastUsed)) {
+            oldest = (int)i;
+        }
+    }
+    if (oldest >= 0) {
+        erase(oldest);
+    }
+}
+
+#endif // ENABLE_WEB_HANDLER
@@ -0,0 +1,71 @@
+#pragma once
+
+#ifdef ENABLE_WEB_HANDLER
+
+#include <Arduino.h>
+
+// Most sessions kept at once; logging in past this ends the least recently used
+#ifndef SESSION_MAX
+#define SESSION_MAX 16
+#endif
+
+// A session ends this long after login, however busy it is
+#ifndef SESSION_LIFETIME_MS
+#define SESSION_LIFETIME_MS (12UL * 60 * 60 * 1000)
+#endif
+
+// ... or after this long without a request
+#ifndef SESSION_IDLE_MS
+#define SESSION_IDLE_MS (30UL * 60 * 1000)
+#endif
+
+// Login sessions for the /secure pages. Tokens are 16 bytes from the
+// hardware RNG, sent as 32 hex digits. They are kept in a fixed table of
+// twice SESSION_MAX slots, found by linear probing from the token's first
+// bytes (already uniformly random, so they serve as the hash). Lookups are
+// O(1), memory does not grow with logins, and tokens are compared in
+// constant time.
+//
+// Logins, logouts and the cookie check on each /secure request are the only
+// callers, all on the AsyncTCP task, so the table is not locked.
+class SessionTable
+{
+public:
+    static const size_t TOKEN_SIZE = 16;
+    static const size_t TOKEN_TEXT_SIZE = TOKEN_SIZE * 2 + 1; // Hex digits plus NUL
+
+    // Start a session and write its token to text. Returns false only if
+    // text is too small.
+    static bool create(char *text, size_t size);
+    // True if text names a live session; refreshes its idle timer
+    static bool touch(const char *text, size_t length);
+    static void remove(const char *text, size_t length);
+    static size_t count() { return used; }
+
+    // Finds the value of the session cookie in a Cookie header, wherever it
+    // is among the others, without copying. Returns false if there is none.
+    static bool findCookie(const char *header, const char *&value, size_t &length);
+
+private:
+    static const size_t SLOTS = SESSION_MAX * 2;
+
+    struct Slot {
+        uint8_t token[TOKEN_SIZE];
+        uint32_t createdAt;
+        uint32_t lastUsed;
+        bool used;
+    };
+
+    static Slot slots[SLOTS];
+    static size_t used;
+
+    static bool parse(const char *text, size_t length, uint8_t *token);
+    static size_t home(const uint8_t *token);
+    static int find(const uint8_t *token);
+    static bool expired(const Slot &slot, uint32_t now);
+    static bool sameToken(const uint8_t *a, const uint8_t *b);
+    static void erase(size_t index);
+    static void evict(uint32_t now);
+};
+
+#endif // ENABLE_WEB_HANDLER
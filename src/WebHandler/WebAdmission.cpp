@@ -0,0 +1,136 @@
+#ifdef ENABLE_WEB_HANDLER
+
+#include "WebAdmission.h"
+#include "Globals.h"
+#include "WebHandler.h"
+
+const WebAdmission::Budget WebAdmission::budgets[CLASS_COUNT] = {
+    {"static", WEB_MAX_STATIC_REQUESTS, WEB_MIN_HEAP_STATIC, WEB_MIN_BLOCK_STATIC},
+    {"api", WEB_MAX_API_REQUESTS, WEB_MIN_HEAP_API, WEB_MIN_BLOCK_API},
+    {"upload", WEB_MAX_UPLOAD_REQUESTS, WEB_MIN_HEAP_UPLOAD, WEB_MIN_BLOCK_UPLOAD},
+};
+
+WebAdmission::Gate WebAdmission::gate;
+WebAdmission::Counters WebAdmission::counters[CLASS_COUNT];
+WebAdmission::Admitted WebAdmission::admitted[MAX_ADMITTED];
+uint32_t WebAdmission::largestBlock = 0;
+uint32_t WebAdmission::sampledAt = 0;
+bool WebAdmission::sampled = false;
+
+void WebAdmission::begin(AsyncWebServer &server)
+{
+    server.addHandler(&gate);
+    server.onRequestEnd(release);
+}
+
+void WebAdmission::report(JsonDocument &doc)
+{
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        JsonObject entry = doc[budgets[i].name].to<JsonObject>();
+        entry["accepted"] = counters[i].accepted;
+        entry["shedBusy"] = counters[i].shedBusy;
+        entry["shedHeap"] = counters[i].shedHeap;
+        entry["inFlight"] = counters[i].inFlight;
+        entry["peak"] = counters[i].peak;
+        entry["maxRequests"] = budgets[i].maxRequests;
+        entry["minHeap"] = budgets[i].minHeap;
+        entry["minBlock"] = budgets[i].minBlock;
+    }
+    doc["freeHeap"] = ESP.getFreeHeap();
+    doc["maxAllocHeap"] = ESP.getMaxAllocHeap();
+}
+
+// Page loads ask for files by name ("/", "/index.html", "/js/app.js");
+// the API's routes have no extension
+WebAdmission::RequestClass WebAdmission::classify(AsyncWebServerRequest *request)
+{
+    if (request->multipart() || request->contentLength() >= WEB_UPLOAD_MIN_BYTES) {
+        return CLASS_UPLOAD;
+    }
+    if (request->method() == HTTP_GET || request->method() == HTTP_HEAD) {
+        const String &url = request->url();
+        int slash = url.lastIndexOf('/');
+        if (url.length() == 1 || url.indexOf('.', slash) >= 0) {
+            return CLASS_STATIC;
+        }
+    }
+    return CLASS_API;
+}
+
+bool WebAdmission::admit(AsyncWebServerRequest *request)
+{
+    RequestClass requestClass = classify(request);
+    const Budget &budget = budgets[requestClass];
+    Counters &counter = counters[requestClass];
+
+    if (counter.inFlight >= budget.maxRequests) {
+        counter.shedBusy++;
+        debugW("Busy, turning away %s (%u %s requests in flight)", request->url().c_str(), (unsigned int)counter.inFlight, budget.name);
+        return false;
+    }
+
+    uint32_t now = millis();
+    if (!sampled || now - sampledAt >= WEB_HEAP_SAMPLE_MS) {
+        largestBlock = ESP.getMaxAllocHeap();
+        sampledAt = now;
+        sampled = true;
+    }
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < budget.minHeap || largestBlock < budget.minBlock) {
+        counter.shedHeap++;
+        debugW("Low heap (%u free, %u largest block), turning away %s", (unsigned int)freeHeap, (unsigned int)largestBlock, request->url().c_str());
+        return false;
+    }
+
+    // Each class stays within its own share, so a full table means a
+    // release went missing; refuse rather than count a request never freed
+    Admitted *slot = nullptr;
+    for (size_t i = 0; i < MAX_ADMITTED && !slot; i++) {
+        if (!admitted[i].request) {
+            slot = &admitted[i];
+        }
+    }
+    if (!slot) {
+        counter.shedBusy++;
+        debugE("No admission slot left, turning away %s", request->url().c_str());
+        return false;
+    }
+    slot->request = request;
+    slot->requestClass = requestClass;
+    counter.accepted++;
+    counter.inFlight++;
+    if (counter.inFlight > counter.peak) {
+        counter.peak = counter.inFlight;
+    }
+    return true;
+}
+
+// Called as the server frees each request, admitted or not
+void WebAdmission::release(AsyncWebServerRequest *request)
+{
+    for (size_t i = 0; i < MAX_ADMITTED; i++) {
+        if (admitted[i].request == request) {
+            counters[admitted[i].requestClass].inFlight--;
+            admitted[i].request = nullptr;
+            return;
+        }
+    }
+}
+
+// Runs once the headers are in, before any other handler is picked
+bool WebAdmission::Gate::canHandle(AsyncWebServerRequest *request)
+{
+    return !admit(request);
+}
+
+// The gate never asks for the body, so the server drops it unread and
+// this runs once it has all gone by
+void WebAdmission::Gate::handleRequest(AsyncWebServerRequest *request)
+{
+    AsyncWebServerResponse *response = request->beginResponse(503, "application/json", R"({"status":"error","message":"Server busy, try again shortly"})");
+    response->addHeader("Retry-After", String(WEB_RETRY_AFTER_S));
+    WebHandler::addCorsHeaders(response);
+    request->send(response);
+}
+
+#endif // ENABLE_WEB_HANDLER
@@ -0,0 +1,133 @@
+#pragma once
+
+#ifdef ENABLE_WEB_HANDLER
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+
+// Requests of each kind handled at once; past this the next is turned away
+#ifndef WEB_MAX_STATIC_REQUESTS
+#define WEB_MAX_STATIC_REQUESTS 6 // A browser opens up to six connections for a page load
+#endif
+
+#ifndef WEB_MAX_API_REQUESTS
+#define WEB_MAX_API_REQUESTS 4
+#endif
+
+#ifndef WEB_MAX_UPLOAD_REQUESTS
+#define WEB_MAX_UPLOAD_REQUESTS 1
+#endif
+
+// Free heap, and largest free block, each kind needs before it is taken on.
+// API requests build JSON documents, uploads hold a write buffer.
+#ifndef WEB_MIN_HEAP_STATIC
+#define WEB_MIN_HEAP_STATIC 24576
+#endif
+
+#ifndef WEB_MIN_BLOCK_STATIC
+#define WEB_MIN_BLOCK_STATIC 4096
+#endif
+
+#ifndef WEB_MIN_HEAP_API
+#define WEB_MIN_HEAP_API 32768
+#endif
+
+#ifndef WEB_MIN_BLOCK_API
+#define WEB_MIN_BLOCK_API 12288
+#endif
+
+#ifndef WEB_MIN_HEAP_UPLOAD
+#define WEB_MIN_HEAP_UPLOAD 49152
+#endif
+
+#ifndef WEB_MIN_BLOCK_UPLOAD
+#define WEB_MIN_BLOCK_UPLOAD 8192
+#endif
+
+// A body at least this long (or any multipart one) counts as an upload
+#ifndef WEB_UPLOAD_MIN_BYTES
+#define WEB_UPLOAD_MIN_BYTES 4096
+#endif
+
+// Finding the largest free block walks the heap, so it is looked up at most this often
+#ifndef WEB_HEAP_SAMPLE_MS
+#define WEB_HEAP_SAMPLE_MS 250
+#endif
+
+// Seconds a turned away client is told to wait
+#ifndef WEB_RETRY_AFTER_S
+#define WEB_RETRY_AFTER_S 2
+#endif
+
+// Admission control for the web server, so a burst from a browser or a
+// script cannot run the heap down under the HID path. Each request is put
+// in a class (static file, JSON API or upload) once its headers are in,
+// before any route runs. If its class already has its fill of requests in
+// flight, or free heap or the largest free block is under the class's
+// watermark, it gets a 503 with Retry-After instead: no handler, body
+// buffer, JSON document or file is set up for it, and any body is dropped
+// unread. A request counts as in flight until the server frees it.
+//
+// The gate, the request-end hook and /device/admission are the only users
+// of the counters and the admitted table, and all run on the AsyncTCP task.
+class WebAdmission
+{
+public:
+    // Adds the check ahead of every other handler
+    static void begin(AsyncWebServer &server);
+    // Counters and current state, for GET /device/admission
+    static void report(JsonDocument &doc);
+
+private:
+    enum RequestClass : uint8_t {
+        CLASS_STATIC,
+        CLASS_API,
+        CLASS_UPLOAD,
+        CLASS_COUNT,
+    };
+
+    struct Budget {
+        const char *name;
+        uint8_t maxRequests;
+        uint32_t minHeap;
+        uint32_t minBlock;
+    };
+
+    struct Counters {
+        uint32_t accepted;
+        uint32_t shedBusy; // Turned away, too many in flight
+        uint32_t shedHeap; // Turned away, heap under the watermark
+        uint8_t inFlight;
+        uint8_t peak;
+    };
+
+    struct Admitted {
+        AsyncWebServerRequest *request;
+        RequestClass requestClass;
+    };
+
+    static const size_t MAX_ADMITTED = WEB_MAX_STATIC_REQUESTS + WEB_MAX_API_REQUESTS + WEB_MAX_UPLOAD_REQUESTS;
+    static const Budget budgets[CLASS_COUNT];
+
+    // Takes the requests that are turned away
+    class Gate : public AsyncWebHandler
+    {
+    public:
+        bool canHandle(AsyncWebServerRequest *request) override;
+        void handleRequest(AsyncWebServerRequest *request) override;
+    };
+
+    static Gate gate;
+    static Counters counters[CLASS_COUNT];
+    static Admitted admitted[MAX_ADMITTED];
+    static uint32_t largestBlock;
+    static uint32_t sampledAt;
+    static bool sampled;
+
+    static RequestClass classify(AsyncWebServerRequest *request);
+    static bool admit(AsyncWebServerRequest *request);
+    static void release(AsyncWebServerRequest *request);
+};
+
+#endif // ENABLE_WEB_HANDLER
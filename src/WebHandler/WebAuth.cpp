@@ -0,0 +1,135 @@
+#ifdef ENABLE_WEB_HANDLER
+
+#include "WebAuth.h"
+#include "Globals.h"
+#include "WebHandler.h"
+#include "SessionTable.h"
+#include "mbedtls/md.h"
+
+WebAuth::Gate WebAuth::gate;
+std::vector<WebAuth::Route> WebAuth::routes;
+uint8_t WebAuth::keyDigest[WebAuth::DIGEST_SIZE];
+uint32_t WebAuth::keyGeneration = 0;
+bool WebAuth::keyReady = false;
+
+static const char BEARER_PREFIX[] = "Bearer ";
+static const size_t BEARER_PREFIX_LENGTH = sizeof(BEARER_PREFIX) - 1;
+
+void WebAuth::begin(AsyncWebServer &server)
+{
+    server.addHandler(&gate);
+}
+
+AsyncCallbackWebHandler &WebAuth::on(AsyncWebServer &server, const char *uri, WebRequestMethodComposite method, AuthPolicy policy,
+                                     ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+{
+    AsyncCallbackWebHandler &handler = server.on(uri, method, onRequest, onUpload, onBody);
+    routes.push_back({&handler, policy});
+    return handler;
+}
+
+AsyncWebHandler &WebAuth::add(AsyncWebServer &server, AsyncWebHandler *handler, AuthPolicy policy)
+{
+    server.addHandler(handler);
+    routes.push_back({handler, policy});
+    return *handler;
+}
+
+bool WebAuth::isAuthorized(AsyncWebServerRequest *request, AuthPolicy policy)
+{
+    switch (policy) {
+    case AUTH_NONE:
+        return true;
+    case AUTH_BEARER:
+        return hasValidToken(request, false);
+    case AUTH_BEARER_PARAM:
+        return hasValidToken(request, true);
+    case AUTH_SESSION: {
+        AsyncWebHeader *cookie = request->getHeader("Cookie");
+        const char *token;
+        size_t length;
+        return cookie && SessionTable::findCookie(cookie->value().c_str(), token, length) && SessionTable::touch(token, length);
+    }
+    }
+    return false;
+}
+
+bool WebAuth::hasValidToken(AsyncWebServerRequest *request, bool allowParam)
+{
+    if (!settings.security.apiToken) {
+        return true;
+    }
+
+    AsyncWebHeader *header = request->getHeader("Authorization");
+    if (header) {
+        const String &value = header->value();
+        if (value.startsWith(BEARER_PREFIX) && matchesKey(value.c_str() + BEARER_PREFIX_LENGTH, value.length() - BEARER_PREFIX_LENGTH)) {
+            return true;
+        }
+    }
+    if (allowParam && request->hasParam("token")) {
+        const String &value = request->getParam("token")->value();
+        if (matchesKey(value.c_str(), value.length())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The first route registered for the request, as the server would pick it
+const WebAuth::Route *WebAuth::findRoute(AsyncWebServerRequest *request)
+{
+    for (const Route &route : routes) {
+        if (route.handler->filter(request) && route.handler->canHandle(request)) {
+            return &route;
+        }
+    }
+    return nullptr;
+}
+
+// Hashing first means the comparison takes the same time whatever the
+// length of the guess and however much of it is right
+bool WebAuth::matchesKey(const char *token, size_t length)
+{
+    const mbedtls_md_info_t *sha256 = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+
+    uint32_t generation = ConfigManager::getGeneration();
+    if (!keyReady || keyGeneration != generation) {
+        const String &key = settings.security.apiKey;
+        mbedtls_md(sha256, (const uint8_t *)key.c_str(), key.length(), keyDigest);
+        keyGeneration = generation;
+        keyReady = true;
+    }
+
+    uint8_t digest[DIGEST_SIZE];
+    mbedtls_md(sha256, (const uint8_t *)token, length, digest);
+
+    uint8_t diff = 0;
+    for (size_t i = 0; i < DIGEST_SIZE; i++) {
+        diff |= digest[i] ^ keyDigest[i];
+    }
+    return diff == 0;
+}
+
+// Runs once the headers are in, before any body is read
+bool WebAuth::Gate::canHandle(AsyncWebServerRequest *request)
+{
+    const Route *route = findRoute(request);
+    return route && !isAuthorized(request, route->policy);
+}
+
+// The gate never asks for the body, so the server drops it unparsed and
+// this runs once it has all gone by
+void WebAuth::Gate::handleRequest(AsyncWebServerRequest *request)
+{
+    const Route *route = findRoute(request);
+    if (route && route->policy == AUTH_SESSION) {
+        debugI("No valid session for %s, redirecting to /login.html", request->url().c_str());
+        request->redirect("/login.html");
+        return;
+    }
+    debugE("Invalid token for %s", request->url().c_str());
+    WebHandler::sendErrorResponse(request, 403, "Forbidden: Invalid token", false);
+}
+
+#endif // ENABLE_WEB_HANDLER
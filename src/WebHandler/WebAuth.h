@@ -0,0 +1,67 @@
+#pragma once
+
+#ifdef ENABLE_WEB_HANDLER
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <vector>
+
+// Who may use a route
+enum AuthPolicy : uint8_t {
+    AUTH_NONE,         // Anyone
+    AUTH_BEARER,       // "Authorization: Bearer <apiKey>", when settings.security.apiToken is on
+    AUTH_BEARER_PARAM, // The same, or ?token=<apiKey> for WebSocket and EventSource, which cannot set headers
+    AUTH_SESSION,      // A session cookie from /auth/login; others are sent to /login.html
+};
+
+// Route-level authorization. Routes are registered here with a policy
+// instead of straight on the server. A gate handler added ahead of all of
+// them looks up the route a request is for as soon as its headers are in,
+// and if the request may not use it, takes the request itself: the route's
+// handler, body and upload callbacks never run, and any body is dropped as
+// it arrives without being parsed, buffered or written anywhere.
+//
+// The API key is kept as a SHA-256 digest, worked out again only when the
+// settings change. A presented key is hashed and compared in constant time.
+class WebAuth
+{
+public:
+    // Adds the gate; call before any route is registered
+    static void begin(AsyncWebServer &server);
+
+    static AsyncCallbackWebHandler &on(AsyncWebServer &server, const char *uri, WebRequestMethodComposite method, AuthPolicy policy,
+                                       ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr);
+    // For handlers not made by server.on(), such as AsyncWebSocket
+    static AsyncWebHandler &add(AsyncWebServer &server, AsyncWebHandler *handler, AuthPolicy policy);
+
+    static bool isAuthorized(AsyncWebServerRequest *request, AuthPolicy policy);
+    // True if the request carries the API key (or none is required)
+    static bool hasValidToken(AsyncWebServerRequest *request, bool allowParam);
+
+private:
+    struct Route {
+        AsyncWebHandler *handler;
+        AuthPolicy policy;
+    };
+
+    // Takes the requests that fail their route's policy
+    class Gate : public AsyncWebHandler
+    {
+    public:
+        bool canHandle(AsyncWebServerRequest *request) override;
+        void handleRequest(AsyncWebServerRequest *request) override;
+    };
+
+    static const size_t DIGEST_SIZE = 32;
+
+    static Gate gate;
+    static std::vector<Route> routes;
+    static uint8_t keyDigest[DIGEST_SIZE];
+    static uint32_t keyGeneration;
+    static bool keyReady;
+
+    static const Route *findRoute(AsyncWebServerRequest *request);
+    static bool matchesKey(const char *token, size_t length);
+};
+
+#endif // ENABLE_WEB_HANDLER
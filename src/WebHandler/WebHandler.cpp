@@ -9,11 +9,18 @@
 #include "ServeButtons.h"
 #include "ServeAuth.h"
 #include "ServeCategories.h"
-//#include "ServeEmbedded.h"
+#include "ServeDucky.h"
+#include "ServeEmbedded.h"
+#include "ServeSocket.h"
+#include "WebAuth.h"
+#include "WebAdmission.h"
+#include "CryptoHandler.h"
 #include <LittleFS.h>
+#include <memory>
 
 //NonBlockingTimer WebHandler::myTimer(60000);
 AsyncWebServer WebHandler::server(80);
+uint32_t WebHandler::bootId = 0;
 
 void WebHandler::serveNotFound()
 {
@@ -43,15 +50,7 @@ void WebHandler::printRequestBody(AsyncWebServerRequest *request, uint8_t *data,
 
 bool WebHandler::isTokenValid(AsyncWebServerRequest *request)
 {
-    if (!settings.security.apiToken) return true;
-    if (request->hasHeader("Authorization"))
-    {
-        AsyncWebHeader *header = request->getHeader("Authorization");
-        if (String(header->value()) == String("Bearer ") + settings.security.apiKey)
-        {
-            return true;
-        }
-    }
+    if (WebAuth::hasValidToken(request, false)) return true;
     debugE("Invalid token");
     return false;
 }
@@ -66,6 +65,34 @@ void WebHandler::addCorsHeaders(AsyncWebServerResponse *response)
     response->addHeader("Access-Control-Max-Age", "86400"); // Set max age for preflight requests (optional, but improves efficiency)
 }
 
+String WebHandler::makeEtag(const char *name, uint32_t generation)
+{
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%s-%08x-%u\"", name, (unsigned int)bootId, (unsigned int)generation);
+    return String(etag);
+}
+
+bool WebHandler::sendIfNotModified(AsyncWebServerRequest *request, const String &etag)
+{
+    AsyncWebHeader *match = request->getHeader("If-None-Match");
+    if (!match || match->value().indexOf(etag) < 0) {
+        return false;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    addEtagHeaders(response, etag);
+    addCorsHeaders(response);
+    request->send(response);
+    debugV("Not modified: %s", request->url().c_str());
+    return true;
+}
+
+void WebHandler::addEtagHeaders(AsyncWebServerResponse *response, const String &etag)
+{
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache"); // Always revalidate, a 304 while unchanged
+}
+
 void WebHandler::sendErrorResponse(AsyncWebServerRequest *request, int statusCode, const char *message, bool checkToken)
 {
     if (checkToken && !isTokenValid(request))
@@ -87,6 +114,43 @@ void WebHandler::sendErrorResponse(AsyncWebServerRequest *request, int statusCod
     request->send(response);
 }
 
+void WebHandler::sendVaultLocked(AsyncWebServerRequest *request)
+{
+    if (CryptoHandler::isLockedByUser())
+    {
+        sendErrorResponse(request, 423, "Vault locked: run CRYPTO UNLOCK <password>");
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse(503, "application/json", R"({"status":"error","message":"Vault unlocking, try again shortly"})");
+    response->addHeader("Retry-After", String(VAULT_RETRY_AFTER_S));
+    addCorsHeaders(response);
+    request->send(response);
+}
+
+void WebHandler::appendJsonString(String &out, const char *text)
+{
+    out += '"';
+    for (const char *c = text; *c; c++) {
+        switch (*c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)*c < 0x20) {
+                char escaped[7];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+                out += escaped;
+            } else {
+                out += *c;
+            }
+        }
+    }
+    out += '"';
+}
+
 void WebHandler::sendSuccessResponse(AsyncWebServerRequest *request, const char *message, JsonDocument *data, bool checkToken)
 {
     if (checkToken && !isTokenValid(request))
@@ -96,19 +160,76 @@ void WebHandler::sendSuccessResponse(AsyncWebServerRequest *request, const char
         return;
     }
 
-    JsonDocument doc;
-    doc["status"] = "success";
-    doc["message"] = message;
+    // Write the envelope around data instead of copying data into a second
+    // document and that into a String
+    String head = "{\"status\":\"success\",\"message\":";
+    appendJsonString(head, message);
 
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->print(head);
     if (data != nullptr)
     {
-        doc["data"] = *data;
+        response->print(",\"data\":");
+        serializeJson(*data, *response);
     }
+    response->print('}');
+    addCorsHeaders(response);
+    request->send(response);
+}
 
-    String jsonResponse;
-    serializeJson(doc, jsonResponse);
+// State of a chunked response: the piece being sent and how much of it is out
+struct ChunkedJsonState {
+    std::function<bool(String &out)> nextFragment;
+    String pending;
+    size_t sent;
+    bool dataDone;
+    bool closed;
+};
 
-    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", jsonResponse);
+void WebHandler::sendChunkedSuccess(AsyncWebServerRequest *request, const char *message, std::function<bool(String &out)> nextFragment, bool checkToken)
+{
+    if (checkToken && !isTokenValid(request))
+    {
+        debugE("Token validation failed for chunked response");
+        sendErrorResponse(request, 403, "Forbidden: Invalid token", false);
+        return;
+    }
+
+    std::shared_ptr<ChunkedJsonState> state(new ChunkedJsonState());
+    state->nextFragment = nextFragment;
+    state->pending = "{\"status\":\"success\",\"message\":";
+    appendJsonString(state->pending, message);
+    state->pending += ",\"data\":";
+    state->sent = 0;
+    state->dataDone = false;
+    state->closed = false;
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                      {
+        size_t written = 0;
+        while (written < maxLen) {
+            if (state->sent == state->pending.length()) {
+                state->sent = 0;
+                if (!state->dataDone && state->nextFragment(state->pending)) {
+                    continue;
+                }
+                state->dataDone = true;
+                if (state->closed) {
+                    state->pending = "";
+                    break; // Returning 0 from a later call ends the response
+                }
+                state->pending = "}";
+                state->closed = true;
+            }
+            size_t count = state->pending.length() - state->sent;
+            if (count > maxLen - written) {
+                count = maxLen - written;
+            }
+            memcpy(buffer + written, state->pending.c_str() + state->sent, count);
+            state->sent += count;
+            written += count;
+        }
+        return written; });
     addCorsHeaders(response);
     request->send(response);
 }
@@ -117,6 +238,9 @@ void WebHandler::init()
 {
     if (!settings.features.webHandler) return;
 
+    bootId = esp_random();
+    WebAdmission::begin(server); // Ahead of every other handler, so a turned away request costs nothing more
+    WebAuth::begin(server);      // Ahead of every route
     ServeDevice::registerEndpoints(server);
     ServeSettings::registerEndpoints(server);
     ServeFiles::registerEndpoints(server);
@@ -124,12 +248,14 @@ void WebHandler::init()
     ServeButtons::registerEndpoints(server);
     ServeCategories::registerEndpoints(server);
     ServeAuth::registerEndpoints(server);
-    //ServeEmbedded::registerEndpoints(server);
+    ServeDucky::registerEndpoints(server);
+    ServeSocket::registerEndpoints(server);
     //server.serveStatic("/", LittleFS, "/").setDefaultFile("index.html");
     //server.serveStatic("/", LittleFS, "/www").setDefaultFile("index.html");
     //server.serveStatic("/www", LittleFS, "/www").setDefaultFile("index.html");
     //server.serveStatic("/secure/secure.html", LittleFS, "/secure/secure.html").setAuthentication("admin", "pass");
     //server.serveStatic("/", LittleFS, "/www").setDefaultFile("index.html").setAuthentication("admin", "pass");
+    ServeEmbedded::registerEndpoints(server); // Flash copy first, over the same path in /www; LittleFS serves the rest
     server.serveStatic("/", LittleFS, "/www").setDefaultFile("index.html");
     serveNotFound();
     server.begin();
@@ -139,6 +265,8 @@ void WebHandler::init()
 void WebHandler::loop()
 {
     // debugI("WebHandler loop");
+    ServeSocket::loop();
+    ServeDevice::loop();
 }
 
 #endif // ENABLE_WIFI_HANDLER
\ No newline at end of file
@@ -6,23 +6,48 @@
 
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include <functional>
 
 #define ENABLE_SERVE_ACTIONS
 
+// Seconds a client is told to wait while the vault key is derived
+#ifndef VAULT_RETRY_AFTER_S
+#define VAULT_RETRY_AFTER_S 2
+#endif
+
 class WebHandler
 {
 public:
     static void printRequestBody(AsyncWebServerRequest* request, uint8_t* data, size_t len);
-    static void sendErrorResponse(AsyncWebServerRequest* request, int statusCode, const char* message, bool checkToken = true);
-    static void sendSuccessResponse(AsyncWebServerRequest* request, const char* message, JsonDocument* data = nullptr, bool checkToken = true);
+    // Routes are authorized by WebAuth before their handler runs; checkToken
+    // is only for the odd response sent from outside one
+    static void sendErrorResponse(AsyncWebServerRequest* request, int statusCode, const char* message, bool checkToken = false);
+    static void sendSuccessResponse(AsyncWebServerRequest* request, const char* message, JsonDocument* data = nullptr, bool checkToken = false);
+    // 423 if the user locked the vault, otherwise 503 with Retry-After while
+    // CryptoHandler::loop() derives the key. Web callbacks never derive it
+    // themselves: the derivation would stall every connection.
+    static void sendVaultLocked(AsyncWebServerRequest* request);
+    // Like sendSuccessResponse, but the "data" value is produced a piece at a
+    // time as the client takes it: nextFragment sets out to the next piece of
+    // JSON and returns false once there is none. Only one piece is held in RAM.
+    static void sendChunkedSuccess(AsyncWebServerRequest* request, const char* message, std::function<bool(String& out)> nextFragment, bool checkToken = false);
+    // Appends text as a quoted, escaped JSON string
+    static void appendJsonString(String& out, const char* text);
     static bool isTokenValid(AsyncWebServerRequest* request);
     static void addCorsHeaders(AsyncWebServerResponse* response);
+    // Strong ETag for data named by name at a change counter. Counters start
+    // over at boot, so the tag also carries a random boot id.
+    static String makeEtag(const char* name, uint32_t generation);
+    // Sends a 304 and returns true if the request's If-None-Match holds etag
+    static bool sendIfNotModified(AsyncWebServerRequest* request, const String& etag);
+    static void addEtagHeaders(AsyncWebServerResponse* response, const String& etag);
     static void init();
     static void loop();
     
 private:
     //static NonBlockingTimer myTimer;
     static AsyncWebServer server;
+    static uint32_t bootId;
     static void serveNotFound();
 };
 
@@ -37,13 +62,18 @@ class WebHandler
 public:
     static void printRequestBody(AsyncWebServerRequest*, uint8_t*, size_t) {}
     static void sendErrorResponse(AsyncWebServerRequest*, int, const char*, bool) {}
+    static void sendVaultLocked(AsyncWebServerRequest*) {}
 
     // Use 'void*' or some other type that won't collide with ArduinoJson.
     // We do not need JsonDocument in the no-op scenario.
     static void sendSuccessResponse(AsyncWebServerRequest*, const char*, void*, bool) {}
+    static void appendJsonString(String&, const char*) {}
     
     static bool isTokenValid(AsyncWebServerRequest*) { return false; }
     static void addCorsHeaders(AsyncWebServerResponse*) {}
+    static String makeEtag(const char*, uint32_t) { return String(); }
+    static bool sendIfNotModified(AsyncWebServerRequest*, const String&) { return false; }
+    static void addEtagHeaders(AsyncWebServerResponse*, const String&) {}
     static void init() {}
     static void loop() {}
 };
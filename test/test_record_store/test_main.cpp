@@ -0,0 +1,300 @@
+// RecordStore on the host filesystem: pio test -e native -f test_record_store
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include "RecordStore.h"
+
+static const char *LOG_PATH = "/test.log";
+static const char *TEMP_PATH = "/test.log.tmp";
+static const char *IMPORT_PATH = "/test.log.import";
+static const char *JSON_PATH = "/test.json";
+
+static void putName(RecordStore &store, uint32_t id, const char *name)
+{
+    JsonDocument doc;
+    doc["id"] = id;
+    doc["name"] = name;
+    TEST_ASSERT_TRUE(store.put(id, doc.as<JsonObjectConst>()));
+}
+
+static void assertName(RecordStore &store, uint32_t id, const char *name)
+{
+    JsonDocument doc;
+    TEST_ASSERT_TRUE(store.get(id, doc));
+    TEST_ASSERT_EQUAL_STRING(name, doc["name"].as<const char *>());
+}
+
+static size_t logSize()
+{
+    File file = LittleFS.open(LOG_PATH, "r");
+    size_t size = file ? file.size() : 0;
+    file.close();
+    return size;
+}
+
+static void writeFile(const char *path, const char *mode, const char *text)
+{
+    File file = LittleFS.open(path, mode);
+    file.write((const uint8_t *)text, strlen(text));
+    file.close();
+}
+
+void setUp()
+{
+    LittleFS.begin();
+    LittleFS.remove(LOG_PATH);
+    LittleFS.remove(TEMP_PATH);
+    LittleFS.remove(IMPORT_PATH);
+    LittleFS.remove(JSON_PATH);
+}
+
+void tearDown() {}
+
+void test_put_get_remove_survive_reopen()
+{
+    {
+        RecordStore store(LOG_PATH, JSON_PATH, "items");
+        TEST_ASSERT_TRUE(store.open());
+        putName(store, 1, "one");
+        putName(store, 2, "two");
+        putName(store, 1, "uno");
+        TEST_ASSERT_TRUE(store.remove(2));
+        TEST_ASSERT_FALSE(store.remove(2));
+        TEST_ASSERT_EQUAL_UINT32(2, store.nextId());
+    }
+
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    assertName(store, 1, "uno");
+    TEST_ASSERT_FALSE(store.contains(2));
+    TEST_ASSERT_EQUAL(1, store.getStats().records);
+}
+
+void test_torn_tail_is_dropped_on_open()
+{
+    size_t goodSize;
+    {
+        RecordStore store(LOG_PATH, JSON_PATH, "items");
+        TEST_ASSERT_TRUE(store.open());
+        putName(store, 1, "one");
+        putName(store, 2, "two");
+        goodSize = logSize();
+    }
+
+    // Half a header, as left by a power cut during an append
+    writeFile(LOG_PATH, "a", "RT\x01\x00\x03");
+
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    TEST_ASSERT_EQUAL(2, store.getStats().records);
+    TEST_ASSERT_EQUAL(goodSize, logSize());
+
+    // Appends land after the good records, not after the damage
+    putName(store, 3, "three");
+    RecordStore reopened(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(reopened.open());
+    assertName(reopened, 3, "three");
+    TEST_ASSERT_EQUAL(3, reopened.getStats().records);
+}
+
+void test_corrupt_record_stops_the_scan()
+{
+    {
+        RecordStore store(LOG_PATH, JSON_PATH, "items");
+        TEST_ASSERT_TRUE(store.open());
+        putName(store, 1, "one");
+        putName(store, 2, "two");
+    }
+
+    // Flip a byte in the second payload so its checksum no longer matches
+    File file = LittleFS.open(LOG_PATH, "r");
+    std::vector<uint8_t> bytes(file.size());
+    file.read(bytes.data(), bytes.size());
+    file.close();
+    bytes[bytes.size() - 3] ^= 0x20;
+    file = LittleFS.open(LOG_PATH, "w");
+    file.write(bytes.data(), bytes.size());
+    file.close();
+
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    assertName(store, 1, "one");
+    TEST_ASSERT_FALSE(store.contains(2));
+}
+
+void test_interrupted_compaction_is_finished_on_open()
+{
+    {
+        RecordStore store(LOG_PATH, JSON_PATH, "items");
+        TEST_ASSERT_TRUE(store.open());
+        putName(store, 1, "one");
+    }
+
+    // Stopped after removing the old log, before the rename
+    TEST_ASSERT_TRUE(LittleFS.rename(LOG_PATH, TEMP_PATH));
+
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    assertName(store, 1, "one");
+    TEST_ASSERT_FALSE(LittleFS.exists(TEMP_PATH));
+}
+
+void test_stale_temp_file_is_discarded()
+{
+    {
+        RecordStore store(LOG_PATH, JSON_PATH, "items");
+        TEST_ASSERT_TRUE(store.open());
+        putName(store, 1, "one");
+    }
+
+    // Stopped while the copy was still being written
+    writeFile(TEMP_PATH, "w", "RT");
+
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    assertName(store, 1, "one");
+    TEST_ASSERT_FALSE(LittleFS.exists(TEMP_PATH));
+}
+
+void test_interrupted_import_is_redone_on_open()
+{
+    writeFile(JSON_PATH, "w", "{\"items\": [{\"id\": 3, \"name\": \"three\"}, {\"id\": 4, \"name\": \"four\"}]}");
+
+    // Stopped after one record of the first import, before any log existed
+    {
+        RecordStore store(LOG_PATH, JSON_PATH, "items");
+        TEST_ASSERT_TRUE(store.open());
+        TEST_ASSERT_TRUE(LittleFS.rename(LOG_PATH, IMPORT_PATH));
+    }
+    File in = LittleFS.open(IMPORT_PATH, "r");
+    RecordHeader header;
+    in.read((uint8_t *)&header, sizeof(header));
+    std::vector<uint8_t> first(sizeof(header) + header.length);
+    in.seek(0);
+    in.read(first.data(), first.size());
+    in.close();
+    File out = LittleFS.open(IMPORT_PATH, "w");
+    out.write(first.data(), first.size());
+    out.close();
+
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    assertName(store, 3, "three");
+    assertName(store, 4, "four");
+    TEST_ASSERT_FALSE(LittleFS.exists(IMPORT_PATH));
+}
+
+void test_compaction_drops_garbage_and_keeps_records()
+{
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    for (int i = 0; i < 200; i++) {
+        putName(store, 1 + (i % 4), i % 2 ? "odd" : "even");
+    }
+    TEST_ASSERT_TRUE(store.remove(4));
+    putName(store, 5, "five");
+
+    RecordStoreStats before = store.getStats();
+    TEST_ASSERT_TRUE(store.needsCompaction());
+    uint32_t generation = store.getGeneration();
+
+    TEST_ASSERT_TRUE(store.compact());
+    RecordStoreStats after = store.getStats();
+    TEST_ASSERT_EQUAL(0, after.garbage);
+    TEST_ASSERT_EQUAL(4, after.records);
+    TEST_ASSERT_LESS_THAN(before.fileSize, after.fileSize);
+    TEST_ASSERT_EQUAL(after.fileSize, logSize());
+    TEST_ASSERT_EQUAL_UINT32(generation, store.getGeneration());
+    TEST_ASSERT_FALSE(store.needsCompaction());
+
+    assertName(store, 1, "even");
+    assertName(store, 2, "odd");
+    assertName(store, 5, "five");
+    TEST_ASSERT_FALSE(store.contains(4));
+
+    RecordStore reopened(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(reopened.open());
+    TEST_ASSERT_EQUAL(4, reopened.getStats().records);
+    assertName(reopened, 5, "five");
+}
+
+void test_json_is_imported_once_and_exported()
+{
+    writeFile(JSON_PATH, "w", "{\"items\": [{\"id\": 3, \"name\": \"three\"}, {\"name\": \"four\"}]}");
+
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    assertName(store, 3, "three");
+    assertName(store, 4, "four");
+
+    const char *exportPath = "/export.json";
+    TEST_ASSERT_TRUE(store.exportJson(exportPath));
+    JsonDocument doc;
+    File file = LittleFS.open(exportPath, "r");
+    TEST_ASSERT_FALSE(deserializeJson(doc, file));
+    file.close();
+    LittleFS.remove(exportPath);
+    TEST_ASSERT_EQUAL(2, doc["items"].size());
+    TEST_ASSERT_EQUAL_STRING("four", doc["items"][1]["name"].as<const char *>());
+}
+
+void test_put_if_refuses_a_write_made_since_the_read()
+{
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    putName(store, 1, "one");
+
+    JsonDocument doc;
+    uint32_t generation;
+    TEST_ASSERT_TRUE(store.get(1, doc, generation));
+    putName(store, 1, "edited");
+
+    bool conflict;
+    doc["name"] = "stale";
+    TEST_ASSERT_FALSE(store.putIf(1, doc.as<JsonObjectConst>(), generation, conflict));
+    TEST_ASSERT_TRUE(conflict);
+    assertName(store, 1, "edited");
+
+    TEST_ASSERT_TRUE(store.get(1, doc, generation));
+    doc["name"] = "fresh";
+    TEST_ASSERT_TRUE(store.putIf(1, doc.as<JsonObjectConst>(), generation, conflict));
+    TEST_ASSERT_FALSE(conflict);
+    assertName(store, 1, "fresh");
+}
+
+void test_failed_import_leaves_the_store_alone()
+{
+    RecordStore store(LOG_PATH, JSON_PATH, "items");
+    TEST_ASSERT_TRUE(store.open());
+    putName(store, 1, "one");
+    uint32_t generation = store.getGeneration();
+    RecordStoreStats before = store.getStats();
+
+    writeFile(JSON_PATH, "w", "{\"other\": []}");
+    TEST_ASSERT_FALSE(store.importJson(JSON_PATH));
+    writeFile(JSON_PATH, "w", "{\"items\": [{\"id\": 2, \"name\": ");
+    TEST_ASSERT_FALSE(store.importJson(JSON_PATH));
+
+    TEST_ASSERT_EQUAL_UINT32(generation, store.getGeneration());
+    TEST_ASSERT_EQUAL(before.garbage, store.getStats().garbage);
+    TEST_ASSERT_FALSE(LittleFS.exists(IMPORT_PATH));
+    assertName(store, 1, "one");
+    TEST_ASSERT_FALSE(store.contains(2));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_put_get_remove_survive_reopen);
+    RUN_TEST(test_torn_tail_is_dropped_on_open);
+    RUN_TEST(test_corrupt_record_stops_the_scan);
+    RUN_TEST(test_interrupted_compaction_is_finished_on_open);
+    RUN_TEST(test_stale_temp_file_is_discarded);
+    RUN_TEST(test_interrupted_import_is_redone_on_open);
+    RUN_TEST(test_compaction_drops_garbage_and_keeps_records);
+    RUN_TEST(test_json_is_imported_once_and_exported);
+    RUN_TEST(test_failed_import_leaves_the_store_alone);
+    RUN_TEST(test_put_if_refuses_a_write_made_since_the_read);
+    return UNITY_END();
+}
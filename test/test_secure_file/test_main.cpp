@@ -0,0 +1,207 @@
+// SecureFile on the host filesystem: pio test -e native -f test_secure_file
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <vector>
+#include "CryptoHandler.h"
+#include "SecureFile.h"
+
+static const char *PLAIN_PATH = "/plain.txt";
+static const char *SECURE_PATH = "/secure.txt";
+static const char *OTHER_PATH = "/other.txt";
+static const size_t CHUNK_ON_FLASH = SecureFile::CHUNK_SIZE + CryptoHandler::CHUNK_TAG_SIZE;
+
+static std::vector<uint8_t> pattern(size_t length, uint8_t seed)
+{
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; i++) {
+        data[i] = (uint8_t)(seed + i * 13 + (i >> 8));
+    }
+    return data;
+}
+
+static void writeSecure(const char *path, const std::vector<uint8_t> &data)
+{
+    SecureFileWriter writer;
+    TEST_ASSERT_TRUE(writer.open(path));
+    // Odd-sized writes so chunks fill across calls
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t n = std::min((size_t)77, data.size() - offset);
+        TEST_ASSERT_EQUAL(n, writer.write(data.data() + offset, n));
+        offset += n;
+    }
+    TEST_ASSERT_TRUE(writer.close());
+}
+
+// Everything the reader hands back; false if it reported a failure
+static bool readSecure(const char *path, std::vector<uint8_t> &data)
+{
+    data.clear();
+    SecureFileReader reader;
+    if (!reader.open(path)) {
+        return false;
+    }
+    uint8_t buffer[64]; // Divides CHUNK_SIZE, so a failed read loses nothing that was good
+    int n;
+    while ((n = reader.read(buffer, sizeof(buffer))) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    return n == 0;
+}
+
+static std::vector<uint8_t> readRaw(const char *path)
+{
+    File file = LittleFS.open(path, "r");
+    std::vector<uint8_t> bytes(file.size());
+    file.read(bytes.data(), bytes.size());
+    file.close();
+    return bytes;
+}
+
+static void writeRaw(const char *path, const std::vector<uint8_t> &bytes)
+{
+    File file = LittleFS.open(path, "w");
+    file.write(bytes.data(), bytes.size());
+    file.close();
+}
+
+void setUp()
+{
+    LittleFS.remove(PLAIN_PATH);
+    LittleFS.remove(SECURE_PATH);
+    LittleFS.remove(OTHER_PATH);
+    TEST_ASSERT_TRUE(CryptoHandler::unlock("test-password"));
+}
+
+void tearDown() {}
+
+void test_round_trip_at_chunk_boundaries()
+{
+    const size_t chunk = SecureFile::CHUNK_SIZE;
+    const size_t sizes[] = {0, 1, chunk - 1, chunk, chunk + 1, 3 * chunk + 17};
+    for (size_t size : sizes) {
+        std::vector<uint8_t> data = pattern(size, (uint8_t)size);
+        writeSecure(SECURE_PATH, data);
+        TEST_ASSERT_TRUE(SecureFile::isEncrypted(SECURE_PATH));
+
+        std::vector<uint8_t> back;
+        TEST_ASSERT_TRUE(readSecure(SECURE_PATH, back));
+        TEST_ASSERT_EQUAL(size, back.size());
+        TEST_ASSERT_TRUE(back == data);
+    }
+}
+
+void test_encrypt_and_decrypt_in_place()
+{
+    std::vector<uint8_t> data = pattern(2000, 7);
+    writeRaw(PLAIN_PATH, data);
+    TEST_ASSERT_FALSE(SecureFile::isEncrypted(PLAIN_PATH));
+
+    TEST_ASSERT_TRUE(SecureFile::encryptFile(PLAIN_PATH, PLAIN_PATH));
+    TEST_ASSERT_TRUE(SecureFile::isEncrypted(PLAIN_PATH));
+    TEST_ASSERT_FALSE(readRaw(PLAIN_PATH) == data);
+
+    TEST_ASSERT_TRUE(SecureFile::decryptFile(PLAIN_PATH, PLAIN_PATH));
+    TEST_ASSERT_FALSE(SecureFile::isEncrypted(PLAIN_PATH));
+    TEST_ASSERT_TRUE(readRaw(PLAIN_PATH) == data);
+}
+
+void test_dropped_last_chunk_is_detected()
+{
+    writeSecure(SECURE_PATH, pattern(3 * SecureFile::CHUNK_SIZE + 17, 1));
+    std::vector<uint8_t> bytes = readRaw(SECURE_PATH);
+
+    // Cut at a chunk boundary: what is left looks whole, but its final
+    // chunk was not sealed as the last one
+    bytes.resize(sizeof(SecureFileHeader) + 3 * CHUNK_ON_FLASH);
+    writeRaw(SECURE_PATH, bytes);
+
+    std::vector<uint8_t> back;
+    TEST_ASSERT_FALSE(readSecure(SECURE_PATH, back));
+    TEST_ASSERT_EQUAL(2 * SecureFile::CHUNK_SIZE, back.size());
+}
+
+void test_cut_inside_a_chunk_is_detected()
+{
+    writeSecure(SECURE_PATH, pattern(2 * SecureFile::CHUNK_SIZE, 2));
+    std::vector<uint8_t> bytes = readRaw(SECURE_PATH);
+    bytes.resize(bytes.size() - 5);
+    writeRaw(SECURE_PATH, bytes);
+
+    std::vector<uint8_t> back;
+    TEST_ASSERT_FALSE(readSecure(SECURE_PATH, back));
+    TEST_ASSERT_EQUAL(SecureFile::CHUNK_SIZE, back.size());
+}
+
+void test_reordered_chunks_are_detected()
+{
+    writeSecure(SECURE_PATH, pattern(3 * SecureFile::CHUNK_SIZE, 3));
+    std::vector<uint8_t> bytes = readRaw(SECURE_PATH);
+    uint8_t *first = bytes.data() + sizeof(SecureFileHeader);
+    std::swap_ranges(first, first + CHUNK_ON_FLASH, first + CHUNK_ON_FLASH);
+    writeRaw(SECURE_PATH, bytes);
+
+    std::vector<uint8_t> back;
+    TEST_ASSERT_FALSE(readSecure(SECURE_PATH, back));
+    TEST_ASSERT_EQUAL(0, back.size());
+}
+
+void test_chunk_from_another_file_is_detected()
+{
+    writeSecure(SECURE_PATH, pattern(2 * SecureFile::CHUNK_SIZE, 4));
+    writeSecure(OTHER_PATH, pattern(2 * SecureFile::CHUNK_SIZE, 5));
+
+    // Same position, same key, different file
+    std::vector<uint8_t> bytes = readRaw(SECURE_PATH);
+    std::vector<uint8_t> other = readRaw(OTHER_PATH);
+    size_t second = sizeof(SecureFileHeader) + CHUNK_ON_FLASH;
+    std::copy(other.begin() + second, other.end(), bytes.begin() + second);
+    writeRaw(SECURE_PATH, bytes);
+
+    std::vector<uint8_t> back;
+    TEST_ASSERT_FALSE(readSecure(SECURE_PATH, back));
+    TEST_ASSERT_EQUAL(SecureFile::CHUNK_SIZE, back.size());
+}
+
+void test_flipped_bit_is_detected()
+{
+    writeSecure(SECURE_PATH, pattern(100, 6));
+    std::vector<uint8_t> bytes = readRaw(SECURE_PATH);
+    bytes[sizeof(SecureFileHeader) + 10] ^= 0x01;
+    writeRaw(SECURE_PATH, bytes);
+
+    // The first chunk is checked by open(), before anything is returned
+    SecureFileReader reader;
+    TEST_ASSERT_FALSE(reader.open(SECURE_PATH));
+}
+
+void test_locked_vault_cannot_read_or_write()
+{
+    writeSecure(SECURE_PATH, pattern(100, 8));
+    CryptoHandler::lock();
+
+    SecureFileReader reader;
+    TEST_ASSERT_FALSE(reader.open(SECURE_PATH));
+    SecureFileWriter writer;
+    bool written = writer.open(OTHER_PATH) && writer.write((const uint8_t *)"x", 1) == 1 && writer.close();
+    TEST_ASSERT_FALSE(written);
+}
+
+int main(int argc, char **argv)
+{
+    LittleFS.begin();
+    CryptoHandler::init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_at_chunk_boundaries);
+    RUN_TEST(test_encrypt_and_decrypt_in_place);
+    RUN_TEST(test_dropped_last_chunk_is_detected);
+    RUN_TEST(test_cut_inside_a_chunk_is_detected);
+    RUN_TEST(test_reordered_chunks_are_detected);
+    RUN_TEST(test_chunk_from_another_file_is_detected);
+    RUN_TEST(test_flipped_bit_is_detected);
+    RUN_TEST(test_locked_vault_cannot_read_or_write);
+    return UNITY_END();
+}
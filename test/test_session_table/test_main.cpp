@@ -0,0 +1,260 @@
+// SessionTable with a fake clock and RNG: pio test -e native -f test_session_table
+//
+// The table is only built with the web server, which the native env leaves
+// out, so its source is compiled in here with a small table and short
+// timeouts.
+
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+
+#define SESSION_MAX 4
+#define SESSION_LIFETIME_MS 10000UL
+#define SESSION_IDLE_MS 1000UL
+
+static uint32_t fakeNow = 0;
+static const uint8_t *plannedToken = nullptr;
+static uint8_t tokenCounter = 0;
+
+static unsigned long fakeMillis()
+{
+    return fakeNow;
+}
+
+// Hands out the planned token if there is one, otherwise distinct ones
+static void fakeFillRandom(void *buf, size_t len)
+{
+    uint8_t *out = (uint8_t *)buf;
+    if (plannedToken) {
+        memcpy(out, plannedToken, len);
+        plannedToken = nullptr;
+        return;
+    }
+    tokenCounter++;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = (uint8_t)(tokenCounter * 31 + i * 7);
+    }
+}
+
+#define millis fakeMillis
+#define esp_fill_random fakeFillRandom
+#define ENABLE_WEB_HANDLER
+#include "../../src/WebHandler/SessionTable.cpp"
+#undef millis
+#undef esp_fill_random
+
+typedef char TokenText[SessionTable::TOKEN_TEXT_SIZE];
+
+// Slots in the table, as SessionTable sizes it
+static const uint8_t SLOTS = SESSION_MAX * 2;
+
+// Every token handed out, so setUp() can empty the table again
+static std::vector<std::string> created;
+
+static void create(TokenText text)
+{
+    TEST_ASSERT_TRUE(SessionTable::create(text, sizeof(TokenText)));
+    created.push_back(text);
+}
+
+// A token whose home slot is home; tag keeps tokens with the same home apart
+static void createAt(TokenText text, uint8_t home, uint8_t tag)
+{
+    uint8_t token[SessionTable::TOKEN_SIZE] = {0};
+    token[0] = home;
+    token[SessionTable::TOKEN_SIZE - 1] = tag;
+    plannedToken = token;
+    create(text);
+}
+
+static bool touch(const char *text)
+{
+    return SessionTable::touch(text, strlen(text));
+}
+
+void setUp()
+{
+    for (const std::string &text : created) {
+        SessionTable::remove(text.c_str(), text.length());
+    }
+    created.clear();
+    fakeNow = 1000;
+    plannedToken = nullptr;
+}
+
+void tearDown() {}
+
+void test_create_touch_remove()
+{
+    TokenText text;
+    create(text);
+    TEST_ASSERT_EQUAL(32, strlen(text));
+    TEST_ASSERT_EQUAL(1, SessionTable::count());
+    TEST_ASSERT_TRUE(touch(text));
+
+    SessionTable::remove(text, strlen(text));
+    TEST_ASSERT_FALSE(touch(text));
+    TEST_ASSERT_EQUAL(0, SessionTable::count());
+}
+
+void test_malformed_tokens_are_rejected()
+{
+    TokenText text;
+    create(text);
+
+    TEST_ASSERT_FALSE(SessionTable::touch(text, strlen(text) - 1));
+    TEST_ASSERT_FALSE(SessionTable::touch("", 0));
+
+    TokenText other;
+    strcpy(other, text);
+    other[5] = 'g';
+    TEST_ASSERT_FALSE(touch(other));
+
+    // Hex digits in either case name the same token
+    for (char *p = other; *p; p++) {
+        *p = toupper(text[p - other]);
+    }
+    TEST_ASSERT_TRUE(touch(other));
+}
+
+void test_erase_keeps_probe_run_reachable()
+{
+    TokenText a, b, c;
+    createAt(a, 1, 1);
+    createAt(b, 1, 2);
+    createAt(c, 1, 3);
+
+    SessionTable::remove(a, strlen(a));
+    TEST_ASSERT_TRUE(touch(b));
+    TEST_ASSERT_TRUE(touch(c));
+
+    SessionTable::remove(b, strlen(b));
+    TEST_ASSERT_TRUE(touch(c));
+    TEST_ASSERT_EQUAL(1, SessionTable::count());
+}
+
+void test_erase_keeps_run_reachable_across_wrap()
+{
+    // Home is the last slot, so the run wraps to the start of the table
+    const uint8_t last = SLOTS - 1;
+    TokenText a, b, c, d;
+    createAt(a, last, 1);
+    createAt(b, last, 2);
+    createAt(c, 0, 3); // At home in slot 1, after b took slot 0
+    createAt(d, last, 4);
+
+    SessionTable::remove(a, strlen(a));
+    TEST_ASSERT_TRUE(touch(b));
+    TEST_ASSERT_TRUE(touch(c));
+    TEST_ASSERT_TRUE(touch(d));
+
+    SessionTable::remove(b, strlen(b));
+    TEST_ASSERT_TRUE(touch(c));
+    TEST_ASSERT_TRUE(touch(d));
+    TEST_ASSERT_EQUAL(2, SessionTable::count());
+}
+
+void test_full_table_evicts_least_recently_used()
+{
+    TokenText texts[SESSION_MAX];
+    for (int i = 0; i < SESSION_MAX; i++) {
+        create(texts[i]);
+        fakeNow += 10;
+    }
+    // Session 0 is the oldest login but was just used; 1 has been idle longest
+    for (int i = 0; i < SESSION_MAX; i++) {
+        if (i != 1) {
+            TEST_ASSERT_TRUE(touch(texts[i]));
+        }
+    }
+
+    TokenText extra;
+    create(extra);
+    TEST_ASSERT_EQUAL(SESSION_MAX, SessionTable::count());
+    TEST_ASSERT_FALSE(touch(texts[1]));
+    TEST_ASSERT_TRUE(touch(texts[0]));
+    TEST_ASSERT_TRUE(touch(texts[2]));
+    TEST_ASSERT_TRUE(touch(extra));
+}
+
+void test_idle_session_expires()
+{
+    TokenText text;
+    create(text);
+    fakeNow += SESSION_IDLE_MS - 1;
+    TEST_ASSERT_TRUE(touch(text));
+    fakeNow += SESSION_IDLE_MS;
+    TEST_ASSERT_FALSE(touch(text));
+    TEST_ASSERT_EQUAL(0, SessionTable::count());
+}
+
+void test_busy_session_ends_at_lifetime()
+{
+    TokenText text;
+    create(text);
+    for (uint32_t t = 0; t + SESSION_IDLE_MS / 2 < SESSION_LIFETIME_MS; t += SESSION_IDLE_MS / 2) {
+        fakeNow += SESSION_IDLE_MS / 2;
+        TEST_ASSERT_TRUE(touch(text));
+    }
+    fakeNow += SESSION_IDLE_MS / 2;
+    TEST_ASSERT_FALSE(touch(text));
+}
+
+void test_full_table_drops_expired_before_live()
+{
+    TokenText texts[SESSION_MAX];
+    for (int i = 0; i < SESSION_MAX; i++) {
+        create(texts[i]);
+    }
+    fakeNow += SESSION_IDLE_MS - 1;
+    TEST_ASSERT_TRUE(touch(texts[0]));
+    TEST_ASSERT_TRUE(touch(texts[3]));
+    fakeNow += 1; // 1 and 2 are now idle too long
+
+    TokenText extra;
+    create(extra);
+    TEST_ASSERT_EQUAL(3, SessionTable::count());
+    TEST_ASSERT_TRUE(touch(texts[0]));
+    TEST_ASSERT_TRUE(touch(texts[3]));
+    TEST_ASSERT_TRUE(touch(extra));
+}
+
+static void assertCookie(const char *header, const char *expected)
+{
+    const char *value;
+    size_t length;
+    TEST_ASSERT_TRUE(SessionTable::findCookie(header, value, length));
+    TEST_ASSERT_EQUAL(strlen(expected), length);
+    TEST_ASSERT_EQUAL_MEMORY(expected, value, length);
+}
+
+void test_find_cookie()
+{
+    assertCookie("session=abc", "abc");
+    assertCookie("theme=dark; session=abc; lang=en", "abc");
+    assertCookie("theme=dark;session=abc", "abc");
+    assertCookie("oldsession=xyz; session=abc", "abc");
+    assertCookie("session=", "");
+
+    const char *value;
+    size_t length;
+    TEST_ASSERT_FALSE(SessionTable::findCookie("", value, length));
+    TEST_ASSERT_FALSE(SessionTable::findCookie("oldsession=xyz", value, length));
+    TEST_ASSERT_FALSE(SessionTable::findCookie("theme=session", value, length));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_create_touch_remove);
+    RUN_TEST(test_malformed_tokens_are_rejected);
+    RUN_TEST(test_erase_keeps_probe_run_reachable);
+    RUN_TEST(test_erase_keeps_run_reachable_across_wrap);
+    RUN_TEST(test_full_table_evicts_least_recently_used);
+    RUN_TEST(test_idle_session_expires);
+    RUN_TEST(test_busy_session_ends_at_lifetime);
+    RUN_TEST(test_full_table_drops_expired_before_live);
+    RUN_TEST(test_find_cookie);
+    return UNITY_END();
+}
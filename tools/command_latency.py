@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# Compares sending a command sequence as separate POST /command/set requests
+# against a single POST /command/batch. Both answer 202 with an id straight
+# away, so each run is timed until GET /command/result has its outcome.
+# Usage: python3 tools/command_latency.py http://demo1.local [count] [--token <api key>]
+
+import argparse
+import json
+import time
+import urllib.error
+import urllib.request
+
+def post(url, body, token):
+    request = urllib.request.Request(url, data=body.encode(), method="POST",
+                                     headers={"Content-Type": "text/plain", "Authorization": "Bearer " + token})
+    with urllib.request.urlopen(request, timeout=30) as response:
+        return json.loads(response.read())["data"]["id"]
+
+def wait_for_result(base, id, token):
+    request = urllib.request.Request(base + "/command/result?id=%d" % id, headers={"Authorization": "Bearer " + token})
+    while True:
+        try:
+            with urllib.request.urlopen(request, timeout=30) as response:
+                return response.read()
+        except urllib.error.HTTPError as error:
+            body = json.loads(error.read())
+            if "id" in body:
+                return body  # The command ran and failed; not-yet-finished answers carry no id
+        time.sleep(0.005)
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("base", help="device URL, e.g. http://demo1.local")
+    parser.add_argument("count", nargs="?", type=int, default=20)
+    parser.add_argument("--token", default="test", help="API key, sent as a Bearer token")
+    args = parser.parse_args()
+
+    base = args.base.rstrip("/")
+    count = args.count
+    token = args.token
+    commands = ["led color %s" % ("white" if i % 2 else "black") for i in range(count)]
+
+    start = time.perf_counter()
+    for command in commands:
+        wait_for_result(base, post(base + "/command/set", command, token), token)
+    single = time.perf_counter() - start
+
+    start = time.perf_counter()
+    wait_for_result(base, post(base + "/command/batch", "\n".join(commands), token), token)
+    batch = time.perf_counter() - start
+
+    print("%d commands: %.1f ms one by one, %.1f ms as a batch (%.1fx)"
+          % (count, single * 1000, batch * 1000, single / batch))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,134 @@
+import gzip
+import hashlib
+import os
+from os.path import join
+
+Import("env")
+
+# Gzips the web UI under data/www into a header of flash arrays plus a route
+# table sorted by path, which ServeEmbedded serves straight from flash. The
+# navbar and footer are pasted into each page here, so a page load does not
+# have to fetch them separately. An embedded file wins over the file of the
+# same name in LittleFS /www; change it here and rebuild.
+
+SKIP_FILES = {"package.json", "package-lock.json"}
+SKIP_EXTENSIONS = {".md"}
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+    ".svg": "image/svg+xml",
+}
+
+# Every file is revalidated (a 304 once cached). The scripts import each other
+# by plain name, so a cached copy could outlive a firmware update otherwise.
+CACHE_CONTROL = "no-cache"
+
+PARTIALS = {
+    '<div id="navbar-container"></div>': "navbar.html",
+    '<div id="footer-container"></div>': "footer.html",
+}
+
+
+def read_partials(www_dir):
+    partials = {}
+    for placeholder, name in PARTIALS.items():
+        with open(join(www_dir, name), "rb") as f:
+            markup = f.read().decode("utf-8")
+        partials[placeholder] = placeholder.replace("></div>", ">" + markup + "</div>")
+    return partials
+
+
+def collect_files(www_dir):
+    files = []
+    for root, dirs, names in os.walk(www_dir):
+        dirs.sort()
+        for name in sorted(names):
+            if name in SKIP_FILES or os.path.splitext(name)[1] in SKIP_EXTENSIONS:
+                continue
+            path = join(root, name)
+            url = "/" + os.path.relpath(path, www_dir).replace(os.sep, "/")
+            files.append((url, path))
+    return sorted(files)
+
+
+def build_header(www_dir):
+    partials = read_partials(www_dir)
+    arrays = []
+    routes = []
+    raw_total = 0
+    gz_total = 0
+
+    for index, (url, path) in enumerate(collect_files(www_dir)):
+        extension = os.path.splitext(path)[1]
+        with open(path, "rb") as f:
+            content = f.read()
+        if extension == ".html":
+            text = content.decode("utf-8")
+            for placeholder, markup in partials.items():
+                text = text.replace(placeholder, markup)
+            content = text.encode("utf-8")
+
+        # mtime=0 keeps the output, and so the ETag, the same between builds
+        compressed = gzip.compress(content, compresslevel=9, mtime=0)
+        etag = hashlib.sha256(compressed).hexdigest()[:16]
+        raw_total += len(content)
+        gz_total += len(compressed)
+
+        name = "www_%d" % index
+        data = ",".join(str(b) for b in compressed)
+        arrays.append("static const uint8_t %s[] PROGMEM = {%s};" % (name, data))
+        routes.append('    {"%s", "%s", "\\"%s\\"", "%s", %s, sizeof(%s)},' % (
+            url,
+            CONTENT_TYPES.get(extension, "application/octet-stream"),
+            etag,
+            CACHE_CONTROL,
+            name,
+            name))
+
+    lines = [
+        "// Generated by tools/embed_www.py from data/www; do not edit",
+        "#pragma once",
+        "",
+    ]
+    lines += arrays
+    lines += [
+        "",
+        "static const EmbeddedFile embeddedFiles[] = {",
+    ]
+    lines += routes
+    lines += [
+        "};",
+        "",
+        "#define EMBEDDED_FILE_COUNT (sizeof(embeddedFiles) / sizeof(embeddedFiles[0]))",
+        "",
+    ]
+    return "\n".join(lines), len(routes), raw_total, gz_total
+
+
+def embed_www(env):
+    www_dir = join(env.subst("$PROJECT_DIR"), "data", "www")
+    out_dir = join(env.subst("$BUILD_DIR"), "www")
+    out_path = join(out_dir, "EmbeddedWww.h")
+
+    header, count, raw_total, gz_total = build_header(www_dir)
+
+    # Only rewrite on a change, so an unchanged UI does not rebuild the server
+    old = None
+    if os.path.exists(out_path):
+        with open(out_path, "r") as f:
+            old = f.read()
+    if old != header:
+        os.makedirs(out_dir, exist_ok=True)
+        with open(out_path, "w") as f:
+            f.write(header)
+        print("Embedded %d web files: %d bytes, %d gzipped" % (count, raw_total, gz_total))
+
+    env.Append(CPPPATH=[out_dir], CPPDEFINES=["ENABLE_EMBEDDED_WWW"])
+
+
+embed_www(env)
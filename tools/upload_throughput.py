@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Uploads files of a few sizes through POST /file with a sha256 check and
+# prints the throughput seen by the client and reported by the device.
+# Usage: python3 tools/upload_throughput.py http://demo1.local [path] [--token <api key>]
+
+import argparse
+import hashlib
+import json
+import os
+import time
+import urllib.parse
+import urllib.request
+
+SIZES = [64 * 1024, 256 * 1024, 1024 * 1024]
+
+def upload(base, path, body, token):
+    query = urllib.parse.urlencode({"filename": path, "sha256": hashlib.sha256(body).hexdigest()})
+    request = urllib.request.Request(base + "/file?" + query, data=body, method="POST",
+                                     headers={"Content-Type": "application/octet-stream", "Authorization": "Bearer " + token})
+    with urllib.request.urlopen(request, timeout=120) as response:
+        return json.loads(response.read())
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("base", help="device URL, e.g. http://demo1.local")
+    parser.add_argument("path", nargs="?", default="/bench.bin")
+    parser.add_argument("--token", default="test", help="API key, sent as a Bearer token")
+    args = parser.parse_args()
+
+    base = args.base.rstrip("/")
+    path = args.path
+    token = args.token
+
+    for size in SIZES:
+        body = os.urandom(size)
+        start = time.perf_counter()
+        result = upload(base, path, body, token)
+        elapsed = time.perf_counter() - start
+        device = result.get("data", {})
+        print("%5d KB: %7.1f KB/s client, %5d KB/s on the device (%d ms)"
+              % (size // 1024, size / 1024 / elapsed, device.get("kbps", 0), device.get("ms", 0)))
+
+    request = urllib.request.Request(base + "/file?" + urllib.parse.urlencode({"filename": path}),
+                                     method="DELETE", headers={"Authorization": "Bearer " + token})
+    urllib.request.urlopen(request, timeout=30).read()
+
+if __name__ == "__main__":
+    main()
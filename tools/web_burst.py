@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# Fires a burst of concurrent requests at the device, counts how many were
+# answered and how many were turned away with a 503, then prints the
+# device's admission counters.
+# Usage: python3 tools/web_burst.py http://demo1.local [requests] [token]
+
+import json
+import sys
+import threading
+import urllib.error
+import urllib.request
+
+URLS = ["/", "/js/config.js", "/device/info", "/files", "/buttons"]
+
+def fetch(base, url, token, results, lock):
+    request = urllib.request.Request(base + url, headers={"Authorization": "Bearer " + token})
+    try:
+        with urllib.request.urlopen(request, timeout=30) as response:
+            response.read()
+            status = response.status
+    except urllib.error.HTTPError as error:
+        status = error.code
+    except Exception:
+        status = "failed"
+    with lock:
+        results[status] = results.get(status, 0) + 1
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: web_burst.py <base url> [requests] [token]")
+        sys.exit(1)
+
+    base = sys.argv[1].rstrip("/")
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 40
+    token = sys.argv[3] if len(sys.argv) > 3 else "test"
+
+    results = {}
+    lock = threading.Lock()
+    threads = [threading.Thread(target=fetch, args=(base, URLS[i % len(URLS)], token, results, lock))
+               for i in range(count)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    for status, seen in sorted(results.items(), key=lambda item: str(item[0])):
+        print("%-7s %d" % (status, seen))
+
+    request = urllib.request.Request(base + "/device/admission", headers={"Authorization": "Bearer " + token})
+    with urllib.request.urlopen(request, timeout=30) as response:
+        print(json.dumps(json.loads(response.read()).get("data", {}), indent=2))
+
+if __name__ == "__main__":
+    main()